@@ -1766,6 +1766,93 @@ static void test_kmeans(void)
 	return;
 }
 
+/*
+* Mini-batch k-means only kicks in above 2 * KMEANS_MINIBATCH_SIZE points,
+* so build well-separated square blobs large enough to reach it.
+*/
+#define KMEANS_BLOBS 4
+#define KMEANS_BLOB_SIZE 2500
+
+static LWGEOM **
+kmeans_blobs(void)
+{
+	static const double centers[KMEANS_BLOBS][2] = {{0, 0}, {100, 0}, {0, 100}, {100, 100}};
+	LWGEOM **geoms = lwalloc(sizeof(LWGEOM *) * KMEANS_BLOBS * KMEANS_BLOB_SIZE);
+	int i, j, k = 0;
+
+	srand(4326);
+	for (j = 0; j < KMEANS_BLOBS; j++)
+	{
+		for (i = 0; i < KMEANS_BLOB_SIZE; i++)
+		{
+			double x = centers[j][0] + 2.0 * rand() / RAND_MAX - 1.0;
+			double y = centers[j][1] + 2.0 * rand() / RAND_MAX - 1.0;
+			geoms[k++] = lwpoint_as_lwgeom(lwpoint_make2d(SRID_UNKNOWN, x, y));
+		}
+	}
+	return geoms;
+}
+
+/* Every blob maps onto one cluster and no two blobs share a cluster */
+static void
+check_kmeans_blobs(const int *r)
+{
+	int ids[KMEANS_BLOBS];
+	int i, j;
+
+	for (j = 0; j < KMEANS_BLOBS; j++)
+	{
+		ids[j] = r[j * KMEANS_BLOB_SIZE];
+		for (i = 0; i < KMEANS_BLOB_SIZE; i++)
+			CU_ASSERT_EQUAL(r[j * KMEANS_BLOB_SIZE + i], ids[j]);
+		for (i = 0; i < j; i++)
+			CU_ASSERT_NOT_EQUAL(ids[i], ids[j]);
+	}
+}
+
+static void
+free_kmeans_blobs(LWGEOM **geoms)
+{
+	int i;
+	for (i = 0; i < KMEANS_BLOBS * KMEANS_BLOB_SIZE; i++)
+		lwgeom_free(geoms[i]);
+	lwfree(geoms);
+}
+
+static void test_kmeans_minibatch(void)
+{
+	LWGEOM **geoms = kmeans_blobs();
+	int *r;
+
+	r = lwgeom_cluster_kmeans_method(
+	    (const LWGEOM **)geoms, KMEANS_BLOBS * KMEANS_BLOB_SIZE, KMEANS_BLOBS, 0.0, LW_KMEANS_MINIBATCH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(r);
+	check_kmeans_blobs(r);
+
+	lwfree(r);
+	free_kmeans_blobs(geoms);
+}
+
+static void test_kmeans_minibatch_max_radius(void)
+{
+	LWGEOM **geoms = kmeans_blobs();
+	int *r;
+	int i, max_id = 0;
+
+	/* Two clusters cannot hold four blobs within radius 5, so they must split */
+	r = lwgeom_cluster_kmeans_method(
+	    (const LWGEOM **)geoms, KMEANS_BLOBS * KMEANS_BLOB_SIZE, 2, 5.0, LW_KMEANS_MINIBATCH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(r);
+	check_kmeans_blobs(r);
+	for (i = 0; i < KMEANS_BLOBS * KMEANS_BLOB_SIZE; i++)
+		if (r[i] > max_id)
+			max_id = r[i];
+	CU_ASSERT_EQUAL(max_id + 1, KMEANS_BLOBS);
+
+	lwfree(r);
+	free_kmeans_blobs(geoms);
+}
+
 static void test_trim_bits(void)
 {
 	POINTARRAY *pta = ptarray_construct_empty(LW_TRUE, LW_TRUE, 2);
@@ -1859,6 +1946,8 @@ void algorithms_suite_setup(void)
 	PG_ADD_TEST(suite,test_lw_arc_center);
 	PG_ADD_TEST(suite,test_point_density);
 	PG_ADD_TEST(suite,test_kmeans);
+	PG_ADD_TEST(suite,test_kmeans_minibatch);
+	PG_ADD_TEST(suite,test_kmeans_minibatch_max_radius);
 	PG_ADD_TEST(suite,test_median_handles_3d_correctly);
 	PG_ADD_TEST(suite,test_median_robustness);
 	PG_ADD_TEST(suite,test_lwpoly_construct_circle);
@@ -367,6 +367,58 @@ static void dbscan_test_3612c(void)
 	do_dbscan_test(test);
 }
 
+/* Points go through the grid implementation, adding a distant polygon
+ * sends the same points through the STRtree. The clusters must match. */
+static void dbscan_grid_test(void)
+{
+	uint32_t num_points = 400;
+	uint32_t min_points, i, j;
+
+	for (min_points = 1; min_points <= 5; min_points += 2)
+	{
+		LWGEOM** geoms = lwalloc((num_points + 1) * sizeof(LWGEOM*));
+		UNIONFIND* uf_grid = UF_create(num_points);
+		UNIONFIND* uf_tree = UF_create(num_points + 1);
+		char* in_grid;
+		char* in_tree;
+		double eps = 1.5;
+
+		srand(min_points);
+		for (i = 0; i < num_points; i++)
+		{
+			if (i % 37 == 0)
+				geoms[i] = lwpoint_as_lwgeom(lwpoint_construct_empty(SRID_UNKNOWN, 0, 0));
+			else
+				geoms[i] = lwpoint_as_lwgeom(lwpoint_make2d(SRID_UNKNOWN, rand() % 40, (rand() % 400) / 10.0));
+		}
+		geoms[num_points] = lwgeom_from_wkt("POLYGON((1000 1000, 1001 1000, 1001 1001, 1000 1000))", LW_PARSER_CHECK_NONE);
+
+		CU_ASSERT_EQUAL(union_dbscan(geoms, num_points, uf_grid, eps, min_points, &in_grid), LW_SUCCESS);
+		CU_ASSERT_EQUAL(union_dbscan(geoms, num_points + 1, uf_tree, eps, min_points, &in_tree), LW_SUCCESS);
+
+		for (i = 0; i < num_points; i++)
+		{
+			ASSERT_INT_EQUAL(in_grid[i], in_tree[i]);
+			if (!in_grid[i])
+				continue;
+			for (j = i + 1; j < num_points; j++)
+			{
+				if (!in_grid[j])
+					continue;
+				CU_ASSERT_EQUAL(UF_find(uf_grid, i) == UF_find(uf_grid, j), UF_find(uf_tree, i) == UF_find(uf_tree, j));
+			}
+		}
+
+		for (i = 0; i <= num_points; i++)
+			lwgeom_free(geoms[i]);
+		lwfree(geoms);
+		lwfree(in_grid);
+		lwfree(in_tree);
+		UF_destroy(uf_grid);
+		UF_destroy(uf_tree);
+	}
+}
+
 void geos_cluster_suite_setup(void);
 void geos_cluster_suite_setup(void)
 {
@@ -381,4 +433,5 @@ void geos_cluster_suite_setup(void)
 	PG_ADD_TEST(suite, dbscan_test_3612a);
 	PG_ADD_TEST(suite, dbscan_test_3612b);
 	PG_ADD_TEST(suite, dbscan_test_3612c);
+	PG_ADD_TEST(suite, dbscan_grid_test);
 }
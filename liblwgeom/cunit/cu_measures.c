@@ -638,6 +638,13 @@ test_rect_tree_distance_tree(void)
 
 	wkt = "POLYGON((0 0,0 10,10 10,10 0,0 0), (4 4,4 6,6 6,6 4,4 4))";
 	TDT(wkt, "POINT(5 5)", 1);
+
+	wkt = "MULTIPOLYGON(((0 0,0 10,10 10,10 0,0 0),(4 4,4 6,6 6,6 4,4 4)),((20 0,20 10,30 10,30 0,20 0)))";
+	TDT(wkt, "POINT(2 2)", 0);
+	TDT(wkt, "POINT(25 5)", 0);
+	TDT(wkt, "POINT(5 5)", 1);
+	TDT(wkt, "POINT(15 5)", 5);
+	TDT(wkt, "LINESTRING(1 1,2 2)", 0);
 	TDT(wkt, "POLYGON((5 5,5 5.5,5.5 5.5,5.5 5, 5 5))", 0.5);
 }
 
@@ -256,6 +256,41 @@ static void test_lwmpoint_from_lwgeom(void)
 	do_fn_test(to_points, "TIN(((80 130,50 160,80 70,80 130)),((50 160,10 190,10 70,50 160)))", "MULTIPOINT (80 130, 50 160, 80 70, 80 130, 50 160, 10 190, 10 70, 50 160)");
 }
 
+static void test_sort_hilbert(void)
+{
+	/* A 4x4 grid of points in scrambled order, with an empty and a NULL in front */
+	LWGEOM *geoms[18];
+	uint32_t i;
+
+	geoms[0] = lwgeom_from_wkt("POLYGON EMPTY", LW_PARSER_CHECK_NONE);
+	geoms[1] = NULL;
+	for (i = 0; i < 16; i++)
+	{
+		uint32_t j = (i * 7) % 16;
+		geoms[i + 2] = lwpoint_as_lwgeom(lwpoint_make2d(SRID_UNKNOWN, j % 4, j / 4));
+	}
+
+	lwgeom_sort_hilbert(geoms, 18);
+
+	/* Consecutive cells of a Hilbert curve are always adjacent */
+	for (i = 0; i < 15; i++)
+	{
+		const POINT2D *p1 = getPoint2d_cp(((LWPOINT *)geoms[i])->point, 0);
+		const POINT2D *p2 = getPoint2d_cp(((LWPOINT *)geoms[i + 1])->point, 0);
+		CU_ASSERT_DOUBLE_EQUAL(fabs(p1->x - p2->x) + fabs(p1->y - p2->y), 1.0, 0.0);
+	}
+	/* No box was attached to the inputs */
+	CU_ASSERT_PTR_NULL(geoms[0]->bbox);
+
+	/* Empty then NULL at the end, as they came in */
+	CU_ASSERT_EQUAL(geoms[16]->type, POLYGONTYPE);
+	CU_ASSERT(lwgeom_is_empty(geoms[16]));
+	CU_ASSERT_PTR_NULL(geoms[17]);
+
+	for (i = 0; i < 17; i++)
+		lwgeom_free(geoms[i]);
+}
+
 static void test_gbox_serialized_size(void)
 {
 	lwflags_t flags = lwflags(0, 0, 0);
@@ -359,6 +394,7 @@ void misc_suite_setup(void)
 	PG_ADD_TEST(suite, test_clone);
 	PG_ADD_TEST(suite, test_lwmpoint_from_lwgeom);
 	PG_ADD_TEST(suite, test_gbox_serialized_size);
+	PG_ADD_TEST(suite, test_sort_hilbert);
 	PG_ADD_TEST(suite, test_optionlist);
 	PG_ADD_TEST(suite, test_stringlist);
 }
@@ -832,6 +832,55 @@ static void test_ptarray_closest_point_on_segment(void)
 
 }
 
+static void test_ptarray_calculate_gbox_cartesian(void)
+{
+	int hasz, hasm;
+	uint32_t npoints, i;
+
+	/* Lengths around the vector step, with and without a tail */
+	for (hasz = 0; hasz <= 1; hasz++)
+	for (hasm = 0; hasm <= 1; hasm++)
+	for (npoints = 1; npoints <= 41; npoints += 5)
+	{
+		POINTARRAY *pa = ptarray_construct(hasz, hasm, npoints);
+		GBOX gbox;
+		POINT4D p;
+		double xmin = FLT_MAX, xmax = -FLT_MAX, ymin = FLT_MAX, ymax = -FLT_MAX;
+		double zmin = FLT_MAX, zmax = -FLT_MAX, mmin = FLT_MAX, mmax = -FLT_MAX;
+
+		for (i = 0; i < npoints; i++)
+		{
+			/* Extremes land on every position of the step */
+			p.x = (double)((i * 7) % 13) - 6;
+			p.y = (double)((i * 5) % 11) * 2.5;
+			p.z = -(double)((i * 3) % 17);
+			p.m = (double)((i * 11) % 19) / 4;
+			ptarray_set_point4d(pa, i, &p);
+			xmin = FP_MIN(xmin, p.x); xmax = FP_MAX(xmax, p.x);
+			ymin = FP_MIN(ymin, p.y); ymax = FP_MAX(ymax, p.y);
+			zmin = FP_MIN(zmin, p.z); zmax = FP_MAX(zmax, p.z);
+			mmin = FP_MIN(mmin, p.m); mmax = FP_MAX(mmax, p.m);
+		}
+
+		CU_ASSERT_EQUAL(ptarray_calculate_gbox_cartesian(pa, &gbox), LW_SUCCESS);
+		ASSERT_DOUBLE_EQUAL(gbox.xmin, xmin);
+		ASSERT_DOUBLE_EQUAL(gbox.xmax, xmax);
+		ASSERT_DOUBLE_EQUAL(gbox.ymin, ymin);
+		ASSERT_DOUBLE_EQUAL(gbox.ymax, ymax);
+		if (hasz)
+		{
+			ASSERT_DOUBLE_EQUAL(gbox.zmin, zmin);
+			ASSERT_DOUBLE_EQUAL(gbox.zmax, zmax);
+		}
+		if (hasm)
+		{
+			ASSERT_DOUBLE_EQUAL(gbox.mmin, mmin);
+			ASSERT_DOUBLE_EQUAL(gbox.mmax, mmax);
+		}
+		ptarray_free(pa);
+	}
+}
+
 
 /*
 ** Used by the test harness to register the tests in this file.
@@ -853,4 +902,5 @@ void ptarray_suite_setup(void)
 	PG_ADD_TEST(suite, test_ptarray_closest_vertex_2d);
 	PG_ADD_TEST(suite, test_ptarray_closest_segment_2d);
 	PG_ADD_TEST(suite, test_ptarray_closest_point_on_segment);
+	PG_ADD_TEST(suite, test_ptarray_calculate_gbox_cartesian);
 }
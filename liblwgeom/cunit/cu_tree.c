@@ -622,6 +622,59 @@ static void test_itree_degenerate_poly(void)
 	test_itree_once(wktPoly, 0, 0, ITREE_BOUNDARY);
 }
 
+static void test_itree_batch_once(const char *polyWkt)
+{
+	POINT2D pts[441];
+	IntervalTreeResult rslts[441];
+	uint32_t npoints = 0;
+	LWGEOM *poly = lwgeom_from_wkt(polyWkt, LW_PARSER_CHECK_NONE);
+	if(!poly)
+		CU_FAIL_FATAL("unable to parse WKT");
+	IntervalTree *itree = itree_from_lwgeom(poly);
+
+	/* grid with points on vertices, edges, and in between */
+	for (int i = -10; i <= 10; i++)
+	{
+		for (int j = -10; j <= 10; j++)
+		{
+			pts[npoints].x = 1.1 * i;
+			pts[npoints].y = j;
+			npoints++;
+		}
+	}
+	pts[0].x = NAN;
+	pts[1].y = INFINITY;
+
+	itree_point_in_multipolygon_batch(itree, pts, npoints, rslts);
+	for (uint32_t k = 0; k < npoints; k++)
+	{
+		LWPOINT *pt = lwpoint_make2d(SRID_DEFAULT, pts[k].x, pts[k].y);
+		CU_ASSERT_EQUAL(rslts[k], itree_point_in_multipolygon(itree, pt));
+		lwpoint_free(pt);
+	}
+
+	itree_free(itree);
+	lwgeom_free(poly);
+}
+
+static void test_itree_batch(void)
+{
+	test_itree_batch_once(
+		"MULTIPOLYGON(((-1 -1, 0 -1, 1 -1, 1 0, 1 1, -1 1, -1 -1)))");
+	test_itree_batch_once(
+		"POLYGON("
+		"(-10 -10, 6 -10, 7 -10, 7.5 2, 8 -10, 9 -10, 10 -10, 10 10, -10 10, -10 2, -10 2, -10 -10),"
+		"(-5 -5, -5 5, 5 5, 5 -5, -5 -5))");
+	test_itree_batch_once(
+		"MULTIPOLYGON("
+		"((-10 -10, 6 -10, 7 -10, 7.5 2, 8 -10, 9 -10, 10 -10, 10 10, -10 10, -10 2, -10 2, -10 -10),"
+		"(-5 -5, -5 5, 5 5, 5 -5, -5 -5)),"
+		"EMPTY, ((-1 -1, 1 -1, 1 1, -1 1, -1 -1)))");
+	test_itree_batch_once(
+		"MULTIPOLYGON(((0 0, 0 1, 1 1, 2 2, 1 1, 0 1, 0 0)),"
+		"((0 0, 0 NaN, 0 NaN, 0 0, 0 1, 0 0)),((3 3, 3 3, 3 3, 3 3)))");
+}
+
 
 static void test_geography_tree_closestpoint(void)
 {
@@ -656,6 +709,7 @@ void tree_suite_setup(void)
 	PG_ADD_TEST(suite, test_itree_hole_spike);
 	PG_ADD_TEST(suite, test_itree_multipoly_empty);
 	PG_ADD_TEST(suite, test_itree_degenerate_poly);
+	PG_ADD_TEST(suite, test_itree_batch);
 	PG_ADD_TEST(suite, test_tree_circ_create);
 	PG_ADD_TEST(suite, test_tree_circ_pip);
 	PG_ADD_TEST(suite, test_tree_circ_pip2);
@@ -87,6 +87,27 @@ static void test_unionfind_ordered_by_cluster(void)
 	lwfree(ids_by_cluster);
 }
 
+static void test_unionfind_ordered_by_cluster_exact(void)
+{
+	UNIONFIND* uf = UF_create(10);
+
+	/* Roots that are not in element order */
+	UF_union(uf, 9, 4);
+	UF_union(uf, 6, 1);
+	UF_union(uf, 4, 0);
+	UF_union(uf, 1, 8);
+	UF_union(uf, 3, 5);
+
+	/* Clusters in root id order, elements in id order within each */
+	uint32_t expected_ordered_ids[] = { 1, 6, 8, 2, 3, 5, 0, 4, 9, 7 };
+	uint32_t* ids_by_cluster = UF_ordered_by_cluster(uf);
+
+	ASSERT_INTARRAY_EQUAL(ids_by_cluster, expected_ordered_ids, 10);
+
+	lwfree(ids_by_cluster);
+	UF_destroy(uf);
+}
+
 static void test_unionfind_path_compression(void)
 {
 	UNIONFIND* uf = UF_create(5);
@@ -158,6 +179,19 @@ static void test_unionfind_collapse_cluster_ids(void)
 			ASSERT_INT_EQUAL(expected_collapsed_ids2[i], collapsed_ids[i]);
 	}
 
+	lwfree(collapsed_ids);
+
+	/* A cluster without any member leaves no gap in the numbering */
+	char is_in_cluster3[] = { 1, 0, 0, 0, 1, 0, 1, 1, 1, 0 };
+	uint32_t expected_collapsed_ids3[] = { 1, 0, 0, 0, 0, 0, 1, 0, 1, 0 };
+
+	collapsed_ids = UF_get_collapsed_cluster_ids(uf, is_in_cluster3);
+	for (i = 0; i < uf->N; i++)
+	{
+		if (is_in_cluster3[i])
+			ASSERT_INT_EQUAL(expected_collapsed_ids3[i], collapsed_ids[i]);
+	}
+
 	lwfree(collapsed_ids);
 	UF_destroy(uf);
 }
@@ -169,6 +203,7 @@ void unionfind_suite_setup(void)
 	PG_ADD_TEST(suite, test_unionfind_create);
 	PG_ADD_TEST(suite, test_unionfind_union);
 	PG_ADD_TEST(suite, test_unionfind_ordered_by_cluster);
+	PG_ADD_TEST(suite, test_unionfind_ordered_by_cluster_exact);
 	PG_ADD_TEST(suite, test_unionfind_path_compression);
 	PG_ADD_TEST(suite, test_unionfind_collapse_cluster_ids);
 }
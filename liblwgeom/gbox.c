@@ -28,6 +28,15 @@
 #include <stdlib.h>
 #include <math.h>
 
+/*
+* The bounding box of long point arrays is computed with SSE2, which
+* every x86-64 CPU has, or with AVX2 when the CPU running us has it.
+*/
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PTARRAY_EXTENT_SIMD 1
+#include <immintrin.h>
+#endif
+
 
 GBOX* gbox_new(lwflags_t flags)
 {
@@ -545,10 +554,201 @@ static int lw_arc_calculate_gbox_cartesian(const POINT4D *p1, const POINT4D *p2,
 	return rv;
 }
 
+/* Below this many points the vector setup costs more than it saves */
+#define PTARRAY_EXTENT_SIMD_MIN_POINTS 16
+
+#ifdef PTARRAY_EXTENT_SIMD
+
+/*
+* The vector kernels read the coordinates as a flat array of doubles,
+* four points per step, keeping a min and a max accumulator for each
+* double of the step: accumulator lane j only ever sees dimension
+* j % ndims. The lanes are then folded per dimension, and the points
+* left over after the last whole step are added one by one.
+*/
+static int
+ptarray_extent_fold(const double *lane_min, const double *lane_max, int nlanes, int ndims,
+                    const double *tail, uint32_t ntail, double *min, double *max)
+{
+	int d, j;
+	uint32_t i;
+
+	for (d = 0; d < ndims; d++)
+	{
+		min[d] = lane_min[d];
+		max[d] = lane_max[d];
+	}
+	for (j = ndims; j < nlanes; j++)
+	{
+		d = j % ndims;
+		min[d] = FP_MIN(min[d], lane_min[j]);
+		max[d] = FP_MAX(max[d], lane_max[j]);
+	}
+	for (i = 0; i < ntail * ndims; i++)
+	{
+		/* See below, NaN is left to the scalar loop */
+		if (isnan(tail[i]))
+			return LW_FAILURE;
+		d = i % ndims;
+		min[d] = FP_MIN(min[d], tail[i]);
+		max[d] = FP_MAX(max[d], tail[i]);
+	}
+	return LW_SUCCESS;
+}
+
+/*
+* Both kernels fail on arrays holding a NaN: the scalar loop, where the
+* result depends on the position of the NaN, has the final say on those.
+*/
+static inline __attribute__((always_inline)) int
+ptarray_extent_sse2_n(const double *c, uint32_t npoints, int ndims, double *min, double *max)
+{
+	__m128d vmin[8], vmax[8];
+	__m128d vnan = _mm_setzero_pd();
+	double lane_min[16], lane_max[16];
+	const int nregs = 2 * ndims; /* 4 * ndims doubles per step */
+	uint32_t i, nsteps = npoints / 4;
+	int r;
+
+	for (r = 0; r < nregs; r++)
+	{
+		vmin[r] = vmax[r] = _mm_loadu_pd(c + 2 * r);
+		vnan = _mm_or_pd(vnan, _mm_cmpunord_pd(vmin[r], vmin[r]));
+	}
+
+	for (i = 1; i < nsteps; i++)
+	{
+		const double *step = c + (size_t)i * 4 * ndims;
+		for (r = 0; r < nregs; r++)
+		{
+			__m128d v = _mm_loadu_pd(step + 2 * r);
+			vmin[r] = _mm_min_pd(vmin[r], v);
+			vmax[r] = _mm_max_pd(vmax[r], v);
+			vnan = _mm_or_pd(vnan, _mm_cmpunord_pd(v, v));
+		}
+	}
+	for (r = 0; r < nregs; r++)
+	{
+		_mm_storeu_pd(lane_min + 2 * r, vmin[r]);
+		_mm_storeu_pd(lane_max + 2 * r, vmax[r]);
+	}
+	if (_mm_movemask_pd(vnan))
+		return LW_FAILURE;
+
+	return ptarray_extent_fold(lane_min, lane_max, 2 * nregs, ndims,
+	                           c + (size_t)nsteps * 4 * ndims, npoints - nsteps * 4, min, max);
+}
+
+static inline __attribute__((always_inline, target("avx2"))) int
+ptarray_extent_avx2_n(const double *c, uint32_t npoints, int ndims, double *min, double *max)
+{
+	__m256d vmin[4], vmax[4];
+	__m256d vnan = _mm256_setzero_pd();
+	double lane_min[16], lane_max[16];
+	const int nregs = ndims; /* 4 * ndims doubles per step */
+	uint32_t i, nsteps = npoints / 4;
+	int r;
+
+	for (r = 0; r < nregs; r++)
+	{
+		vmin[r] = vmax[r] = _mm256_loadu_pd(c + 4 * r);
+		vnan = _mm256_or_pd(vnan, _mm256_cmp_pd(vmin[r], vmin[r], _CMP_UNORD_Q));
+	}
+
+	for (i = 1; i < nsteps; i++)
+	{
+		const double *step = c + (size_t)i * 4 * ndims;
+		for (r = 0; r < nregs; r++)
+		{
+			__m256d v = _mm256_loadu_pd(step + 4 * r);
+			vmin[r] = _mm256_min_pd(vmin[r], v);
+			vmax[r] = _mm256_max_pd(vmax[r], v);
+			vnan = _mm256_or_pd(vnan, _mm256_cmp_pd(v, v, _CMP_UNORD_Q));
+		}
+	}
+	for (r = 0; r < nregs; r++)
+	{
+		_mm256_storeu_pd(lane_min + 4 * r, vmin[r]);
+		_mm256_storeu_pd(lane_max + 4 * r, vmax[r]);
+	}
+	if (_mm256_movemask_pd(vnan))
+		return LW_FAILURE;
+
+	return ptarray_extent_fold(lane_min, lane_max, 4 * nregs, ndims,
+	                           c + (size_t)nsteps * 4 * ndims, npoints - nsteps * 4, min, max);
+}
+
+static int
+ptarray_extent_sse2(const double *c, uint32_t npoints, int ndims, double *min, double *max)
+{
+	switch (ndims)
+	{
+	case 2:
+		return ptarray_extent_sse2_n(c, npoints, 2, min, max);
+	case 3:
+		return ptarray_extent_sse2_n(c, npoints, 3, min, max);
+	default:
+		return ptarray_extent_sse2_n(c, npoints, 4, min, max);
+	}
+}
+
+__attribute__((target("avx2"))) static int
+ptarray_extent_avx2(const double *c, uint32_t npoints, int ndims, double *min, double *max)
+{
+	switch (ndims)
+	{
+	case 2:
+		return ptarray_extent_avx2_n(c, npoints, 2, min, max);
+	case 3:
+		return ptarray_extent_avx2_n(c, npoints, 3, min, max);
+	default:
+		return ptarray_extent_avx2_n(c, npoints, 4, min, max);
+	}
+}
+
+#endif /* PTARRAY_EXTENT_SIMD */
+
+/*
+* Per-dimension extent of the ndims doubles of each point of pa.
+* Returns LW_FAILURE when the caller should use the scalar loop.
+*/
+static int
+ptarray_extent_simd(const POINTARRAY *pa, int ndims, double *min, double *max)
+{
+#ifdef PTARRAY_EXTENT_SIMD
+	static int use_avx2 = -1;
+	const double *c = (const double *)pa->serialized_pointlist;
+
+	if (pa->npoints < PTARRAY_EXTENT_SIMD_MIN_POINTS)
+		return LW_FAILURE;
+
+	if (use_avx2 < 0)
+		use_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+	if (use_avx2)
+		return ptarray_extent_avx2(c, pa->npoints, ndims, min, max);
+	return ptarray_extent_sse2(c, pa->npoints, ndims, min, max);
+#else
+	return LW_FAILURE;
+#endif
+}
+
 static void
 ptarray_calculate_gbox_cartesian_2d(const POINTARRAY *pa, GBOX *gbox)
 {
-	const POINT2D *p = getPoint2d_cp(pa, 0);
+	const POINT2D *p;
+	double min[2], max[2];
+
+	if (ptarray_extent_simd(pa, 2, min, max))
+	{
+		gbox->xmin = min[0];
+		gbox->xmax = max[0];
+		gbox->ymin = min[1];
+		gbox->ymax = max[1];
+		return;
+	}
+
+	p = getPoint2d_cp(pa, 0);
 
 	gbox->xmax = gbox->xmin = p->x;
 	gbox->ymax = gbox->ymin = p->y;
@@ -567,7 +767,21 @@ ptarray_calculate_gbox_cartesian_2d(const POINTARRAY *pa, GBOX *gbox)
 static void
 ptarray_calculate_gbox_cartesian_3d(const POINTARRAY *pa, GBOX *gbox)
 {
-	const POINT3D *p = getPoint3d_cp(pa, 0);
+	const POINT3D *p;
+	double min[3], max[3];
+
+	if (ptarray_extent_simd(pa, 3, min, max))
+	{
+		gbox->xmin = min[0];
+		gbox->xmax = max[0];
+		gbox->ymin = min[1];
+		gbox->ymax = max[1];
+		gbox->zmin = min[2];
+		gbox->zmax = max[2];
+		return;
+	}
+
+	p = getPoint3d_cp(pa, 0);
 
 	gbox->xmax = gbox->xmin = p->x;
 	gbox->ymax = gbox->ymin = p->y;
@@ -588,7 +802,23 @@ ptarray_calculate_gbox_cartesian_3d(const POINTARRAY *pa, GBOX *gbox)
 static void
 ptarray_calculate_gbox_cartesian_4d(const POINTARRAY *pa, GBOX *gbox)
 {
-	const POINT4D *p = getPoint4d_cp(pa, 0);
+	const POINT4D *p;
+	double min[4], max[4];
+
+	if (ptarray_extent_simd(pa, 4, min, max))
+	{
+		gbox->xmin = min[0];
+		gbox->xmax = max[0];
+		gbox->ymin = min[1];
+		gbox->ymax = max[1];
+		gbox->zmin = min[2];
+		gbox->zmax = max[2];
+		gbox->mmin = min[3];
+		gbox->mmax = max[3];
+		return;
+	}
+
+	p = getPoint4d_cp(pa, 0);
 
 	gbox->xmax = gbox->xmin = p->x;
 	gbox->ymax = gbox->ymin = p->y;
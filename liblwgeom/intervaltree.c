@@ -521,5 +521,277 @@ itree_point_in_multipolygon(const IntervalTree *itree, const LWPOINT *point)
 }
 
 
+/*******************************************************************************
+ * Batch point-in-polygon.
+ *
+ * Rather than walking the tree once per point, each ring tree is walked
+ * once for the whole batch. The points are sorted on Y up front, so the
+ * points that fall inside a node interval are always a contiguous run
+ * of the sorted coordinates, found by binary search within the run of
+ * the parent node. The leaf edge tests are then a flat loop over
+ * contiguous x/y arrays, which compilers can vectorize.
+ */
+
+typedef struct
+{
+	double y;
+	uint32_t id;
+} IntervalTreeBatchPoint;
+
+typedef struct
+{
+	double *xs;               /* x values of current points, sorted on y */
+	double *ys;               /* y values of current points, sorted on y */
+	int *winding;             /* winding number of current points */
+	uint8_t *boundary;        /* current point is on ring boundary */
+} IntervalTreeBatch;
+
+static int
+itree_batch_point_cmp(const void *a, const void *b)
+{
+	const IntervalTreeBatchPoint *pa = a;
+	const IntervalTreeBatchPoint *pb = b;
+	if (pa->y < pb->y) return -1;
+	if (pa->y > pb->y) return 1;
+	return (pa->id > pb->id) - (pa->id < pb->id);
+}
+
+/* First position in [lo, hi) where FP_LTEQ(min, y) holds */
+static uint32_t
+itree_batch_lower(const double *ys, uint32_t lo, uint32_t hi, double min)
+{
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (FP_LTEQ(min, ys[mid]))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+/* First position in [lo, hi) where FP_LTEQ(y, max) fails */
+static uint32_t
+itree_batch_upper(const double *ys, uint32_t lo, uint32_t hi, double max)
+{
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (FP_LTEQ(ys[mid], max))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+itree_point_in_ring_batch_recursive(
+	const IntervalTreeNode *node,
+	const POINTARRAY *pa,
+	IntervalTreeBatch *batch,
+	uint32_t lo,
+	uint32_t hi)
+{
+	/*
+	 * Narrow the parent run down to the points whose
+	 * Y value is within range of this node.
+	 */
+	lo = itree_batch_lower(batch->ys, lo, hi, node->min);
+	hi = itree_batch_upper(batch->ys, lo, hi, node->max);
+	if (lo >= hi)
+		return;
+
+	/* This is a leaf node, so evaluate winding numbers */
+	if (node->numChildren == 0)
+	{
+		const POINT2D *seg1 = getPoint2d_cp(pa, node->edgeIndex);
+		const POINT2D *seg2 = getPoint2d_cp(pa, node->edgeIndex + 1);
+		const double *xs = batch->xs;
+		const double *ys = batch->ys;
+		int *winding = batch->winding;
+		uint8_t *boundary = batch->boundary;
+		double x1 = seg1->x, y1 = seg1->y;
+		double x2 = seg2->x, y2 = seg2->y;
+		double minx = FP_MIN(x1, x2), maxx = FP_MAX(x1, x2);
+		double miny = FP_MIN(y1, y2), maxy = FP_MAX(y1, y2);
+
+		/* Same rules as itree_point_in_ring_recursive, without branches */
+		for (uint32_t k = lo; k < hi; k++)
+		{
+			double x = xs[k];
+			double y = ys[k];
+			double side = (x2 - x1) * (y - y1) - (x - x1) * (y2 - y1);
+
+			boundary[k] |= (side == 0.0) &
+			               (x >= minx) & (x <= maxx) &
+			               (y >= miny) & (y <= maxy);
+
+			winding[k] += ((y1 <= y) & (y < y2) & (side > 0)) -
+			              ((y2 <= y) & (y < y1) & (side < 0));
+		}
+		return;
+	}
+
+	/* This is an interior node, so recurse downwards */
+	for (uint32_t i = 0; i < node->numChildren; i++)
+		itree_point_in_ring_batch_recursive(node->children[i], pa, batch, lo, hi);
+}
+
+/*
+ * Evaluate the points in list, which are in Y order, against
+ * one ring, writing the ring result of each point into ring.
+ */
+static void
+itree_point_in_ring_batch(
+	const IntervalTree *itree,
+	uint32_t ringNumber,
+	IntervalTreeBatch *batch,
+	const POINT2D *pts,
+	const uint32_t *list,
+	uint32_t n,
+	IntervalTreeResult *ring)
+{
+	const IntervalTreeNode *node = itree->indexes[ringNumber];
+	const POINTARRAY *pa = itree->indexArrays[ringNumber];
+
+	for (uint32_t k = 0; k < n; k++)
+	{
+		batch->xs[k] = pts[list[k]].x;
+		batch->ys[k] = pts[list[k]].y;
+	}
+	memset(batch->winding, 0, n * sizeof(int));
+	memset(batch->boundary, 0, n * sizeof(uint8_t));
+
+	if (node)
+		itree_point_in_ring_batch_recursive(node, pa, batch, 0, n);
+
+	/* Boundary case is separate from winding number */
+	for (uint32_t k = 0; k < n; k++)
+	{
+		if (batch->boundary[k])
+			ring[k] = ITREE_BOUNDARY;
+		else
+			ring[k] = batch->winding[k] ? ITREE_INSIDE : ITREE_OUTSIDE;
+	}
+}
 
+/*
+ * Batch version of itree_point_in_multipolygon, writing one
+ * result per input point into results. Gives the same answers
+ * as calling itree_point_in_multipolygon on each point in turn.
+ */
+void
+itree_point_in_multipolygon_batch(
+	const IntervalTree *itree,
+	const POINT2D *pts,
+	uint32_t npoints,
+	IntervalTreeResult *results)
+{
+	IntervalTreeBatch batch;
+	IntervalTreeBatchPoint *order;
+	IntervalTreeResult *ring;
+	uint32_t *active, *cand;
+	uint32_t nactive = 0;
+	uint32_t i = 0;
+
+	if (!npoints)
+		return;
 
+	/* Non-finite points are not within anything, the rest are undecided */
+	order = lwalloc(npoints * sizeof(IntervalTreeBatchPoint));
+	for (uint32_t j = 0; j < npoints; j++)
+	{
+		if (isfinite(pts[j].x) && isfinite(pts[j].y))
+		{
+			results[j] = ITREE_OK;
+			order[nactive].y = pts[j].y;
+			order[nactive].id = j;
+			nactive++;
+		}
+		else
+			results[j] = ITREE_OUTSIDE;
+	}
+
+	/*
+	 * Working lists keep Y order, since they are only
+	 * ever compacted after this sort.
+	 */
+	qsort(order, nactive, sizeof(IntervalTreeBatchPoint), itree_batch_point_cmp);
+	active = lwalloc(2 * npoints * sizeof(uint32_t));
+	cand = active + npoints;
+	for (uint32_t k = 0; k < nactive; k++)
+		active[k] = order[k].id;
+	lwfree(order);
+
+	batch.xs = lwalloc(npoints * sizeof(double));
+	batch.ys = lwalloc(npoints * sizeof(double));
+	batch.winding = lwalloc(npoints * sizeof(int));
+	batch.boundary = lwalloc(npoints * sizeof(uint8_t));
+	ring = lwalloc(npoints * sizeof(IntervalTreeResult));
+
+	for (uint32_t p = 0; p < itree->numPolys && nactive; p++)
+	{
+		uint32_t ringCount = itree->ringCounts[p];
+		uint32_t ncand = 0;
+		uint32_t nkeep = 0;
+
+		/* Skip empty polygons */
+		if (ringCount == 0) continue;
+
+		/* Check undecided points against exterior ring */
+		itree_point_in_ring_batch(itree, i, &batch, pts, active, nactive, ring);
+		for (uint32_t k = 0; k < nactive; k++)
+		{
+			uint32_t j = active[k];
+			if (ring[k] == ITREE_BOUNDARY)
+				results[j] = ITREE_BOUNDARY;
+			else if (ring[k] == ITREE_INSIDE)
+				cand[ncand++] = j;
+		}
+
+		/* Points inside the exterior ring must be outside all the holes */
+		for (uint32_t r = 1; r < ringCount && ncand; r++)
+		{
+			uint32_t nout = 0;
+			itree_point_in_ring_batch(itree, i+r, &batch, pts, cand, ncand, ring);
+			for (uint32_t k = 0; k < ncand; k++)
+			{
+				uint32_t j = cand[k];
+				if (ring[k] == ITREE_BOUNDARY)
+					results[j] = ITREE_BOUNDARY;
+				/* Inside a hole stays undecided, other polygons may be in it */
+				else if (ring[k] == ITREE_OUTSIDE)
+					cand[nout++] = j;
+			}
+			ncand = nout;
+		}
+
+		for (uint32_t k = 0; k < ncand; k++)
+			results[cand[k]] = ITREE_INSIDE;
+
+		/* Carry the still undecided points on to the next polygon */
+		for (uint32_t k = 0; k < nactive; k++)
+		{
+			uint32_t j = active[k];
+			if (results[j] == ITREE_OK)
+				active[nkeep++] = j;
+		}
+		nactive = nkeep;
+
+		/* Move to first ring of next polygon */
+		i += ringCount;
+	}
+
+	/* Not in any rings */
+	for (uint32_t k = 0; k < nactive; k++)
+		results[active[k]] = ITREE_OUTSIDE;
+
+	lwfree(ring);
+	lwfree(batch.boundary);
+	lwfree(batch.winding);
+	lwfree(batch.ys);
+	lwfree(batch.xs);
+	lwfree(active);
+}
@@ -747,6 +747,111 @@ lwgeom_get_bbox(const LWGEOM *lwg)
 	return lwg->bbox;
 }
 
+typedef struct
+{
+	uint64_t key;
+	uint32_t idx;
+	int has_key; /* NULL and empty inputs have no center */
+	LWGEOM *geom;
+} LWGEOM_HILBERT_ITEM;
+
+static int
+lwgeom_hilbert_item_cmp(const void *a, const void *b)
+{
+	const LWGEOM_HILBERT_ITEM *ia = a;
+	const LWGEOM_HILBERT_ITEM *ib = b;
+	if (ia->has_key != ib->has_key)
+		return ia->has_key ? -1 : 1;
+	if (ia->key != ib->key)
+		return ia->key < ib->key ? -1 : 1;
+	/* Keep ties in input order, qsort is not stable */
+	return ia->idx < ib->idx ? -1 : (ia->idx > ib->idx ? 1 : 0);
+}
+
+void
+lwgeom_sort_hilbert(LWGEOM **geoms, uint32_t ngeoms)
+{
+	LWGEOM_HILBERT_ITEM *items;
+	double *cx, *cy;
+	double xmin = DBL_MAX, ymin = DBL_MAX;
+	double xmax = -DBL_MAX, ymax = -DBL_MAX;
+	double xscale, yscale;
+	uint32_t i;
+
+	if (ngeoms < 2)
+		return;
+
+	items = lwalloc(sizeof(LWGEOM_HILBERT_ITEM) * ngeoms);
+	cx = lwalloc(sizeof(double) * ngeoms);
+	cy = lwalloc(sizeof(double) * ngeoms);
+
+	/* Box centers and their extent */
+	for (i = 0; i < ngeoms; i++)
+	{
+		LWGEOM *geom = geoms[i];
+		GBOX box;
+
+		items[i].idx = i;
+		items[i].geom = geom;
+		items[i].key = 0;
+		items[i].has_key = LW_FALSE;
+		cx[i] = cy[i] = NAN;
+
+		if (!geom || lwgeom_is_empty(geom))
+			continue;
+
+		/* Do not attach a box to the input, only read one */
+		if (geom->bbox)
+			box = *(geom->bbox);
+		else if (lwgeom_calculate_gbox(geom, &box) != LW_SUCCESS)
+			continue;
+
+		cx[i] = (box.xmin + box.xmax) / 2.0;
+		cy[i] = (box.ymin + box.ymax) / 2.0;
+		if (!(isfinite(cx[i]) && isfinite(cy[i])))
+		{
+			cx[i] = cy[i] = NAN;
+			continue;
+		}
+		xmin = FP_MIN(xmin, cx[i]);
+		xmax = FP_MAX(xmax, cx[i]);
+		ymin = FP_MIN(ymin, cy[i]);
+		ymax = FP_MAX(ymax, cy[i]);
+	}
+
+	/* Nothing to order */
+	if (xmin > xmax)
+	{
+		lwfree(items);
+		lwfree(cx);
+		lwfree(cy);
+		return;
+	}
+
+	/* Map the centers onto the full 32-bit grid of the curve */
+	xscale = xmax > xmin ? UINT32_MAX / (xmax - xmin) : 0.0;
+	yscale = ymax > ymin ? UINT32_MAX / (ymax - ymin) : 0.0;
+	for (i = 0; i < ngeoms; i++)
+	{
+		if (isnan(cx[i]))
+			continue;
+		/* Clamp, the scaled maximum can round just above the grid */
+		items[i].has_key = LW_TRUE;
+		items[i].key = uint32_hilbert(
+			(uint32_t)FP_MIN((cx[i] - xmin) * xscale, UINT32_MAX),
+			(uint32_t)FP_MIN((cy[i] - ymin) * yscale, UINT32_MAX));
+	}
+
+	qsort(items, ngeoms, sizeof(LWGEOM_HILBERT_ITEM), lwgeom_hilbert_item_cmp);
+
+	for (i = 0; i < ngeoms; i++)
+		geoms[i] = items[i].geom;
+
+	lwfree(items);
+	lwfree(cx);
+	lwfree(cy);
+}
+
 
 /**
 * Calculate the gbox for this geometry, a cartesian box or
@@ -525,8 +525,309 @@ union_dbscan_general(LWGEOM** geoms, uint32_t num_geoms, UNIONFIND* uf, double e
 	return success;
 }
 
+/*
+ * Grid partition used by DBSCAN when every input is a point.
+ * Points are bucketed into square cells a little larger than eps,
+ * so all neighbors of a point lie in the 3x3 block of cells around
+ * its own cell (the cell plus its eps halo). Cells are stored sorted
+ * on (cx, cy) and found by binary search, so the grid is never more
+ * than the number of non-empty cells however small eps is.
+ */
+struct GridCell
+{
+	int64_t cx;
+	int64_t cy;
+	uint32_t start;  /* offset of first point of the cell in ids */
+	uint32_t count;
+};
+
+struct PointGrid
+{
+	struct GridCell* cells;
+	uint32_t num_cells;
+	uint32_t* ids;       /* point ids, grouped by cell */
+	POINT2D* pts;        /* point coordinates, in the same order as ids */
+	uint32_t* cell_at;   /* cell index of each point, in the same order as ids */
+	uint32_t* pos_of;    /* position of each input in ids, UINT32_MAX for empties */
+	uint32_t num_points;
+};
+
+/* Give up on the grid when eps is lost in the precision of the coordinates */
+static const double GRID_MIN_RELATIVE_EPS = 1e-10;
+static const double GRID_MAX_COORD = 1e18;
+static const double GRID_MAX_CELLS = 2147483647.0;
+
+struct GridSortItem
+{
+	int64_t cx;
+	int64_t cy;
+	uint32_t id;
+};
+
+static int
+grid_sort_item_cmp(const void* a, const void* b)
+{
+	const struct GridSortItem* ia = a;
+	const struct GridSortItem* ib = b;
+	if (ia->cx != ib->cx)
+		return ia->cx < ib->cx ? -1 : 1;
+	if (ia->cy != ib->cy)
+		return ia->cy < ib->cy ? -1 : 1;
+	return (ia->id > ib->id) - (ia->id < ib->id);
+}
+
+static void
+destroy_point_grid(struct PointGrid* grid)
+{
+	lwfree(grid->cells);
+	lwfree(grid->ids);
+	lwfree(grid->pts);
+	lwfree(grid->cell_at);
+	lwfree(grid->pos_of);
+}
+
+/* Build a grid over the inputs, or return LW_FAILURE if they are not all points
+ * or the grid would not be exact, in which case the caller should use the STRtree. */
+static int
+make_point_grid(LWGEOM** geoms, uint32_t num_geoms, double eps, struct PointGrid* grid)
+{
+	struct GridSortItem* items;
+	double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+	double cell_size;
+	uint32_t i, n = 0;
+
+	if (!(eps > 0.0 && eps <= GRID_MAX_COORD))
+		return LW_FAILURE;
+
+	for (i = 0; i < num_geoms; i++)
+	{
+		const POINT2D* pt;
+		if (lwgeom_get_type(geoms[i]) != POINTTYPE)
+			return LW_FAILURE;
+		if (lwgeom_is_empty(geoms[i]))
+			continue;
+
+		pt = getPoint2d_cp(lwgeom_as_lwpoint(geoms[i])->point, 0);
+		if (!(fabs(pt->x) <= GRID_MAX_COORD && fabs(pt->y) <= GRID_MAX_COORD))
+			return LW_FAILURE;
+
+		xmin = FP_MIN(xmin, pt->x);
+		ymin = FP_MIN(ymin, pt->y);
+		xmax = FP_MAX(xmax, pt->x);
+		ymax = FP_MAX(ymax, pt->y);
+		n++;
+	}
+
+	if (n == 0)
+		return LW_FAILURE;
+
+	if (eps < GRID_MIN_RELATIVE_EPS * FP_MAX(FP_MAX(fabs(xmin), fabs(xmax)), FP_MAX(fabs(ymin), fabs(ymax))))
+		return LW_FAILURE;
+
+	/* Slightly oversized cells absorb rounding in the cell computation */
+	cell_size = eps * 1.001;
+	if ((xmax - xmin) / cell_size >= GRID_MAX_CELLS || (ymax - ymin) / cell_size >= GRID_MAX_CELLS)
+		return LW_FAILURE;
+
+	items = lwalloc(n * sizeof(struct GridSortItem));
+	grid->pos_of = lwalloc(num_geoms * sizeof(uint32_t));
+	for (i = 0, n = 0; i < num_geoms; i++)
+	{
+		const POINT2D* pt;
+		grid->pos_of[i] = UINT32_MAX;
+		if (lwgeom_is_empty(geoms[i]))
+			continue;
+
+		pt = getPoint2d_cp(lwgeom_as_lwpoint(geoms[i])->point, 0);
+		items[n].cx = (int64_t) floor((pt->x - xmin) / cell_size);
+		items[n].cy = (int64_t) floor((pt->y - ymin) / cell_size);
+		items[n].id = i;
+		n++;
+	}
+	qsort(items, n, sizeof(struct GridSortItem), grid_sort_item_cmp);
+
+	grid->num_points = n;
+	grid->num_cells = 0;
+	grid->cells = lwalloc(n * sizeof(struct GridCell));
+	grid->ids = lwalloc(n * sizeof(uint32_t));
+	grid->pts = lwalloc(n * sizeof(POINT2D));
+	grid->cell_at = lwalloc(n * sizeof(uint32_t));
+	for (i = 0; i < n; i++)
+	{
+		uint32_t id = items[i].id;
+		struct GridCell* cell = grid->num_cells ? &grid->cells[grid->num_cells - 1] : NULL;
+
+		if (!cell || cell->cx != items[i].cx || cell->cy != items[i].cy)
+		{
+			cell = &grid->cells[grid->num_cells++];
+			cell->cx = items[i].cx;
+			cell->cy = items[i].cy;
+			cell->start = i;
+			cell->count = 0;
+		}
+		cell->count++;
+
+		grid->ids[i] = id;
+		grid->pts[i] = *getPoint2d_cp(lwgeom_as_lwpoint(geoms[id])->point, 0);
+		grid->cell_at[i] = grid->num_cells - 1;
+		grid->pos_of[id] = i;
+	}
+
+	lwfree(items);
+	return LW_SUCCESS;
+}
+
+static const struct GridCell*
+point_grid_find_cell(const struct PointGrid* grid, int64_t cx, int64_t cy)
+{
+	uint32_t lo = 0, hi = grid->num_cells;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		const struct GridCell* cell = &grid->cells[mid];
+		if (cell->cx < cx || (cell->cx == cx && cell->cy < cy))
+			lo = mid + 1;
+		else if (cell->cx == cx && cell->cy == cy)
+			return cell;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/* Find the inputs within eps of input p, including p itself, searching only
+ * the cell of p and its halo. Stops once max_found neighbors are found.
+ * The tests are the same as the STRtree envelope query followed by
+ * lwgeom_mindistance2d_tolerance, so the same neighbors are found. */
+static uint32_t
+point_grid_query(const struct PointGrid* grid, uint32_t p, double eps, uint32_t* found, uint32_t max_found)
+{
+	uint32_t pos = grid->pos_of[p];
+	const struct GridCell* home;
+	const POINT2D* pt;
+	double qxmin, qxmax, qymin, qymax;
+	uint32_t num_found = 0;
+	int dx, dy;
+
+	/* Empties have no neighbors */
+	if (pos == UINT32_MAX)
+		return 0;
+
+	home = &grid->cells[grid->cell_at[pos]];
+	pt = &grid->pts[pos];
+	qxmin = pt->x - eps;
+	qxmax = pt->x + eps;
+	qymin = pt->y - eps;
+	qymax = pt->y + eps;
+
+	for (dx = -1; dx <= 1; dx++)
+	{
+		for (dy = -1; dy <= 1; dy++)
+		{
+			const struct GridCell* cell = point_grid_find_cell(grid, home->cx + dx, home->cy + dy);
+			if (!cell)
+				continue;
+
+			for (uint32_t k = cell->start; k < cell->start + cell->count; k++)
+			{
+				const POINT2D* q = &grid->pts[k];
+				double hside, vside;
+
+				if (q->x < qxmin || q->x > qxmax || q->y < qymin || q->y > qymax)
+					continue;
+
+				hside = q->x - pt->x;
+				vside = q->y - pt->y;
+				if (sqrt(hside * hside + vside * vside) > eps)
+					continue;
+
+				found[num_found++] = grid->ids[k];
+				if (num_found >= max_found)
+					return num_found;
+			}
+		}
+	}
+	return num_found;
+}
+
+/* DBSCAN over a point grid. Gives the same clusters as the STRtree based
+ * implementations: core points are those with at least min_points neighbors,
+ * core points within eps of each other share a cluster, and a border point
+ * joins the cluster of the lowest numbered core point within eps of it.
+ */
+static int
+union_dbscan_grid(LWGEOM** geoms, uint32_t num_geoms, struct PointGrid* grid, UNIONFIND* uf, double eps, uint32_t min_points, char** in_a_cluster_ret)
+{
+	uint32_t p, i, c;
+	uint32_t* found = lwalloc(grid->num_points * sizeof(uint32_t));
+	char* in_a_cluster = lwalloc(num_geoms * sizeof(char));
+	char* is_in_core = lwalloc(num_geoms * sizeof(char));
+
+	/* With min_points == 1 everything, even an empty, is a cluster of its own */
+	memset(in_a_cluster, min_points <= 1 ? LW_TRUE : LW_FALSE, num_geoms * sizeof(char));
+	memset(is_in_core, LW_FALSE, num_geoms * sizeof(char));
+
+	/* Core points only depend on their own cell and its halo,
+	 * so they are found one cell at a time. */
+	for (c = 0; c < grid->num_cells; c++)
+	{
+		const struct GridCell* cell = &grid->cells[c];
+		for (i = cell->start; i < cell->start + cell->count; i++)
+		{
+			p = grid->ids[i];
+			LW_ON_INTERRUPT(goto fail);
+			is_in_core[p] = point_grid_query(grid, p, eps, found, min_points) >= min_points;
+		}
+	}
+
+	/* Link core points to their neighbors in input order, so that
+	 * border points go to the lowest numbered core point. */
+	for (p = 0; p < num_geoms; p++)
+	{
+		uint32_t num_found;
+
+		if (!is_in_core[p])
+			continue;
+
+		LW_ON_INTERRUPT(goto fail);
+		in_a_cluster[p] = LW_TRUE;
+		num_found = point_grid_query(grid, p, eps, found, grid->num_points);
+		for (i = 0; i < num_found; i++)
+		{
+			uint32_t q = found[i];
+			if (is_in_core[q] || !in_a_cluster[q])
+			{
+				UF_union(uf, p, q);
+				in_a_cluster[q] = LW_TRUE;
+			}
+		}
+	}
+
+	lwfree(found);
+	lwfree(is_in_core);
+	if (in_a_cluster_ret)
+		*in_a_cluster_ret = in_a_cluster;
+	else
+		lwfree(in_a_cluster);
+	return LW_SUCCESS;
+
+fail:
+	lwfree(found);
+	lwfree(is_in_core);
+	lwfree(in_a_cluster);
+	return LW_FAILURE;
+}
+
 int union_dbscan(LWGEOM** geoms, uint32_t num_geoms, UNIONFIND* uf, double eps, uint32_t min_points, char** in_a_cluster_ret)
 {
+	struct PointGrid grid;
+	if (make_point_grid(geoms, num_geoms, eps, &grid) == LW_SUCCESS)
+	{
+		int success = union_dbscan_grid(geoms, num_geoms, &grid, uf, eps, min_points, in_a_cluster_ret);
+		destroy_point_grid(&grid);
+		return success;
+	}
+
 	if (min_points <= 1)
 		return union_dbscan_minpoints_1(geoms, num_geoms, uf, eps, in_a_cluster_ret);
 	else
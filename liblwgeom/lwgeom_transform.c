@@ -29,19 +29,30 @@
 #include <string.h>
 
 /** convert decimal degrees to radians */
-static void
-to_rad(POINT4D *pt)
-{
-	pt->x *= M_PI/180.0;
-	pt->y *= M_PI/180.0;
-}
-
+#define DEG_TO_RAD (M_PI/180.0)
 /** convert radians to decimal degrees */
+#define RAD_TO_DEG (180.0/M_PI)
+
+/**
+ * Multiply the X and Y of npoints coordinates, held stride doubles
+ * apart, by factor. Plain loops over the doubles, which the compiler
+ * can vectorize.
+ */
 static void
-to_dec(POINT4D *pt)
+coords_scale_xy(double *xy, size_t stride, size_t npoints, double factor)
 {
-	pt->x *= 180.0/M_PI;
-	pt->y *= 180.0/M_PI;
+	size_t i;
+	if (stride == 2)
+	{
+		for (i = 0; i < 2 * npoints; i++)
+			xy[i] *= factor;
+		return;
+	}
+	for (i = 0; i < npoints; i++)
+	{
+		xy[i * stride] *= factor;
+		xy[i * stride + 1] *= factor;
+	}
 }
 
 /***************************************************************************/
@@ -229,8 +240,6 @@ box3d_transform(GBOX *gbox, LWPROJ *pj)
 int
 ptarray_transform(POINTARRAY *pa, LWPROJ *pj)
 {
-	uint32_t i;
-	POINT4D p;
 	size_t n_converted;
 	size_t n_points = pa->npoints;
 	size_t point_size = ptarray_point_size(pa);
@@ -241,14 +250,7 @@ ptarray_transform(POINTARRAY *pa, LWPROJ *pj)
 
 	/* Convert to radians if necessary */
 	if (proj_angular_input(pj->pj, direction))
-	{
-		for (i = 0; i < pa->npoints; i++)
-		{
-			getPoint4d_p(pa, i, &p);
-			to_rad(&p);
-			ptarray_set_point4d(pa, i, &p);
-		}
-	}
+		coords_scale_xy(pa_double, point_size / sizeof(double), n_points, DEG_TO_RAD);
 
 	if (n_points == 1)
 	{
@@ -310,19 +312,222 @@ ptarray_transform(POINTARRAY *pa, LWPROJ *pj)
 	}
 
 	/* Convert radians to degrees if necessary */
+	if (proj_angular_output(pj->pj, direction))
+		coords_scale_xy(pa_double, point_size / sizeof(double), n_points, RAD_TO_DEG);
+
+	return LW_SUCCESS;
+}
+
+/*
+ * Point arrays gathered from many geometries, to be transformed
+ * together by lwgeom_transform_many.
+ */
+typedef struct
+{
+	POINTARRAY **pas;
+	uint32_t npas;
+	uint32_t maxpas;
+	size_t npoints;
+} PTARRAY_LIST;
+
+static void
+ptarray_list_add(PTARRAY_LIST *list, POINTARRAY *pa)
+{
+	if (!pa || pa->npoints == 0)
+		return;
+	if (list->npas == list->maxpas)
+	{
+		list->maxpas = list->maxpas ? 2 * list->maxpas : 64;
+		list->pas = list->pas ? lwrealloc(list->pas, sizeof(POINTARRAY *) * list->maxpas)
+		                      : lwalloc(sizeof(POINTARRAY *) * list->maxpas);
+	}
+	list->pas[list->npas++] = pa;
+	list->npoints += pa->npoints;
+}
+
+/*
+ * Single point arrays go to the points list, the others to the runs
+ * list, so each list keeps the PROJ call ptarray_transform would
+ * have made for its arrays.
+ */
+static int
+ptarray_list_add_lwgeom(PTARRAY_LIST *points, PTARRAY_LIST *runs, LWGEOM *geom)
+{
+	uint32_t i;
+
+	if (lwgeom_is_empty(geom))
+		return LW_SUCCESS;
+
+	switch(geom->type)
+	{
+		case POINTTYPE:
+		case LINETYPE:
+		case CIRCSTRINGTYPE:
+		case TRIANGLETYPE:
+		{
+			LWLINE *g = (LWLINE*)geom;
+			ptarray_list_add(g->points->npoints == 1 ? points : runs, g->points);
+			break;
+		}
+		case POLYGONTYPE:
+		{
+			LWPOLY *g = (LWPOLY*)geom;
+			for ( i = 0; i < g->nrings; i++ )
+				ptarray_list_add(g->rings[i]->npoints == 1 ? points : runs, g->rings[i]);
+			break;
+		}
+		case MULTIPOINTTYPE:
+		case MULTILINETYPE:
+		case MULTIPOLYGONTYPE:
+		case COLLECTIONTYPE:
+		case COMPOUNDTYPE:
+		case CURVEPOLYTYPE:
+		case MULTICURVETYPE:
+		case MULTISURFACETYPE:
+		case POLYHEDRALSURFACETYPE:
+		case TINTYPE:
+		{
+			LWCOLLECTION *g = (LWCOLLECTION*)geom;
+			for ( i = 0; i < g->ngeoms; i++ )
+			{
+				if ( ! ptarray_list_add_lwgeom(points, runs, g->geoms[i]) ) return LW_FAILURE;
+			}
+			break;
+		}
+		default:
+		{
+			lwerror("lwgeom_transform_many: Cannot handle type '%s'",
+			          lwtype_name(geom->type));
+			return LW_FAILURE;
+		}
+	}
+	return LW_SUCCESS;
+}
+
+/*
+ * Copy the coordinates of all the arrays of the list into one
+ * X, one Y and one Z buffer, transform them with a single PROJ
+ * call and copy them back.
+ */
+static int
+ptarray_list_transform(PTARRAY_LIST *list, int single_points, LWPROJ *pj)
+{
+	/* proj_trans, used by ptarray_transform for single points, is given a zero time */
+	const double t_zero = 0.0;
+	PJ_DIRECTION direction = pj->pipeline_is_forward ? PJ_FWD : PJ_INV;
+	size_t n_points = list->npoints;
+	size_t n_converted, k = 0;
+	double *x, *y, *z;
+	uint32_t i, j;
+	int pj_errno_val;
+
+	if (!n_points)
+		return LW_SUCCESS;
+
+	x = lwalloc(sizeof(double) * 3 * n_points);
+	y = x + n_points;
+	z = y + n_points;
+
+	for (i = 0; i < list->npas; i++)
+	{
+		const POINTARRAY *pa = list->pas[i];
+		const double *pa_double = (const double*)(pa->serialized_pointlist);
+		size_t stride = ptarray_point_size(pa) / sizeof(double);
+		int has_z = ptarray_has_z(pa);
+		for (j = 0; j < pa->npoints; j++, k++)
+		{
+			x[k] = pa_double[j * stride];
+			y[k] = pa_double[j * stride + 1];
+			z[k] = has_z ? pa_double[j * stride + 2] : 0.0;
+		}
+	}
+
+	if (proj_angular_input(pj->pj, direction))
+	{
+		coords_scale_xy(x, 1, n_points, DEG_TO_RAD);
+		coords_scale_xy(y, 1, n_points, DEG_TO_RAD);
+	}
+
+	n_converted = proj_trans_generic(pj->pj,
+					 direction,
+					 x, sizeof(double), n_points,
+					 y, sizeof(double), n_points,
+					 z, sizeof(double), n_points,
+					 single_points ? (double*)&t_zero : NULL,
+					 single_points ? sizeof(double) : 0,
+					 single_points ? 1 : 0
+	);
+
+	if (n_converted != n_points)
+	{
+		lwfree(x);
+		lwerror("lwgeom_transform_many: converted (%zu) != input (%zu)", n_converted, n_points);
+		return LW_FAILURE;
+	}
+
+	pj_errno_val = proj_errno_reset(pj->pj);
+	if (pj_errno_val)
+	{
+		lwfree(x);
+		lwerror("transform: %s (%d)", proj_errno_string(pj_errno_val), pj_errno_val);
+		return LW_FAILURE;
+	}
+
 	if (proj_angular_output(pj->pj, direction))
 	{
-		for (i = 0; i < pa->npoints; i++)
+		coords_scale_xy(x, 1, n_points, RAD_TO_DEG);
+		coords_scale_xy(y, 1, n_points, RAD_TO_DEG);
+	}
+
+	for (i = 0, k = 0; i < list->npas; i++)
+	{
+		POINTARRAY *pa = list->pas[i];
+		double *pa_double = (double*)(pa->serialized_pointlist);
+		size_t stride = ptarray_point_size(pa) / sizeof(double);
+		int has_z = ptarray_has_z(pa);
+		for (j = 0; j < pa->npoints; j++, k++)
 		{
-			getPoint4d_p(pa, i, &p);
-			to_dec(&p);
-			ptarray_set_point4d(pa, i, &p);
+			pa_double[j * stride] = x[k];
+			pa_double[j * stride + 1] = y[k];
+			if (has_z)
+				pa_double[j * stride + 2] = z[k];
 		}
 	}
 
+	lwfree(x);
 	return LW_SUCCESS;
 }
 
+/**
+ * Transform many geometries in-place with the same transformation,
+ * making one PROJ call for all their coordinates rather than one per
+ * point array, which saves most of the per-call overhead on batches
+ * of small geometries.
+ */
+int
+lwgeom_transform_many(LWGEOM **geoms, uint32_t ngeoms, LWPROJ *pj)
+{
+	PTARRAY_LIST points = {NULL, 0, 0, 0};
+	PTARRAY_LIST runs = {NULL, 0, 0, 0};
+	uint32_t i;
+	int ret = LW_SUCCESS;
+
+	for (i = 0; i < ngeoms && ret; i++)
+	{
+		if (geoms[i])
+			ret = ptarray_list_add_lwgeom(&points, &runs, geoms[i]);
+	}
+
+	if (ret)
+		ret = ptarray_list_transform(&points, LW_TRUE, pj);
+	if (ret)
+		ret = ptarray_list_transform(&runs, LW_FALSE, pj);
+
+	if (points.pas) lwfree(points.pas);
+	if (runs.pas) lwfree(runs.pas);
+	return ret;
+}
+
 /**
  * Transform given LWGEOM geometry
  * from inpj projection to outpj projection
@@ -19,13 +19,46 @@
  */
 #define KMEANS_MAX_ITERATIONS 1000
 
+/*
+ * Mini-batch k-means samples this many objects per iteration (or a few
+ * per cluster if that is more), and runs this many iterations. Inputs
+ * that are not much bigger than a batch are clustered exactly instead.
+ */
+#define KMEANS_MINIBATCH_SIZE 4096
+#define KMEANS_MINIBATCH_PER_CLUSTER 8
+#define KMEANS_MINIBATCH_ITERATIONS 100
+
+/*
+ * Relative slack on the Hamerly bounds, so that rounding in the bounds
+ * never lets a point skip a center that is not strictly farther away.
+ */
+#define KMEANS_BOUND_SLACK 1e-9
+
+/*
+ * Hamerly bounds for pruned assignment: an upper bound on the distance
+ * to the assigned center, and a lower bound on the distance to any
+ * other center, per object. The centers the bounds were computed
+ * against are kept to measure how far each center moved since.
+ */
+typedef struct
+{
+	double *upper;
+	double *lower;
+	double *half_gap;  /* half the distance from a center to the closest other center */
+	double *drift;     /* how far a center moved since the bounds were set */
+	POINT4D *bound_centers;
+	uint32_t k;        /* number of centers the bounds are for, 0 if not set yet */
+	uint32_t k_alloc;  /* number of centers the per-center arrays have room for */
+} kmeans_bounds;
+
 static uint32_t kmeans(POINT4D *objs,
 		       uint32_t *clusters,
 		       uint32_t n,
 		       POINT4D *centers,
 		       double *radii,
 		       uint32_t min_k,
-		       double max_radius);
+		       double max_radius,
+		       lwkmeans_method method);
 
 inline static double
 distance3d_sqr_pt4d_pt4d(const POINT4D *p1, const POINT4D *p2)
@@ -82,7 +115,7 @@ improve_structure(POINT4D *objs,
 			continue;
 
 		/* run 2-means on the cluster */
-		kmeans(temp_objs, temp_clusters, cluster_size, temp_centers, temp_radii, 2, 0);
+		kmeans(temp_objs, temp_clusters, cluster_size, temp_centers, temp_radii, 2, 0, LW_KMEANS_HAMERLY);
 
 		/* replace cluster with split */
 		uint32_t d = 0;
@@ -144,6 +177,137 @@ update_r(POINT4D *objs, uint32_t *clusters, uint32_t n, POINT4D *centers, double
 	return converged;
 }
 
+/* Squared distance from each center to its farthest object */
+static void
+update_radii(const POINT4D *objs, const uint32_t *clusters, uint32_t n, const POINT4D *centers, double *radii, uint32_t k)
+{
+	memset(radii, 0, sizeof(double) * k);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		double distance = distance3d_sqr_pt4d_pt4d(&objs[i], &centers[clusters[i]]);
+		if (radii[clusters[i]] < distance)
+			radii[clusters[i]] = distance;
+	}
+}
+
+/* Nearest center to obj, in the same order and with the same ties as update_r */
+static uint32_t
+nearest_center(const POINT4D *obj, const POINT4D *centers, uint32_t k, double *nearest, double *second)
+{
+	double curr_distance = distance3d_sqr_pt4d_pt4d(obj, &centers[0]);
+	double next_distance = DBL_MAX;
+	uint32_t curr_cluster = 0;
+
+	for (uint32_t cluster = 1; cluster < k; cluster++)
+	{
+		double distance = distance3d_sqr_pt4d_pt4d(obj, &centers[cluster]);
+		if (distance < curr_distance)
+		{
+			next_distance = curr_distance;
+			curr_distance = distance;
+			curr_cluster = cluster;
+		}
+		else if (distance < next_distance)
+			next_distance = distance;
+	}
+	*nearest = curr_distance;
+	*second = next_distance;
+	return curr_cluster;
+}
+
+/*
+ * Same result as update_r, but skips the search over all centers for
+ * objects whose bounds prove the assigned center is still strictly the
+ * closest one (Hamerly, "Making k-means even faster", 2010).
+ */
+/* Make room in the per-center arrays for k centers, max_radius splits add centers */
+static void
+kmeans_bounds_reserve(kmeans_bounds *b, uint32_t k)
+{
+	if (k <= b->k_alloc)
+		return;
+	b->half_gap = lwrealloc(b->half_gap, sizeof(double) * k);
+	b->drift = lwrealloc(b->drift, sizeof(double) * k);
+	b->bound_centers = lwrealloc(b->bound_centers, sizeof(POINT4D) * k);
+	b->k_alloc = k;
+}
+
+static uint8_t
+update_r_pruned(POINT4D *objs, uint32_t *clusters, uint32_t n, POINT4D *centers, double *radii, uint32_t k, kmeans_bounds *b)
+{
+	uint8_t converged = LW_TRUE;
+	uint8_t have_bounds = (b->k == k);
+	double max_drift = 0, max_drift_2nd = 0;
+	uint32_t max_drift_cluster = 0;
+
+	kmeans_bounds_reserve(b, k);
+
+	/* How far did every center move since the bounds were set? */
+	for (uint32_t c = 0; c < k && have_bounds; c++)
+	{
+		b->drift[c] = sqrt(distance3d_sqr_pt4d_pt4d(&centers[c], &b->bound_centers[c]));
+		if (b->drift[c] > max_drift)
+		{
+			max_drift_2nd = max_drift;
+			max_drift = b->drift[c];
+			max_drift_cluster = c;
+		}
+		else if (b->drift[c] > max_drift_2nd)
+			max_drift_2nd = b->drift[c];
+	}
+
+	/* Half distance to the closest other center */
+	for (uint32_t c = 0; c < k; c++)
+	{
+		double gap = DBL_MAX;
+		for (uint32_t o = 0; o < k; o++)
+			if (o != c)
+				gap = FP_MIN(gap, distance3d_sqr_pt4d_pt4d(&centers[c], &centers[o]));
+		b->half_gap[c] = sqrt(gap) / 2;
+	}
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint32_t curr_cluster = clusters[i];
+		double nearest, second;
+
+		if (have_bounds)
+		{
+			/* Move the bounds along with the centers */
+			b->upper[i] += b->drift[curr_cluster];
+			b->lower[i] -= (curr_cluster == max_drift_cluster) ? max_drift_2nd : max_drift;
+
+			double limit = FP_MAX(b->lower[i], b->half_gap[curr_cluster]) * (1 - KMEANS_BOUND_SLACK);
+			if (b->upper[i] < limit)
+				continue;
+
+			/* Tighten the upper bound and try again */
+			b->upper[i] = sqrt(distance3d_sqr_pt4d_pt4d(&objs[i], &centers[curr_cluster])) * (1 + KMEANS_BOUND_SLACK);
+			if (b->upper[i] < limit)
+				continue;
+		}
+
+		curr_cluster = nearest_center(&objs[i], centers, k, &nearest, &second);
+		b->upper[i] = sqrt(nearest) * (1 + KMEANS_BOUND_SLACK);
+		b->lower[i] = sqrt(second) * (1 - KMEANS_BOUND_SLACK);
+
+		if (clusters[i] != curr_cluster)
+		{
+			converged = LW_FALSE;
+			clusters[i] = curr_cluster;
+		}
+	}
+
+	memcpy(b->bound_centers, centers, sizeof(POINT4D) * k);
+	b->k = k;
+
+	/* Radii are only needed once assignment is stable, so only compute them then */
+	if (radii && converged)
+		update_radii(objs, clusters, n, centers, radii, k);
+
+	return converged;
+}
+
 /* Refresh cluster centroids based on all of their objects */
 static void
 update_means(POINT4D *objs, uint32_t *clusters, uint32_t n, POINT4D *centers, uint32_t k)
@@ -272,6 +436,65 @@ kmeans_init(POINT4D *objs, uint32_t n, POINT4D *centers, uint32_t k)
 	}
 }
 
+/* Small deterministic generator for mini-batch sampling, so results are repeatable */
+static inline uint32_t
+kmeans_next_random(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(*state >> 33);
+}
+
+/*
+ * Mini-batch k-means (Sculley, "Web-scale k-means clustering", 2010).
+ * Centers are seeded from an evenly strided sample, then moved towards
+ * randomly sampled batches of objects with a per-center learning rate.
+ * Returns LW_FALSE if the input is small enough to be clustered exactly.
+ */
+static uint8_t
+kmeans_minibatch(POINT4D *objs, uint32_t n, POINT4D *centers, uint32_t k)
+{
+	uint32_t batch_size = FP_MAX(KMEANS_MINIBATCH_SIZE, KMEANS_MINIBATCH_PER_CLUSTER * k);
+	uint32_t sample_size = batch_size;
+	uint64_t state = n;
+	POINT4D *sample;
+	double *weights;
+
+	if (n <= 2 * batch_size)
+		return LW_FALSE;
+
+	/* Seed the centers from a sample rather than from all objects */
+	sample = lwalloc(sizeof(POINT4D) * sample_size);
+	for (uint32_t i = 0; i < sample_size; i++)
+		sample[i] = objs[(uint64_t)i * n / sample_size];
+	kmeans_init(sample, sample_size, centers, k);
+	lwfree(sample);
+
+	weights = lwalloc(sizeof(double) * k);
+	memset(weights, 0, sizeof(double) * k);
+
+	for (uint32_t t = 0; t < KMEANS_MINIBATCH_ITERATIONS; t++)
+	{
+		LW_ON_INTERRUPT(break);
+		for (uint32_t i = 0; i < batch_size; i++)
+		{
+			const POINT4D *obj = &objs[kmeans_next_random(&state) % n];
+			double nearest, second;
+			uint32_t cluster = nearest_center(obj, centers, k, &nearest, &second);
+			double eta;
+
+			/* Running weighted mean of everything assigned to the center so far */
+			weights[cluster] += obj->m;
+			eta = obj->m / weights[cluster];
+			centers[cluster].x += eta * (obj->x - centers[cluster].x);
+			centers[cluster].y += eta * (obj->y - centers[cluster].y);
+			centers[cluster].z += eta * (obj->z - centers[cluster].z);
+		}
+	}
+
+	lwfree(weights);
+	return LW_TRUE;
+}
+
 static uint32_t
 kmeans(POINT4D *objs,
        uint32_t *clusters,
@@ -279,34 +502,80 @@ kmeans(POINT4D *objs,
        POINT4D *centers,
        double *radii,
        uint32_t min_k,
-       double max_radius)
+       double max_radius,
+       lwkmeans_method method)
 {
 	uint8_t converged = LW_FALSE;
 	uint32_t cur_k = min_k;
+	kmeans_bounds bounds = {0};
 
-	kmeans_init(objs, n, centers, cur_k);
-	/* One iteration of kmeans needs to happen without shortcuts to fully initialize structures */
-	update_r(objs, clusters, n, centers, radii, cur_k);
-	update_means(objs, clusters, n, centers, cur_k);
-	for (uint32_t t = 0; t < KMEANS_MAX_ITERATIONS; t++)
+	if (method != LW_KMEANS_LLOYD)
 	{
-		/* Standard KMeans loop */
-		for (uint32_t i = 0; i < KMEANS_MAX_ITERATIONS; i++)
+		bounds.upper = lwalloc(sizeof(double) * n);
+		bounds.lower = lwalloc(sizeof(double) * n);
+		bounds.half_gap = lwalloc(sizeof(double) * min_k);
+		bounds.drift = lwalloc(sizeof(double) * min_k);
+		bounds.bound_centers = lwalloc(sizeof(POINT4D) * min_k);
+		bounds.k_alloc = min_k;
+	}
+
+	if (method == LW_KMEANS_MINIBATCH && kmeans_minibatch(objs, n, centers, cur_k))
+	{
+		/* Assign everything to the sampled centers, then only split clusters */
+		converged = LW_TRUE;
+		for (uint32_t t = 0; t < KMEANS_MAX_ITERATIONS; t++)
 		{
-			LW_ON_INTERRUPT(break);
-			converged = update_r(objs, clusters, n, centers, radii, cur_k);
-			if (converged)
+			bounds.k = 0;
+			update_r_pruned(objs, clusters, n, centers, NULL, cur_k, &bounds);
+			if (!max_radius)
 				break;
-			update_means(objs, clusters, n, centers, cur_k);
+
+			update_radii(objs, clusters, n, centers, radii, cur_k);
+
+			uint32_t new_k = improve_structure(objs, clusters, n, centers, radii, cur_k, max_radius);
+			if (new_k == cur_k)
+				break;
+			cur_k = new_k;
 		}
-		if (!converged || !max_radius)
-			break;
+	}
+	else
+	{
+		kmeans_init(objs, n, centers, cur_k);
+		/* One iteration of kmeans needs to happen without shortcuts to fully initialize structures */
+		update_r(objs, clusters, n, centers, radii, cur_k);
+		update_means(objs, clusters, n, centers, cur_k);
+		for (uint32_t t = 0; t < KMEANS_MAX_ITERATIONS; t++)
+		{
+			/* Standard KMeans loop */
+			for (uint32_t i = 0; i < KMEANS_MAX_ITERATIONS; i++)
+			{
+				LW_ON_INTERRUPT(break);
+				if (method == LW_KMEANS_LLOYD)
+					converged = update_r(objs, clusters, n, centers, radii, cur_k);
+				else
+					converged = update_r_pruned(objs, clusters, n, centers, radii, cur_k, &bounds);
+				if (converged)
+					break;
+				update_means(objs, clusters, n, centers, cur_k);
+			}
+			if (!converged || !max_radius)
+				break;
 
-		/* XMeans-inspired improve_structure pass to split clusters bigger than limit into 2 */
-		uint32_t new_k = improve_structure(objs, clusters, n, centers, radii, cur_k, max_radius);
-		if (new_k == cur_k)
-			break;
-		cur_k = new_k;
+			/* XMeans-inspired improve_structure pass to split clusters bigger than limit into 2 */
+			uint32_t new_k = improve_structure(objs, clusters, n, centers, radii, cur_k, max_radius);
+			if (new_k == cur_k)
+				break;
+			cur_k = new_k;
+		}
+	}
+
+	if (method != LW_KMEANS_LLOYD)
+	{
+		lwfree(bounds.upper);
+		lwfree(bounds.lower);
+		lwfree(bounds.half_gap);
+		lwfree(bounds.drift);
+		lwfree(bounds.bound_centers);
 	}
 
 	if (!converged)
@@ -319,6 +588,12 @@ kmeans(POINT4D *objs,
 
 int *
 lwgeom_cluster_kmeans(const LWGEOM **geoms, uint32_t n, uint32_t k, double max_radius)
+{
+	return lwgeom_cluster_kmeans_method(geoms, n, k, max_radius, LW_KMEANS_HAMERLY);
+}
+
+int *
+lwgeom_cluster_kmeans_method(const LWGEOM **geoms, uint32_t n, uint32_t k, double max_radius, lwkmeans_method method)
 {
 	uint32_t num_non_empty = 0;
 
@@ -426,7 +701,7 @@ lwgeom_cluster_kmeans(const LWGEOM **geoms, uint32_t n, uint32_t k, double max_r
 	{
 		uint32_t *clusters_dense = lwalloc(sizeof(uint32_t) * num_non_empty);
 		memset(clusters_dense, 0, sizeof(uint32_t) * num_non_empty);
-		uint32_t output_cluster_count = kmeans(objs_dense, clusters_dense, num_non_empty, centers, radii, k, max_radius);
+		uint32_t output_cluster_count = kmeans(objs_dense, clusters_dense, num_non_empty, centers, radii, k, max_radius, method);
 
 		uint32_t d = 0;
 		for (uint32_t i = 0; i < n; i++)
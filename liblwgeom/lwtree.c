@@ -439,6 +439,7 @@ rect_tree_is_area(const RECT_NODE *node)
 	{
 		case POLYGONTYPE:
 		case CURVEPOLYTYPE:
+		case MULTIPOLYGONTYPE:
 		case MULTISURFACETYPE:
 			return LW_TRUE;
 
@@ -28,9 +28,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-static int cmp_int(const void *a, const void *b);
-static int cmp_int_ptr(const void *a, const void *b);
-
 UNIONFIND*
 UF_create(uint32_t N)
 {
@@ -113,101 +110,71 @@ uint32_t*
 UF_ordered_by_cluster(UNIONFIND* uf)
 {
 	size_t i;
-	uint32_t** cluster_id_ptr_by_elem_id = lwalloc(uf->N * sizeof (uint32_t*));
+	uint32_t* cluster_offsets = lwalloc((uf->N + 1) * sizeof(uint32_t));
 	uint32_t* ordered_ids = lwalloc(uf->N * sizeof (uint32_t));
 
+	memset(cluster_offsets, 0, (uf->N + 1) * sizeof(uint32_t));
+
+	/* Count the elements in each cluster, making sure each
+	 * value in uf->clusters is pointing to the root of the cluster.
+	 * */
 	for (i = 0; i < uf->N; i++)
 	{
-		/* Make sure each value in uf->clusters is pointing to the
-		 * root of the cluster.
-		 * */
-		UF_find(uf, i);
-		cluster_id_ptr_by_elem_id[i] = &(uf->clusters[i]);
+		cluster_offsets[UF_find(uf, i) + 1]++;
 	}
 
-	/* Sort the array of cluster id pointers, so that pointers to the
-	 * same cluster id are grouped together.
+	/* Turn the counts into the starting offset of each cluster,
+	 * so clusters are laid out in order of cluster id.
 	 * */
-	qsort(cluster_id_ptr_by_elem_id, uf->N, sizeof (uint32_t*), &cmp_int_ptr);
+	for (i = 0; i < uf->N; i++)
+	{
+		cluster_offsets[i + 1] += cluster_offsets[i];
+	}
 
-	/* Recover the input element ids from the cluster id pointers, so
-	 * we can return element ids grouped by cluster id.
+	/* Place the element ids, in element id order within each cluster.
+	 * This is a counting sort, so it runs in linear time.
 	 * */
-	for (i = 0; i < uf-> N; i++)
+	for (i = 0; i < uf->N; i++)
 	{
-		ordered_ids[i] = (cluster_id_ptr_by_elem_id[i] - uf->clusters);
+		ordered_ids[cluster_offsets[uf->clusters[i]]++] = i;
 	}
 
-	lwfree(cluster_id_ptr_by_elem_id);
+	lwfree(cluster_offsets);
 	return ordered_ids;
 }
 
 uint32_t*
 UF_get_collapsed_cluster_ids(UNIONFIND* uf, const char* is_in_cluster)
 {
-	uint32_t* ordered_components = UF_ordered_by_cluster(uf);
 	uint32_t* new_ids = lwalloc(uf->N * sizeof(uint32_t));
-	uint32_t last_old_id, current_new_id, i;
-	char encountered_cluster = LW_FALSE;
+	uint32_t* root_ids = lwalloc(uf->N * sizeof(uint32_t));
+	uint32_t current_new_id = 0, i;
 
-	current_new_id = 0; last_old_id = 0;
+	/* Flag the clusters that have at least one member to number */
 	for (i = 0; i < uf->N; i++)
 	{
-		uint32_t j = ordered_components[i];
-		if (!is_in_cluster || is_in_cluster[j])
-		{
-			uint32_t current_old_id = UF_find(uf, j);
-			if (!encountered_cluster)
-			{
-				encountered_cluster = LW_TRUE;
-				last_old_id = current_old_id;
-			}
-
-			if (current_old_id != last_old_id)
-				current_new_id++;
-
-			new_ids[j] = current_new_id;
-			last_old_id = current_old_id;
-		}
-	}
-
-	lwfree(ordered_components);
-
-	return new_ids;
-}
-
-static int
-cmp_int(const void *a, const void *b)
-{
-	if (*((uint32_t*) a) > *((uint32_t*) b))
-	{
-		return 1;
+		root_ids[i] = UINT32_MAX;
 	}
-	else if (*((uint32_t*) a) < *((uint32_t*) b))
-	{
-		return -1;
-	}
-	else
+	for (i = 0; i < uf->N; i++)
 	{
-		return 0;
+		if (!is_in_cluster || is_in_cluster[i])
+			root_ids[UF_find(uf, i)] = 0;
 	}
-}
 
-static int
-cmp_int_ptr(const void *a, const void *b)
-{
-	int val_cmp = cmp_int(*((uint32_t**) a), *((uint32_t**) b));
-	if (val_cmp != 0)
-	{
-		return val_cmp;
-	}
-	if (a > b)
+	/* Number the flagged clusters sequentially in order of cluster id */
+	for (i = 0; i < uf->N; i++)
 	{
-		return 1;
+		if (root_ids[i] != UINT32_MAX)
+			root_ids[i] = current_new_id++;
 	}
-	if (a < b)
+
+	for (i = 0; i < uf->N; i++)
 	{
-		return -1;
+		if (!is_in_cluster || is_in_cluster[i])
+			new_ids[i] = root_ids[uf->clusters[i]];
 	}
-	return 0;
+
+	lwfree(root_ids);
+
+	return new_ids;
 }
@@ -12,9 +12,12 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "catalog/pg_type.h" /* for CSTRINGOID */
 #include "executor/spi.h"
 #include "fmgr.h"
+#include "lib/ilist.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 
 #include "../postgis_config.h"
@@ -87,110 +90,597 @@ GetGenericCacheCollection(FunctionCallInfo fcinfo)
 }
 
 
-/**
-* Get an appropriate (based on the entry type number)
-* GeomCache entry from the generic cache if one exists.
-* Returns a cache pointer if there is a cache hit and we have an
-* index built and ready to use. Returns NULL otherwise.
+/******************************************************************************/
+
+/*
+* Backend geometry cache
+*
+* The per-statement GeomCache only lives as long as the fn_extra
+* of one call site, so a polygon that is hit over and over in
+* many short statements gets its index rebuilt every time. The
+* backend cache keeps built indexes in a TopMemoryContext child
+* for the whole life of the backend.
+*
+* Each entry gets its own memory context, holding a private copy
+* of the key geometry (indexes like RECT_NODE point into it) and
+* everything the GeomIndexBuilder allocated. Objects allocated
+* outside PgSQL (GEOS) are tied to that context with reset
+* callbacks, so evicting an entry is just a MemoryContextDelete.
+*
+* The first time a geometry is seen only a small "ghost" entry
+* is recorded, the index gets built the second time around, the
+* same admission rule the per-statement cache uses.
 */
-GeomCache *
-GetGeomCache(FunctionCallInfo fcinfo,
-	     const GeomCacheMethods *cache_methods,
-	     SHARED_GSERIALIZED *g1,
-	     SHARED_GSERIALIZED *g2)
+int postgis_geometry_cache_size = 0;
+
+typedef struct
+{
+	uint32 hash;         /* hash_any() of the serialized geometry */
+	uint32 size;         /* VARSIZE() of the serialized geometry */
+	uint32 entry_number; /* kind of index, as in CacheEntryEnum */
+} GeomCacheBackendKey;
+
+typedef struct GeomCacheBackendEntry
+{
+	GeomCacheBackendKey key; /* hash key, must be first */
+	uint64 id;               /* unique id, zero once evicted */
+	MemoryContext context;   /* owns geom, cache and the index, NULL for ghosts */
+	GSERIALIZED *geom;       /* private copy of the key geometry */
+	GeomCache *cache;        /* built index, NULL for ghosts */
+	Size bytes;              /* memory charged to the budget */
+	dlist_node lru_node;     /* head of the list is most recently used */
+} GeomCacheBackendEntry;
+
+#define GEOM_CACHE_BACKEND_HASH_SIZE 256
+
+static HTAB *GeomCacheBackendHash = NULL;
+static MemoryContext GeomCacheBackendContext = NULL;
+static dlist_head GeomCacheBackendLRU;
+static GeomCacheBackendStats GeomCacheBackendCounters;
+static uint64 GeomCacheBackendNextId = 1;
+
+/*
+* Entry of the argument looked up last by GetGeomCache, kept out
+* of eviction while the other argument of the same call gets
+* looked up, so the second argument cannot push out the first.
+*/
+static GeomCacheBackendEntry *GeomCacheBackendPinned = NULL;
+
+static inline Size
+GeomCacheBackendBudget(void)
+{
+	return (Size)postgis_geometry_cache_size * 1024;
+}
+
+static void
+GeomCacheBackendInit(void)
+{
+	HASHCTL ctl;
+
+	GeomCacheBackendContext = AllocSetContextCreate(TopMemoryContext,
+	                                                "PostGIS Backend Geometry Cache",
+	                                                ALLOCSET_DEFAULT_SIZES);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(GeomCacheBackendKey);
+	ctl.entrysize = sizeof(GeomCacheBackendEntry);
+	ctl.hcxt = GeomCacheBackendContext;
+
+	GeomCacheBackendHash = hash_create("PostGIS Backend Geometry Cache Hash",
+	                                   GEOM_CACHE_BACKEND_HASH_SIZE,
+	                                   &ctl,
+	                                   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	dlist_init(&GeomCacheBackendLRU);
+}
+
+static void
+GeomCacheBackendKeyFill(GeomCacheBackendKey *key, const GeomCacheMethods *cache_methods, const GSERIALIZED *g)
+{
+	memset(key, 0, sizeof(GeomCacheBackendKey));
+	key->size = VARSIZE(g);
+	key->hash = DatumGetUInt32(hash_any((const unsigned char *)g, key->size));
+	key->entry_number = cache_methods->entry_number;
+}
+
+/*
+* Drop an entry and everything it owns. The hash element memory
+* is recycled by dynahash rather than freed, so call sites holding
+* a stale pointer can still safely compare the (now zeroed) id.
+*/
+static void
+GeomCacheBackendEvict(GeomCacheBackendEntry *entry)
+{
+	GeomCacheBackendKey key = entry->key;
+
+	if (entry == GeomCacheBackendPinned)
+		GeomCacheBackendPinned = NULL;
+
+	dlist_delete(&entry->lru_node);
+	GeomCacheBackendCounters.bytes -= entry->bytes;
+	GeomCacheBackendCounters.entries--;
+	if (entry->context)
+	{
+		GeomCacheBackendCounters.evictions++;
+		MemoryContextDelete(entry->context);
+	}
+	entry->id = 0;
+	entry->context = NULL;
+	entry->cache = NULL;
+	entry->geom = NULL;
+	hash_search(GeomCacheBackendHash, &key, HASH_REMOVE, NULL);
+}
+
+/*
+* Evict least recently used entries until "needed" more bytes
+* fit in the budget, sparing the pinned entry. Returns false if
+* they cannot fit at all.
+*/
+static bool
+GeomCacheBackendMakeRoom(Size needed)
 {
-	GeomCache* cache;
-	int cache_hit = 0;
+	Size budget = GeomCacheBackendBudget();
+
+	if (needed > budget)
+		return false;
+
+	while (GeomCacheBackendCounters.bytes + needed > budget &&
+	       !dlist_is_empty(&GeomCacheBackendLRU))
+	{
+		dlist_node *node = dlist_tail_node(&GeomCacheBackendLRU);
+		GeomCacheBackendEntry *victim = dlist_container(GeomCacheBackendEntry, lru_node, node);
+
+		if (victim == GeomCacheBackendPinned)
+		{
+			/* Only the pinned entry left, no room for this call */
+			if (!dlist_has_prev(&GeomCacheBackendLRU, node))
+				return false;
+			victim = dlist_container(GeomCacheBackendEntry, lru_node, dlist_prev_node(&GeomCacheBackendLRU, node));
+		}
+		GeomCacheBackendEvict(victim);
+	}
+	return true;
+}
+
+/* Drop everything, used when the cache gets disabled */
+static void
+GeomCacheBackendPurge(void)
+{
+	while (!dlist_is_empty(&GeomCacheBackendLRU))
+	{
+		GeomCacheBackendEntry *entry = dlist_head_element(GeomCacheBackendEntry, lru_node, &GeomCacheBackendLRU);
+		GeomCacheBackendEvict(entry);
+	}
+}
+
+/*
+* Build the index of a ghost entry, in its own memory context.
+* On failure the entry is removed and NULL returned.
+*/
+static GeomCacheBackendEntry *
+GeomCacheBackendBuild(GeomCacheBackendEntry *entry,
+		      const GeomCacheMethods *cache_methods,
+		      const GSERIALIZED *g)
+{
+	GeomCacheBackendKey key = entry->key;
 	MemoryContext old_context;
-	const GSERIALIZED *geom;
-	GenericCacheCollection* generic_cache = GetGenericCacheCollection(fcinfo);
+	volatile int rv = LW_FAILURE;
+	Size bytes;
+
+	/* Take the ghost off the LRU list while we work on it */
+	dlist_delete(&entry->lru_node);
+	GeomCacheBackendCounters.bytes -= entry->bytes;
+	GeomCacheBackendCounters.entries--;
+
+	entry->context = AllocSetContextCreate(GeomCacheBackendContext,
+	                                       "PostGIS Backend Geometry Cache Entry",
+	                                       ALLOCSET_SMALL_SIZES);
+	old_context = MemoryContextSwitchTo(entry->context);
+	PG_TRY();
+	{
+		LWGEOM *lwgeom;
+
+		entry->geom = palloc(key.size);
+		memcpy(entry->geom, g, key.size);
+		lwgeom = lwgeom_from_gserialized(entry->geom);
+
+		/* Can't build a tree on a NULL or empty */
+		if (lwgeom && !lwgeom_is_empty(lwgeom))
+		{
+			entry->cache = cache_methods->GeomCacheAllocator();
+			entry->cache->type = cache_methods->entry_number;
+			rv = cache_methods->GeomIndexBuilder(lwgeom, entry->cache);
+		}
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(old_context);
+		MemoryContextDelete(entry->context);
+		hash_search(GeomCacheBackendHash, &key, HASH_REMOVE, NULL);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	MemoryContextSwitchTo(old_context);
+
+	if (rv == LW_SUCCESS)
+	{
+#if POSTGIS_PGSQL_VERSION >= 130
+		bytes = MemoryContextMemAllocated(entry->context, true);
+#else
+		bytes = 4 * key.size;
+#endif
+		bytes += sizeof(GeomCacheBackendEntry);
+		if (cache_methods->GeomIndexSize)
+			bytes += cache_methods->GeomIndexSize(entry->cache);
+
+		if (GeomCacheBackendMakeRoom(bytes))
+		{
+			entry->id = GeomCacheBackendNextId++;
+			entry->bytes = bytes;
+			dlist_push_head(&GeomCacheBackendLRU, &entry->lru_node);
+			GeomCacheBackendCounters.entries++;
+			GeomCacheBackendCounters.bytes += bytes;
+			GeomCacheBackendCounters.builds++;
+			return entry;
+		}
+	}
+
+	MemoryContextDelete(entry->context);
+	hash_search(GeomCacheBackendHash, &key, HASH_REMOVE, NULL);
+	return NULL;
+}
+
+/*
+* Find the built entry for this geometry and kind of index.
+* A first sighting only records a ghost, a second one builds
+* the index. Returns NULL unless a built entry is available.
+* A new ghost is left pinned.
+*/
+static GeomCacheBackendEntry *
+GeomCacheBackendLookup(const GeomCacheMethods *cache_methods, const GSERIALIZED *g)
+{
+	GeomCacheBackendKey key;
+	GeomCacheBackendEntry *entry;
+	bool found;
+
+	/* Nothing to gain from indexing a lone point */
+	if (gserialized_get_type(g) == POINTTYPE)
+		return NULL;
+
+	if (!GeomCacheBackendHash)
+		GeomCacheBackendInit();
+
+	GeomCacheBackendKeyFill(&key, cache_methods, g);
+	entry = hash_search(GeomCacheBackendHash, &key, HASH_FIND, NULL);
+
+	/* Built entry, make sure it is not just a hash collision */
+	if (entry && entry->cache)
+	{
+		if (memcmp(entry->geom, g, key.size) != 0)
+		{
+			GeomCacheBackendCounters.misses++;
+			return NULL;
+		}
+		dlist_move_head(&GeomCacheBackendLRU, &entry->lru_node);
+		GeomCacheBackendCounters.hits++;
+		return entry;
+	}
+
+	GeomCacheBackendCounters.misses++;
+
+	/* Second sighting, worth building */
+	if (entry)
+		return GeomCacheBackendBuild(entry, cache_methods, g);
+
+	/* First sighting, just remember we saw it */
+	if (!GeomCacheBackendMakeRoom(sizeof(GeomCacheBackendEntry)))
+		return NULL;
+
+	entry = hash_search(GeomCacheBackendHash, &key, HASH_ENTER, &found);
+	entry->id = GeomCacheBackendNextId++;
+	entry->context = NULL;
+	entry->geom = NULL;
+	entry->cache = NULL;
+	entry->bytes = sizeof(GeomCacheBackendEntry);
+	dlist_push_head(&GeomCacheBackendLRU, &entry->lru_node);
+	GeomCacheBackendCounters.entries++;
+	GeomCacheBackendCounters.bytes += entry->bytes;
+	GeomCacheBackendPinned = entry;
+	return NULL;
+}
+
+/* A built backend entry is being used, count it and keep it warm */
+static GeomCache *
+GeomCacheBackendUse(GeomCacheBackendEntry *entry, uint32 argnum)
+{
+	dlist_move_head(&GeomCacheBackendLRU, &entry->lru_node);
+	GeomCacheBackendCounters.hits++;
+	entry->cache->argnum = argnum;
+	return entry->cache;
+}
+
+void
+GetGeomCacheBackendStats(GeomCacheBackendStats *stats)
+{
+	*stats = GeomCacheBackendCounters;
+}
+
+/******************************************************************************/
+
+/*
+* Each call site holds a GeomCacheSet per kind of index, a small
+* associative cache of GeomCacheSize slots. A slot holds a key
+* geometry and, once the key has been seen a second time, its
+* index (or a reference to the backend cache entry holding it).
+*
+* Eviction follows the GreedyDual policy: whenever a slot is used
+* it gets a credit of clock + cost, the slot with the lowest credit
+* is the victim, and its credit becomes the new clock, so slots
+* that are not used age relative to the others. A key without an
+* index costs next to nothing to lose, while an index costs about
+* as much as its number of vertices to rebuild, so expensive
+* indexes survive much longer than keys that were seen only once.
+*/
+typedef struct {
+	int type;
+	double clock;
+	GeomCache *slot[GeomCacheSize];
+} GeomCacheSet;
+
+static GeomCacheSet *
+GetGeomCacheSet(FunctionCallInfo fcinfo, const GeomCacheMethods *cache_methods)
+{
+	GenericCacheCollection *generic_cache = GetGenericCacheCollection(fcinfo);
 	uint32_t entry_number = cache_methods->entry_number;
+	GeomCacheSet *set;
 
 	Assert(entry_number < NUM_CACHE_ENTRIES);
 
-	cache = (GeomCache*)(generic_cache->entry[entry_number]);
-	if ( ! cache )
+	set = (GeomCacheSet *)(generic_cache->entry[entry_number]);
+	if (!set)
 	{
-		old_context = MemoryContextSwitchTo(PostgisCacheContext(fcinfo));
-		/* Allocate in the upper context */
-		cache = cache_methods->GeomCacheAllocator();
-		MemoryContextSwitchTo(old_context);
-		/* Store the pointer in GenericCache */
-		cache->type = entry_number;
-		generic_cache->entry[entry_number] = (GenericCache*)cache;
+		set = MemoryContextAllocZero(PostgisCacheContext(fcinfo), sizeof(GeomCacheSet));
+		set->type = entry_number;
+		generic_cache->entry[entry_number] = (GenericCache *)set;
 	}
+	return set;
+}
+
+static inline bool
+GeomCacheSlotIsBuilt(const GeomCache *slot)
+{
+	return slot->argnum || slot->backend_entry;
+}
 
-	/* Cache hit on the first argument */
-	if (g1 && cache->geom1 && cache->argnum != 2 && shared_gserialized_equal(g1, cache->geom1))
+static void
+GeomCacheSlotTouch(GeomCacheSet *set, GeomCache *slot)
+{
+	double cost = 1.0;
+	if (GeomCacheSlotIsBuilt(slot))
+		cost += VARSIZE(shared_gserialized_get(slot->geom)) / 1024.0;
+	slot->credit = set->clock + cost;
+}
+
+static void
+GeomCacheSlotClear(FunctionCallInfo fcinfo, GeomCache *slot, const GeomCacheMethods *cache_methods)
+{
+	if (slot->argnum)
 	{
-		cache_hit = 1;
-		geom = shared_gserialized_get(cache->geom1);
+		cache_methods->GeomIndexFreer(slot);
+		slot->argnum = 0;
 	}
-	/* Cache hit on second argument */
-	else if (g2 && cache->geom2 && cache->argnum != 1 && shared_gserialized_equal(g2, cache->geom2))
+	if (slot->geom)
 	{
-		cache_hit = 2;
-		geom = shared_gserialized_get(cache->geom2);
+		shared_gserialized_unref(fcinfo, slot->geom);
+		slot->geom = NULL;
 	}
-	/* No cache hit. If we have a tree, free it. */
-	else
+	slot->backend_entry = NULL;
+	slot->backend_id = 0;
+}
+
+static GeomCache *
+GeomCacheSetFind(GeomCacheSet *set, SHARED_GSERIALIZED *g)
+{
+	uint32 i;
+	for (i = 0; i < GeomCacheSize && set->slot[i]; i++)
 	{
-		cache_hit = 0;
-		if ( cache->argnum )
+		GeomCache *slot = set->slot[i];
+		if (slot->geom && shared_gserialized_equal(g, slot->geom))
+			return slot;
+	}
+	return NULL;
+}
+
+/**
+* Store a new key in a free slot, or in place of the
+* slot with the lowest credit other than "keep".
+*/
+static GeomCache *
+GeomCacheSetInsert(FunctionCallInfo fcinfo,
+		   GeomCacheSet *set,
+		   const GeomCacheMethods *cache_methods,
+		   SHARED_GSERIALIZED *g,
+		   const GeomCache *keep)
+{
+	GeomCache *victim = NULL;
+	uint32 i;
+
+	for (i = 0; i < GeomCacheSize; i++)
+	{
+		GeomCache *slot = set->slot[i];
+		if (!slot)
 		{
-			cache_methods->GeomIndexFreer(cache);
-			cache->argnum = 0;
+			/* Allocate in the upper context */
+			MemoryContext old_context = MemoryContextSwitchTo(PostgisCacheContext(fcinfo));
+			slot = cache_methods->GeomCacheAllocator();
+			MemoryContextSwitchTo(old_context);
+			slot->type = cache_methods->entry_number;
+			set->slot[i] = slot;
+			victim = slot;
+			break;
 		}
+		if (slot == keep)
+			continue;
+		if (!victim || slot->credit < victim->credit)
+			victim = slot;
 	}
 
-	/* Cache hit, but no tree built yet, build it! */
-	if ( cache_hit && ! cache->argnum )
+	if (victim->geom)
 	{
-		int rv;
-		LWGEOM *lwgeom;
+		set->clock = victim->credit;
+		GeomCacheSlotClear(fcinfo, victim, cache_methods);
+	}
+	victim->geom = shared_gserialized_ref(fcinfo, g);
+	GeomCacheSlotTouch(set, victim);
+	return victim;
+}
+
+/**
+* Return the index of a slot if it is ready to use,
+* either built locally or held by the backend cache.
+*/
+static GeomCache *
+GeomCacheSlotReady(GeomCacheSet *set, GeomCache *slot, uint32 argnum)
+{
+	if (!slot)
+		return NULL;
 
-		/* Save the tree and supporting geometry in the cache */
-		/* memory context */
-		old_context = MemoryContextSwitchTo(PostgisCacheContext(fcinfo));
-		lwgeom = lwgeom_from_gserialized(geom);
-		cache->argnum = 0;
+	if (slot->argnum)
+	{
+		slot->argnum = argnum;
+		GeomCacheSlotTouch(set, slot);
+		return slot;
+	}
 
-		/* Can't build a tree on a NULL or empty */
-		if ((!lwgeom) || lwgeom_is_empty(lwgeom))
+	if (slot->backend_entry)
+	{
+		if (slot->backend_entry->id == slot->backend_id)
 		{
-			MemoryContextSwitchTo(old_context);
-			return NULL;
+			GeomCacheSlotTouch(set, slot);
+			return GeomCacheBackendUse(slot->backend_entry, argnum);
 		}
-		rv = cache_methods->GeomIndexBuilder(lwgeom, cache);
-		MemoryContextSwitchTo(old_context);
+		/* Evicted from the backend cache since */
+		slot->backend_entry = NULL;
+		slot->backend_id = 0;
+	}
+	return NULL;
+}
 
-		/* Something went awry in the tree build phase */
-		if ( ! rv )
-			return NULL;
+/**
+* Build the index for a slot, in the call site memory context.
+*/
+static GeomCache *
+GeomCacheSlotBuild(FunctionCallInfo fcinfo,
+		   GeomCacheSet *set,
+		   GeomCache *slot,
+		   uint32 argnum,
+		   const GeomCacheMethods *cache_methods)
+{
+	int rv;
+	LWGEOM *lwgeom;
+
+	/* Save the tree and supporting geometry in the cache */
+	/* memory context */
+	MemoryContext old_context = MemoryContextSwitchTo(PostgisCacheContext(fcinfo));
+	lwgeom = lwgeom_from_gserialized(shared_gserialized_get(slot->geom));
 
-		/* Only set an argnum if everything completely successfully */
-		cache->argnum = cache_hit;
+	/* Can't build a tree on a NULL or empty */
+	if ((!lwgeom) || lwgeom_is_empty(lwgeom))
+	{
+		MemoryContextSwitchTo(old_context);
+		return NULL;
 	}
+	rv = cache_methods->GeomIndexBuilder(lwgeom, slot);
+	MemoryContextSwitchTo(old_context);
 
-	/* We have a hit and a calculated tree, we're done */
-	if ( cache_hit && cache->argnum )
-		return cache;
+	/* Something went awry in the tree build phase */
+	if ( ! rv )
+		return NULL;
+
+	/* Only set an argnum if everything completely successfully */
+	slot->argnum = argnum;
+	GeomCacheSlotTouch(set, slot);
+	return slot;
+}
 
-	/* Argument one didn't match, so copy the new value in. */
-	if ( g1 && cache_hit != 1 )
+/**
+* Get an appropriate (based on the entry type number)
+* GeomCache entry from the generic cache if one exists.
+* Returns a cache pointer if there is a cache hit and we have an
+* index built and ready to use. Returns NULL otherwise.
+*
+* The index is built the second time a geometry shows up. When
+* the backend cache is enabled, indexes are built into it instead,
+* and the returned cache may be shared with other call sites.
+* Callers must not hold onto it across calls.
+*/
+GeomCache *
+GetGeomCache(FunctionCallInfo fcinfo,
+	     const GeomCacheMethods *cache_methods,
+	     SHARED_GSERIALIZED *g1,
+	     SHARED_GSERIALIZED *g2)
+{
+	GeomCacheSet *set = GetGeomCacheSet(fcinfo, cache_methods);
+	GeomCache *slots[3];
+	SHARED_GSERIALIZED *args[3] = {NULL, g1, g2};
+	GeomCache *cache;
+	uint32 argnum;
+
+	slots[0] = NULL;
+	slots[1] = g1 ? GeomCacheSetFind(set, g1) : NULL;
+	slots[2] = g2 ? GeomCacheSetFind(set, g2) : NULL;
+
+	/* An index ready to use on either argument, we're done */
+	for (argnum = 1; argnum <= 2; argnum++)
 	{
-		if (cache->geom1)
-			shared_gserialized_unref(fcinfo, cache->geom1);
-		cache->geom1 = shared_gserialized_ref(fcinfo, g1);
+		if ((cache = GeomCacheSlotReady(set, slots[argnum], argnum)))
+			return cache;
 	}
 
-	/* Argument two didn't match, so copy the new value in. */
-	if ( g2 && cache_hit != 2 )
+	/* Look for the arguments in the backend cache */
+	if (postgis_geometry_cache_size > 0)
 	{
-		if (cache->geom2)
-			shared_gserialized_unref(fcinfo, cache->geom2);
-		cache->geom2 = shared_gserialized_ref(fcinfo, g2);
+		GeomCacheBackendPinned = NULL;
+		for (argnum = 1; argnum <= 2; argnum++)
+		{
+			GeomCacheBackendEntry *entry;
+			GeomCache *slot = slots[argnum];
+
+			if (!args[argnum])
+				continue;
+
+			entry = GeomCacheBackendLookup(cache_methods, shared_gserialized_get(args[argnum]));
+			if (!entry)
+				continue;
+
+			/* Remember the entry, so the next call skips the lookup */
+			if (!slot)
+				slot = GeomCacheSetInsert(fcinfo, set, cache_methods, args[argnum], NULL);
+			slot->backend_entry = entry;
+			slot->backend_id = entry->id;
+			GeomCacheSlotTouch(set, slot);
+			GeomCacheBackendPinned = NULL;
+			entry->cache->argnum = argnum;
+			return entry->cache;
+		}
+		GeomCacheBackendPinned = NULL;
 	}
+	else if (GeomCacheBackendCounters.entries)
+	{
+		GeomCacheBackendPurge();
+	}
+
+	/* Cache hit, but no tree built yet, build it! */
+	for (argnum = 1; argnum <= 2; argnum++)
+	{
+		if (slots[argnum])
+			return GeomCacheSlotBuild(fcinfo, set, slots[argnum], argnum, cache_methods);
+	}
+
+	/* No cache hit, remember the arguments for next time */
+	if (g1)
+		slots[1] = GeomCacheSetInsert(fcinfo, set, cache_methods, g1, NULL);
+	if (g2 && !(g1 && shared_gserialized_equal(g1, g2)))
+		GeomCacheSetInsert(fcinfo, set, cache_methods, g2, slots[1]);
 
 	return NULL;
 }
@@ -217,7 +707,7 @@ ToastCacheGetGeometry(FunctionCallInfo fcinfo, uint32_t argnum)
 {
 	Assert(argnum < ToastCacheSize);
 	ToastCache* cache = ToastCacheGet(fcinfo);
-	ToastCacheArgument* arg = &(cache->arg[argnum]);
+	ToastCacheArgument* lru = NULL;
 
 	Datum datum = PG_GETARG_DATUM(argnum);
 	struct varlena *attr = (struct varlena *) DatumGetPointer(datum);
@@ -242,21 +732,26 @@ ToastCacheGetGeometry(FunctionCallInfo fcinfo, uint32_t argnum)
 	Oid toastrelid = ve.va_toastrelid;
 
 	/* We've seen this object before? */
-	if (arg->valueid == valueid && arg->toastrelid == toastrelid)
+	for (uint32_t i = 0; i < ToastCacheEntries; i++)
 	{
-		return arg->geom;
-	}
-	/* New object, clear our old copies and see if it */
-	/* shows up a second time before taking a copy */
-	else
-	{
-		if (arg->geom)
-			shared_gserialized_unref(fcinfo, arg->geom);
-		arg->valueid = valueid;
-		arg->toastrelid = toastrelid;
-		arg->geom = shared_gserialized_new_cached(fcinfo, datum);
-		return arg->geom;
+		ToastCacheArgument* arg = &(cache->arg[argnum][i]);
+		if (arg->geom && arg->valueid == valueid && arg->toastrelid == toastrelid)
+		{
+			arg->last_used = ++cache->clock;
+			return arg->geom;
+		}
+		if (!lru || arg->last_used < lru->last_used)
+			lru = arg;
 	}
+
+	/* New object, replace the least recently used copy */
+	if (lru->geom)
+		shared_gserialized_unref(fcinfo, lru->geom);
+	lru->valueid = valueid;
+	lru->toastrelid = toastrelid;
+	lru->last_used = ++cache->clock;
+	lru->geom = shared_gserialized_new_cached(fcinfo, datum);
+	return lru->geom;
 }
 
 /*
@@ -49,17 +49,25 @@ const GSERIALIZED *shared_gserialized_get(SHARED_GSERIALIZED *s);
 
 /*
 * A generic GeomCache just needs space for the cache type,
-* the cache keys (GSERIALIZED geometries), the key sizes,
-* and the argument number the cached index/tree is going
-* to refer to.
+* the cache key (GSERIALIZED geometry), and the argument
+* number the cached index/tree is going to refer to.
+*
+* Each call site keeps GeomCacheSize of them per kind of
+* index, so that joins alternating between a few geometries
+* don't rebuild the index on every row.
 */
 typedef struct {
 	uint32_t type;
-	uint32 argnum;
-	SHARED_GSERIALIZED *geom1;
-	SHARED_GSERIALIZED *geom2;
+	uint32 argnum; /* argument the index was returned for, 0 while not built */
+	SHARED_GSERIALIZED *geom;
+	double credit; /* eviction priority, see GeomCacheSet in lwgeom_cache.c */
+	/* Backend cache entry matching the key, see GetGeomCache */
+	struct GeomCacheBackendEntry *backend_entry;
+	uint64 backend_id;
 } GeomCache;
 
+#define GeomCacheSize 4
+
 /*
 * Other specific geometry cache types are the
 * IntervalTreeGeomCache - lwgeom_itree.h
@@ -76,6 +84,7 @@ typedef struct
 	int (*GeomIndexBuilder)(const LWGEOM* lwgeom, GeomCache* cache); /* Build an index/tree and add it to your cache */
 	int (*GeomIndexFreer)(GeomCache* cache); /* Free the index/tree in your cache */
 	GeomCache* (*GeomCacheAllocator)(void); /* Allocate the kind of cache object you use (GeomCache+some extra space) */
+	Size (*GeomIndexSize)(const GeomCache* cache); /* Bytes held outside of PgSQL memory contexts (GEOS), may be NULL */
 } GeomCacheMethods;
 
 /*
@@ -86,21 +95,44 @@ GeomCache *GetGeomCache(FunctionCallInfo fcinfo,
 			SHARED_GSERIALIZED *g1,
 			SHARED_GSERIALIZED *g2);
 
+/*
+* Backend-lifetime cache of built indexes, shared by all the
+* call sites and statements of a backend. Entries are keyed on
+* the serialized geometry and evicted in LRU order once the
+* postgis.geometry_cache_size budget (in kB) is exceeded.
+* A budget of zero disables the cache.
+*/
+extern int postgis_geometry_cache_size;
+
+typedef struct {
+	uint64 hits;      /* calls served by an already built entry */
+	uint64 misses;    /* lookups that found no built entry */
+	uint64 builds;    /* indexes built into the cache */
+	uint64 evictions; /* entries dropped to stay within budget */
+	uint32 entries;   /* entries currently held */
+	Size bytes;       /* memory currently charged to the budget */
+} GeomCacheBackendStats;
+
+void GetGeomCacheBackendStats(GeomCacheBackendStats *stats);
+
 /******************************************************************************/
 
 #define ToastCacheSize 2
+#define ToastCacheEntries GeomCacheSize
 
 typedef struct
 {
 	Oid valueid;
 	Oid toastrelid;
+	uint64 last_used;
 	SHARED_GSERIALIZED *geom;
 } ToastCacheArgument;
 
 typedef struct
 {
 	int type;
-	ToastCacheArgument arg[ToastCacheSize];
+	uint64 clock;
+	ToastCacheArgument arg[ToastCacheSize][ToastCacheEntries];
 } ToastCache;
 
 SHARED_GSERIALIZED *ToastCacheGetGeometry(FunctionCallInfo fcinfo, uint32_t argnum);
@@ -19,6 +19,7 @@
 #include "executor/spi.h"
 #include "access/hash.h"
 #include "utils/hsearch.h"
+#include "portability/instr_time.h"
 
 /* PostGIS headers */
 #include "../postgis_config.h"
@@ -31,6 +32,7 @@
 #include <float.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 
 #define maxprojlen  512
 #define spibufferlen 512
@@ -47,6 +49,9 @@
 /* Global to hold the Proj object cache */
 PROJSRSCache *PROJ_CACHE = NULL;
 
+/* GUC postgis.proj_preload */
+char *postgis_proj_preload = NULL;
+
 
 /**
  * Utility structure to get many potential string representations
@@ -142,6 +147,7 @@ GetProjectionFromPROJCache(PROJSRSCache *cache, int32_t srid_from, int32_t srid_
 		    cache->PROJSRSCache[i].srid_to == srid_to)
 		{
 			cache->PROJSRSCache[i].hits++;
+			cache->hits++;
 			return cache->PROJSRSCache[i].projection;
 		}
 	}
@@ -376,6 +382,10 @@ AddToPROJSRSCache(PROJSRSCache *PROJCache, int32_t srid_from, int32_t srid_to)
 
 	PjStrs from_strs, to_strs;
 	char *pj_from_str, *pj_to_str;
+	instr_time start, duration;
+
+	INSTR_TIME_SET_CURRENT(start);
+	PROJCache->misses++;
 
 	/*
 	** Turn the SRID number into a proj4 string, by reading from spatial_ref_sys
@@ -414,6 +424,10 @@ AddToPROJSRSCache(PROJSRSCache *PROJCache, int32_t srid_from, int32_t srid_to)
 		return NULL;
 	}
 
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	PROJCache->build_ms += INSTR_TIME_GET_MILLISEC(duration);
+
 	/* If the cache is already full then find the least used element and delete it */
 	uint32_t cache_position = PROJCache->PROJSRSCacheCount;
 	uint32_t hits = 1;
@@ -479,6 +493,7 @@ DeleteFromPROJSRSCache(PROJSRSCache *PROJCache, uint32_t position)
 	PROJCache->PROJSRSCache[position].projection = NULL;
 	PROJCache->PROJSRSCache[position].srid_from = SRID_UNKNOWN;
 	PROJCache->PROJSRSCache[position].srid_to = SRID_UNKNOWN;
+	PROJCache->evictions++;
 }
 
 
@@ -501,6 +516,97 @@ lwproj_lookup(int32_t srid_from, int32_t srid_to, LWPROJ **pj)
 	return *pj != NULL;
 }
 
+/**
+ * Parse a "from:to, from:to" list of SRID pairs into pairs, which
+ * has room for maxpairs pairs. Returns LW_FAILURE on a malformed
+ * list or one with more than maxpairs pairs.
+ */
+int
+lwproj_parse_pairs(const char *str, int32_t *pairs, uint32_t maxpairs, uint32_t *npairs)
+{
+	const char *ptr = str;
+	*npairs = 0;
+
+	if (!str)
+		return LW_SUCCESS;
+
+	while (*ptr)
+	{
+		char *end;
+		long srid[2];
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			while (isspace((unsigned char)*ptr))
+				ptr++;
+			if (i == 0 && *ptr == '\0')
+				return LW_SUCCESS;
+			srid[i] = strtol(ptr, &end, 10);
+			if (end == ptr || srid[i] <= 0 || srid[i] > SRID_MAXIMUM)
+				return LW_FAILURE;
+			ptr = end;
+			while (isspace((unsigned char)*ptr))
+				ptr++;
+			if (i == 0 && *ptr++ != ':')
+				return LW_FAILURE;
+		}
+		if (*ptr == ',')
+			ptr++;
+		else if (*ptr != '\0')
+			return LW_FAILURE;
+
+		if (*npairs == maxpairs)
+			return LW_FAILURE;
+		pairs[2 * *npairs] = (int32_t)srid[0];
+		pairs[2 * *npairs + 1] = (int32_t)srid[1];
+		(*npairs)++;
+	}
+	return LW_SUCCESS;
+}
+
+/**
+ * Build the transforms of a list of SRID pairs (see
+ * lwproj_parse_pairs) into the backend PROJ cache, so the first
+ * transforms of a session do not pay for them. Returns the number
+ * of transforms that were not cached yet.
+ */
+uint32_t
+lwproj_prewarm(const char *str)
+{
+	int32_t pairs[2 * PROJ_CACHE_ITEMS];
+	uint32_t npairs, nbuilt = 0;
+	PROJSRSCache *proj_cache;
+
+	if (lwproj_parse_pairs(str, pairs, PROJ_CACHE_ITEMS, &npairs) == LW_FAILURE)
+		elog(ERROR, "invalid list of SRID pairs \"%s\"", str);
+
+	proj_cache = GetPROJSRSCache();
+	postgis_initialize_cache();
+	for (uint32_t i = 0; i < npairs; i++)
+	{
+		int32_t srid_from = pairs[2 * i];
+		int32_t srid_to = pairs[2 * i + 1];
+		uint32_t j;
+
+		if (srid_from == srid_to)
+			continue;
+
+		/* Look without touching the hit counters */
+		for (j = 0; j < proj_cache->PROJSRSCacheCount; j++)
+		{
+			if (proj_cache->PROJSRSCache[j].srid_from == srid_from &&
+			    proj_cache->PROJSRSCache[j].srid_to == srid_to)
+				break;
+		}
+		if (j < proj_cache->PROJSRSCacheCount)
+			continue;
+
+		AddToPROJSRSCache(proj_cache, srid_from, srid_to);
+		nbuilt++;
+	}
+	return nbuilt;
+}
+
 int
 lwproj_is_latlong(const LWPROJ *pj)
 {
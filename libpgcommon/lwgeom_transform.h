@@ -45,9 +45,21 @@ typedef struct struct_PROJSRSCache
 	PROJSRSCacheItem PROJSRSCache[PROJ_CACHE_ITEMS];
 	uint32_t PROJSRSCacheCount;
 	MemoryContext PROJSRSCacheContext;
+	/* Counters, see _postgis_proj_cache_stats() */
+	uint64_t hits;      /* lookups served by a cached entry */
+	uint64_t misses;    /* lookups that had to build the transform */
+	uint64_t evictions; /* entries dropped to make room */
+	double build_ms;    /* time spent building transforms */
 }
 PROJSRSCache;
 
+/*
+* SRID pairs to build into the cache ahead of the first
+* transform, as a "from:to, from:to" list.
+* See postgis.proj_preload and lwproj_prewarm().
+*/
+extern char *postgis_proj_preload;
+
 
 typedef struct srs_precision
 {
@@ -59,6 +71,8 @@ typedef struct srs_precision
 /* Prototypes */
 PROJSRSCache* GetPROJSRSCache();
 int lwproj_lookup(int32_t srid_from, int32_t srid_to, LWPROJ **pj);
+int lwproj_parse_pairs(const char *str, int32_t *pairs, uint32_t maxpairs, uint32_t *npairs);
+uint32_t lwproj_prewarm(const char *str);
 int lwproj_is_latlong(const LWPROJ *pj);
 int spheroid_init_from_srid(int32_t srid, SPHEROID *s);
 void srid_check_latlong(int32_t srid);
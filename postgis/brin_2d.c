@@ -1,5 +1,14 @@
 #include "postgis_brin.h"
 
+#include "access/brin_internal.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "catalog/pg_type.h"
+#include "utils/typcache.h"
+#if POSTGIS_PGSQL_VERSION >= 130
+#include "access/reloptions.h"
+#endif
+
 /*
  * As we index geometries but store either a BOX2DF or GIDX according to the
  * operator class, we need to overload the original brin_inclusion_add_value()
@@ -116,3 +125,337 @@ geom2d_brin_inclusion_merge(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Multi-box summaries (brin_geometry_multi_ops_2d)
+ *
+ * A single box per block range is useless when the rows of a range are
+ * spread over the map, as with the points of vehicle tracks appended in
+ * time order: every range box ends up covering most of the area. As
+ * with the minmax-multi opclasses of PostgreSQL, we keep a few boxes
+ * per range instead. A new box that is not covered by one of them is
+ * added to the list, and once the list is over the limit the two boxes
+ * whose union wastes the least area are merged, until it fits again.
+ *
+ * The summary is stored as a bytea holding a BOX2DF_MULTI. Each row box
+ * is always covered by one of the boxes of its range, so a range can be
+ * skipped when none of its boxes passes the test of the query.
+ */
+
+#define BOX2DF_MULTI_CONTAINS_EMPTY 0x01
+
+#define BOX2DF_MULTI_DEFAULT_BOXES 8
+#define BOX2DF_MULTI_MIN_BOXES 1
+#define BOX2DF_MULTI_MAX_BOXES 64
+
+typedef struct
+{
+	int32 vl_len_;
+	uint16 nboxes;
+	uint16 flags;
+	BOX2DF boxes[FLEXIBLE_ARRAY_MEMBER];
+} BOX2DF_MULTI;
+
+#define BOX2DF_MULTI_SIZE(n) (offsetof(BOX2DF_MULTI, boxes) + (n) * sizeof(BOX2DF))
+
+#if POSTGIS_PGSQL_VERSION >= 130
+typedef struct
+{
+	int32 vl_len_;
+	int boxes_per_range;
+} Box2DFMultiOptions;
+#endif
+
+static int
+box2df_multi_max_boxes(FunctionCallInfo fcinfo)
+{
+#if POSTGIS_PGSQL_VERSION >= 130
+	if (PG_HAS_OPCLASS_OPTIONS())
+		return ((Box2DFMultiOptions *) PG_GET_OPCLASS_OPTIONS())->boxes_per_range;
+#endif
+	return BOX2DF_MULTI_DEFAULT_BOXES;
+}
+
+static BOX2DF_MULTI *
+box2df_multi_new(int nboxes, uint16 flags)
+{
+	BOX2DF_MULTI *multi = palloc(BOX2DF_MULTI_SIZE(nboxes));
+	SET_VARSIZE(multi, BOX2DF_MULTI_SIZE(nboxes));
+	multi->nboxes = nboxes;
+	multi->flags = flags;
+	return multi;
+}
+
+/* Copy of the summary with room for extra boxes, in the current context */
+static BOX2DF_MULTI *
+box2df_multi_copy(Datum summary, int extra)
+{
+	BOX2DF_MULTI *multi = (BOX2DF_MULTI *) PG_DETOAST_DATUM(summary);
+	BOX2DF_MULTI *copy = box2df_multi_new(multi->nboxes + extra, multi->flags);
+	memcpy(copy->boxes, multi->boxes, multi->nboxes * sizeof(BOX2DF));
+	copy->nboxes = multi->nboxes;
+	SET_VARSIZE(copy, BOX2DF_MULTI_SIZE(copy->nboxes));
+	if ((Pointer) multi != DatumGetPointer(summary))
+		pfree(multi);
+	return copy;
+}
+
+static inline double
+box2df_multi_area(const BOX2DF *a)
+{
+	return ((double)a->xmax - a->xmin) * ((double)a->ymax - a->ymin);
+}
+
+static inline double
+box2df_multi_margin(const BOX2DF *a)
+{
+	return ((double)a->xmax - a->xmin) + ((double)a->ymax - a->ymin);
+}
+
+/*
+ * Merge boxes until there are no more than max_boxes left. Each step
+ * merges the pair whose union adds the least area, or the least margin
+ * when the areas tie, as happens for points lying on a line.
+ */
+static void
+box2df_multi_reduce(BOX2DF_MULTI *multi, int max_boxes)
+{
+	while (multi->nboxes > max_boxes)
+	{
+		BOX2DF *boxes = multi->boxes;
+		double best_area = DBL_MAX, best_margin = DBL_MAX;
+		int best_i = 0, best_j = 1;
+		int i, j, n;
+
+		for (i = 0; i < multi->nboxes; i++)
+		{
+			for (j = i + 1; j < multi->nboxes; j++)
+			{
+				BOX2DF u = boxes[i];
+				double area, margin;
+
+				box2df_merge(&u, &boxes[j]);
+				area = box2df_multi_area(&u) - box2df_multi_area(&boxes[i]) - box2df_multi_area(&boxes[j]);
+				margin = box2df_multi_margin(&u);
+				if (area < best_area || (area == best_area && margin < best_margin))
+				{
+					best_area = area;
+					best_margin = margin;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+
+		box2df_merge(&boxes[best_i], &boxes[best_j]);
+
+		/* Drop the merged box and any other box the union now covers */
+		for (i = 0, n = 0; i < multi->nboxes; i++)
+		{
+			if (i != best_i && (i == best_j || box2df_contains(&boxes[best_i], &boxes[i])))
+				continue;
+			boxes[n++] = boxes[i];
+		}
+		multi->nboxes = n;
+	}
+	SET_VARSIZE(multi, BOX2DF_MULTI_SIZE(multi->nboxes));
+}
+
+/* Replace the summary of the column, releasing the previous one */
+static void
+box2df_multi_store(BrinValues *column, BOX2DF_MULTI *multi)
+{
+	if (!column->bv_allnulls)
+		pfree(DatumGetPointer(column->bv_values[0]));
+	column->bv_values[0] = PointerGetDatum(multi);
+	column->bv_allnulls = false;
+}
+
+#if POSTGIS_PGSQL_VERSION >= 130
+PG_FUNCTION_INFO_V1(geom2d_brin_multi_options);
+Datum
+geom2d_brin_multi_options(PG_FUNCTION_ARGS)
+{
+	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+	init_local_reloptions(relopts, sizeof(Box2DFMultiOptions));
+	add_local_int_reloption(relopts, "boxes_per_range",
+	                        "maximum number of boxes kept for each block range",
+	                        BOX2DF_MULTI_DEFAULT_BOXES,
+	                        BOX2DF_MULTI_MIN_BOXES, BOX2DF_MULTI_MAX_BOXES,
+	                        offsetof(Box2DFMultiOptions, boxes_per_range));
+	PG_RETURN_VOID();
+}
+#endif
+
+PG_FUNCTION_INFO_V1(geom2d_brin_multi_opcinfo);
+Datum
+geom2d_brin_multi_opcinfo(PG_FUNCTION_ARGS)
+{
+	BrinOpcInfo *result = palloc0(SizeofBrinOpcInfo(1));
+
+	result->oi_nstored = 1;
+#if POSTGIS_PGSQL_VERSION >= 140
+	result->oi_regular_nulls = true;
+#endif
+	result->oi_typcache[0] = lookup_type_cache(BYTEAOID, 0);
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(geom2d_brin_multi_add_value);
+Datum
+geom2d_brin_multi_add_value(PG_FUNCTION_ARGS)
+{
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	Datum      newval = PG_GETARG_DATUM(2);
+	bool	   isnull = PG_GETARG_BOOL(3);
+	BOX2DF     box_geom;
+	BOX2DF_MULTI *multi;
+	int i;
+
+	if (isnull)
+	{
+		if (column->bv_hasnulls)
+			PG_RETURN_BOOL(false);
+
+		column->bv_hasnulls = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	if (gserialized_datum_get_box2df_p(newval, &box_geom) == LW_FAILURE)
+	{
+		if (!is_gserialized_from_datum_empty(newval))
+			elog(ERROR, "Error while extracting the box2df from the geom");
+
+		if (column->bv_allnulls)
+		{
+			box2df_multi_store(column, box2df_multi_new(0, BOX2DF_MULTI_CONTAINS_EMPTY));
+			PG_RETURN_BOOL(true);
+		}
+
+		multi = (BOX2DF_MULTI *) PG_DETOAST_DATUM(column->bv_values[0]);
+		if (multi->flags & BOX2DF_MULTI_CONTAINS_EMPTY)
+			PG_RETURN_BOOL(false);
+
+		multi = box2df_multi_copy(column->bv_values[0], 0);
+		multi->flags |= BOX2DF_MULTI_CONTAINS_EMPTY;
+		box2df_multi_store(column, multi);
+		PG_RETURN_BOOL(true);
+	}
+
+	if (column->bv_allnulls)
+	{
+		multi = box2df_multi_new(1, 0);
+		multi->boxes[0] = box_geom;
+		box2df_multi_store(column, multi);
+		PG_RETURN_BOOL(true);
+	}
+
+	/* Nothing to do if one of the boxes already covers the geometry */
+	multi = (BOX2DF_MULTI *) PG_DETOAST_DATUM(column->bv_values[0]);
+	for (i = 0; i < multi->nboxes; i++)
+	{
+		if (box2df_contains(&multi->boxes[i], &box_geom))
+			PG_RETURN_BOOL(false);
+	}
+
+	multi = box2df_multi_copy(column->bv_values[0], 1);
+	multi->boxes[multi->nboxes++] = box_geom;
+	box2df_multi_reduce(multi, box2df_multi_max_boxes(fcinfo));
+	box2df_multi_store(column, multi);
+
+	PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(geom2d_brin_multi_consistent);
+Datum
+geom2d_brin_multi_consistent(PG_FUNCTION_ARGS)
+{
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	ScanKey key = (ScanKey) PG_GETARG_POINTER(2);
+	BOX2DF_MULTI *multi;
+	BOX2DF box_query;
+	int i;
+
+	/* IS NULL and IS NOT NULL tests, handled by BRIN itself from PostgreSQL 14 */
+	if (key->sk_flags & SK_ISNULL)
+	{
+		if (key->sk_flags & SK_SEARCHNULL)
+			PG_RETURN_BOOL(column->bv_allnulls || column->bv_hasnulls);
+
+		if (key->sk_flags & SK_SEARCHNOTNULL)
+			PG_RETURN_BOOL(!column->bv_allnulls);
+
+		PG_RETURN_BOOL(false);
+	}
+
+	if (column->bv_allnulls)
+		PG_RETURN_BOOL(false);
+
+	if (key->sk_subtype == postgis_oid(BOX2DFOID))
+		memcpy(&box_query, DatumGetPointer(key->sk_argument), sizeof(BOX2DF));
+	else if (gserialized_datum_get_box2df_p(key->sk_argument, &box_query) == LW_FAILURE)
+		PG_RETURN_BOOL(true); /* Empty query, leave it to the operator */
+
+	multi = (BOX2DF_MULTI *) PG_DETOAST_DATUM(column->bv_values[0]);
+
+	switch (key->sk_strategy)
+	{
+	case RTOverlapStrategyNumber:
+		for (i = 0; i < multi->nboxes; i++)
+			if (box2df_overlaps(&multi->boxes[i], &box_query))
+				PG_RETURN_BOOL(true);
+		PG_RETURN_BOOL(false);
+
+	case RTContainsStrategyNumber:
+		for (i = 0; i < multi->nboxes; i++)
+			if (box2df_contains(&multi->boxes[i], &box_query))
+				PG_RETURN_BOOL(true);
+		PG_RETURN_BOOL(false);
+
+	case RTContainedByStrategyNumber:
+		if (multi->flags & BOX2DF_MULTI_CONTAINS_EMPTY)
+			PG_RETURN_BOOL(true);
+		for (i = 0; i < multi->nboxes; i++)
+			if (box2df_overlaps(&multi->boxes[i], &box_query))
+				PG_RETURN_BOOL(true);
+		PG_RETURN_BOOL(false);
+
+	default:
+		elog(ERROR, "%s: unknown strategy %d", __func__, key->sk_strategy);
+	}
+	PG_RETURN_BOOL(false);
+}
+
+PG_FUNCTION_INFO_V1(geom2d_brin_multi_union);
+Datum
+geom2d_brin_multi_union(PG_FUNCTION_ARGS)
+{
+	BrinValues *col_a = (BrinValues *) PG_GETARG_POINTER(1);
+	BrinValues *col_b = (BrinValues *) PG_GETARG_POINTER(2);
+	BOX2DF_MULTI *multi, *multi_b;
+
+	if (col_b->bv_hasnulls)
+		col_a->bv_hasnulls = true;
+
+	if (col_b->bv_allnulls)
+		PG_RETURN_VOID();
+
+	multi_b = (BOX2DF_MULTI *) PG_DETOAST_DATUM(col_b->bv_values[0]);
+
+	if (col_a->bv_allnulls)
+	{
+		multi = box2df_multi_copy(col_b->bv_values[0], 0);
+	}
+	else
+	{
+		multi = box2df_multi_copy(col_a->bv_values[0], multi_b->nboxes);
+		memcpy(multi->boxes + multi->nboxes, multi_b->boxes, multi_b->nboxes * sizeof(BOX2DF));
+		multi->nboxes += multi_b->nboxes;
+		multi->flags |= multi_b->flags;
+		box2df_multi_reduce(multi, box2df_multi_max_boxes(fcinfo));
+	}
+	box2df_multi_store(col_a, multi);
+
+	PG_RETURN_VOID();
+}
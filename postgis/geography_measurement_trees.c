@@ -86,7 +86,8 @@ static GeomCacheMethods CircTreeCacheMethods =
 	CIRC_CACHE_ENTRY,
 	CircTreeBuilder,
 	CircTreeFreer,
-	CircTreeAllocator
+	CircTreeAllocator,
+	NULL
 };
 
 static CircTreeGeomCache *
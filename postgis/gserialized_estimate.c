@@ -50,6 +50,11 @@ will be 2D or ND.
 - geometry &&& geometry ==> ND
 - geography && geography ==> ND
 
+The cells of the histograms are not evenly spaced: along each axis
+the cell edges follow the quantiles of the sampled features (blended
+with an even spread), so densely populated areas get more, smaller
+cells. The edges are stored after the histogram values.
+
 The 2D mode is put in effect by retrieving the 2D histogram from the
 statistics cache and then allowing the generic ND calculations to
 go to work.
@@ -104,11 +109,21 @@ dimensionality cases. (2D geometry) &&& (3D column), etc.
 #include "utils/syscache.h"
 #include "utils/rel.h"
 #include "utils/selfuncs.h"
+#include "utils/sampling.h"
+#include "utils/acl.h"
+#include "access/table.h"
+#include "catalog/pg_statistic.h"
 
 #include "../postgis_config.h"
 
 #include "access/htup_details.h"
 
+#if PG_VERSION_NUM < 140000
+#include "utils/guc.h"
+#define message_level_is_interesting(elevel) \
+	((elevel) >= log_min_messages || (elevel) >= client_min_messages)
+#endif
+
 #include "stringbuffer.h"
 #include "liblwgeom.h"
 #include "lwgeodetic.h"
@@ -141,6 +156,7 @@ Datum _postgis_gserialized_index_extent(PG_FUNCTION_ARGS);
 Datum _postgis_gserialized_sel(PG_FUNCTION_ARGS);
 Datum _postgis_gserialized_joinsel(PG_FUNCTION_ARGS);
 Datum _postgis_gserialized_stats(PG_FUNCTION_ARGS);
+Datum _postgis_gserialized_stats_merge(PG_FUNCTION_ARGS);
 
 /* Local prototypes */
 static Oid table_get_spatial_index(Oid tbl_oid, int16 attnum, int *key_type, int16 *idx_attnum);
@@ -167,6 +183,15 @@ Datum geometry_estimated_extent(PG_FUNCTION_ARGS);
 #define STATISTIC_KIND_ND 102
 #define STATISTIC_KIND_2D 103
 
+/*
+ * Histograms carrying their own cell edges (see nd_stats_edges)
+ * are stored under new kinds, so that the uniform histograms
+ * written by older versions are still recognized (and read as
+ * having evenly spaced edges) until the next ANALYZE.
+ */
+#define STATISTIC_KIND_ND_EDGES 104
+#define STATISTIC_KIND_2D_EDGES 105
+
 /*
  * Postgres does not pin its slots and uses them as they come.
  * We need to preserve its Correlation for brin to work
@@ -186,6 +211,15 @@ Datum geometry_estimated_extent(PG_FUNCTION_ARGS);
 */
 #define SDFACTOR 3.25
 
+/**
+* Cell edges of the histogram are the quantiles of a blend of
+* the distribution of the sample box centers and an even spread
+* over the extent. EDGE_DEPTH_WEIGHT is the weight of the sample:
+* cells shrink where the data is dense, and the even part keeps
+* some cells in the sparse areas.
+*/
+#define EDGE_DEPTH_WEIGHT 0.8
+
 /**
 * The maximum number of dimensions our code can handle.
 * We'll use this to statically allocate a bunch of
@@ -278,6 +312,7 @@ typedef struct ND_STATS_T
 	float4 cells_covered;
 
 	/* Variable length # of floats for histogram */
+	/* followed by size[d]+1 cell edges for each dimension */
 	float4 value[1];
 } ND_STATS;
 
@@ -452,6 +487,89 @@ nd_stats_value_index(const ND_STATS *stats, int *indexes)
 	return vdx;
 }
 
+/**
+* How many cell edges, over all dimensions, follow the
+* histogram values?
+*/
+static int
+nd_stats_num_edges(const ND_STATS *stats)
+{
+	int d;
+	int num_edges = 0;
+	for ( d = 0; d < (int)roundf(stats->ndims); d++ )
+		num_edges += (int)roundf(stats->size[d]) + 1;
+	return num_edges;
+}
+
+/**
+* The size[d]+1 cell edges of dimension d, from extent.min[d]
+* to extent.max[d]. Cell i of that dimension runs from edge i
+* to edge i+1.
+*/
+static float4 *
+nd_stats_edges(const ND_STATS *stats, int d)
+{
+	int k;
+	size_t offset = (size_t)roundf(stats->histogram_cells);
+	for ( k = 0; k < d; k++ )
+		offset += (size_t)roundf(stats->size[k]) + 1;
+	return (float4*)(stats->value + offset);
+}
+
+/**
+* Set the edges of every dimension evenly spaced over the extent,
+* the layout of histograms before the edges were stored.
+*/
+static void
+nd_stats_uniform_edges(ND_STATS *stats)
+{
+	int d, i;
+	for ( d = 0; d < (int)roundf(stats->ndims); d++ )
+	{
+		float4 *edges = nd_stats_edges(stats, d);
+		int size = (int)roundf(stats->size[d]);
+		double min = stats->extent.min[d];
+		double cellsize = (stats->extent.max[d] - min) / size;
+		for ( i = 0; i <= size; i++ )
+			edges[i] = min + i * cellsize;
+	}
+}
+
+/**
+* Find the cell of a dimension holding the value: the last
+* one whose lower edge is at or below it. Values beyond the
+* edges go to the first or last cell.
+*/
+static inline int
+nd_edges_search(const float4 *edges, int size, double value)
+{
+	int lo = 0, hi = size - 1;
+	while ( lo < hi )
+	{
+		int mid = (lo + hi + 1) / 2;
+		if ( edges[mid] <= value )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/**
+* Set the bounds of the histogram cell at the (i,j,k) position.
+*/
+static inline void
+nd_stats_cell_box(const ND_STATS *stats, const int *at, ND_BOX *nd_cell)
+{
+	int d;
+	for ( d = 0; d < (int)roundf(stats->ndims); d++ )
+	{
+		const float4 *edges = nd_stats_edges(stats, d);
+		nd_cell->min[d] = edges[at[d]];
+		nd_cell->max[d] = edges[at[d]+1];
+	}
+}
+
 /**
 * Convert an #ND_BOX to a JSON string for printing
 */
@@ -706,17 +824,15 @@ nd_box_overlap(const ND_STATS *nd_stats, const ND_BOX *nd_box, ND_IBOX *nd_ibox)
 		else
 		{
 			int size = (int)roundf(nd_stats->size[d]);
+			const float4 *edges = nd_stats_edges(nd_stats, d);
 
-			/* ... find cells the box overlaps with in this dimension */
-			nd_ibox->min[d] = floor(size * (nd_box->min[d] - smin) / width);
-			nd_ibox->max[d] = floor(size * (nd_box->max[d] - smin) / width);
+			/* ... find cells the box overlaps with in this dimension, */
+			/* out-of range values are pushed into range */
+			nd_ibox->min[d] = nd_edges_search(edges, size, nd_box->min[d]);
+			nd_ibox->max[d] = nd_edges_search(edges, size, nd_box->max[d]);
 
 			POSTGIS_DEBUGF(5, " stats: dim %d: min %g: max %g: width %g", d, smin, smax, width);
 			POSTGIS_DEBUGF(5, " overlap: dim %d: (%d, %d)", d, nd_ibox->min[d], nd_ibox->max[d]);
-
-			/* Push any out-of range values into range */
-			nd_ibox->min[d] = Max(nd_ibox->min[d], 0);
-			nd_ibox->max[d] = Min(nd_ibox->max[d], size - 1);
 		}
 	}
 	return true;
@@ -724,6 +840,8 @@ nd_box_overlap(const ND_STATS *nd_stats, const ND_BOX *nd_box, ND_IBOX *nd_ibox)
 
 /**
 * Returns the proportion of b2 that is covered by b1.
+* A b2 that is flat in some dimension (a point, or a
+* horizontal line) lying on the edge of b1 is covered by it.
 */
 static inline double
 nd_box_ratio(const ND_BOX *b1, const ND_BOX *b2, int ndims)
@@ -735,9 +853,12 @@ nd_box_ratio(const ND_BOX *b1, const ND_BOX *b2, int ndims)
 
 	for ( d = 0 ; d < ndims; d++ )
 	{
-		if ( b1->max[d] <= b2->min[d] || b1->min[d] >= b2->max[d] )
+		if ( b1->max[d] < b2->min[d] || b1->min[d] > b2->max[d] )
 			return 0.0; /* Disjoint */
 
+		if ( b2->min[d] < b2->max[d] && ( b1->max[d] == b2->min[d] || b1->min[d] == b2->max[d] ) )
+			return 0.0; /* Only touching */
+
 		if ( b1->min[d] > b2->min[d] || b1->max[d] < b2->max[d] )
 			covered = false;
 	}
@@ -884,6 +1005,101 @@ nd_box_array_distribution(const ND_BOX **nd_boxes, int num_boxes, const ND_BOX *
 	return true;
 }
 
+/**
+* Double comparison function for qsort
+*/
+static int
+cmp_double(const void *a, const void *b)
+{
+	double da = *((const double*)a);
+	double db = *((const double*)b);
+
+	if ( da == db )
+		return 0;
+	else if ( da > db )
+		return 1;
+	else
+		return -1;
+}
+
+/**
+* Place the size+1 cell edges of dimension d over the extent.
+* Evenly spaced cells put most of a skewed sample (say, a few
+* cities in a country-wide table) into a handful of cells,
+* and then every search box inside a city is estimated
+* at the average density of its cells. So the inner edges are
+* drawn towards the quantiles of the sample box centers,
+* making cells small where the features are dense and large
+* where they are sparse. The histogram stays a grid, and the
+* estimators just look the edges up.
+*/
+static void
+nd_box_array_edges(const ND_BOX **nd_boxes, int num_boxes, const ND_BOX *extent, int d, int size, float4 *edges)
+{
+	int i, k, num_centers = 0;
+	double *centers;
+	double smin = extent->min[d];
+	double swidth = extent->max[d] - smin;
+
+	edges[0] = extent->min[d];
+	edges[size] = extent->max[d];
+
+	/* Dimensions we don't compute a distribution for get even cells */
+	if ( size < 2 || swidth < MIN_DIMENSION_WIDTH || swidth > MAX_DIMENSION_WIDTH )
+	{
+		for ( i = 1; i < size; i++ )
+			edges[i] = smin + i * swidth / size;
+		return;
+	}
+
+	centers = palloc(sizeof(double) * num_boxes);
+	for ( i = 0; i < num_boxes; i++ )
+	{
+		const ND_BOX *ndb = nd_boxes[i];
+		double center;
+
+		/* Skip null entries */
+		if ( ! ndb ) continue;
+
+		center = ((double)ndb->min[d] + ndb->max[d]) / 2;
+		centers[num_centers++] = Min(Max(center, smin), smin + swidth);
+	}
+	qsort(centers, num_centers, sizeof(double), cmp_double);
+
+	/*
+	 * Edge i sits where the blended distribution, the weighted sum
+	 * of the share of centers up to x and of the share of the extent
+	 * up to x, reaches i/size. Between two centers that share grows
+	 * linearly, so we solve for x in the current gap and move on to
+	 * the next gap while the solution lies beyond it.
+	 */
+	k = 0;
+	for ( i = 1; i < size; i++ )
+	{
+		double share = (double)i / size;
+		double x;
+		while ( true )
+		{
+			double depth = num_centers ? EDGE_DEPTH_WEIGHT * k / num_centers : 0.0;
+			double even = num_centers ? 1.0 - EDGE_DEPTH_WEIGHT : 1.0;
+			x = smin + swidth * (share - depth) / even;
+			if ( k < num_centers && x >= centers[k] )
+			{
+				k++;
+				continue;
+			}
+			/* Solution falls behind the last center: the share is */
+			/* reached right at that center */
+			if ( k > 0 )
+				x = Max(x, centers[k-1]);
+			break;
+		}
+		edges[i] = Min(Max(x, smin), smin + swidth);
+	}
+
+	pfree(centers);
+}
+
 /**
 * Given an n-d index array (counter), and a domain to increment it
 * in (ibox) increment it by one, unless it's already at the max of
@@ -912,32 +1128,183 @@ nd_increment(ND_IBOX *ibox, int ndims, int *counter)
 	return true;
 }
 
+/**
+* Spatial extent of the histogram of a sample of boxes: the mean
+* bounds +/- SDFACTOR standard deviations, within the sample extent.
+* Boxes entirely outside of that (hard deviants) are nulled out of
+* the array, and the extent of the remaining ones, expanded by 1%
+* to avoid edge effects, is returned.
+*/
+static void
+nd_box_array_histo_extent(const ND_BOX **nd_boxes, int num_boxes, int ndims, ND_BOX *histo_extent)
+{
+	int d, i;
+	int num_valid = 0;
+	ND_BOX sum, avg, stddev, sample_extent, extent_new;
+
+	nd_box_init(&sum);
+	nd_box_init(&stddev);
+	nd_box_init(&avg);
+	nd_box_init_bounds(&sample_extent);
+
+	for ( i = 0; i < num_boxes; i++ )
+	{
+		const ND_BOX *ndb = nd_boxes[i];
+		if ( ! ndb ) continue;
+		nd_box_merge(ndb, &sample_extent);
+		for ( d = 0; d < ndims; d++ )
+		{
+			sum.min[d] += ndb->min[d];
+			sum.max[d] += ndb->max[d];
+		}
+		num_valid++;
+	}
+
+	nd_box_init(histo_extent);
+	if ( ! num_valid )
+		return;
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		/* Calculate average bounds values */
+		avg.min[d] = sum.min[d] / num_valid;
+		avg.max[d] = sum.max[d] / num_valid;
+
+		/* Calculate standard deviation for this dimension bounds */
+		for ( i = 0; i < num_boxes; i++ )
+		{
+			const ND_BOX *ndb = nd_boxes[i];
+			if ( ! ndb ) continue;
+			stddev.min[d] += (ndb->min[d] - avg.min[d]) * (ndb->min[d] - avg.min[d]);
+			stddev.max[d] += (ndb->max[d] - avg.max[d]) * (ndb->max[d] - avg.max[d]);
+		}
+		stddev.min[d] = sqrt(stddev.min[d] / num_valid);
+		stddev.max[d] = sqrt(stddev.max[d] / num_valid);
+
+		/* Histogram bounds for this dimension bounds is avg +/- SDFACTOR * stdev */
+		histo_extent->min[d] = Max(avg.min[d] - SDFACTOR * stddev.min[d], sample_extent.min[d]);
+		histo_extent->max[d] = Min(avg.max[d] + SDFACTOR * stddev.max[d], sample_extent.max[d]);
+	}
+
+	nd_box_init_bounds(&extent_new);
+	for ( i = 0; i < num_boxes; i++ )
+	{
+		const ND_BOX *ndb = nd_boxes[i];
+		if ( ! ndb ) continue;
+		/* Skip any hard deviants (boxes entirely outside our histo_extent */
+		if ( ! nd_box_intersects(histo_extent, ndb, ndims) )
+		{
+			POSTGIS_DEBUGF(4, " feature %d is a hard deviant, skipped", i);
+			nd_boxes[i] = NULL;
+			continue;
+		}
+		/* Expand our new box to fit all the other features. */
+		nd_box_merge(ndb, &extent_new);
+	}
+	nd_box_expand(&extent_new, 0.01);
+	*histo_extent = extent_new;
+}
+
+/**
+* Spread the weight of a feature box over the histogram cells
+* it overlaps, in proportion to the overlap: a feature box
+* completely inside one cell adds the weight to that cell, one
+* 50% in two cells adds half of it to each. Returns the number
+* of cells covered (the sum of the proportions).
+*/
+static double
+nd_stats_add_box(ND_STATS *nd_stats, const ND_BOX *nd_box, double weight)
+{
+	int d;
+	ND_IBOX nd_ibox;
+	int at[ND_DIMS];
+	double num_cells = 0;
+
+	/* Find the cells that overlap with this box and put them into the ND_IBOX */
+	nd_box_overlap(nd_stats, nd_box, &nd_ibox);
+	memset(at, 0, sizeof(int)*ND_DIMS);
+
+	POSTGIS_DEBUGF(3, " feature: ibox (%d, %d, %d, %d) (%d, %d, %d, %d)",
+	  nd_ibox.min[0], nd_ibox.min[1], nd_ibox.min[2], nd_ibox.min[3],
+	  nd_ibox.max[0], nd_ibox.max[1], nd_ibox.max[2], nd_ibox.max[3]);
+
+	/* Initialize the starting values */
+	for ( d = 0; d < nd_stats->ndims; d++ )
+		at[d] = nd_ibox.min[d];
+
+	/*
+	 * Move through all the overlapped histogram cells values and
+	 * add the box overlap proportion to them.
+	 */
+	do
+	{
+		ND_BOX nd_cell = { {0.0, 0.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.0} };
+		double ratio;
+		/* Create a box for this histogram cell */
+		nd_stats_cell_box(nd_stats, at, &nd_cell);
+
+		ratio = nd_box_ratio(&nd_cell, nd_box, nd_stats->ndims);
+		nd_stats->value[nd_stats_value_index(nd_stats, at)] += weight * ratio;
+		num_cells += ratio;
+		POSTGIS_DEBUGF(3, "               ratio (%.8g)  num_cells (%.8g)", ratio, num_cells);
+		POSTGIS_DEBUGF(3, "               at (%d, %d, %d, %d)", at[0], at[1], at[2], at[3]);
+	}
+	while ( nd_increment(&nd_ibox, nd_stats->ndims, at) );
+
+	return num_cells;
+}
+
 static ND_STATS*
 pg_nd_stats_from_tuple(HeapTuple stats_tuple, int mode)
 {
-	int stats_kind = STATISTIC_KIND_ND;
+	int stats_kind = STATISTIC_KIND_ND_EDGES;
+	int legacy_kind = STATISTIC_KIND_ND;
 	int rv;
+	bool has_edges = true;
 	ND_STATS *nd_stats;
 
 	/* If we're in 2D mode, set the kind appropriately */
-	if ( mode == 2 ) stats_kind = STATISTIC_KIND_2D;
+	if ( mode == 2 )
+	{
+		stats_kind = STATISTIC_KIND_2D_EDGES;
+		legacy_kind = STATISTIC_KIND_2D;
+	}
 
     /* Then read the geom status histogram from that */
 	{
 		AttStatsSlot sslot;
+		size_t nd_stats_size;
 		rv = get_attstatsslot(&sslot, stats_tuple, stats_kind, InvalidOid,
 							 ATTSTATSSLOT_NUMBERS);
+		if ( ! rv )
+		{
+			/* Stats from before the edges were stored */
+			has_edges = false;
+			rv = get_attstatsslot(&sslot, stats_tuple, legacy_kind, InvalidOid,
+			                      ATTSTATSSLOT_NUMBERS);
+		}
 		if ( ! rv ) {
 			POSTGIS_DEBUGF(2, "no slot of kind %d in stats tuple", stats_kind);
 			return NULL;
 		}
 
 		/* Clone the stats here so we can release the attstatsslot immediately */
-		nd_stats = palloc(sizeof(float4) * sslot.nnumbers);
+		nd_stats_size = sizeof(float4) * sslot.nnumbers;
+		if ( ! has_edges )
+		{
+			const ND_STATS *legacy = (const ND_STATS*)sslot.numbers;
+			nd_stats_size += sizeof(float4) * nd_stats_num_edges(legacy);
+		}
+		nd_stats = palloc(nd_stats_size);
 		memcpy(nd_stats, sslot.numbers, sizeof(float4) * sslot.nnumbers);
 
 		free_attstatsslot(&sslot);
 	}
+
+	/* Old histograms have evenly spaced cells */
+	if ( ! has_edges )
+		nd_stats_uniform_edges(nd_stats);
+
 	return nd_stats;
 }
 
@@ -1043,14 +1410,6 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 	ND_IBOX ibox1, ibox2;
 	int at1[ND_DIMS];
 	int at2[ND_DIMS];
-	double min1[ND_DIMS];
-	double width1[ND_DIMS];
-	double cellsize1[ND_DIMS];
-	int size2[ND_DIMS];
-	double min2[ND_DIMS];
-	double width2[ND_DIMS];
-	double cellsize2[ND_DIMS];
-	int size1[ND_DIMS];
 	int d;
 	double val = 0;
 	float8 selectivity;
@@ -1113,24 +1472,9 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 		PG_RETURN_FLOAT8(FALLBACK_ND_JOINSEL);
 	}
 
-	/* Initialize counters / constants on s1 */
+	/* Initialize counters on s1 */
 	for ( d = 0; d < ndims1; d++ )
-	{
 		at1[d] = ibox1.min[d];
-		min1[d] = s1->extent.min[d];
-		width1[d] = s1->extent.max[d] - s1->extent.min[d];
-		size1[d] = (int)roundf(s1->size[d]);
-		cellsize1[d] = width1[d] / size1[d];
-	}
-
-	/* Initialize counters / constants on s2 */
-	for ( d = 0; d < ndims2; d++ )
-	{
-		min2[d] = s2->extent.min[d];
-		width2[d] = s2->extent.max[d] - s2->extent.min[d];
-		size2[d] = (int)roundf(s2->size[d]);
-		cellsize2[d] = width2[d] / size2[d];
-	}
 
 	/* For each affected cell of s1... */
 	do
@@ -1139,11 +1483,7 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 		/* Construct the bounds of this cell */
 		ND_BOX nd_cell1;
 		nd_box_init(&nd_cell1);
-		for ( d = 0; d < ndims1; d++ )
-		{
-			nd_cell1.min[d] = min1[d] + (at1[d]+0) * cellsize1[d];
-			nd_cell1.max[d] = min1[d] + (at1[d]+1) * cellsize1[d];
-		}
+		nd_stats_cell_box(s1, at1, &nd_cell1);
 
 		/* Find the cells of s2 that cell1 overlaps.. */
 		nd_box_overlap(s2, &nd_cell1, &ibox2);
@@ -1168,11 +1508,7 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 			/* Construct the bounds of this cell */
 			ND_BOX nd_cell2;
 			nd_box_init(&nd_cell2);
-			for ( d = 0; d < ndims2; d++ )
-			{
-				nd_cell2.min[d] = min2[d] + (at2[d]+0) * cellsize2[d];
-				nd_cell2.max[d] = min2[d] + (at2[d]+1) * cellsize2[d];
-			}
+			nd_stats_cell_box(s2, at2, &nd_cell2);
 
 			POSTGIS_DEBUGF(3, "  at2 %d,%d  %s", at2[0], at2[1], nd_box_to_json(&nd_cell2, ndims2));
 
@@ -1380,18 +1716,14 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	double total_width = 0;            /* # of bytes used by sample */
 	double total_cell_count = 0;       /* # of cells in histogram affected by sample */
 
-	ND_BOX sum;                        /* Sum of extents of sample boxes */
-	ND_BOX avg;                        /* Avg of extents of sample boxes */
-	ND_BOX stddev;                     /* StdDev of extents of sample boxes */
-
 	const ND_BOX **sample_boxes;       /* ND_BOXes for each of the sample features */
 	ND_BOX sample_extent;              /* Extent of the raw sample */
 	int    histo_size[ND_DIMS];        /* histogram nrows, ncols, etc */
 	ND_BOX histo_extent;               /* Spatial extent of the histogram */
-	ND_BOX histo_extent_new;           /* Temporary variable */
 	int    histo_cells_target;         /* Number of cells we will shoot for, given the stats target */
 	int    histo_cells;                /* Number of cells in the histogram */
 	int    histo_cells_new = 1;        /* Temporary variable */
+	int    histo_edges;                /* Number of cell edges over all dimensions */
 
 	int   ndims = 2;                    /* Dimensionality of the sample */
 	int   histo_ndims = 0;              /* Dimensionality of the histogram */
@@ -1401,12 +1733,7 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	int stats_slot;                     /* What slot is this data going into? (2D vs ND) */
 	int stats_kind;                     /* And this is what? (2D vs ND) */
 
-	/* Initialize sum and stddev */
-	nd_box_init(&sum);
-	nd_box_init(&stddev);
-	nd_box_init(&avg);
 	nd_box_init(&histo_extent);
-	nd_box_init(&histo_extent_new);
 
 	/*
 	 * This is where gserialized_analyze_nd
@@ -1431,8 +1758,6 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	 *  o find extent of the sample
 	 *  o count null-infinite/not-null values
 	 *  o compute total_width
-	 *  o compute total features's box area (for avgFeatureArea)
-	 *  o sum features box coordinates (for standard deviation)
 	 */
 	for ( i = 0; i < sample_rows; i++ )
 	{
@@ -1494,13 +1819,6 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 		/* How many bytes does this sample use? */
 		total_width += toast_raw_datum_size(datum);
 
-		/* Add bounds coordinates to sums for stddev calculation */
-		for ( d = 0; d < ndims; d++ )
-		{
-			sum.min[d] += nd_box->min[d];
-			sum.max[d] += nd_box->max[d];
-		}
-
 		/* Increment our "good feature" count */
 		notnull_cnt++;
 
@@ -1540,55 +1858,11 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	POSTGIS_DEBUGF(3, " sample_extent: %s", nd_box_to_json(&sample_extent, ndims));
 
 	/*
-	 * Second scan:
-	 *  o compute standard deviation
+	 * Second and third scans:
+	 *  o skip hard deviants
+	 *  o compute histogram box
 	 */
-	for ( d = 0; d < ndims; d++ )
-	{
-		/* Calculate average bounds values */
-		avg.min[d] = sum.min[d] / notnull_cnt;
-		avg.max[d] = sum.max[d] / notnull_cnt;
-
-		/* Calculate standard deviation for this dimension bounds */
-		for ( i = 0; i < notnull_cnt; i++ )
-		{
-			const ND_BOX *ndb = sample_boxes[i];
-			stddev.min[d] += (ndb->min[d] - avg.min[d]) * (ndb->min[d] - avg.min[d]);
-			stddev.max[d] += (ndb->max[d] - avg.max[d]) * (ndb->max[d] - avg.max[d]);
-		}
-		stddev.min[d] = sqrt(stddev.min[d] / notnull_cnt);
-		stddev.max[d] = sqrt(stddev.max[d] / notnull_cnt);
-
-		/* Histogram bounds for this dimension bounds is avg +/- SDFACTOR * stdev */
-		histo_extent.min[d] = Max(avg.min[d] - SDFACTOR * stddev.min[d], sample_extent.min[d]);
-		histo_extent.max[d] = Min(avg.max[d] + SDFACTOR * stddev.max[d], sample_extent.max[d]);
-	}
-
-	/*
-	 * Third scan:
-	 *   o skip hard deviants
-	 *   o compute new histogram box
-	 */
-	nd_box_init_bounds(&histo_extent_new);
-	for ( i = 0; i < notnull_cnt; i++ )
-	{
-		const ND_BOX *ndb = sample_boxes[i];
-		/* Skip any hard deviants (boxes entirely outside our histo_extent */
-		if ( ! nd_box_intersects(&histo_extent, ndb, ndims) )
-		{
-			POSTGIS_DEBUGF(4, " feature %d is a hard deviant, skipped", i);
-			sample_boxes[i] = NULL;
-			continue;
-		}
-		/* Expand our new box to fit all the other features. */
-		nd_box_merge(ndb, &histo_extent_new);
-	}
-	/*
-	 * Expand the box slightly (1%) to avoid edge effects
-	 * with objects that are on the boundary
-	 */
-	nd_box_expand(&histo_extent_new, 0.01);
-	histo_extent = histo_extent_new;
+	nd_box_array_histo_extent(sample_boxes, notnull_cnt, ndims, &histo_extent);
 
 	/*
 	 * How should we allocate our histogram cells to the
@@ -1684,8 +1958,11 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	/*
 	 * Create the histogram (ND_STATS) in the stats memory context
 	 */
+	histo_edges = 0;
+	for ( d = 0; d < ndims; d++ )
+		histo_edges += histo_size[d] + 1;
 	old_context = MemoryContextSwitchTo(stats->anl_context);
-	nd_stats_size = sizeof(ND_STATS) + ((histo_cells - 1) * sizeof(float4));
+	nd_stats_size = sizeof(ND_STATS) + ((histo_cells + histo_edges - 1) * sizeof(float4));
 	nd_stats = palloc(nd_stats_size);
 	memset(nd_stats, 0, nd_stats_size); /* Initialize all values to 0 */
 	MemoryContextSwitchTo(old_context);
@@ -1696,10 +1973,18 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	nd_stats->sample_features = sample_rows;
 	nd_stats->table_features = total_rows;
 	nd_stats->not_null_features = notnull_cnt;
+	nd_stats->histogram_cells = histo_cells;
 	/* Copy in the histogram dimensions */
 	for ( d = 0; d < ndims; d++ )
 		nd_stats->size[d] = histo_size[d];
 
+	/* Place the cell edges, denser where the sample is */
+	for ( d = 0; d < ndims; d++ )
+	{
+		nd_box_array_edges(sample_boxes, notnull_cnt, &histo_extent, d,
+		                   histo_size[d], nd_stats_edges(nd_stats, d));
+	}
+
 	/*
 	 * Fourth scan:
 	 *  o fill histogram values with the proportion of
@@ -1715,15 +2000,7 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	 */
 	for ( i = 0; i < notnull_cnt; i++ )
 	{
-		const ND_BOX *nd_box;
-		ND_IBOX nd_ibox;
-		int at[ND_DIMS];
-		double num_cells = 0;
-		double min[ND_DIMS] = {0.0, 0.0, 0.0, 0.0};
-		double max[ND_DIMS] = {0.0, 0.0, 0.0, 0.0};
-		double cellsize[ND_DIMS] = {0.0, 0.0, 0.0, 0.0};
-
-		nd_box = sample_boxes[i];
+		const ND_BOX *nd_box = sample_boxes[i];
 		if ( ! nd_box ) continue; /* Skip Null'ed out hard deviants */
 
 		/* Give backend a chance of interrupting us */
@@ -1733,53 +2010,8 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 		vacuum_delay_point();
 #endif
 
-		/* Find the cells that overlap with this box and put them into the ND_IBOX */
-		nd_box_overlap(nd_stats, nd_box, &nd_ibox);
-		memset(at, 0, sizeof(int)*ND_DIMS);
-
-		POSTGIS_DEBUGF(3, " feature %d: ibox (%d, %d, %d, %d) (%d, %d, %d, %d)", i,
-		  nd_ibox.min[0], nd_ibox.min[1], nd_ibox.min[2], nd_ibox.min[3],
-		  nd_ibox.max[0], nd_ibox.max[1], nd_ibox.max[2], nd_ibox.max[3]);
-
-		for ( d = 0; d < nd_stats->ndims; d++ )
-		{
-			/* Initialize the starting values */
-			at[d] = nd_ibox.min[d];
-			min[d] = nd_stats->extent.min[d];
-			max[d] = nd_stats->extent.max[d];
-			cellsize[d] = (max[d] - min[d])/(nd_stats->size[d]);
-		}
-
-		/*
-		 * Move through all the overlapped histogram cells values and
-		 * add the box overlap proportion to them.
-		 */
-		do
-		{
-			ND_BOX nd_cell = { {0.0, 0.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.0} };
-			double ratio;
-			/* Create a box for this histogram cell */
-			for ( d = 0; d < nd_stats->ndims; d++ )
-			{
-				nd_cell.min[d] = min[d] + (at[d]+0) * cellsize[d];
-				nd_cell.max[d] = min[d] + (at[d]+1) * cellsize[d];
-			}
-
-			/*
-			 * If a feature box is completely inside one cell the ratio will be
-			 * 1.0. If a feature box is 50% in two cells, each cell will get
-			 * 0.5 added on.
-			 */
-			ratio = nd_box_ratio(&nd_cell, nd_box, nd_stats->ndims);
-			nd_stats->value[nd_stats_value_index(nd_stats, at)] += ratio;
-			num_cells += ratio;
-			POSTGIS_DEBUGF(3, "               ratio (%.8g)  num_cells (%.8g)", ratio, num_cells);
-			POSTGIS_DEBUGF(3, "               at (%d, %d, %d, %d)", at[0], at[1], at[2], at[3]);
-		}
-		while ( nd_increment(&nd_ibox, nd_stats->ndims, at) );
-
 		/* Keep track of overall number of overlaps counted */
-		total_cell_count += num_cells;
+		total_cell_count += nd_stats_add_box(nd_stats, nd_box, 1.0);
 		/* How many features have we added to this histogram? */
 		histogram_features++;
 	}
@@ -1798,19 +2030,18 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	}
 
 	nd_stats->histogram_features = histogram_features;
-	nd_stats->histogram_cells = histo_cells;
 	nd_stats->cells_covered = total_cell_count;
 
 	/* Put this histogram data into the right slot/kind */
 	if ( mode == 2 )
 	{
 		stats_slot = STATISTIC_SLOT_2D;
-		stats_kind = STATISTIC_KIND_2D;
+		stats_kind = STATISTIC_KIND_2D_EDGES;
 	}
 	else
 	{
 		stats_slot = STATISTIC_SLOT_ND;
-		stats_kind = STATISTIC_KIND_ND;
+		stats_kind = STATISTIC_KIND_ND_EDGES;
 	}
 
 	/* Write the statistics data */
@@ -1838,6 +2069,155 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 }
 
 
+/**
+* Merge a sample of the boxes of rows added to a table since the
+* last ANALYZE into its histogram, without sampling the table again.
+*
+* The histogram keeps its cells. When the new boxes reach beyond
+* its extent, cells are added on the sides they fall, as many as
+* the share of the sample lying there calls for (at most half as
+* many again in each dimension), with edges placed by the sample
+* as ANALYZE does. The old counts move to their cells unchanged,
+* and the new boxes are counted in with a weight that scales them
+* to the sampling rate of the last ANALYZE.
+*
+* batch_rows is the number of rows added, and batch_valid the number
+* of those that have a (non-empty, finite) box, of which nd_boxes
+* holds a sample. Returns NULL if the histogram would grow beyond
+* what ANALYZE would build.
+*/
+static ND_STATS*
+nd_stats_merge_sample(const ND_STATS *old, const ND_BOX **nd_boxes, int num_boxes,
+                      double batch_rows, double batch_valid)
+{
+	int d, i;
+	int ndims = (int)roundf(old->ndims);
+	int old_size[ND_DIMS], lo[ND_DIMS], hi[ND_DIMS];
+	int cells = 1, num_edges = 0, histogram_features = 0;
+	int at[ND_DIMS], new_at[ND_DIMS];
+	double sample_ratio = old->sample_features / Max(old->table_features, 1.0);
+	double weight = num_boxes ? sample_ratio * batch_valid / num_boxes : 0.0;
+	double cells_covered = 0;
+	const ND_BOX **side_boxes;
+	ND_BOX batch_extent;
+	ND_IBOX old_ibox;
+	ND_STATS *nd_stats;
+	size_t nd_stats_size;
+
+	/* Histogram extent of the new boxes, without the hard deviants */
+	nd_box_array_histo_extent(nd_boxes, num_boxes, ndims, &batch_extent);
+	for ( i = 0; i < num_boxes; i++ )
+		if ( nd_boxes[i] ) histogram_features++;
+
+	/* How many cells to add below and above the old extent? */
+	for ( d = 0; d < ndims; d++ )
+	{
+		int num_lo = 0, num_hi = 0;
+		int max_side;
+
+		old_size[d] = (int)roundf(old->size[d]);
+		max_side = Max(old_size[d] / 2, 1);
+		lo[d] = hi[d] = 0;
+
+		for ( i = 0; i < num_boxes; i++ )
+		{
+			double center;
+			if ( ! nd_boxes[i] ) continue;
+			center = ((double)nd_boxes[i]->min[d] + nd_boxes[i]->max[d]) / 2;
+			if ( center < old->extent.min[d] ) num_lo++;
+			if ( center > old->extent.max[d] ) num_hi++;
+		}
+
+		if ( histogram_features && batch_extent.min[d] < old->extent.min[d] )
+			lo[d] = Min(Max((int)rint(old_size[d] * (double)num_lo / histogram_features), 1), max_side);
+		if ( histogram_features && batch_extent.max[d] > old->extent.max[d] )
+			hi[d] = Min(Max((int)rint(old_size[d] * (double)num_hi / histogram_features), 1), max_side);
+
+		cells *= old_size[d] + lo[d] + hi[d];
+		num_edges += old_size[d] + lo[d] + hi[d] + 1;
+	}
+
+	if ( cells > roundf(old->histogram_cells) && cells > ndims * 100000 )
+		return NULL;
+
+	nd_stats_size = sizeof(ND_STATS) + ((cells + num_edges - 1) * sizeof(float4));
+	nd_stats = palloc0(nd_stats_size);
+	memcpy(nd_stats, old, offsetof(ND_STATS, value));
+	nd_stats->histogram_cells = cells;
+	for ( d = 0; d < ndims; d++ )
+	{
+		nd_stats->size[d] = old_size[d] + lo[d] + hi[d];
+		if ( lo[d] ) nd_stats->extent.min[d] = batch_extent.min[d];
+		if ( hi[d] ) nd_stats->extent.max[d] = batch_extent.max[d];
+	}
+
+	/* Old edges in the middle, new ones on the sides */
+	side_boxes = palloc(sizeof(ND_BOX*) * Max(num_boxes, 1));
+	for ( d = 0; d < ndims; d++ )
+	{
+		float4 *edges = nd_stats_edges(nd_stats, d);
+		memcpy(edges + lo[d], nd_stats_edges(old, d), (old_size[d] + 1) * sizeof(float4));
+
+		if ( lo[d] || hi[d] )
+		{
+			ND_BOX side;
+			int num_side;
+			nd_box_init(&side);
+
+			if ( lo[d] )
+			{
+				for ( i = 0, num_side = 0; i < num_boxes; i++ )
+					if ( nd_boxes[i] && ((double)nd_boxes[i]->min[d] + nd_boxes[i]->max[d]) / 2 < old->extent.min[d] )
+						side_boxes[num_side++] = nd_boxes[i];
+				side.min[d] = nd_stats->extent.min[d];
+				side.max[d] = old->extent.min[d];
+				nd_box_array_edges(side_boxes, num_side, &side, d, lo[d], edges);
+			}
+			if ( hi[d] )
+			{
+				for ( i = 0, num_side = 0; i < num_boxes; i++ )
+					if ( nd_boxes[i] && ((double)nd_boxes[i]->min[d] + nd_boxes[i]->max[d]) / 2 > old->extent.max[d] )
+						side_boxes[num_side++] = nd_boxes[i];
+				side.min[d] = old->extent.max[d];
+				side.max[d] = nd_stats->extent.max[d];
+				nd_box_array_edges(side_boxes, num_side, &side, d, hi[d], edges + lo[d] + old_size[d]);
+			}
+		}
+	}
+	pfree(side_boxes);
+
+	/* Move the old counts to their cells */
+	memset(&old_ibox, 0, sizeof(ND_IBOX));
+	memset(at, 0, sizeof(int)*ND_DIMS);
+	memset(new_at, 0, sizeof(int)*ND_DIMS);
+	for ( d = 0; d < ndims; d++ )
+		old_ibox.max[d] = old_size[d] - 1;
+	do
+	{
+		for ( d = 0; d < ndims; d++ )
+			new_at[d] = at[d] + lo[d];
+		nd_stats->value[nd_stats_value_index(nd_stats, new_at)] =
+		    old->value[nd_stats_value_index(old, at)];
+	}
+	while ( nd_increment(&old_ibox, ndims, at) );
+
+	/* Count the new boxes in */
+	for ( i = 0; i < num_boxes; i++ )
+	{
+		if ( ! nd_boxes[i] ) continue;
+		cells_covered += weight * nd_stats_add_box(nd_stats, nd_boxes[i], weight);
+	}
+
+	nd_stats->table_features = old->table_features + batch_rows;
+	nd_stats->sample_features = old->sample_features + batch_rows * sample_ratio;
+	nd_stats->not_null_features = old->not_null_features + batch_valid * sample_ratio;
+	nd_stats->histogram_features = old->histogram_features + histogram_features * weight;
+	nd_stats->cells_covered = old->cells_covered + cells_covered;
+
+	return nd_stats;
+}
+
+
 /**
 * In order to do useful selectivity calculations in both 2-D and N-D
 * modes, we actually have to generate two stats objects, one for 2-D
@@ -1944,9 +2324,6 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 	ND_BOX nd_box;
 	ND_IBOX nd_ibox;
 	int at[ND_DIMS];
-	double cell_size[ND_DIMS];
-	double min[ND_DIMS];
-	double max[ND_DIMS];
 	double total_count = 0.0;
 	int ndims_max;
 
@@ -2006,18 +2383,9 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 		return FALLBACK_ND_SEL;
 	}
 
-	/* Work out some measurements of the histogram */
+	/* Initialize the counter */
 	for ( d = 0; d < nd_stats->ndims; d++ )
-	{
-		/* Cell size in each dim */
-		min[d] = nd_stats->extent.min[d];
-		max[d] = nd_stats->extent.max[d];
-		cell_size[d] = (max[d] - min[d]) / nd_stats->size[d];
-		POSTGIS_DEBUGF(3, " cell_size[%d] : %.9g", d, cell_size[d]);
-
-		/* Initialize the counter */
 		at[d] = nd_ibox.min[d];
-	}
 
 	/* Move through all the overlap values and sum them */
 	do
@@ -2026,11 +2394,7 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 		ND_BOX nd_cell = { {0.0, 0.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.0} };
 
 		/* We have to pro-rate partially overlapped cells. */
-		for ( d = 0; d < nd_stats->ndims; d++ )
-		{
-			nd_cell.min[d] = min[d] + (at[d]+0) * cell_size[d];
-			nd_cell.max[d] = min[d] + (at[d]+1) * cell_size[d];
-		}
+		nd_stats_cell_box(nd_stats, at, &nd_cell);
 
 		ratio = nd_box_ratio(&nd_box, &nd_cell, nd_stats->ndims);
 		cell_count = nd_stats->value[nd_stats_value_index(nd_stats, at)];
@@ -2082,8 +2446,9 @@ Datum _postgis_gserialized_stats(PG_FUNCTION_ARGS)
 	if ( ! nd_stats )
 		elog(ERROR, "stats for \"%s.%s\" do not exist", get_rel_name(table_oid), text_to_cstring(att_text));
 
-	/* Convert to JSON */
-	elog(DEBUG1, "stats grid:\n%s", nd_stats_to_grid(nd_stats));
+	/* Convert to JSON, printing the grid only when someone will read it */
+	if ( message_level_is_interesting(DEBUG1) )
+		elog(DEBUG1, "stats grid:\n%s", nd_stats_to_grid(nd_stats));
 	str = nd_stats_to_json(nd_stats);
 	json = cstring_to_text(str);
 	pfree(str);
@@ -2093,6 +2458,213 @@ Datum _postgis_gserialized_stats(PG_FUNCTION_ARGS)
 }
 
 
+/**
+* Run the batch query and keep a sample of the boxes of the rows
+* it returns, using the same reservoir sampling as ANALYZE does
+* for the table rows. Only non-empty, finite boxes are sampled;
+* the rows and NULLs are counted.
+*/
+static int
+pg_batch_sample_boxes(const char *query, Oid typid, ND_BOX *sample, int target_rows,
+                      double *batch_rows, double *batch_nulls, double *batch_valid)
+{
+	SPIPlanPtr plan;
+	Portal portal;
+	ReservoirStateData rstate;
+	double rowstoskip = -1;
+	int num_sample = 0;
+
+	*batch_rows = *batch_nulls = *batch_valid = 0;
+	reservoir_init_selection_state(&rstate, target_rows);
+
+	if ( SPI_connect() != SPI_OK_CONNECT )
+		elog(ERROR, "%s: could not connect to SPI manager", __func__);
+
+	plan = SPI_prepare(query, 0, NULL);
+	if ( ! plan )
+		elog(ERROR, "%s: could not prepare batch query: %s", __func__, query);
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+
+	while ( true )
+	{
+		uint64 i;
+
+		SPI_cursor_fetch(portal, true, 1000);
+		if ( SPI_processed == 0 )
+			break;
+
+		if ( SPI_gettypeid(SPI_tuptable->tupdesc, 1) != typid )
+			elog(ERROR, "batch query must return the type of the column (%s)", format_type_be(typid));
+
+		for ( i = 0; i < SPI_processed; i++ )
+		{
+			bool is_null;
+			GBOX gbox = {0};
+			ND_BOX nd_box;
+			Datum datum = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &is_null);
+
+			*batch_rows += 1;
+			if ( is_null )
+			{
+				*batch_nulls += 1;
+				continue;
+			}
+			if ( gserialized_datum_get_gbox_p(datum, &gbox) == LW_FAILURE || ! gbox_is_valid(&gbox) )
+				continue;
+
+			nd_box_from_gbox(&gbox, &nd_box);
+			if ( num_sample < target_rows )
+			{
+				sample[num_sample++] = nd_box;
+			}
+			else
+			{
+				if ( rowstoskip < 0 )
+					rowstoskip = reservoir_get_next_S(&rstate, *batch_valid, target_rows);
+				if ( rowstoskip <= 0 )
+				{
+#if POSTGIS_PGSQL_VERSION >= 150
+					int k = (int)(target_rows * sampler_random_fract(&rstate.randstate));
+#else
+					int k = (int)(target_rows * sampler_random_fract(rstate.randstate));
+#endif
+					sample[k] = nd_box;
+				}
+				rowstoskip -= 1;
+			}
+			*batch_valid += 1;
+		}
+		SPI_freetuptable(SPI_tuptable);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	SPI_cursor_close(portal);
+	SPI_finish();
+	return num_sample;
+}
+
+/**
+* Merge the rows returned by a query (typically the rows just loaded
+* into the table) into the 2D and N-D histograms of a table column,
+* so the planner knows about them without waiting for the next
+* ANALYZE of the whole table. See nd_stats_merge_sample.
+*/
+PG_FUNCTION_INFO_V1(_postgis_gserialized_stats_merge);
+Datum _postgis_gserialized_stats_merge(PG_FUNCTION_ARGS)
+{
+	Oid table_oid = PG_GETARG_OID(0);
+	char *att_name = text_to_cstring(PG_GETARG_TEXT_P(1));
+	char *query = text_to_cstring(PG_GETARG_TEXT_P(2));
+	AttrNumber att_num;
+	Relation stats_rel;
+	HeapTuple stats_tuple, new_tuple;
+	Datum values[Natts_pg_statistic];
+	bool nulls[Natts_pg_statistic];
+	bool replaces[Natts_pg_statistic];
+	ND_STATS *nd_stats_2d;
+	ND_BOX *sample;
+	const ND_BOX **sample_boxes;
+	int num_sample, target_rows, k, i;
+	double batch_rows, batch_nulls, batch_valid;
+	bool isnull;
+	float4 nullfrac;
+
+	att_num = get_attnum(table_oid, att_name);
+	if ( ! att_num )
+		elog(ERROR, "attribute \"%s\" does not exist", att_name);
+
+#if POSTGIS_PGSQL_VERSION >= 160
+	if ( ! object_ownercheck(RelationRelationId, table_oid, GetUserId()) )
+#else
+	if ( ! pg_class_ownercheck(table_oid, GetUserId()) )
+#endif
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE, get_rel_name(table_oid));
+
+	/* Sample the new rows as the last ANALYZE sampled the table */
+	nd_stats_2d = pg_get_nd_stats(table_oid, att_num, 2, true);
+	if ( ! nd_stats_2d )
+		elog(ERROR, "stats for \"%s.%s\" do not exist", get_rel_name(table_oid), att_name);
+	target_rows = Max((int)roundf(nd_stats_2d->sample_features), 1);
+	sample = palloc(sizeof(ND_BOX) * target_rows);
+	sample_boxes = palloc(sizeof(ND_BOX*) * target_rows);
+
+	num_sample = pg_batch_sample_boxes(query, get_atttype(table_oid, att_num), sample, target_rows,
+	                                   &batch_rows, &batch_nulls, &batch_valid);
+	if ( ! batch_rows )
+		PG_RETURN_BOOL(false);
+
+	stats_rel = table_open(StatisticRelationId, RowExclusiveLock);
+	stats_tuple = SearchSysCacheCopy3(STATRELATTINH, ObjectIdGetDatum(table_oid),
+	                                  Int16GetDatum(att_num), BoolGetDatum(false));
+	if ( ! HeapTupleIsValid(stats_tuple) )
+		elog(ERROR, "stats for \"%s.%s\" do not exist", get_rel_name(table_oid), att_name);
+
+	memset(values, 0, sizeof(values));
+	memset(nulls, false, sizeof(nulls));
+	memset(replaces, false, sizeof(replaces));
+
+	/* Replace the 2D and N-D histograms, wherever they sit */
+	for ( k = 0; k < STATISTIC_NUM_SLOTS; k++ )
+	{
+		int16 kind = DatumGetInt16(heap_getattr(stats_tuple, Anum_pg_statistic_stakind1 + k,
+		                                        RelationGetDescr(stats_rel), &isnull));
+		int mode;
+		ND_STATS *old, *merged;
+		Datum *numdatums;
+		int num_numbers;
+
+		if ( kind == STATISTIC_KIND_2D || kind == STATISTIC_KIND_2D_EDGES )
+			mode = 2;
+		else if ( kind == STATISTIC_KIND_ND || kind == STATISTIC_KIND_ND_EDGES )
+			mode = 0;
+		else
+			continue;
+
+		old = pg_nd_stats_from_tuple(stats_tuple, mode);
+		for ( i = 0; i < num_sample; i++ )
+			sample_boxes[i] = &sample[i];
+		merged = nd_stats_merge_sample(old, sample_boxes, num_sample, batch_rows, batch_valid);
+		if ( ! merged )
+		{
+			elog(NOTICE, "stats for \"%s.%s\" would grow too large, ANALYZE the table instead",
+			     get_rel_name(table_oid), att_name);
+			heap_freetuple(stats_tuple);
+			table_close(stats_rel, RowExclusiveLock);
+			PG_RETURN_BOOL(false);
+		}
+
+		num_numbers = (sizeof(ND_STATS) + ((int)roundf(merged->histogram_cells) +
+		               nd_stats_num_edges(merged) - 1) * sizeof(float4)) / sizeof(float4);
+		numdatums = palloc(sizeof(Datum) * num_numbers);
+		for ( i = 0; i < num_numbers; i++ )
+			numdatums[i] = Float4GetDatum(((float4*)merged)[i]);
+
+		values[Anum_pg_statistic_stakind1 - 1 + k] =
+		    Int16GetDatum(mode == 2 ? STATISTIC_KIND_2D_EDGES : STATISTIC_KIND_ND_EDGES);
+		replaces[Anum_pg_statistic_stakind1 - 1 + k] = true;
+		values[Anum_pg_statistic_stanumbers1 - 1 + k] =
+		    PointerGetDatum(construct_array(numdatums, num_numbers, FLOAT4OID, sizeof(float4), true, 'i'));
+		replaces[Anum_pg_statistic_stanumbers1 - 1 + k] = true;
+	}
+
+	/* The NULLs of the batch were all counted */
+	nullfrac = DatumGetFloat4(heap_getattr(stats_tuple, Anum_pg_statistic_stanullfrac,
+	                                       RelationGetDescr(stats_rel), &isnull));
+	nullfrac = (nullfrac * nd_stats_2d->table_features + batch_nulls) /
+	           (nd_stats_2d->table_features + batch_rows);
+	values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(nullfrac);
+	replaces[Anum_pg_statistic_stanullfrac - 1] = true;
+
+	new_tuple = heap_modify_tuple(stats_tuple, RelationGetDescr(stats_rel), values, nulls, replaces);
+	CatalogTupleUpdate(stats_rel, &new_tuple->t_self, new_tuple);
+
+	heap_freetuple(new_tuple);
+	heap_freetuple(stats_tuple);
+	table_close(stats_rel, RowExclusiveLock);
+
+	PG_RETURN_BOOL(true);
+}
+
 /**
 * Utility function to read the calculated selectivity for a given search
 * box and table/column. Used for debugging the selectivity code.
@@ -73,6 +73,8 @@ static int g2d_counter_internal = 0;
 */
 Datum box2df_out(PG_FUNCTION_ARGS);
 Datum box2df_in(PG_FUNCTION_ARGS);
+Datum box2dfc_out(PG_FUNCTION_ARGS);
+Datum box2dfc_in(PG_FUNCTION_ARGS);
 
 /*
 ** GiST 2D index function prototypes
@@ -86,6 +88,10 @@ Datum gserialized_gist_union_2d(PG_FUNCTION_ARGS);
 Datum gserialized_gist_same_2d(PG_FUNCTION_ARGS);
 Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS);
 Datum gserialized_gist_sortsupport_2d(PG_FUNCTION_ARGS);
+Datum gserialized_gist_compress_2d_compact(PG_FUNCTION_ARGS);
+Datum gserialized_gist_decompress_2d_compact(PG_FUNCTION_ARGS);
+Datum gserialized_gist_consistent_2d_compact(PG_FUNCTION_ARGS);
+Datum gserialized_gist_distance_2d_compact(PG_FUNCTION_ARGS);
 
 /*
 ** GiST 2D operator prototypes
@@ -1197,6 +1203,251 @@ Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8(distance);
 }
 
+/***********************************************************************
+** Compact 2D keys (gist_geometry_ops_2d_compact).
+**
+** The keys are short varlenas (box2dfc type) holding the BOX2DF with
+** the low mantissa bits of every coordinate dropped, rounding the box
+** outward. A point, whose BOX2DF spans a couple of float steps, is
+** stored as one X and one Y of 28 bits each: with the 1 byte header
+** that is 8 bytes, and the index tuple shrinks from 24 to 16 bytes.
+** Any other box keeps 30 bits per coordinate, 16 bytes with the header,
+** so it still fits in the 24 byte tuple of the plain BOX2DF key.
+**
+** Keys are decompressed into a BOX2DF before GiST hands them to the
+** other support functions, so only compress, decompress, consistent
+** and distance are specific to this opclass. Since the keys are larger
+** than the geometry boxes, leaf matches are always rechecked.
+*/
+
+#define BOX2DFC_POINT_BITS 28
+#define BOX2DFC_BOX_BITS 30
+#define BOX2DFC_POINT_SIZE 7  /* 2 * 28 bits */
+#define BOX2DFC_BOX_SIZE 15   /* 4 * 30 bits */
+
+union box2dfc_float {
+	uint32_t u;
+	float f;
+};
+
+/* Top bits of a float, to be decoded with float_from_prefix_* */
+static inline uint32_t
+float_prefix(float f, int bits)
+{
+	union box2dfc_float v;
+	v.f = f;
+	return v.u >> (32 - bits);
+}
+
+/*
+** Smallest float starting with the prefix. The sign is in the prefix,
+** so for negative values that means filling the dropped bits.
+*/
+static inline float
+float_from_prefix_min(uint32_t prefix, int bits)
+{
+	union box2dfc_float v;
+	uint32_t mask = (1u << (32 - bits)) - 1;
+	v.u = prefix << (32 - bits);
+	if (v.u & 0x80000000u)
+		v.u |= mask;
+	return v.f;
+}
+
+/* Largest float starting with the prefix */
+static inline float
+float_from_prefix_max(uint32_t prefix, int bits)
+{
+	union box2dfc_float v;
+	uint32_t mask = (1u << (32 - bits)) - 1;
+	v.u = prefix << (32 - bits);
+	if (!(v.u & 0x80000000u))
+		v.u |= mask;
+	return v.f;
+}
+
+/* Append the low bits of value to a big-endian bit string */
+static inline void
+bits_put(uint8_t *buf, int *pos, uint32_t value, int bits)
+{
+	int i;
+	for (i = bits - 1; i >= 0; i--, (*pos)++)
+	{
+		if ((value >> i) & 1)
+			buf[*pos / 8] |= 0x80 >> (*pos % 8);
+	}
+}
+
+static inline uint32_t
+bits_get(const uint8_t *buf, int *pos, int bits)
+{
+	int i;
+	uint32_t value = 0;
+	for (i = 0; i < bits; i++, (*pos)++)
+		value = (value << 1) | ((buf[*pos / 8] >> (7 - *pos % 8)) & 1);
+	return value;
+}
+
+/*
+** Compact a BOX2DF into a new box2dfc varlena. Empty boxes have no data.
+*/
+static struct varlena *
+box2df_compact(const BOX2DF *box)
+{
+	struct varlena *key;
+	uint8_t *buf;
+	int pos = 0;
+	size_t size = BOX2DFC_BOX_SIZE;
+	uint32_t x = 0, y = 0;
+
+	if (box2df_is_empty(box))
+		size = 0;
+	else
+	{
+		x = float_prefix(box->xmin, BOX2DFC_POINT_BITS);
+		y = float_prefix(box->ymin, BOX2DFC_POINT_BITS);
+		if (x == float_prefix(box->xmax, BOX2DFC_POINT_BITS) &&
+		    y == float_prefix(box->ymax, BOX2DFC_POINT_BITS))
+			size = BOX2DFC_POINT_SIZE;
+	}
+
+	key = palloc0(VARHDRSZ + size);
+	SET_VARSIZE(key, VARHDRSZ + size);
+	buf = (uint8_t *)VARDATA(key);
+
+	if (size == BOX2DFC_POINT_SIZE)
+	{
+		bits_put(buf, &pos, x, BOX2DFC_POINT_BITS);
+		bits_put(buf, &pos, y, BOX2DFC_POINT_BITS);
+	}
+	else if (size == BOX2DFC_BOX_SIZE)
+	{
+		bits_put(buf, &pos, float_prefix(box->xmin, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		bits_put(buf, &pos, float_prefix(box->xmax, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		bits_put(buf, &pos, float_prefix(box->ymin, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		bits_put(buf, &pos, float_prefix(box->ymax, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+	}
+	return key;
+}
+
+/*
+** Read a box2dfc key, which may have a short header, back into
+** a BOX2DF covering the box it was made from.
+*/
+static void
+box2df_from_compact(const struct varlena *key, BOX2DF *box)
+{
+	const uint8_t *buf = (const uint8_t *)VARDATA_ANY(key);
+	int pos = 0;
+
+	switch (VARSIZE_ANY_EXHDR(key))
+	{
+	case BOX2DFC_POINT_SIZE:
+	{
+		uint32_t x = bits_get(buf, &pos, BOX2DFC_POINT_BITS);
+		uint32_t y = bits_get(buf, &pos, BOX2DFC_POINT_BITS);
+		box->xmin = float_from_prefix_min(x, BOX2DFC_POINT_BITS);
+		box->xmax = float_from_prefix_max(x, BOX2DFC_POINT_BITS);
+		box->ymin = float_from_prefix_min(y, BOX2DFC_POINT_BITS);
+		box->ymax = float_from_prefix_max(y, BOX2DFC_POINT_BITS);
+		break;
+	}
+	case BOX2DFC_BOX_SIZE:
+		box->xmin = float_from_prefix_min(bits_get(buf, &pos, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		box->xmax = float_from_prefix_max(bits_get(buf, &pos, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		box->ymin = float_from_prefix_min(bits_get(buf, &pos, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		box->ymax = float_from_prefix_max(bits_get(buf, &pos, BOX2DFC_BOX_BITS), BOX2DFC_BOX_BITS);
+		break;
+	default:
+		box2df_set_empty(box);
+	}
+}
+
+/*
+** GiST support function. Build the BOX2DF key as the plain opclass
+** does, then compact it. Internal keys come from union and picksplit
+** as BOX2DF and are compacted too.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_compress_2d_compact);
+Datum gserialized_gist_compress_2d_compact(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry_in = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *entry_box = (GISTENTRY*)DatumGetPointer(gserialized_gist_compress_2d(fcinfo));
+	GISTENTRY *entry_out = palloc(sizeof(GISTENTRY));
+	Datum key = entry_box->key;
+
+	if (DatumGetPointer(key))
+		key = PointerGetDatum(box2df_compact((BOX2DF*)DatumGetPointer(key)));
+
+	gistentryinit(*entry_out, key, entry_in->rel, entry_in->page, entry_in->offset, false);
+	PG_RETURN_POINTER(entry_out);
+}
+
+/*
+** GiST support function. Expand a compact key into a BOX2DF.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_decompress_2d_compact);
+Datum gserialized_gist_decompress_2d_compact(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry_in = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *entry_out;
+	BOX2DF *box;
+
+	if (!DatumGetPointer(entry_in->key))
+		PG_RETURN_POINTER(entry_in);
+
+	box = palloc(sizeof(BOX2DF));
+	box2df_from_compact((struct varlena *)DatumGetPointer(entry_in->key), box);
+
+	entry_out = palloc(sizeof(GISTENTRY));
+	gistentryinit(*entry_out, PointerGetDatum(box),
+	              entry_in->rel, entry_in->page, entry_in->offset, entry_in->leafkey);
+	PG_RETURN_POINTER(entry_out);
+}
+
+/*
+** GiST support function. Leaf keys are wider than the geometry boxes,
+** so they can only rule rows out, like internal keys do: every key
+** gets the internal tests, and leaf matches are rechecked.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_consistent_2d_compact);
+Datum gserialized_gist_consistent_2d_compact(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	bool *recheck = (bool *) PG_GETARG_POINTER(4);
+	BOX2DF query_gbox_index;
+
+	*recheck = GIST_LEAF(entry);
+
+	if ( DatumGetPointer(PG_GETARG_DATUM(1)) == NULL ||
+	     DatumGetPointer(entry->key) == NULL )
+		PG_RETURN_BOOL(false);
+
+	if ( gserialized_datum_get_box2df_p(PG_GETARG_DATUM(1), &query_gbox_index) == LW_FAILURE )
+		PG_RETURN_BOOL(false);
+
+	PG_RETURN_BOOL(gserialized_gist_consistent_internal_2d(
+	                   (BOX2DF*)DatumGetPointer(entry->key),
+	                   &query_gbox_index, strategy));
+}
+
+/*
+** GiST support function. Box distances to leaf keys are lower bounds
+** only, so both <-> and <#> are rechecked on leaves.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_distance_2d_compact);
+Datum gserialized_gist_distance_2d_compact(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	bool *recheck = (bool *) PG_GETARG_POINTER(4);
+	Datum distance = gserialized_gist_distance_2d(fcinfo);
+
+	if (GIST_LEAF(entry))
+		*recheck = true;
+	PG_RETURN_DATUM(distance);
+}
+
 /*
 ** Function to pack floats of different realms.
 ** This function serves to pack bit flags inside float type.
@@ -2150,3 +2401,19 @@ Datum box2df_out(PG_FUNCTION_ARGS)
   char *result = box2df_to_string(box);
   PG_RETURN_CSTRING(result);
 }
+
+PG_FUNCTION_INFO_V1(box2dfc_in);
+Datum box2dfc_in(PG_FUNCTION_ARGS)
+{
+	ereport(ERROR,(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+	               errmsg("function box2dfc_in not implemented")));
+	PG_RETURN_POINTER(NULL);
+}
+
+PG_FUNCTION_INFO_V1(box2dfc_out);
+Datum box2dfc_out(PG_FUNCTION_ARGS)
+{
+	BOX2DF box;
+	box2df_from_compact(PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0)), &box);
+	PG_RETURN_CSTRING(box2df_to_string(&box));
+}
@@ -40,6 +40,7 @@
 #include "access/gist.h" /* For GiST */
 #include "access/itup.h"
 #include "access/skey.h"
+#include "utils/sortsupport.h" /* For index building sort support */
 
 #include "../postgis_config.h"
 
@@ -83,6 +84,8 @@ Datum gserialized_gist_union(PG_FUNCTION_ARGS);
 Datum gserialized_gist_same(PG_FUNCTION_ARGS);
 Datum gserialized_gist_distance(PG_FUNCTION_ARGS);
 Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS);
+Datum gserialized_gist_sortsupport(PG_FUNCTION_ARGS);
+Datum gserialized_gist_geog_sortsupport(PG_FUNCTION_ARGS);
 
 /*
 ** ND Operator prototypes
@@ -1264,6 +1267,165 @@ Datum gserialized_gist_same(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(result);
 }
 
+/*
+** Sort key of a GIDX for sorted index builds: the Hilbert code of the
+** X/Y center, as box2df_get_sortable_hash does for 2D keys. Higher
+** dimensions are left to the full comparator.
+*/
+static inline uint64_t
+gidx_get_sortable_hash(const GIDX *b)
+{
+	union floatuint {
+		uint32_t u;
+		float f;
+	} x, y;
+
+	x.f = (GIDX_GET_MAX(b, 0) + GIDX_GET_MIN(b, 0)) / 2;
+	y.f = (GIDX_GET_MAX(b, 1) + GIDX_GET_MIN(b, 1)) / 2;
+
+	return uint32_hilbert(y.u, x.u);
+}
+
+/*
+** Geography keys are boxes on the geocentric unit sphere, where
+** nearby features can have far apart X/Y (across the equator plane),
+** so the Hilbert code is taken on the longitude/latitude of the
+** box center instead.
+*/
+static inline uint64_t
+gidx_get_sortable_hash_geog(const GIDX *b)
+{
+	double x = ((double)GIDX_GET_MAX(b, 0) + GIDX_GET_MIN(b, 0)) / 2;
+	double y = ((double)GIDX_GET_MAX(b, 1) + GIDX_GET_MIN(b, 1)) / 2;
+	double z = GIDX_NDIMS(b) > 2 ? ((double)GIDX_GET_MAX(b, 2) + GIDX_GET_MIN(b, 2)) / 2 : 0.0;
+	double lon = atan2(y, x);
+	double lat = atan2(z, sqrt(x * x + y * y));
+	uint32_t ulon = (uint32_t)((lon + M_PI) / (2 * M_PI) * UINT32_MAX);
+	uint32_t ulat = (uint32_t)((lat + M_PI / 2) / M_PI * UINT32_MAX);
+
+	return uint32_hilbert(ulon, ulat);
+}
+
+static int
+gserialized_gist_cmp_abbrev(Datum x, Datum y, SortSupport ssup)
+{
+	/* Unknown boxes are a special case */
+	if (x == 0 || y == 0 || x == y)
+		return 0; /* 0 means "ask bigger comparator" and not equality*/
+	else if (x > y)
+		return 1;
+	else
+		return -1;
+}
+
+static bool
+gserialized_gist_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	return LW_FALSE;
+}
+
+static Datum
+gserialized_gist_abbrev_convert(Datum original, SortSupport ssup)
+{
+	GIDX *b = (GIDX *)DatumGetPointer(original);
+	if (gidx_is_unknown(b))
+		return 0;
+	return gidx_get_sortable_hash(b);
+}
+
+static Datum
+gserialized_gist_abbrev_convert_geog(Datum original, SortSupport ssup)
+{
+	GIDX *b = (GIDX *)DatumGetPointer(original);
+	if (gidx_is_unknown(b))
+		return 0;
+	return gidx_get_sortable_hash_geog(b);
+}
+
+static inline int
+gidx_cmp_sortable(GIDX *b1, GIDX *b2, bool geodetic)
+{
+	uint64_t hash1, hash2;
+	bool unknown1 = gidx_is_unknown(b1);
+	bool unknown2 = gidx_is_unknown(b2);
+	int cmp;
+
+	/* Unknown boxes go first */
+	if (unknown1 || unknown2)
+		return unknown1 == unknown2 ? 0 : (unknown1 ? -1 : 1);
+
+	hash1 = geodetic ? gidx_get_sortable_hash_geog(b1) : gidx_get_sortable_hash(b1);
+	hash2 = geodetic ? gidx_get_sortable_hash_geog(b2) : gidx_get_sortable_hash(b2);
+	if (hash1 > hash2)
+		return 1;
+	else if (hash1 < hash2)
+		return -1;
+
+	/* Same cell, break the tie on the dimensions and the raw box */
+	if (VARSIZE(b1) != VARSIZE(b2))
+		return VARSIZE(b1) > VARSIZE(b2) ? 1 : -1;
+
+	cmp = memcmp(b1, b2, VARSIZE(b1));
+	if (cmp == 0)
+		return 0;
+	return cmp > 0 ? 1 : -1;
+}
+
+static int
+gserialized_gist_cmp_full(Datum a, Datum b, SortSupport ssup)
+{
+	return gidx_cmp_sortable((GIDX *)DatumGetPointer(a), (GIDX *)DatumGetPointer(b), false);
+}
+
+static int
+gserialized_gist_cmp_full_geog(Datum a, Datum b, SortSupport ssup)
+{
+	return gidx_cmp_sortable((GIDX *)DatumGetPointer(a), (GIDX *)DatumGetPointer(b), true);
+}
+
+/*
+** GiST support function. Sort support for sorted (bulk) index builds,
+** which pack the leaf pages in the sort order instead of inserting
+** every key and splitting pages with picksplit.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_sortsupport);
+Datum gserialized_gist_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
+
+	ssup->comparator = gserialized_gist_cmp_full;
+	ssup->ssup_extra = NULL;
+	/* Enable sortsupport only on 64 bit Datum */
+	if (ssup->abbreviate && sizeof(Datum) == 8)
+	{
+		ssup->comparator = gserialized_gist_cmp_abbrev;
+		ssup->abbrev_converter = gserialized_gist_abbrev_convert;
+		ssup->abbrev_abort = gserialized_gist_abbrev_abort;
+		ssup->abbrev_full_comparator = gserialized_gist_cmp_full;
+	}
+
+	PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(gserialized_gist_geog_sortsupport);
+Datum gserialized_gist_geog_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
+
+	ssup->comparator = gserialized_gist_cmp_full_geog;
+	ssup->ssup_extra = NULL;
+	/* Enable sortsupport only on 64 bit Datum */
+	if (ssup->abbreviate && sizeof(Datum) == 8)
+	{
+		ssup->comparator = gserialized_gist_cmp_abbrev;
+		ssup->abbrev_converter = gserialized_gist_abbrev_convert_geog;
+		ssup->abbrev_abort = gserialized_gist_abbrev_abort;
+		ssup->abbrev_full_comparator = gserialized_gist_cmp_full_geog;
+	}
+
+	PG_RETURN_VOID();
+}
+
 PG_FUNCTION_INFO_V1(gserialized_gist_geog_distance);
 Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS)
 {
@@ -77,6 +77,9 @@
 /* Maximum number of children nodes given that GIDX_MAX_DIM = 4 */
 #define GIDX_MAX_NODES 256
 
+/* Ordering strategy of the geography <-> operator, as in the GiST opclass */
+#define SPGIST_GEOG_DISTANCE_STRATEGY 13
+
 /*
  * ND SP-GiST prototypes
  */
@@ -120,6 +123,10 @@ compareFloats(const void *a, const void *b)
  * The octant is a 16-bit unsigned integer with 8 bits in use. The function
  * accepts 2 GIDX as input. The 8 bits are set by comparing a corner of the
  * box. This makes 256 octants in total.
+ *
+ * Only the centroid decides which dimensions take bits, as nextCubeBox only
+ * knows the centroid. A dimension the box lacks, or has padded with
+ * -+FLT_MAX, is unbounded: above the centroid maximum and below its minimum.
  */
 static uint16_t
 getOctant(const GIDX *centroid, const GIDX *inBox)
@@ -127,17 +134,19 @@ getOctant(const GIDX *centroid, const GIDX *inBox)
 	uint16_t octant = 0, dim = 0x01;
 	int ndims, i;
 
-	ndims = Min(GIDX_NDIMS(centroid), GIDX_NDIMS(inBox));
+	ndims = GIDX_NDIMS(centroid);
 
 	for (i = 0; i < ndims; i++)
 	{
 		/* If the missing dimension was not padded with -+FLT_MAX */
-		if (GIDX_GET_MAX(centroid, i) != FLT_MAX && GIDX_GET_MAX(inBox, i) != FLT_MAX)
+		if (GIDX_GET_MAX(centroid, i) != FLT_MAX)
 		{
-			if (GIDX_GET_MAX(inBox, i) > GIDX_GET_MAX(centroid, i))
+			if (i >= GIDX_NDIMS(inBox) || GIDX_GET_MAX(inBox, i) == FLT_MAX ||
+			    GIDX_GET_MAX(inBox, i) > GIDX_GET_MAX(centroid, i))
 				octant |= dim;
 			dim = dim << 1;
-			if (GIDX_GET_MIN(inBox, i) > GIDX_GET_MIN(centroid, i))
+			if (i < GIDX_NDIMS(inBox) && GIDX_GET_MAX(inBox, i) != FLT_MAX &&
+			    GIDX_GET_MIN(inBox, i) > GIDX_GET_MIN(centroid, i))
 				octant |= dim;
 			dim = dim << 1;
 		}
@@ -188,8 +197,8 @@ nextCubeBox(CubeGIDX *cube_box, GIDX *centroid, uint16_t octant)
 {
 	int ndims = GIDX_NDIMS(centroid), i;
 	CubeGIDX *next_cube_box = (CubeGIDX *)palloc(sizeof(CubeGIDX));
-	GIDX *left = (GIDX *)palloc(GIDX_SIZE(ndims));
-	GIDX *right = (GIDX *)palloc(GIDX_SIZE(ndims));
+	GIDX *left = (GIDX *)palloc(VARSIZE(cube_box->left));
+	GIDX *right = (GIDX *)palloc(VARSIZE(cube_box->right));
 	uint16_t dim = 0x01;
 
 	memcpy(left, cube_box->left, VARSIZE(cube_box->left));
@@ -199,7 +208,8 @@ nextCubeBox(CubeGIDX *cube_box, GIDX *centroid, uint16_t octant)
 
 	for (i = 0; i < ndims; i++)
 	{
-		if (GIDX_GET_MAX(cube_box->left, i) != FLT_MAX && GIDX_GET_MAX(centroid, i) != FLT_MAX)
+		/* Same dimensions as getOctant */
+		if (GIDX_GET_MAX(centroid, i) != FLT_MAX)
 		{
 			if (octant & dim)
 				GIDX_GET_MIN(next_cube_box->right, i) = GIDX_GET_MAX(centroid, i);
@@ -232,7 +242,7 @@ overlapND(CubeGIDX *cube_box, GIDX *query)
 	for (i = 0; i < ndims; i++)
 	{
 		/* If the missing dimension was not padded with -+FLT_MAX */
-		if (GIDX_GET_MAX(cube_box->left, i) != FLT_MAX && GIDX_GET_MAX(query, i) != FLT_MAX)
+		if (GIDX_GET_MAX(query, i) != FLT_MAX)
 			result &= (GIDX_GET_MIN(cube_box->left, i) <= GIDX_GET_MAX(query, i)) &&
 				  (GIDX_GET_MAX(cube_box->right, i) >= GIDX_GET_MIN(query, i));
 	}
@@ -251,13 +261,93 @@ containND(CubeGIDX *cube_box, GIDX *query)
 	for (i = 0; i < ndims; i++)
 	{
 		/* If the missing dimension was not padded with -+FLT_MAX */
-		if (GIDX_GET_MAX(cube_box->left, i) != FLT_MAX && GIDX_GET_MAX(query, i) != FLT_MAX)
+		if (GIDX_GET_MAX(query, i) != FLT_MAX)
 			result &= (GIDX_GET_MAX(cube_box->right, i) >= GIDX_GET_MAX(query, i)) &&
 				  (GIDX_GET_MIN(cube_box->left, i) <= GIDX_GET_MIN(query, i));
 	}
 	return result;
 }
 
+/*
+ * Minimum distance from any box of cube_box to the query box.
+ * Boxes of the cube have their minimums at or above left->min and
+ * their maximums at or below right->max, so the gap on each
+ * dimension can not be smaller than the one to those bounds.
+ * A side still at -+FLT_MAX never makes a gap, only the finite
+ * side of a half-open dimension counts.
+ */
+static double
+distanceND(CubeGIDX *cube_box, GIDX *query)
+{
+	int i, ndims;
+	double sum = 0;
+
+	ndims = Min(GIDX_NDIMS(cube_box->left), GIDX_NDIMS(query));
+
+	for (i = 0; i < ndims; i++)
+	{
+		double d = 0;
+		/* If the missing dimension was not padded with -+FLT_MAX */
+		if (GIDX_GET_MAX(query, i) == FLT_MAX)
+			continue;
+
+		if (GIDX_GET_MAX(cube_box->right, i) < GIDX_GET_MIN(query, i))
+			d = (double)GIDX_GET_MIN(query, i) - GIDX_GET_MAX(cube_box->right, i);
+		else if (GIDX_GET_MIN(cube_box->left, i) > GIDX_GET_MAX(query, i))
+			d = (double)GIDX_GET_MIN(cube_box->left, i) - GIDX_GET_MAX(query, i);
+		sum += d * d;
+	}
+	return sqrt(sum);
+}
+
+/* Distance between a leaf box and the query box */
+static double
+distanceLeafND(GIDX *leaf, GIDX *query)
+{
+	int i, ndims;
+	double sum = 0;
+
+	ndims = Min(GIDX_NDIMS(leaf), GIDX_NDIMS(query));
+
+	for (i = 0; i < ndims; i++)
+	{
+		double d = 0;
+		if (GIDX_GET_MAX(leaf, i) == FLT_MAX || GIDX_GET_MAX(query, i) == FLT_MAX)
+			continue;
+
+		if (GIDX_GET_MAX(leaf, i) < GIDX_GET_MIN(query, i))
+			d = (double)GIDX_GET_MIN(query, i) - GIDX_GET_MAX(leaf, i);
+		else if (GIDX_GET_MIN(leaf, i) > GIDX_GET_MAX(query, i))
+			d = (double)GIDX_GET_MIN(leaf, i) - GIDX_GET_MAX(query, i);
+		sum += d * d;
+	}
+	return sqrt(sum);
+}
+
+/*
+ * Read the boxes of the ORDER BY arguments. Only the geography <->
+ * operator orders an SP-GiST scan; its box distances are on the unit
+ * sphere and get scaled up to compare with the distances of the
+ * recheck, as gserialized_gist_geog_distance does.
+ */
+static GIDX **
+orderbyBoxesND(ScanKey orderbys, int norderbys)
+{
+	GIDX **boxes = palloc(sizeof(GIDX *) * norderbys);
+	int i;
+
+	for (i = 0; i < norderbys; i++)
+	{
+		if (orderbys[i].sk_strategy != SPGIST_GEOG_DISTANCE_STRATEGY)
+			elog(ERROR, "unrecognized strategy number: %d", orderbys[i].sk_strategy);
+
+		boxes[i] = (GIDX *)palloc(GIDX_MAX_SIZE);
+		if (gserialized_datum_get_gidx_p(orderbys[i].sk_argument, boxes[i]) == LW_FAILURE)
+			boxes[i] = NULL;
+	}
+	return boxes;
+}
+
 /*
  * SP-GiST config function
  */
@@ -354,6 +444,13 @@ PGDLLEXPORT Datum gserialized_spgist_picksplit_nd(PG_FUNCTION_ARGS)
 
 	for (dim = 0; dim < maxdims; dim++)
 	{
+		/* No box is bounded on this dimension, pad it as they are */
+		if (count[dim] == 0)
+		{
+			GIDX_SET_MIN(centroid, dim, -1 * FLT_MAX);
+			GIDX_SET_MAX(centroid, dim, FLT_MAX);
+			continue;
+		}
 		median = count[dim] / 2;
 		GIDX_SET_MIN(centroid, dim, lowXs[dim * in->nTuples + median]);
 		GIDX_SET_MAX(centroid, dim, highXs[dim * in->nTuples + median]);
@@ -401,21 +498,17 @@ PGDLLEXPORT Datum gserialized_spgist_inner_consistent_nd(PG_FUNCTION_ARGS)
 	CubeGIDX *cube_box;
 	int *nodeNumbers, i, j;
 	void **traversalValues;
+	double **distances = NULL;
+	GIDX **orderby_boxes = NULL;
 	char gidxmem[GIDX_MAX_SIZE];
 	GIDX *centroid, *query_gbox_index = (GIDX *)gidxmem;
 
 	POSTGIS_DEBUG(4, "[SPGIST] 'inner consistent' function called");
 
-	if (in->allTheSame)
-	{
-		/* Report that all nodes should be visited */
-		out->nNodes = in->nNodes;
-		out->nodeNumbers = (int *)palloc(sizeof(int) * in->nNodes);
-		for (i = 0; i < in->nNodes; i++)
-			out->nodeNumbers[i] = i;
+	centroid = (GIDX *)DatumGetPointer(in->prefixDatum);
 
-		PG_RETURN_VOID();
-	}
+	if (in->norderbys > 0)
+		orderby_boxes = orderbyBoxesND(in->orderbys, in->norderbys);
 
 	/*
 	 * We switch memory context, because we want to allocate memory for new
@@ -424,21 +517,54 @@ PGDLLEXPORT Datum gserialized_spgist_inner_consistent_nd(PG_FUNCTION_ARGS)
 	 */
 	old_ctx = MemoryContextSwitchTo(in->traversalMemoryContext);
 
-	centroid = (GIDX *)DatumGetPointer(in->prefixDatum);
-
 	/*
 	 * We are saving the traversal value or initialize it an unbounded one, if
-	 * we have just begun to walk the tree.
+	 * we have just begun to walk the tree. The root cube has every dimension
+	 * a centroid below it may have.
 	 */
 	if (in->traversalValue)
 		cube_box = in->traversalValue;
 	else
-		cube_box = initCubeBox(GIDX_NDIMS(centroid));
+		cube_box = initCubeBox(GIDX_MAX_DIM);
+
+	if (in->allTheSame)
+	{
+		/*
+		 * Report that all nodes should be visited. The boxes of the node
+		 * were not split by the centroid, so each child keeps the cube of
+		 * the node, and the distance of that cube.
+		 */
+		out->nNodes = in->nNodes;
+		out->nodeNumbers = (int *)palloc(sizeof(int) * in->nNodes);
+		out->traversalValues = (void **)palloc(sizeof(void *) * in->nNodes);
+		if (in->norderbys > 0)
+			out->distances = (double **)palloc(sizeof(double *) * in->nNodes);
+		for (i = 0; i < in->nNodes; i++)
+		{
+			/* The scan frees each traversal value, the bounds can be shared */
+			CubeGIDX *same_cube_box = (CubeGIDX *)palloc(sizeof(CubeGIDX));
+			*same_cube_box = *cube_box;
+			out->nodeNumbers[i] = i;
+			out->traversalValues[i] = same_cube_box;
+			if (in->norderbys > 0)
+			{
+				out->distances[i] = (double *)palloc(sizeof(double) * in->norderbys);
+				for (j = 0; j < in->norderbys; j++)
+					out->distances[i][j] = orderby_boxes[j] ?
+						WGS84_RADIUS * distanceND(cube_box, orderby_boxes[j]) : FLT_MAX;
+			}
+		}
+
+		MemoryContextSwitchTo(old_ctx);
+		PG_RETURN_VOID();
+	}
 
 	/* Allocate enough memory for nodes */
 	out->nNodes = 0;
 	nodeNumbers = (int *)palloc(sizeof(int) * in->nNodes);
 	traversalValues = (void **)palloc(sizeof(void *) * in->nNodes);
+	if (in->norderbys > 0)
+		distances = (double **)palloc(sizeof(double *) * in->nNodes);
 
 	for (i = 0; i < in->nNodes; i++)
 	{
@@ -489,6 +615,13 @@ PGDLLEXPORT Datum gserialized_spgist_inner_consistent_nd(PG_FUNCTION_ARGS)
 
 		if (flag)
 		{
+			if (in->norderbys > 0)
+			{
+				distances[out->nNodes] = (double *)palloc(sizeof(double) * in->norderbys);
+				for (j = 0; j < in->norderbys; j++)
+					distances[out->nNodes][j] = orderby_boxes[j] ?
+						WGS84_RADIUS * distanceND(next_cube_box, orderby_boxes[j]) : FLT_MAX;
+			}
 			traversalValues[out->nNodes] = next_cube_box;
 			nodeNumbers[out->nNodes] = i;
 			out->nNodes++;
@@ -513,6 +646,8 @@ PGDLLEXPORT Datum gserialized_spgist_inner_consistent_nd(PG_FUNCTION_ARGS)
 	}
 	pfree(nodeNumbers);
 	pfree(traversalValues);
+	if (in->norderbys > 0)
+		out->distances = distances;
 
 	/* Switch after */
 	MemoryContextSwitchTo(old_ctx);
@@ -542,6 +677,9 @@ PGDLLEXPORT Datum gserialized_spgist_leaf_consistent_nd(PG_FUNCTION_ARGS)
 	/* leafDatum is what it is... */
 	out->leafValue = in->leafDatum;
 
+	/* Box distances are lower bounds of the geography distances */
+	out->recheckDistances = false;
+
 	/* Perform the required comparison(s) */
 	for (i = 0; i < in->nkeys; i++)
 	{
@@ -589,6 +727,17 @@ PGDLLEXPORT Datum gserialized_spgist_leaf_consistent_nd(PG_FUNCTION_ARGS)
 			break;
 	}
 
+	if (flag && in->norderbys > 0)
+	{
+		GIDX **orderby_boxes = orderbyBoxesND(in->orderbys, in->norderbys);
+
+		out->distances = (double *)palloc(sizeof(double) * in->norderbys);
+		out->recheckDistances = true;
+		for (i = 0; i < in->norderbys; i++)
+			out->distances[i] = orderby_boxes[i] ?
+				WGS84_RADIUS * distanceLeafND(leaf, orderby_boxes[i]) : FLT_MAX;
+	}
+
 	PG_RETURN_BOOL(flag);
 }
 
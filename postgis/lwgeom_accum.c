@@ -38,6 +38,7 @@
 #include "lwgeom_pg.h"
 #include "lwgeom_transform.h"
 #include "lwgeom_accum.h"
+#include "lwgeom_union.h"
 
 /* Local prototypes */
 Datum PGISDirectFunctionCall1(PGFunction func, Datum arg1);
@@ -333,6 +334,34 @@ pgis_geometry_clusterwithin_finalfn(PG_FUNCTION_ARGS)
 
 
 
+/**
+* Put the accumulated geometries of a large state in Hilbert order
+* of their box centers, for the final functions whose result does
+* not depend on the input order.
+*/
+static void
+pgis_accum_sort_hilbert(CollectionBuildState *state)
+{
+	int ngeoms = list_length(state->geoms);
+	LWGEOM **geoms;
+	ListCell *l;
+	int i = 0;
+
+	if (postgis_union_sort_threshold <= 0 || ngeoms < postgis_union_sort_threshold)
+		return;
+
+	geoms = palloc(ngeoms * sizeof(LWGEOM*));
+	foreach (l, state->geoms)
+		geoms[i++] = (LWGEOM*)lfirst(l);
+
+	lwgeom_sort_hilbert(geoms, ngeoms);
+
+	i = 0;
+	foreach (l, state->geoms)
+		lfirst(l) = geoms[i++];
+	pfree(geoms);
+}
+
 /**
 * The "coverage union" final function passes the geometry[] to a
 * GEOSCoverageUnion call before returning the result.
@@ -349,6 +378,7 @@ pgis_geometry_coverageunion_finalfn(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();   /* returns null iff no input values */
 
 	p = (CollectionBuildState*) PG_GETARG_POINTER(0);
+	pgis_accum_sort_hilbert(p);
 
 	geometry_array = pgis_accum_finalfn(p, CurrentMemoryContext, fcinfo);
 	result = PGISDirectFunctionCall1(ST_CoverageUnion, geometry_array);
@@ -27,6 +27,8 @@
 
 #include <assert.h>
 
+#include "utils/builtins.h"
+
 #include "../postgis_config.h"
 #include "lwgeom_geos_prepared.h"
 #include "lwgeom_cache.h"
@@ -345,12 +347,34 @@ PrepGeomCacheAllocator()
 	return (GeomCache*)prepcache;
 }
 
+/**
+* The GEOS objects live outside of the PgSQL memory contexts,
+* so estimate their footprint for the backend cache budget:
+* the coordinates plus the lazily built prepared segment index.
+*/
+static Size
+PrepGeomCacheSize(const GeomCache *cache)
+{
+	const PrepGeomCache* prepcache = (const PrepGeomCache*)cache;
+	int npoints;
+
+	if ( ! prepcache->geom )
+		return 0;
+
+	npoints = GEOSGetNumCoordinates(prepcache->geom);
+	if ( npoints < 0 )
+		return 0;
+
+	return (Size)npoints * 12 * sizeof(double);
+}
+
 static GeomCacheMethods PrepGeomCacheMethods =
 {
 	PREP_CACHE_ENTRY,
 	PrepGeomCacheBuilder,
 	PrepGeomCacheCleaner,
-	PrepGeomCacheAllocator
+	PrepGeomCacheAllocator,
+	PrepGeomCacheSize
 };
 
 
@@ -371,3 +395,27 @@ GetPrepGeomCache(FunctionCallInfo fcinfo, SHARED_GSERIALIZED *g1, SHARED_GSERIAL
 	return (PrepGeomCache*)GetGeomCache(fcinfo, &PrepGeomCacheMethods, g1, g2);
 }
 
+/**
+* Report the counters of the backend geometry cache, as a JSON
+* text. See postgis.geometry_cache_size.
+*/
+PG_FUNCTION_INFO_V1(postgis_geometry_cache_stats);
+Datum postgis_geometry_cache_stats(PG_FUNCTION_ARGS)
+{
+	GeomCacheBackendStats stats;
+	char *str;
+
+	GetGeomCacheBackendStats(&stats);
+	str = psprintf("{\"budget\":" UINT64_FORMAT ",\"bytes\":" UINT64_FORMAT
+	               ",\"entries\":%u,\"hits\":" UINT64_FORMAT ",\"misses\":" UINT64_FORMAT
+	               ",\"builds\":" UINT64_FORMAT ",\"evictions\":" UINT64_FORMAT "}",
+	               (uint64)postgis_geometry_cache_size * 1024,
+	               (uint64)stats.bytes,
+	               stats.entries,
+	               stats.hits,
+	               stats.misses,
+	               stats.builds,
+	               stats.evictions);
+
+	PG_RETURN_TEXT_P(cstring_to_text(str));
+}
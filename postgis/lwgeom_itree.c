@@ -102,7 +102,8 @@ static GeomCacheMethods IntervalTreeCacheMethods =
 	ITREE_CACHE_ENTRY,
 	IntervalTreeBuilder,
 	IntervalTreeFreer,
-	IntervalTreeAllocator
+	IntervalTreeAllocator,
+	NULL
 };
 
 /*
@@ -131,6 +132,102 @@ GetIntervalTree(FunctionCallInfo fcinfo, SHARED_GSERIALIZED *g1)
 	return itree;
 }
 
+/*
+ * Members of a multipoint are classified one at a time first,
+ * so that multipoints decided by their first points do not pay
+ * for a batch. Past ITREE_PIP_BATCH_MIN members they go through
+ * the tree in batches, doubling in size up to ITREE_PIP_BATCH_MAX,
+ * and callers can stop between batches.
+ */
+#define ITREE_PIP_BATCH_MIN 32
+#define ITREE_PIP_BATCH_MAX 4096
+
+typedef struct
+{
+	const IntervalTree *itree;
+	const LWMPOINT *mpoint;
+	uint32_t next;	/* next member to classify */
+	uint32_t size;	/* size of the next batch */
+	POINT2D *pts;
+	IntervalTreeResult *results;
+	IntervalTreeResult result;	/* single member result */
+} ItreePipState;
+
+static void
+itree_pip_multipoint_init(ItreePipState *state, const IntervalTree *itree, const LWMPOINT *mpoint)
+{
+	state->itree = itree;
+	state->mpoint = mpoint;
+	state->next = 0;
+	state->size = ITREE_PIP_BATCH_MIN;
+	state->pts = NULL;
+	state->results = NULL;
+}
+
+static void
+itree_pip_multipoint_free(ItreePipState *state)
+{
+	if (state->pts) pfree(state->pts);
+	if (state->results) pfree(state->results);
+}
+
+/*
+ * Classify the next non-empty members of the multipoint,
+ * returning their results and setting *n, or returning
+ * NULL when all members have been classified.
+ */
+static IntervalTreeResult *
+itree_pip_multipoint_next(ItreePipState *state, uint32_t *n)
+{
+	const LWMPOINT *mpoint = state->mpoint;
+	uint32_t npoints = 0;
+
+	*n = 0;
+
+	/* one at a time */
+	if (state->next < ITREE_PIP_BATCH_MIN)
+	{
+		while (state->next < mpoint->ngeoms)
+		{
+			const LWPOINT *pt = mpoint->geoms[state->next++];
+
+			if (lwpoint_is_empty(pt))
+				continue;
+
+			state->result = itree_point_in_multipolygon(state->itree, pt);
+			*n = 1;
+			return &(state->result);
+		}
+		return NULL;
+	}
+
+	/* in a batch */
+	if (!state->pts)
+	{
+		state->pts = palloc(ITREE_PIP_BATCH_MAX * sizeof(POINT2D));
+		state->results = palloc(ITREE_PIP_BATCH_MAX * sizeof(IntervalTreeResult));
+	}
+
+	while (state->next < mpoint->ngeoms && npoints < state->size)
+	{
+		const LWPOINT *pt = mpoint->geoms[state->next++];
+
+		if (lwpoint_is_empty(pt))
+			continue;
+
+		state->pts[npoints++] = getPoint2d(pt->point, 0);
+	}
+	if (!npoints)
+		return NULL;
+
+	itree_point_in_multipolygon_batch(state->itree, state->pts, npoints, state->results);
+	if (state->size < ITREE_PIP_BATCH_MAX)
+		state->size *= 2;
+
+	*n = npoints;
+	return state->results;
+}
+
 /*
  * A point must be fully inside (not on boundary) of
  * a polygon to be contained. A multipoint must have
@@ -146,29 +243,34 @@ bool itree_pip_contains(const IntervalTree *itree, const LWGEOM *lwpoints)
 	else if (lwgeom_get_type(lwpoints) == MULTIPOINTTYPE)
 	{
 		bool found_completely_inside = false;
-		LWMPOINT *mpoint = lwgeom_as_lwmpoint(lwpoints);
-		for (uint32_t i = 0; i < mpoint->ngeoms; i++)
-		{
-			IntervalTreeResult pip_result;
-			const LWPOINT* pt = mpoint->geoms[i];
+		bool found_outside = false;
+		ItreePipState state;
+		IntervalTreeResult *pip_results;
+		uint32_t npoints;
 
-			if (lwpoint_is_empty(pt))
-				continue;
-			/*
-			 * We need to find at least one point that's completely inside the
-			 * polygons (pip_result == 1).  As long as we have one point that's
-			 * completely inside, we can have as many as we want on the boundary
-			 * itself. (pip_result == 0)
-			 */
-			pip_result = itree_point_in_multipolygon(itree, pt);
-
-			if (pip_result == ITREE_INSIDE)
-				found_completely_inside = true;
-
-			if (pip_result == ITREE_OUTSIDE)
-				return false;
+		itree_pip_multipoint_init(&state, itree, lwgeom_as_lwmpoint(lwpoints));
+		while (!found_outside && (pip_results = itree_pip_multipoint_next(&state, &npoints)))
+		{
+			for (uint32_t i = 0; i < npoints; i++)
+			{
+				/*
+				 * We need to find at least one point that's completely inside the
+				 * polygons (pip_result == 1).  As long as we have one point that's
+				 * completely inside, we can have as many as we want on the boundary
+				 * itself. (pip_result == 0)
+				 */
+				if (pip_results[i] == ITREE_INSIDE)
+					found_completely_inside = true;
+
+				if (pip_results[i] == ITREE_OUTSIDE)
+				{
+					found_outside = true;
+					break;
+				}
+			}
 		}
-		return found_completely_inside;
+		itree_pip_multipoint_free(&state);
+		return found_completely_inside && !found_outside;
 	}
 	else
 	{
@@ -190,18 +292,25 @@ bool itree_pip_covers(const IntervalTree *itree, const LWGEOM *lwpoints)
 	}
 	else if (lwgeom_get_type(lwpoints) == MULTIPOINTTYPE)
 	{
-		LWMPOINT* mpoint = lwgeom_as_lwmpoint(lwpoints);
-		for (uint32_t i = 0; i < mpoint->ngeoms; i++)
-		{
-			const LWPOINT *pt = mpoint->geoms[i];
-
-			if (lwpoint_is_empty(pt))
-				continue;
+		bool covers = true;
+		ItreePipState state;
+		IntervalTreeResult *pip_results;
+		uint32_t npoints;
 
-			if (itree_point_in_multipolygon(itree, pt) == ITREE_OUTSIDE)
-				return false;
+		itree_pip_multipoint_init(&state, itree, lwgeom_as_lwmpoint(lwpoints));
+		while (covers && (pip_results = itree_pip_multipoint_next(&state, &npoints)))
+		{
+			for (uint32_t i = 0; i < npoints; i++)
+			{
+				if (pip_results[i] == ITREE_OUTSIDE)
+				{
+					covers = false;
+					break;
+				}
+			}
 		}
-		return true;
+		itree_pip_multipoint_free(&state);
+		return covers;
 	}
 	else
 	{
@@ -222,18 +331,25 @@ bool itree_pip_intersects(const IntervalTree *itree, const LWGEOM *lwpoints)
 	}
 	else if (lwgeom_get_type(lwpoints) == MULTIPOINTTYPE)
 	{
-		LWMPOINT* mpoint = lwgeom_as_lwmpoint(lwpoints);
-		for (uint32_t i = 0; i < mpoint->ngeoms; i++)
-		{
-			const LWPOINT *pt = mpoint->geoms[i];
-
-			if (lwpoint_is_empty(pt))
-				continue;
+		bool intersects = false;
+		ItreePipState state;
+		IntervalTreeResult *pip_results;
+		uint32_t npoints;
 
-			if (itree_point_in_multipolygon(itree, pt) != ITREE_OUTSIDE)
-				return true;
+		itree_pip_multipoint_init(&state, itree, lwgeom_as_lwmpoint(lwpoints));
+		while (!intersects && (pip_results = itree_pip_multipoint_next(&state, &npoints)))
+		{
+			for (uint32_t i = 0; i < npoints; i++)
+			{
+				if (pip_results[i] != ITREE_OUTSIDE)
+				{
+					intersects = true;
+					break;
+				}
+			}
 		}
-		return false;
+		itree_pip_multipoint_free(&state);
+		return intersects;
 	}
 	else
 	{
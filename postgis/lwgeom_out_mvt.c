@@ -23,8 +23,11 @@
  **********************************************************************/
 
 #include "postgres.h"
+#include "funcapi.h"
 #include "utils/builtins.h"
 #include "executor/spi.h"
+#include "miscadmin.h"
+#include "utils/tuplestore.h"
 #include "../postgis_config.h"
 #include "lwgeom_pg.h"
 #include "lwgeom_log.h"
@@ -279,3 +282,182 @@ Datum pgis_asmvt_combinefn(PG_FUNCTION_ARGS)
 #endif
 }
 
+#ifdef HAVE_LIBPROTOBUF
+/* Write the tiles of the last zoom_min tile to the result */
+static void
+mvt_pyramid_emit(mvt_pyramid_context *ctx, Tuplestorestate *tupstore, TupleDesc tupdesc)
+{
+	MemoryContext old_context;
+	mvt_pyramid_tile_output *tiles;
+	uint32_t n_tiles = 0, i;
+
+	/* The row context is free between rows */
+	old_context = MemoryContextSwitchTo(ctx->row_context);
+	tiles = mvt_pyramid_flush(ctx, &n_tiles);
+	for (i = 0; i < n_tiles; i++)
+	{
+		Datum values[4];
+		bool nulls[4] = {false, false, false, false};
+		values[0] = Int32GetDatum(tiles[i].z);
+		values[1] = Int32GetDatum(tiles[i].x);
+		values[2] = Int32GetDatum(tiles[i].y);
+		values[3] = PointerGetDatum(tiles[i].mvt);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	MemoryContextSwitchTo(old_context);
+	MemoryContextReset(ctx->row_context);
+}
+#endif  /* HAVE_LIBPROTOBUF */
+
+/**
+ * Build the tiles of a range of zoom levels from the rows of a query.
+ *
+ * The rows are sorted on the zoom_min tiles they touch, and the tiles
+ * under a zoom_min tile are written to the result as soon as its rows
+ * are done, so only one such subtree is held in memory.
+ */
+PG_FUNCTION_INFO_V1(ST_AsMVTPyramid);
+Datum ST_AsMVTPyramid(PG_FUNCTION_ARGS)
+{
+#ifndef HAVE_LIBPROTOBUF
+	elog(ERROR, "ST_AsMVTPyramid: Compiled without protobuf-c support");
+	PG_RETURN_NULL();
+#else
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext old_context;
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	mvt_pyramid_context *ctx;
+	int32_t zoom_min, zoom_max, extent, buffer;
+	LWGEOM *bounds;
+	char *query, *sql;
+	SPIPlanPtr plan;
+	Portal portal;
+	int32_t root_x = -1, root_y = -1;
+
+	/* We need to initialize the internal cache to access it later via postgis_oid() */
+	postgis_initialize_cache();
+
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		elog(ERROR, "%s: set-valued function called in context that cannot accept a set", __func__);
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "%s: Query cannot be null", __func__);
+	if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
+		elog(ERROR, "%s: Zoom levels cannot be null", __func__);
+	zoom_min = PG_GETARG_INT32(2);
+	zoom_max = PG_GETARG_INT32(3);
+	if (zoom_min < 0 || zoom_max < zoom_min || zoom_max >= 32)
+		elog(ERROR, "%s: Invalid zoom range, %d to %d", __func__, zoom_min, zoom_max);
+
+	if (PG_ARGISNULL(4))
+		elog(ERROR, "%s: Geometric bounds cannot be null", __func__);
+
+	extent = PG_ARGISNULL(5) ? 4096 : PG_GETARG_INT32(5);
+	if (extent <= 0)
+		elog(ERROR, "%s: Extent must be greater than 0", __func__);
+	buffer = PG_ARGISNULL(6) ? 256 : PG_GETARG_INT32(6);
+	if (buffer < 0)
+		elog(ERROR, "%s: Buffer cannot be negative", __func__);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "%s: return type must be a row type", __func__);
+
+	/* The result lives as long as the query */
+	old_context = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+	MemoryContextSwitchTo(old_context);
+
+	query = text_to_cstring(PG_GETARG_TEXT_P(0));
+
+	ctx = palloc0(sizeof(*ctx));
+	ctx->name = "default";
+	if (!PG_ARGISNULL(1))
+		ctx->name = text_to_cstring(PG_GETARG_TEXT_P(1));
+	ctx->zoom_min = zoom_min;
+	ctx->zoom_max = zoom_max;
+	ctx->extent = extent;
+	ctx->buffer = buffer;
+	ctx->geom_name = NULL;
+	if (!PG_ARGISNULL(7))
+		ctx->geom_name = text_to_cstring(PG_GETARG_TEXT_P(7));
+	ctx->id_name = NULL;
+	if (!PG_ARGISNULL(8))
+		ctx->id_name = text_to_cstring(PG_GETARG_TEXT_P(8));
+
+	/* Recalculate the box from the coordinates, as ST_TileEnvelope does, */
+	/* the serialized box is not precise enough for tile bounds */
+	bounds = lwgeom_from_gserialized(PG_GETARG_GSERIALIZED_P(4));
+	if (lwgeom_calculate_gbox(bounds, &ctx->bounds) != LW_SUCCESS)
+		elog(ERROR, "%s: Unable to compute bbox", __func__);
+	lwgeom_free(bounds);
+
+	ctx->tile_context = AllocSetContextCreate(CurrentMemoryContext, "MVT pyramid tiles", ALLOCSET_DEFAULT_SIZES);
+	ctx->row_context = AllocSetContextCreate(CurrentMemoryContext, "MVT pyramid row", ALLOCSET_DEFAULT_SIZES);
+
+	mvt_pyramid_init_context(ctx);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "%s: could not connect to SPI manager", __func__);
+
+	/* Row type of the query, to find its geometry column */
+	sql = psprintf("SELECT * FROM (%s) mvt_rows LIMIT 0", query);
+	if (SPI_execute(sql, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "%s: could not run query: %s", __func__, query);
+	sql = mvt_pyramid_query(ctx, query, SPI_tuptable->tupdesc);
+	SPI_freetuptable(SPI_tuptable);
+
+	POSTGIS_DEBUGF(3, "%s: %s", __func__, sql);
+	plan = SPI_prepare(sql, 0, NULL);
+	if (!plan)
+		elog(ERROR, "%s: could not prepare query: %s", __func__, query);
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+
+	while (true)
+	{
+		uint64 i;
+
+		SPI_cursor_fetch(portal, true, 1000);
+		if (SPI_processed == 0)
+			break;
+
+		for (i = 0; i < SPI_processed; i++)
+		{
+			HeapTuple tuple = SPI_tuptable->vals[i];
+			TupleDesc rowdesc = SPI_tuptable->tupdesc;
+			bool isnull;
+			Datum row = SPI_getbinval(tuple, rowdesc, 1, &isnull);
+			int32_t x = DatumGetInt32(SPI_getbinval(tuple, rowdesc, 2, &isnull));
+			int32_t y = DatumGetInt32(SPI_getbinval(tuple, rowdesc, 3, &isnull));
+
+			/* Rows come sorted on their zoom_min tile, the previous one is complete */
+			if (x != root_x || y != root_y)
+			{
+				mvt_pyramid_emit(ctx, tupstore, tupdesc);
+				root_x = x;
+				root_y = y;
+			}
+
+			ctx->row = DatumGetHeapTupleHeader(row);
+			mvt_pyramid_add_row(ctx, x, y);
+		}
+		SPI_freetuptable(SPI_tuptable);
+		CHECK_FOR_INTERRUPTS();
+	}
+	mvt_pyramid_emit(ctx, tupstore, tupdesc);
+
+	SPI_cursor_close(portal);
+	mvt_pyramid_free_context(ctx);
+	SPI_finish();
+
+	MemoryContextDelete(ctx->tile_context);
+	MemoryContextDelete(ctx->row_context);
+	MemoryContextSwitchTo(old_context);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	return (Datum) 0;
+#endif
+}
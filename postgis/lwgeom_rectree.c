@@ -36,6 +36,7 @@
 /* Prototypes */
 Datum ST_DistanceRectTree(PG_FUNCTION_ARGS);
 Datum ST_DistanceRectTreeCached(PG_FUNCTION_ARGS);
+Datum ST_DistanceKNN(PG_FUNCTION_ARGS);
 
 
 /**********************************************************************
@@ -102,7 +103,8 @@ static GeomCacheMethods RectTreeCacheMethods =
 	RECT_CACHE_ENTRY,
 	RectTreeBuilder,
 	RectTreeFreer,
-	RectTreeAllocator
+	RectTreeAllocator,
+	NULL
 };
 
 static RectTreeGeomCache *
@@ -200,3 +202,92 @@ Datum ST_DistanceRectTreeCached(PG_FUNCTION_ARGS)
 
 	PG_RETURN_NULL();
 }
+
+
+/**********************************************************************
+* ST_DistanceKNN
+**********************************************************************/
+
+/*
+* The tree finds a point inside an area only for polygonal types.
+* Triangles are built as rings without an inside, and a collection
+* could hold them, so those types are left to lwgeom_mindistance2d.
+*/
+static int
+rect_tree_knn_supported(uint32_t type)
+{
+	switch (type)
+	{
+		case TRIANGLETYPE:
+		case TINTYPE:
+		case POLYHEDRALSURFACETYPE:
+		case COLLECTIONTYPE:
+			return LW_FALSE;
+		default:
+			return LW_TRUE;
+	}
+}
+
+/*
+* Exact distance for the <-> operator. An index scan ordered
+* by <-> hands every candidate row to this function with the
+* same query geometry, so once the query geometry has been seen
+* twice its RECT_NODE tree is kept in the call cache and each
+* candidate only costs a tree over its own edges plus a pruned
+* tree/tree distance search, instead of testing all the edge
+* pairs of the two geometries.
+*/
+PG_FUNCTION_INFO_V1(ST_DistanceKNN);
+Datum ST_DistanceKNN(PG_FUNCTION_ARGS)
+{
+	RectTreeGeomCache *tree_cache;
+	SHARED_GSERIALIZED *shared_geom1 = ToastCacheGetGeometry(fcinfo, 0);
+	SHARED_GSERIALIZED *shared_geom2 = ToastCacheGetGeometry(fcinfo, 1);
+	const GSERIALIZED *g1 = shared_gserialized_get(shared_geom1);
+	const GSERIALIZED *g2 = shared_gserialized_get(shared_geom2);
+	LWGEOM *lwg1, *lwg2;
+	double mindist;
+
+	gserialized_error_if_srid_mismatch(g1, g2, __func__);
+
+	/* Return NULL on empty arguments, as ST_Distance does */
+	if (gserialized_is_empty(g1) || gserialized_is_empty(g2))
+		PG_RETURN_NULL();
+
+	/* Points have no edges to prune, and the tree does not see the */
+	/* inside of triangles, so those are measured the usual way */
+	if ((gserialized_get_type(g1) != POINTTYPE || gserialized_get_type(g2) != POINTTYPE) &&
+	    rect_tree_knn_supported(gserialized_get_type(g1)) &&
+	    rect_tree_knn_supported(gserialized_get_type(g2)))
+	{
+		tree_cache = GetRectTreeGeomCache(fcinfo, shared_geom1, shared_geom2);
+		if (tree_cache && tree_cache->gcache.argnum && tree_cache->index)
+		{
+			RECT_NODE *n_cached = tree_cache->index;
+			LWGEOM *lwg = lwgeom_from_gserialized(tree_cache->gcache.argnum == 1 ? g2 : g1);
+			RECT_NODE *n = rect_tree_from_lwgeom(lwg);
+
+			if (n)
+			{
+				mindist = rect_tree_distance_tree(n, n_cached, 0.0);
+				rect_tree_free(n);
+				lwgeom_free(lwg);
+				if (mindist < FLT_MAX)
+					PG_RETURN_FLOAT8(mindist);
+				PG_RETURN_NULL();
+			}
+			lwgeom_free(lwg);
+		}
+	}
+
+	lwg1 = lwgeom_from_gserialized(g1);
+	lwg2 = lwgeom_from_gserialized(g2);
+	mindist = lwgeom_mindistance2d(lwg1, lwg2);
+	lwgeom_free(lwg1);
+	lwgeom_free(lwg2);
+
+	if (mindist < FLT_MAX)
+		PG_RETURN_FLOAT8(mindist);
+
+	PG_RETURN_NULL();
+}
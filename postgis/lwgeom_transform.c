@@ -27,6 +27,8 @@
 #include "fmgr.h"
 #include "funcapi.h"
 #include "utils/builtins.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
 
 #include "../postgis_config.h"
 #include "liblwgeom.h"
@@ -36,10 +38,13 @@
 
 
 Datum transform(PG_FUNCTION_ARGS);
+Datum transform_batch(PG_FUNCTION_ARGS);
 Datum transform_geom(PG_FUNCTION_ARGS);
 Datum transform_pipeline_geom(PG_FUNCTION_ARGS);
 Datum postgis_proj_version(PG_FUNCTION_ARGS);
 Datum postgis_proj_compiled_version(PG_FUNCTION_ARGS);
+Datum postgis_proj_cache_prewarm(PG_FUNCTION_ARGS);
+Datum postgis_proj_cache_stats(PG_FUNCTION_ARGS);
 Datum LWGEOM_asKML(PG_FUNCTION_ARGS);
 
 /**
@@ -104,6 +109,103 @@ Datum transform(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(result); /* new geometry */
 }
 
+/**
+ * transform_batch( GEOMETRY[], INT (output srid) )
+ * Transforms all the geometries of an array, making one PROJ call
+ * for all the coordinates sharing a source SRID instead of one call
+ * per point array. NULL elements stay NULL.
+ */
+PG_FUNCTION_INFO_V1(transform_batch);
+Datum transform_batch(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	int32 srid_to = PG_GETARG_INT32(1);
+	Oid elmtype = ARR_ELEMTYPE(array);
+	int16 elmlen;
+	bool elmbyval;
+	char elmalign;
+	Datum *elems;
+	bool *nulls;
+	int nelems, i;
+	LWGEOM **lwgeoms, **batch;
+	ArrayType *result;
+
+	if (srid_to == SRID_UNKNOWN)
+	{
+		elog(ERROR, "ST_TransformBatch: %d is an invalid target SRID", SRID_UNKNOWN);
+		PG_RETURN_NULL();
+	}
+
+	get_typlenbyvalalign(elmtype, &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(array, elmtype, elmlen, elmbyval, elmalign, &elems, &nulls, &nelems);
+	if (nelems == 0)
+		PG_RETURN_ARRAYTYPE_P(array);
+
+	lwgeoms = palloc0(sizeof(LWGEOM *) * nelems);
+	batch = palloc(sizeof(LWGEOM *) * nelems);
+
+	/* The coordinates are transformed in place, in copies of the inputs */
+	for (i = 0; i < nelems; i++)
+	{
+		GSERIALIZED *geom;
+		if (nulls[i])
+			continue;
+		geom = (GSERIALIZED *)PG_DETOAST_DATUM_COPY(elems[i]);
+		if (gserialized_get_srid(geom) == SRID_UNKNOWN)
+			elog(ERROR, "ST_TransformBatch: Input geometry has unknown (%d) SRID", SRID_UNKNOWN);
+		lwgeoms[i] = lwgeom_from_gserialized(geom);
+	}
+
+	postgis_initialize_cache();
+
+	/* One batch per source SRID, in the order they first appear */
+	for (i = 0; i < nelems; i++)
+	{
+		int32 srid_from;
+		uint32_t nbatch = 0;
+		LWPROJ *pj;
+		int j;
+
+		if (!lwgeoms[i] || lwgeoms[i]->srid == srid_to)
+			continue;
+
+		srid_from = lwgeoms[i]->srid;
+		for (j = i; j < nelems; j++)
+		{
+			if (lwgeoms[j] && lwgeoms[j]->srid == srid_from)
+			{
+				batch[nbatch++] = lwgeoms[j];
+				lwgeoms[j]->srid = srid_to;
+			}
+		}
+
+		if (lwproj_lookup(srid_from, srid_to, &pj) == LW_FAILURE)
+		{
+			elog(ERROR, "ST_TransformBatch: Failure reading projections from spatial_ref_sys.");
+			PG_RETURN_NULL();
+		}
+		lwgeom_transform_many(batch, nbatch, pj);
+	}
+
+	for (i = 0; i < nelems; i++)
+	{
+		if (!lwgeoms[i])
+			continue;
+
+		/* Re-compute bbox if input had one (COMPUTE_BBOX TAINTING) */
+		if (lwgeoms[i]->bbox)
+			lwgeom_refresh_bbox(lwgeoms[i]);
+
+		elems[i] = PointerGetDatum(geometry_serialize(lwgeoms[i]));
+		lwgeom_free(lwgeoms[i]);
+	}
+
+	result = construct_md_array(elems, nulls, ARR_NDIM(array), ARR_DIMS(array), ARR_LBOUND(array),
+	                            elmtype, elmlen, elmbyval, elmalign);
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
 /**
  * Transform_geom( GEOMETRY, TEXT (input proj4), TEXT (output proj4),
  *	INT (output srid)
@@ -245,6 +347,52 @@ Datum postgis_proj_compiled_version(PG_FUNCTION_ARGS)
   PG_RETURN_POINTER(result);
 }
 
+/**
+* Build the transforms listed in postgis.proj_preload into the
+* backend PROJ cache. Returns the number of transforms built.
+*/
+PG_FUNCTION_INFO_V1(postgis_proj_cache_prewarm);
+Datum postgis_proj_cache_prewarm(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32((int32)lwproj_prewarm(postgis_proj_preload));
+}
+
+/**
+* Report the counters and the entries of the backend PROJ
+* cache, as a JSON text.
+*/
+PG_FUNCTION_INFO_V1(postgis_proj_cache_stats);
+Datum postgis_proj_cache_stats(PG_FUNCTION_ARGS)
+{
+	PROJSRSCache *cache = GetPROJSRSCache();
+	stringbuffer_t sb;
+
+	stringbuffer_init(&sb);
+	stringbuffer_aprintf(&sb,
+		"{\"capacity\":%d,\"entries\":%u,\"hits\":" UINT64_FORMAT
+		",\"misses\":" UINT64_FORMAT ",\"evictions\":" UINT64_FORMAT
+		",\"build_ms\":%.3f,\"transforms\":[",
+		PROJ_CACHE_ITEMS,
+		cache->PROJSRSCacheCount,
+		(uint64)cache->hits,
+		(uint64)cache->misses,
+		(uint64)cache->evictions,
+		cache->build_ms);
+	for (uint32_t i = 0; i < cache->PROJSRSCacheCount; i++)
+	{
+		PROJSRSCacheItem *item = &(cache->PROJSRSCache[i]);
+		stringbuffer_aprintf(&sb,
+			"%s{\"srid_from\":%d,\"srid_to\":%d,\"hits\":" UINT64_FORMAT "}",
+			i ? "," : "",
+			item->srid_from,
+			item->srid_to,
+			(uint64)item->hits);
+	}
+	stringbuffer_append(&sb, "]}");
+
+	PG_RETURN_TEXT_P(cstring_to_text(stringbuffer_getstring(&sb)));
+}
+
 /**
  * Encode feature in KML
  */
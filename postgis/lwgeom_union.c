@@ -19,6 +19,9 @@
 
 #define CheckAggContext() GetAggContext(NULL)
 
+/* GUC, see lwgeom_union.h */
+int postgis_union_sort_threshold = 1000;
+
 
 Datum pgis_geometry_union_parallel_transfn(PG_FUNCTION_ARGS);
 Datum pgis_geometry_union_parallel_combinefn(PG_FUNCTION_ARGS);
@@ -31,6 +34,7 @@ static void state_append(UnionState *state, const GSERIALIZED *gser);
 static bytea* state_serialize(const UnionState *state);
 static UnionState* state_deserialize(const bytea* serialized);
 static void state_combine(UnionState *state1, UnionState *state2);
+static void state_union(UnionState *state);
 
 static LWGEOM* gserialized_list_union(List* list, float8 gridSize);
 
@@ -122,11 +126,23 @@ Datum pgis_geometry_union_parallel_combinefn(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(pgis_geometry_union_parallel_serialfn);
 Datum pgis_geometry_union_parallel_serialfn(PG_FUNCTION_ARGS)
 {
+	MemoryContext aggcontext, old;
 	UnionState *state;
 
-	CheckAggContext();
+	GetAggContext(&aggcontext);
 
 	state = (UnionState*) PG_GETARG_POINTER(0);
+
+	/*
+	 * Serialization only happens when a parallel worker hands its
+	 * partial state to the leader, so union the worker's share of the
+	 * rows here. The leader then only has to union one already
+	 * dissolved piece per worker in the final function.
+	 */
+	old = MemoryContextSwitchTo(aggcontext);
+	state_union(state);
+	MemoryContextSwitchTo(old);
+
 	PG_RETURN_BYTEA_P(state_serialize(state));
 }
 
@@ -265,6 +281,27 @@ void state_combine(UnionState *state1, UnionState *state2)
 }
 
 
+void state_union(UnionState *state)
+{
+	LWGEOM *geom;
+	GSERIALIZED *gser;
+
+	if (list_length(state->list) < 2)
+		return;
+
+	geom = gserialized_list_union(state->list, state->gridSize);
+	if (!geom)
+		return;
+
+	gser = geometry_serialize(geom);
+	lwgeom_free(geom);
+
+	list_free_deep(state->list);
+	state->list = list_make1(gser);
+	state->size = VARSIZE(gser);
+}
+
+
 LWGEOM* gserialized_list_union(List* list, float8 gridSize)
 {
 	int ngeoms = 0;
@@ -310,6 +347,13 @@ LWGEOM* gserialized_list_union(List* list, float8 gridSize)
 
 	if (ngeoms > 0)
 	{
+		/*
+		 * Rows come in table order, put large inputs in spatial
+		 * order so the cascaded union merges neighbours first
+		 */
+		if (postgis_union_sort_threshold > 0 && ngeoms >= postgis_union_sort_threshold)
+			lwgeom_sort_hilbert(geoms, ngeoms);
+
 		/*
 		 * Create a collection and pass it into cascaded union
 		 */
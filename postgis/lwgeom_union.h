@@ -11,4 +11,12 @@ typedef struct UnionState
 	int32 size; /* total size of GSERIAZLIZED values in list in bytes */
 } UnionState;
 
+/*
+* Union inputs of at least this many geometries are put in
+* Hilbert order of their box centers before the cascaded union,
+* so that the pairwise merges combine neighbours.
+* Zero disables the sorting.
+*/
+extern int postgis_union_sort_threshold;
+
 #endif /* _LWGEOM_UNION_H */
@@ -350,6 +350,20 @@ Datum ST_ClusterIntersectingWin(PG_FUNCTION_ARGS)
 }
 
 
+static lwkmeans_method
+kmeans_method(const char *method)
+{
+	if (strcasecmp(method, "auto") == 0 || strcasecmp(method, "hamerly") == 0)
+		return LW_KMEANS_HAMERLY;
+	if (strcasecmp(method, "lloyd") == 0)
+		return LW_KMEANS_LLOYD;
+	if (strcasecmp(method, "minibatch") == 0)
+		return LW_KMEANS_MINIBATCH;
+
+	lwpgerror("Unknown k-means method '%s', use 'auto', 'hamerly', 'lloyd' or 'minibatch'", method);
+	return LW_KMEANS_HAMERLY;
+}
+
 extern Datum ST_ClusterKMeans(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1(ST_ClusterKMeans);
 Datum ST_ClusterKMeans(PG_FUNCTION_ARGS)
@@ -368,6 +382,7 @@ Datum ST_ClusterKMeans(PG_FUNCTION_ARGS)
 		int       i, k, N;
 		bool      isnull, isout;
 		double max_radius = 0.0;
+		lwkmeans_method method = LW_KMEANS_HAMERLY;
 		LWGEOM    **geoms;
 		int       *r;
 		Datum argdatum;
@@ -400,6 +415,14 @@ Datum ST_ClusterKMeans(PG_FUNCTION_ARGS)
 				max_radius = 0.0;
 		}
 
+		/* Clustering algorithm, default if not set */
+		if (PG_NARGS() > 3)
+		{
+			argdatum = WinGetFuncArgCurrent(winobj, 3, &isnull);
+			if (!isnull)
+				method = kmeans_method(text_to_cstring(DatumGetTextP(argdatum)));
+		}
+
 		/* Error out if N < K */
 		if (N<k)
 			lwpgerror("K (%d) must be smaller than the number of rows in the group (%d)", k, N);
@@ -424,7 +447,7 @@ Datum ST_ClusterKMeans(PG_FUNCTION_ARGS)
 		}
 
 		/* Calculate k-means on the list! */
-		r = lwgeom_cluster_kmeans((const LWGEOM **)geoms, N, k, max_radius);
+		r = lwgeom_cluster_kmeans_method((const LWGEOM **)geoms, N, k, max_radius, method);
 
 		/* Clean up */
 		for (i = 0; i < N; i++)
@@ -43,7 +43,13 @@
 
 #include "vector_tile.pb-c.h"
 
-#define FEATURES_CAPACITY_INITIAL 50
+/* Initial size in bytes of the packed features buffer, allocated with the first feature */
+#define FEATURES_BUFFER_INITIAL 1024
+
+/* Protobuf wire tags of the fields written by hand: Tile.layers and Layer.features */
+#define MVT_TILE_LAYERS_TAG ((3 << 3) | 2)
+#define MVT_LAYER_NAME_TAG ((1 << 3) | 2)
+#define MVT_LAYER_FEATURES_TAG ((2 << 3) | 2)
 
 enum mvt_cmd_id
 {
@@ -105,19 +111,78 @@ static void feature_init(struct feature_builder *builder)
 	builder->geometry = NULL;
 }
 
-static VectorTile__Tile__Feature *feature_build(struct feature_builder *builder)
+static size_t varint_size(uint64_t value)
 {
-	VectorTile__Tile__Feature *feature = palloc(sizeof(*feature));
-	vector_tile__tile__feature__init(feature);
-
-	feature->has_id = builder->has_id;
-	feature->id = builder->id;
-	feature->n_tags = builder->n_tags;
-	feature->tags = builder->tags;
-	feature->type = builder->type;
-	feature->n_geometry = builder->n_geometry;
-	feature->geometry = builder->geometry;
-	return feature;
+	size_t size = 1;
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
+
+static size_t varint_pack(uint64_t value, uint8_t *out)
+{
+	size_t size = 0;
+	while (value >= 0x80)
+	{
+		out[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (uint8_t)value;
+	return size;
+}
+
+/* Makes room for size more bytes at the end of the packed features */
+static uint8_t *features_reserve(mvt_agg_context *ctx, size_t size)
+{
+	if (ctx->features_size + size > ctx->features_capacity)
+	{
+		size_t new_capacity = ctx->features_capacity ? ctx->features_capacity * 2 : FEATURES_BUFFER_INITIAL;
+		while (ctx->features_size + size > new_capacity)
+			new_capacity *= 2;
+		if (ctx->features_buffer)
+			ctx->features_buffer = repalloc(ctx->features_buffer, new_capacity);
+		else
+			ctx->features_buffer = palloc(new_capacity);
+		ctx->features_capacity = new_capacity;
+		POSTGIS_DEBUGF(3, "features_reserve new_capacity: %zd", new_capacity);
+	}
+	return ctx->features_buffer + ctx->features_size;
+}
+
+/**
+ * Packs the feature as a Layer.features field at the end of the features
+ * buffer, and frees the arrays of the builder, which are no longer needed.
+ */
+static void feature_pack(mvt_agg_context *ctx, struct feature_builder *builder)
+{
+	VectorTile__Tile__Feature feature;
+	size_t len, header_len;
+	uint8_t *out;
+
+	vector_tile__tile__feature__init(&feature);
+	feature.has_id = builder->has_id;
+	feature.id = builder->id;
+	feature.n_tags = builder->n_tags;
+	feature.tags = builder->tags;
+	feature.type = builder->type;
+	feature.n_geometry = builder->n_geometry;
+	feature.geometry = builder->geometry;
+
+	len = vector_tile__tile__feature__get_packed_size(&feature);
+	header_len = 1 + varint_size(len);
+	out = features_reserve(ctx, header_len + len);
+	out[0] = MVT_LAYER_FEATURES_TAG;
+	varint_pack(len, out + 1);
+	vector_tile__tile__feature__pack(&feature, out + header_len);
+	ctx->features_size += header_len + len;
+	ctx->n_features++;
+
+	pfree(builder->tags);
+	if (builder->geometry)
+		pfree(builder->geometry);
 }
 
 static void feature_add_property(struct feature_builder *builder, uint32_t key_id, uint32_t value_id)
@@ -333,10 +398,34 @@ static uint32_t add_key(mvt_agg_context *ctx, char *name)
 	return kv->id;
 }
 
+/* Position of the geometry column: the one named geom_name, or the first
+ * one of geometry type if no name is given. UINT32_MAX if there is none */
+static uint32_t find_geom_index(TupleDesc tupdesc, const char *geom_name)
+{
+	uint32_t i, natts = tupdesc->natts;
+
+	for (i = 0; i < natts; i++)
+	{
+		Oid typoid = getBaseType(TupleDescAttr(tupdesc, i)->atttypid);
+		char *tkey = TupleDescAttr(tupdesc, i)->attname.data;
+
+		if (typoid == JSONBOID)
+			continue;
+
+		if (geom_name == NULL)
+		{
+			if (typoid == postgis_oid(GEOMETRYOID))
+				return i;
+		}
+		else if (strcmp(tkey, geom_name) == 0)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
 static void parse_column_keys(mvt_agg_context *ctx)
 {
 	uint32_t i, natts;
-	bool geom_found = false;
 
 	POSTGIS_DEBUG(2, "parse_column_keys called");
 
@@ -348,6 +437,10 @@ static void parse_column_keys(mvt_agg_context *ctx)
 	ctx->column_cache.values = palloc(sizeof(Datum) * natts);
 	ctx->column_cache.nulls = palloc(sizeof(bool) * natts);
 
+	ctx->geom_index = find_geom_index(ctx->column_cache.tupdesc, ctx->geom_name);
+	if (ctx->geom_index == UINT32_MAX)
+		elog(ERROR, "parse_column_keys: no geometry column found");
+
 	for (i = 0; i < natts; i++)
 	{
 		Oid typoid = getBaseType(TupleDescAttr(ctx->column_cache.tupdesc, i)->atttypid);
@@ -361,24 +454,8 @@ static void parse_column_keys(mvt_agg_context *ctx)
 			continue;
 		}
 
-		if (ctx->geom_name == NULL)
-		{
-			if (!geom_found && typoid == postgis_oid(GEOMETRYOID))
-			{
-				ctx->geom_index = i;
-				geom_found = true;
-				continue;
-			}
-		}
-		else
-		{
-			if (!geom_found && strcmp(tkey, ctx->geom_name) == 0)
-			{
-				ctx->geom_index = i;
-				geom_found = true;
-				continue;
-			}
-		}
+		if (i == ctx->geom_index)
+			continue;
 
 		if (ctx->id_name &&
 			(ctx->id_index == UINT32_MAX) &&
@@ -393,9 +470,6 @@ static void parse_column_keys(mvt_agg_context *ctx)
 		}
 	}
 
-	if (!geom_found)
-		elog(ERROR, "parse_column_keys: no geometry column found");
-
 	if (ctx->id_name != NULL && ctx->id_index == UINT32_MAX)
 		elog(ERROR, "mvt_agg_transfn: Could not find column '%s' of integer type", ctx->id_name);
 }
@@ -995,7 +1069,10 @@ void mvt_agg_init_context(mvt_agg_context *ctx)
 		elog(ERROR, "mvt_agg_init_context: extent cannot be 0");
 
 	ctx->tile = NULL;
-	ctx->features_capacity = FEATURES_CAPACITY_INITIAL;
+	ctx->features_capacity = 0;
+	ctx->features_buffer = NULL;
+	ctx->features_size = 0;
+	ctx->n_features = 0;
 	ctx->keys_hash = NULL;
 	ctx->string_values_hash = NULL;
 	ctx->float_values_hash = NULL;
@@ -1015,26 +1092,45 @@ void mvt_agg_init_context(mvt_agg_context *ctx)
 	layer->version = 2;
 	layer->name = ctx->name;
 	layer->extent = ctx->extent;
-	layer->features = palloc(ctx->features_capacity * sizeof(*layer->features));
 
 	ctx->layer = layer;
 }
 
+/**
+ * Encode a geometry already in tile coordinates and the properties of
+ * the current row as a feature, and pack it into the layer.
+ */
+static void mvt_agg_add_feature(mvt_agg_context *ctx, LWGEOM *lwgeom)
+{
+	struct feature_builder feature_builder;
+
+	/* Allocate a new feature object */
+	feature_init(&feature_builder);
+
+	/* Set the geometry of the feature */
+	encode_feature_geometry(&feature_builder, lwgeom);
+
+	/* Parse properties */
+	parse_values(ctx, &feature_builder);
+
+	/* Pack the feature into the layer */
+	POSTGIS_DEBUGF(3, "mvt_agg_transfn encoded feature count: %u", ctx->n_features);
+	feature_pack(ctx, &feature_builder);
+}
+
 /**
  * Aggregation step. Parse a row, turn it into a feature, and add it to the layer.
  *
- * Expands features array if needed by a factor of 2.
- * Allocates a new feature, increment feature counter and
- * encode geometry and properties into it.
- */
+ * The feature is packed right away at the end of the features buffer, which
+ * grows by a factor of 2 when needed. Only the packed bytes and the keys and
+ * values tables are kept across rows.
+ */
 void mvt_agg_transfn(mvt_agg_context *ctx)
 {
 	bool isnull = false;
 	Datum datum;
 	GSERIALIZED *gs;
 	LWGEOM *lwgeom;
-	struct feature_builder feature_builder;
-	VectorTile__Tile__Layer *layer = ctx->layer;
 	POSTGIS_DEBUG(2, "mvt_agg_transfn called");
 
 	/* geom_index is the cached index of the geometry. if missing, it needs to be initialized */
@@ -1046,72 +1142,85 @@ void mvt_agg_transfn(mvt_agg_context *ctx)
 	if (isnull) /* Skip rows that have null geometry */
 		return;
 
-	/* Allocate a new feature object */
-	feature_init(&feature_builder);
-
 	/* Deserialize the geometry */
 	gs = (GSERIALIZED *) PG_DETOAST_DATUM(datum);
 	lwgeom = lwgeom_from_gserialized(gs);
 
-	/* Set the geometry of the feature */
-	encode_feature_geometry(&feature_builder, lwgeom);
+	mvt_agg_add_feature(ctx, lwgeom);
 	lwgeom_free(lwgeom);
-	// TODO: free detoasted datum?
+	if ((Pointer) gs != DatumGetPointer(datum))
+		pfree(gs);
+}
 
-	/* Parse properties */
-	parse_values(ctx, &feature_builder);
+/**
+ * Writes the tile of a context filled by mvt_agg_transfn. The layer header
+ * and the key/value tables are packed by protobuf-c, and the features
+ * buffer is spliced in after the layer name, where Layer.features goes in
+ * field number order.
+ */
+static bytea *mvt_ctx_pack_layer(mvt_agg_context *ctx)
+{
+	VectorTile__Tile__Layer *layer = ctx->layer;
+	size_t header_len, name_len, layer_len, len;
+	uint8_t *header, *out;
+	bytea *ba;
 
-	/* Grow the features array of the layer */
-	POSTGIS_DEBUGF(3, "mvt_agg_transfn encoded feature count: %zd", layer->n_features);
-	if (layer->n_features >= ctx->features_capacity)
+	/* The tables are moved out of the hashes once, the final */
+	/* function may be called again on the same context */
+	if (ctx->column_cache.tupdesc)
 	{
-		size_t new_capacity = ctx->features_capacity * 2;
-		layer->features = repalloc(layer->features, new_capacity *
-			sizeof(*layer->features));
-		ctx->features_capacity = new_capacity;
-		POSTGIS_DEBUGF(3, "mvt_agg_transfn new_capacity: %zd", new_capacity);
+		encode_keys(ctx);
+		encode_values(ctx);
 	}
 
-	/* Build and add the feature to the layer */
-	layer->features[layer->n_features++] = feature_build(&feature_builder);
-}
+	/* Zero features => empty bytea output */
+	if (ctx->n_features == 0)
+	{
+		bytea* ba_empty = palloc(VARHDRSZ);
+		SET_VARSIZE(ba_empty, VARHDRSZ);
+		return ba_empty;
+	}
 
-static VectorTile__Tile * mvt_ctx_to_tile(mvt_agg_context *ctx)
-{
-	int n_layers = 1;
-	VectorTile__Tile *tile;
-	encode_keys(ctx);
-	encode_values(ctx);
+	/* The layer without features: name, keys, values, extent, version */
+	header_len = vector_tile__tile__layer__get_packed_size(layer);
+	header = palloc(header_len);
+	vector_tile__tile__layer__pack(layer, header);
 
-	tile = palloc(sizeof(VectorTile__Tile));
-	vector_tile__tile__init(tile);
-	tile->layers = palloc(sizeof(VectorTile__Tile__Layer*) * n_layers);
-	tile->layers[0] = ctx->layer;
-	tile->n_layers = n_layers;
-	return tile;
+	name_len = strlen(layer->name);
+	name_len += 1 + varint_size(name_len);
+	if (header_len < name_len || header[0] != MVT_LAYER_NAME_TAG)
+		elog(ERROR, "%s: unexpected layer header", __func__);
+
+	layer_len = header_len + ctx->features_size;
+	len = VARHDRSZ + 1 + varint_size(layer_len) + layer_len;
+	ba = palloc(len);
+	out = (uint8_t*)VARDATA(ba);
+
+	/* Tile.layers */
+	*out++ = MVT_TILE_LAYERS_TAG;
+	out += varint_pack(layer_len, out);
+
+	memcpy(out, header, name_len);
+	out += name_len;
+	memcpy(out, ctx->features_buffer, ctx->features_size);
+	out += ctx->features_size;
+	memcpy(out, header + name_len, header_len - name_len);
+
+	SET_VARSIZE(ba, len);
+	pfree(header);
+	return ba;
 }
 
 static bytea *mvt_ctx_to_bytea(mvt_agg_context *ctx)
 {
-	/* Fill out the tile slot, if it's not already filled. */
-	/* We should only have a filled slot when all the work of building */
-	/* out the data is complete, so after a serialize/deserialize cycle */
-	/* or after a context combine */
+	/* We only have a filled tile slot after a serialize/deserialize */
+	/* cycle or after a context combine, otherwise the context was */
+	/* filled by the transition function */
 	size_t len;
 	bytea *ba;
 
 	if (!ctx->tile)
-	{
-		ctx->tile = mvt_ctx_to_tile(ctx);
-	}
-
-	/* Zero features => empty bytea output */
-	if (ctx && ctx->layer && ctx->layer->n_features == 0)
-	{
-		bytea* ba_empty = palloc(VARHDRSZ);
-		SET_VARSIZE(ba_empty, VARHDRSZ);
-		return ba_empty;
-	}
+		return mvt_ctx_pack_layer(ctx);
 
 	/* Serialize the Tile */
 	len = VARHDRSZ + vector_tile__tile__get_packed_size(ctx->tile);
@@ -1299,4 +1408,300 @@ bytea *mvt_agg_finalfn(mvt_agg_context *ctx)
 }
 
 
+/* A tile of the pyramid, keyed on its (z, x, y) address */
+struct mvt_pyramid_tile
+{
+	uint32_t zxy[3];
+	mvt_agg_context ctx;
+	UT_hash_handle hh;
+};
+
+/**
+ * Initialize pyramid context.
+ */
+void mvt_pyramid_init_context(mvt_pyramid_context *ctx)
+{
+	POSTGIS_DEBUG(2, "mvt_pyramid_init_context called");
+
+	if (ctx->extent == 0)
+		elog(ERROR, "%s: extent cannot be 0", __func__);
+	if (ctx->zoom_min > ctx->zoom_max || ctx->zoom_max >= 32)
+		elog(ERROR, "%s: Invalid zoom range %u to %u", __func__, ctx->zoom_min, ctx->zoom_max);
+	if (ctx->bounds.xmax - ctx->bounds.xmin <= 0 || ctx->bounds.ymax - ctx->bounds.ymin <= 0)
+		elog(ERROR, "%s: Geometric bounds are too small", __func__);
+
+	memset(&ctx->columns, 0, sizeof(ctx->columns));
+	ctx->columns.name = ctx->name;
+	ctx->columns.extent = ctx->extent;
+	ctx->columns.geom_name = ctx->geom_name;
+	ctx->columns.id_name = ctx->id_name;
+	mvt_agg_init_context(&ctx->columns);
+
+	ctx->tiles_hash = NULL;
+	ctx->n_tiles = 0;
+}
+
+/**
+ * Wrap the query of the pyramid so that it returns every row once for
+ * each zoom_min tile its buffered box touches, as (row, x, y), sorted
+ * on the tile. tupdesc is the row type of the query.
+ */
+char *mvt_pyramid_query(mvt_pyramid_context *ctx, const char *query, TupleDesc tupdesc)
+{
+	uint32_t worldTileSize = 0x01u << ctx->zoom_min;
+	double tileGeoSizeX = (ctx->bounds.xmax - ctx->bounds.xmin) / worldTileSize;
+	double tileGeoSizeY = (ctx->bounds.ymax - ctx->bounds.ymin) / worldTileSize;
+	/* One pixel more than the buffer, as mvt_pyramid_add clips */
+	double margin_x = tileGeoSizeX * (ctx->buffer + 1) / ctx->extent;
+	double margin_y = tileGeoSizeY * (ctx->buffer + 1) / ctx->extent;
+	/* postgis_initialize_cache() must have been called */
+	const char *nsp = quote_identifier(POSTGIS_CONSTANTS->install_nsp);
+	const char *geom;
+	uint32_t geom_index = find_geom_index(tupdesc, ctx->geom_name);
+
+	if (geom_index == UINT32_MAX)
+		elog(ERROR, "%s: no geometry column found", __func__);
+	geom = quote_identifier(NameStr(TupleDescAttr(tupdesc, geom_index)->attname));
+
+	/*
+	 * Only tiles inside the zoom 0 bounds exist. The row number keeps the
+	 * features of each tile in the order of the query, as ST_AsMVT does.
+	 */
+	return psprintf(
+	    "SELECT mvt_input.mvt_rows, mvt_tile_x.mvt_tile_x, mvt_tile_y.mvt_tile_y FROM "
+	    "(SELECT mvt_rows, row_number() OVER () AS mvt_row_number FROM (%s) mvt_rows) mvt_input, "
+	    "generate_series("
+	    "greatest(floor((%s.ST_XMin((mvt_input.mvt_rows).%s) - %.17g - %.17g) / %.17g), 0)::integer, "
+	    "least(floor((%s.ST_XMax((mvt_input.mvt_rows).%s) + %.17g - %.17g) / %.17g), %u)::integer) mvt_tile_x, "
+	    "generate_series("
+	    "greatest(floor((%.17g - %s.ST_YMax((mvt_input.mvt_rows).%s) - %.17g) / %.17g), 0)::integer, "
+	    "least(floor((%.17g - %s.ST_YMin((mvt_input.mvt_rows).%s) + %.17g) / %.17g), %u)::integer) mvt_tile_y "
+	    "ORDER BY 3, 2, mvt_input.mvt_row_number",
+	    query,
+	    nsp, geom, margin_x, ctx->bounds.xmin, tileGeoSizeX,
+	    nsp, geom, margin_x, ctx->bounds.xmin, tileGeoSizeX, worldTileSize - 1,
+	    ctx->bounds.ymax, nsp, geom, margin_y, tileGeoSizeY,
+	    ctx->bounds.ymax, nsp, geom, margin_y, tileGeoSizeY, worldTileSize - 1);
+}
+
+/* Bounds of a tile, computed the same way as ST_TileEnvelope does */
+static void mvt_pyramid_tile_bounds(const mvt_pyramid_context *ctx, uint32_t z, uint32_t x, uint32_t y, GBOX *box)
+{
+	uint32_t worldTileSize = 0x01u << z;
+	double tileGeoSizeX = (ctx->bounds.xmax - ctx->bounds.xmin) / worldTileSize;
+	double tileGeoSizeY = (ctx->bounds.ymax - ctx->bounds.ymin) / worldTileSize;
+
+	gbox_init(box);
+	box->xmin = ctx->bounds.xmin + tileGeoSizeX * x;
+	box->xmax = ctx->bounds.xmin + tileGeoSizeX * (x + 1);
+	box->ymin = ctx->bounds.ymax - tileGeoSizeY * (y + 1);
+	box->ymax = ctx->bounds.ymax - tileGeoSizeY * y;
+}
+
+static mvt_agg_context *mvt_pyramid_get_tile(mvt_pyramid_context *ctx, uint32_t z, uint32_t x, uint32_t y)
+{
+	struct mvt_pyramid_tile *tile;
+	struct mvt_kv_key *kv;
+	uint32_t zxy[3] = {z, x, y};
+
+	HASH_FIND(hh, ctx->tiles_hash, zxy, sizeof(zxy), tile);
+	if (!tile)
+	{
+		tile = palloc0(sizeof(*tile));
+		memcpy(tile->zxy, zxy, sizeof(zxy));
+		tile->ctx.name = ctx->name;
+		tile->ctx.extent = ctx->extent;
+		tile->ctx.geom_name = ctx->geom_name;
+		tile->ctx.id_name = ctx->id_name;
+		mvt_agg_init_context(&tile->ctx);
+
+		/* Share the parsed row type instead of parsing it for every tile. */
+		/* Each tile releases the tuple descriptor when it is packed */
+		tile->ctx.column_cache = ctx->columns.column_cache;
+		PinTupleDesc(tile->ctx.column_cache.tupdesc);
+		tile->ctx.geom_index = ctx->columns.geom_index;
+		tile->ctx.id_index = ctx->columns.id_index;
+		/* Same keys in the same order, so column_keys_index holds for the tile */
+		for (kv = ctx->columns.keys_hash; kv != NULL; kv = kv->hh.next)
+			add_key(&tile->ctx, kv->name);
+
+		HASH_ADD(hh, ctx->tiles_hash, zxy, sizeof(zxy), tile);
+		ctx->n_tiles++;
+	}
+
+	tile->ctx.row = ctx->row;
+	return &tile->ctx;
+}
+
+/**
+ * Add the row geometry to tile (z, x, y) and, below zoom_max, to its
+ * four children. lwgeom, the part of the row geometry around the parent
+ * tile, is cut to the buffered tile in source coordinates, and the
+ * children are cut from that piece, so tiles the row does not reach are
+ * skipped early. The tile itself is built from the whole row geometry:
+ * a cut segment snaps differently, and the tile would no longer match
+ * the one of ST_AsMVTGeom byte for byte.
+ */
+static void mvt_pyramid_add(mvt_pyramid_context *ctx, const LWGEOM *row_geom, LWGEOM *lwgeom,
+			    const GBOX *geom_box, uint32_t z, uint32_t x, uint32_t y)
+{
+	GBOX tile_box, clip_box;
+	LWGEOM *clipped, *tile_geom;
+	double margin_x, margin_y;
+	bool small_geom = false;
+
+	mvt_pyramid_tile_bounds(ctx, z, x, y, &tile_box);
+
+	/* Keep one pixel more than the buffer, so the exact cut is left to mvt_geom */
+	margin_x = (tile_box.xmax - tile_box.xmin) * (ctx->buffer + 1) / ctx->extent;
+	margin_y = (tile_box.ymax - tile_box.ymin) * (ctx->buffer + 1) / ctx->extent;
+	clip_box = tile_box;
+	clip_box.xmin -= margin_x;
+	clip_box.xmax += margin_x;
+	clip_box.ymin -= margin_y;
+	clip_box.ymax += margin_y;
+
+	clipped = mvt_unsafe_clip_by_box(lwgeom, &clip_box);
+	if (!clipped)
+		return;
+
+	/* Same shortcut as ST_AsMVTGeom: lines and polygons under half a pixel
+	 * are dropped, geom_box is only given for those types */
+	if (geom_box)
+	{
+		double half_pixel_x = ((tile_box.xmax - tile_box.xmin) / ctx->extent) / 2.0;
+		double half_pixel_y = ((tile_box.ymax - tile_box.ymin) / ctx->extent) / 2.0;
+		small_geom = (geom_box->xmax - geom_box->xmin) < half_pixel_x &&
+			     (geom_box->ymax - geom_box->ymin) < half_pixel_y;
+	}
+
+	if (!small_geom)
+	{
+		tile_geom = mvt_geom(lwgeom_clone_deep(row_geom), &tile_box, ctx->extent, ctx->buffer, true);
+		if (tile_geom)
+		{
+			MemoryContext old = MemoryContextSwitchTo(ctx->tile_context);
+			mvt_agg_add_feature(mvt_pyramid_get_tile(ctx, z, x, y), tile_geom);
+			MemoryContextSwitchTo(old);
+			lwgeom_free(tile_geom);
+		}
+	}
+
+	if (z < ctx->zoom_max)
+	{
+		uint32_t dx, dy;
+		for (dy = 0; dy < 2; dy++)
+			for (dx = 0; dx < 2; dx++)
+				mvt_pyramid_add(ctx, row_geom, clipped, geom_box, z + 1, 2 * x + dx, 2 * y + dy);
+	}
+
+	if (clipped != lwgeom)
+		lwgeom_free(clipped);
+}
+
+/**
+ * Add the row to zoom_min tile (x, y) and to the tiles under it down
+ * to zoom_max. The row geometry is deserialized once for all of them.
+ * The row type is parsed in the current memory context with the first
+ * row, and must not change.
+ */
+void mvt_pyramid_add_row(mvt_pyramid_context *ctx, uint32_t x, uint32_t y)
+{
+	bool isnull = false;
+	Datum datum;
+	GSERIALIZED *gs;
+	LWGEOM *lwgeom;
+	GBOX box;
+	MemoryContext old;
+	POSTGIS_DEBUG(2, "mvt_pyramid_add_row called");
+
+	if (ctx->columns.geom_index == UINT32_MAX)
+	{
+		ctx->columns.row = ctx->row;
+		parse_column_keys(&ctx->columns);
+	}
+
+	/* Get the geometry column */
+	datum = GetAttributeByNum(ctx->row, ctx->columns.geom_index + 1, &isnull);
+	if (isnull) /* Skip rows that have null geometry */
+		return;
+
+	/* Geometry work happens in a context that is dropped after each row */
+	old = MemoryContextSwitchTo(ctx->row_context);
+
+	gs = (GSERIALIZED *) PG_DETOAST_DATUM(datum);
+	lwgeom = lwgeom_from_gserialized(gs);
+
+	if (!lwgeom_is_empty(lwgeom))
+	{
+		/* Small geometries are measured on the serialized (float) box, as
+		 * ST_AsMVTGeom does, so both drop the same ones at the threshold */
+		uint8_t type = lwgeom->type;
+		bool drop_small = (type == LINETYPE || type == POLYGONTYPE || type == MULTILINETYPE || type == MULTIPOLYGONTYPE) &&
+				  gserialized_fast_gbox_p(gs, &box) == LW_SUCCESS;
+		mvt_pyramid_add(ctx, lwgeom, lwgeom, drop_small ? &box : NULL, ctx->zoom_min, x, y);
+	}
+
+	MemoryContextSwitchTo(old);
+	MemoryContextReset(ctx->row_context);
+}
+
+static int mvt_pyramid_tile_cmp(const void *a, const void *b)
+{
+	const mvt_pyramid_tile_output *ta = a;
+	const mvt_pyramid_tile_output *tb = b;
+	if (ta->z != tb->z)
+		return ta->z < tb->z ? -1 : 1;
+	if (ta->x != tb->x)
+		return ta->x < tb->x ? -1 : 1;
+	if (ta->y != tb->y)
+		return ta->y < tb->y ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Pack the layer of every tile that got a feature since the last flush,
+ * and return them sorted by zoom, x and y. The tiles are then dropped,
+ * so the caller flushes whenever the rows of a zoom_min tile are done.
+ */
+mvt_pyramid_tile_output *mvt_pyramid_flush(mvt_pyramid_context *ctx, uint32_t *n_tiles)
+{
+	struct mvt_pyramid_tile *tile;
+	mvt_pyramid_tile_output *tiles;
+	uint32_t i = 0;
+
+	*n_tiles = ctx->n_tiles;
+	if (ctx->n_tiles == 0)
+		return NULL;
+
+	tiles = palloc(ctx->n_tiles * sizeof(*tiles));
+	for (tile = ctx->tiles_hash; tile != NULL; tile = tile->hh.next)
+	{
+		tiles[i].z = tile->zxy[0];
+		tiles[i].x = tile->zxy[1];
+		tiles[i].y = tile->zxy[2];
+		tiles[i].mvt = mvt_agg_finalfn(&tile->ctx);
+		i++;
+	}
+	qsort(tiles, ctx->n_tiles, sizeof(*tiles), mvt_pyramid_tile_cmp);
+
+	/* The hash table lives in the tile context too */
+	MemoryContextReset(ctx->tile_context);
+	ctx->tiles_hash = NULL;
+	ctx->n_tiles = 0;
+
+	return tiles;
+}
+
+/**
+ * Release the row type held by the pyramid. Tiles not flushed are lost.
+ */
+void mvt_pyramid_free_context(mvt_pyramid_context *ctx)
+{
+	if (ctx->columns.column_cache.tupdesc)
+		ReleaseTupleDesc(ctx->columns.column_cache.tupdesc);
+	memset(&ctx->columns.column_cache, 0, sizeof(ctx->columns.column_cache));
+}
+
+
 #endif
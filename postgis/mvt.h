@@ -72,10 +72,14 @@ typedef struct mvt_agg_context
 	uint32_t geom_index;
 
 	HeapTupleHeader row;
-	/* The layer which stores all the aggregated features. Aggregation can only yield a single layer. */
+	/* The layer header (name, extent, keys and values). Aggregation can only yield a single layer.
+	 * Features are not kept in it, they are packed into features_buffer as rows arrive */
 	VectorTile__Tile__Layer *layer;
-	/* The size of the features array in the layer */
+	/* Packed protobuf bytes of the aggregated features, each one a complete layer field */
+	uint8_t *features_buffer;
+	size_t features_size;
 	size_t features_capacity;
+	uint32_t n_features;
 	/* The cached result of the aggregation. It can only be set once the operation is complete. */
 	VectorTile__Tile *tile;
 
@@ -98,6 +102,44 @@ typedef struct mvt_agg_context
 	mvt_column_cache column_cache;
 } mvt_agg_context;
 
+/* One tile of a pyramid, as returned by mvt_pyramid_flush */
+typedef struct mvt_pyramid_tile_output
+{
+	uint32_t z;
+	uint32_t x;
+	uint32_t y;
+	bytea *mvt;
+} mvt_pyramid_tile_output;
+
+typedef struct mvt_pyramid_context
+{
+	/* Layer options, shared by all the tiles */
+	char *name;
+	uint32_t extent;
+	uint32_t buffer;
+	char *id_name;
+	char *geom_name;
+
+	/* Bounds of the zoom 0 tile, and the zoom levels to fill */
+	GBOX bounds;
+	uint32_t zoom_min;
+	uint32_t zoom_max;
+
+	/* Context of the tiles, and a scratch one reset for every row */
+	MemoryContext tile_context;
+	MemoryContext row_context;
+
+	HeapTupleHeader row;
+
+	/* The row type, parsed with the first row. Its column cache and keys
+	 * are shared by all the tiles */
+	mvt_agg_context columns;
+
+	/* Hash table of the tiles that got at least one feature */
+	struct mvt_pyramid_tile *tiles_hash;
+	uint32_t n_tiles;
+} mvt_pyramid_context;
+
 /* Prototypes */
 LWGEOM *mvt_geom(LWGEOM *geom, const GBOX *bounds, uint32_t extent, uint32_t buffer, bool clip_geom);
 void mvt_agg_init_context(mvt_agg_context *ctx);
@@ -106,6 +148,11 @@ bytea *mvt_agg_finalfn(mvt_agg_context *ctx);
 bytea *mvt_ctx_serialize(mvt_agg_context *ctx);
 mvt_agg_context * mvt_ctx_deserialize(const bytea *ba);
 mvt_agg_context * mvt_ctx_combine(mvt_agg_context *ctx1, mvt_agg_context *ctx2);
+void mvt_pyramid_init_context(mvt_pyramid_context *ctx);
+char *mvt_pyramid_query(mvt_pyramid_context *ctx, const char *query, TupleDesc tupdesc);
+void mvt_pyramid_add_row(mvt_pyramid_context *ctx, uint32_t x, uint32_t y);
+mvt_pyramid_tile_output *mvt_pyramid_flush(mvt_pyramid_context *ctx, uint32_t *n_tiles);
+void mvt_pyramid_free_context(mvt_pyramid_context *ctx);
 
 
 #endif  /* HAVE_LIBPROTOBUF */
@@ -34,6 +34,9 @@
 
 #include "lwgeom_log.h"
 #include "lwgeom_pg.h"
+#include "lwgeom_cache.h"
+#include "lwgeom_union.h"
+#include "lwgeom_transform.h"
 #include "geos_c.h"
 
 #ifdef HAVE_LIBPROTOBUF
@@ -99,6 +102,25 @@ pjLogFunction(void* data, int logLevel, const char* message)
 }
 #endif
 
+/*
+ * Reject postgis.proj_preload values that are not a list
+ * of SRID pairs, the SRIDs themselves are checked when the
+ * transforms get built.
+ */
+static bool
+check_proj_preload(char **newval, void **extra, GucSource source)
+{
+	int32_t pairs[2 * PROJ_CACHE_ITEMS];
+	uint32_t npairs;
+
+	if (lwproj_parse_pairs(*newval, pairs, PROJ_CACHE_ITEMS, &npairs) == LW_FAILURE)
+	{
+		GUC_check_errdetail("Expected a list of at most %d from_srid:to_srid pairs separated by commas.", PROJ_CACHE_ITEMS);
+		return false;
+	}
+	return true;
+}
+
 /*
  * Module load callback
  */
@@ -116,6 +138,75 @@ _PG_init(void)
 	/* Install PostgreSQL error/memory handlers */
 	pg_install_lwgeom_handlers();
 
+	if ( postgis_guc_find_option("postgis.geometry_cache_size") )
+	{
+		/* In this narrow case the previously installed GUC is tied to the callback in */
+		/* the previously loaded library. Probably this is happening during an */
+		/* upgrade, so the old library is where the callback ties to. */
+		elog(WARNING, "'%s' is already set and cannot be changed until you reconnect", "postgis.geometry_cache_size");
+	}
+	else
+	{
+		DefineCustomIntVariable(
+			"postgis.geometry_cache_size", /* name */
+			"Memory budget of the backend geometry index cache.", /* short_desc */
+			"Prepared geometries and index trees of geometries used repeatedly are kept across statements, up to this much memory per backend. Zero disables the cache.", /* long_desc */
+			&postgis_geometry_cache_size, /* valueAddr */
+			0, /* bootValue */
+			0, /* minValue */
+			MAX_KILOBYTES, /* maxValue */
+			PGC_USERSET, /* GucContext context */
+			GUC_UNIT_KB, /* int flags */
+			NULL, /* GucIntCheckHook check_hook */
+			NULL, /* GucIntAssignHook assign_hook */
+			NULL  /* GucShowHook show_hook */
+		);
+	}
+
+	if ( postgis_guc_find_option("postgis.union_sort_threshold") )
+	{
+		/* See the note on postgis.geometry_cache_size above */
+		elog(WARNING, "'%s' is already set and cannot be changed until you reconnect", "postgis.union_sort_threshold");
+	}
+	else
+	{
+		DefineCustomIntVariable(
+			"postgis.union_sort_threshold", /* name */
+			"Number of inputs from which ST_Union sorts them spatially.", /* short_desc */
+			"Union aggregates with at least this many inputs put them in Hilbert order of their box centers before the cascaded union. Zero disables the sorting.", /* long_desc */
+			&postgis_union_sort_threshold, /* valueAddr */
+			1000, /* bootValue */
+			0, /* minValue */
+			INT_MAX, /* maxValue */
+			PGC_USERSET, /* GucContext context */
+			0, /* int flags */
+			NULL, /* GucIntCheckHook check_hook */
+			NULL, /* GucIntAssignHook assign_hook */
+			NULL  /* GucShowHook show_hook */
+		);
+	}
+
+	if ( postgis_guc_find_option("postgis.proj_preload") )
+	{
+		/* See the note on postgis.geometry_cache_size above */
+		elog(WARNING, "'%s' is already set and cannot be changed until you reconnect", "postgis.proj_preload");
+	}
+	else
+	{
+		DefineCustomStringVariable(
+			"postgis.proj_preload", /* name */
+			"SRID pairs whose transforms postgis_proj_cache_prewarm() builds.", /* short_desc */
+			"A list of from_srid:to_srid pairs, separated by commas. Building a transform can take tens of milliseconds, prewarming moves that cost to connection setup.", /* long_desc */
+			&postgis_proj_preload, /* valueAddr */
+			"", /* bootValue */
+			PGC_USERSET, /* GucContext context */
+			GUC_LIST_INPUT, /* int flags */
+			check_proj_preload, /* GucStringCheckHook check_hook */
+			NULL, /* GucStringAssignHook assign_hook */
+			NULL  /* GucShowHook show_hook */
+		);
+	}
+
 #if POSTGIS_PROJ_VERSION > 60000
 	/* Pass proj messages through the pgsql error handler */
 	proj_log_func(NULL, NULL, pjLogFunction);
@@ -153,11 +153,13 @@ typedef struct rt_histogram_t* rt_histogram;
 typedef struct rt_quantile_t* rt_quantile;
 typedef struct rt_valuecount_t* rt_valuecount;
 typedef struct rt_gdaldriver_t* rt_gdaldriver;
+typedef struct rt_gdal_cache_stats_t* rt_gdal_cache_stats;
 typedef struct rt_reclassexpr_t* rt_reclassexpr;
 typedef struct rt_reclassmap_t* rt_reclassmap;
 
 typedef struct rt_iterator_t* rt_iterator;
 typedef struct rt_iterator_arg_t* rt_iterator_arg;
+typedef struct rt_iterator_rows_arg_t* rt_iterator_rows_arg;
 
 typedef struct rt_colormap_entry_t* rt_colormap_entry;
 typedef struct rt_colormap_t* rt_colormap;
@@ -617,6 +619,29 @@ void rt_band_set_ownsdata_flag(rt_band band, int flag);
 	*/
 void* rt_band_get_data(rt_band band);
 
+/**
+	* Get pointer to pixels of band data, starting at pixel (x, y).
+	* For an out-db band whose data is not loaded, only the blocks
+	* of the out-db raster holding the pixels are read. Read blocks
+	* are internally owned and released when the band is destroyed
+	* or its whole data is loaded.
+	*
+	* @param band : the band who's data to get
+	* @param x : column of the first pixel (0-based)
+	* @param y : line of the first pixel (0-based)
+	* @param len : number of pixels wanted
+	* @param nvals : if not NULL, set to the number of contiguous
+	* pixels at the returned pointer, between 1 and len
+	*
+	* @return pointer to pixel (x, y) or NULL if error
+	*/
+uint8_t* rt_band_get_data_line(
+	rt_band band,
+	int x, int y,
+	uint16_t len,
+	uint16_t *nvals
+);
+
 /**
 	* Load offline band's data.  Loaded data is internally owned
 	* and should not be released by the caller.  Data will be
@@ -1002,6 +1027,8 @@ rt_valuecount rt_band_get_value_count(
  * @param exprset : array of rt_reclassexpr structs
  * @param exprcount : number of elements in expr
  *
+ * Rows are reclassified on up to postgis.raster_threads threads.
+ *
  * @return a new rt_band or NULL on error
  */
 rt_band rt_band_reclass(
@@ -2186,6 +2213,74 @@ rt_raster_iterator(
 	rt_raster *rtnraster
 );
 
+/**
+ * n-raster iterator splitting the output raster into strips of rows
+ * processed concurrently on up to postgis.raster_threads threads.
+ * Takes the same parameters as rt_raster_iterator().
+ *
+ * The callback is called from threads other than the calling one
+ * so it _must_ be thread-safe: no rtalloc(), rterror() or anything
+ * else going through the raster core handlers, and userarg is
+ * shared read-only by all threads.
+ *
+ * @return ES_NONE on success, ES_ERROR on error
+ */
+rt_errorstate
+rt_raster_iterator_parallel(
+	rt_iterator itrset, uint16_t itrcount,
+	rt_extenttype extenttype, rt_raster customextent,
+	rt_pixtype pixtype,
+	uint8_t hasnodata, double nodataval,
+	uint16_t distancex, uint16_t distancey,
+	rt_mask mask,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_arg arg,
+		void *userarg,
+		double *value,
+		int *nodata
+	),
+	rt_raster *rtnraster
+);
+
+/**
+ * n-raster iterator calling back once per row.  Returns a raster
+ * with one band.  Takes the same parameters as rt_raster_iterator()
+ * except for mask, and the callback is handed whole rows of the
+ * input rasters as contiguous arrays of values and NODATA flags.
+ *
+ * The callback function _must_ have the following signature.
+ *
+ *    int FNAME(rt_iterator_rows_arg arg, void *userarg, double *values, uint8_t *nodata)
+ *
+ * The callback function _must_ return zero (error) or non-zero (success)
+ * indicating whether the function ran successfully.
+ * The parameters passed to the callback function are as follows.
+ *
+ * - rt_iterator_rows_arg arg : struct containing rows of pixel values, NODATA flags and metadata
+ * - void *userarg : NULL or calling function provides to rt_raster_iterator_rows() for use by callback function
+ * - double *values : values of the arg->columns pixels of the row to be burned
+ * - uint8_t *nodata : flags (0 or 1) indicating that the pixels to be burned are NODATA
+ *
+ * @return ES_NONE on success, ES_ERROR on error
+ */
+rt_errorstate
+rt_raster_iterator_rows(
+	rt_iterator itrset, uint16_t itrcount,
+	rt_extenttype extenttype, rt_raster customextent,
+	rt_pixtype pixtype,
+	uint8_t hasnodata, double nodataval,
+	uint16_t distancex, uint16_t distancey,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	),
+	rt_raster *rtnraster
+);
+
 /**
  * Returns a new raster with up to four 8BUI bands (RGBA) from
  * applying a colormap to the user-specified band of the
@@ -2219,6 +2314,20 @@ extern void rtdealloc(void *mem);
 #define GDAL_DISABLE_ALL "DISABLE_ALL"
 #define GDAL_VSICURL "VSICURL"
 
+/*
+ * Upper limit of postgis.raster_threads, the worker threads
+ * used by rt_raster_iterator_parallel() and rt_band_reclass()
+ */
+
+#define POSTGIS_RT_MAX_THREADS 64
+
+/*
+ * Upper limit of postgis.outdb_max_open_files, the out-db datasets
+ * kept open by rt_util_gdal_cache_open()
+ */
+
+#define POSTGIS_RT_MAX_OPEN_FILES 256
+
 /*
  * Set of functions to clamp double to int of different size
  */
@@ -2360,6 +2469,54 @@ rt_util_gdal_driver_registered(const char *drv);
 GDALDatasetH
 rt_util_gdal_open(const char *fn, GDALAccess fn_access, int shared);
 
+/**
+ * Open an out-db raster read-only through the per-process dataset
+ * cache. Handles stay open between calls, up to the limit given by
+ * the "outdb_max_open_files" option, and are reopened when the file's
+ * modification time or size changes. A limit of 0 disables the cache.
+ * The cache is not thread-safe: call it from the main thread only.
+ *
+ * @param fn : path of the out-db raster
+ *
+ * @return GDAL dataset to release with rt_util_gdal_cache_close(),
+ * or NULL on error
+ */
+GDALDatasetH
+rt_util_gdal_cache_open(const char *fn);
+
+/**
+ * Release a dataset returned by rt_util_gdal_cache_open()
+ *
+ * @param ds : the dataset to release
+ */
+void
+rt_util_gdal_cache_close(GDALDatasetH ds);
+
+/**
+ * Drop every reference held on cached datasets. Call it when no
+ * caller can still be using one, e.g. at transaction end, so that
+ * references leaked by an error raised between
+ * rt_util_gdal_cache_open() and rt_util_gdal_cache_close() do not
+ * pin their datasets forever.
+ */
+void
+rt_util_gdal_cache_release_all(void);
+
+/**
+ * Close every cached dataset. Must be called before the GDAL
+ * driver manager is destroyed.
+ */
+void
+rt_util_gdal_cache_flush(void);
+
+/**
+ * Get the counters of the out-db dataset cache
+ *
+ * @param stats : structure to fill
+ */
+void
+rt_util_gdal_cache_get_stats(rt_gdal_cache_stats stats);
+
 void
 rt_util_from_ogr_envelope(
 	OGREnvelope	env,
@@ -2479,6 +2636,26 @@ struct rt_extband_t {
     uint8_t bandNum; /* 0-based */
     char* path; /* internally owned */
 		void *mem; /* loaded external band data, internally owned */
+		struct rt_extband_blocks_t *blocks; /* blocks read by rt_band_get_data_line, internally owned */
+};
+
+/* blocks of an out-db band, see rt_band_get_data_line() */
+struct rt_extband_blocks_t {
+	/* position of the band's upper-left pixel in the out-db band */
+	int srcx;
+	int srcy;
+
+	/* block size of the out-db band */
+	int xsize;
+	int ysize;
+
+	/* number of blocks covering the band */
+	int nx;
+	int ny;
+
+	/* nx * ny blocks, NULL until read. each block holds the pixels
+	   of the band inside it, row by row */
+	uint8_t **block;
 };
 
 struct rt_band_t {
@@ -2630,6 +2807,9 @@ struct rt_iterator_t {
 	uint8_t nbnodata; /* no band = treat as NODATA  */
 };
 
+/* size of the buffer a raster iterator callback may write its error to */
+#define RT_ITERATOR_ERROR_SIZE 256
+
 /* callback argument from raster iterator */
 struct rt_iterator_arg_t {
 	/* # of rasters, Z-axis */
@@ -2650,6 +2830,40 @@ struct rt_iterator_arg_t {
 
 	/* X,Y of pixel from output raster */
 	int dst_pixel[2];
+
+	/*
+		RT_ITERATOR_ERROR_SIZE bytes where a callback returning an error
+		may write why, reported by the calling thread
+	*/
+	char *error;
+};
+
+/* callback argument from row raster iterator */
+struct rt_iterator_rows_arg_t {
+	/* # of rasters, Z-axis */
+	uint16_t rasters;
+	/* # of rows, Y-axis */
+	uint32_t rows;
+	/* # of columns of output row, X-axis */
+	uint32_t columns;
+	/* # of pixels padding each side of the rows */
+	uint16_t distancex;
+
+	/*
+		axis order: Z,Y,X
+		rows around the output row, each of columns + 2 * distancex pixels
+		so that the neighborhood of output pixel x starts at column x
+	*/
+	/* pixel values, 0 if NODATA */
+	double ***values;
+	/* 0,1 value of nodata flag */
+	uint8_t ***nodata;
+
+	/* X,Y of first pixel of output row from each input raster */
+	int **src_pixel;
+
+	/* Y of output row */
+	int dst_row;
 };
 
 /* gdal driver information */
@@ -2662,6 +2876,16 @@ struct rt_gdaldriver_t {
 	uint8_t can_write;
 };
 
+/* out-db dataset cache counters */
+struct rt_gdal_cache_stats_t {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stale;
+	uint64_t evictions;
+	uint32_t entries;
+	uint32_t capacity;
+};
+
 /* raster colormap entry */
 struct rt_colormap_entry_t {
 	int isnodata;
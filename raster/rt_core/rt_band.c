@@ -324,6 +324,7 @@ rt_band_new_offline(
 	band->data.offline.path[pathlen] = '\0';
 
 	band->data.offline.mem = NULL;
+	band->data.offline.blocks = NULL;
 
 	return band;
 }
@@ -365,7 +366,7 @@ rt_band_new_offline_from_path(
 
 	/* open outdb raster file */
 	rt_util_gdal_register_all(0);
-	hdsSrc = rt_util_gdal_open(path, GA_ReadOnly, 1);
+	hdsSrc = rt_util_gdal_cache_open(path);
 	if (hdsSrc == NULL && !force) {
 		rterror("rt_band_new_offline_from_path: Cannot open offline raster: %s", path);
 		return NULL;
@@ -373,40 +374,40 @@ rt_band_new_offline_from_path(
 
 	nband = GDALGetRasterCount(hdsSrc);
 	if (!nband && !force) {
+		rt_util_gdal_cache_close(hdsSrc);
 		rterror("rt_band_new_offline_from_path: No bands found in offline raster: %s", path);
-		GDALClose(hdsSrc);
 		return NULL;
 	}
 	/* bandNum is 1-based */
 	else if (bandNum > nband && !force) {
+		rt_util_gdal_cache_close(hdsSrc);
 		rterror(
 			"rt_band_new_offline_from_path: Specified band %d not found in offline raster: %s",
 			bandNum,
 			path
 		);
-		GDALClose(hdsSrc);
 		return NULL;
 	}
 
 	hbandSrc = GDALGetRasterBand(hdsSrc, bandNum);
 	if (hbandSrc == NULL && !force) {
+		rt_util_gdal_cache_close(hdsSrc);
 		rterror(
 			"rt_band_new_offline_from_path: Cannot get band %d from GDAL dataset",
 			bandNum
 		);
-		GDALClose(hdsSrc);
 		return NULL;
 	}
 
 	gdpixtype = GDALGetRasterDataType(hbandSrc);
 	pt = rt_util_gdal_datatype_to_pixtype(gdpixtype);
 	if (pt == PT_END && !force) {
+		rt_util_gdal_cache_close(hdsSrc);
 		rterror(
 			"rt_band_new_offline_from_path: Unsupported pixel type %s of band %d from GDAL dataset",
 			GDALGetDataTypeName(gdpixtype),
 			bandNum
 		);
-		GDALClose(hdsSrc);
 		return NULL;
 	}
 
@@ -414,7 +415,7 @@ rt_band_new_offline_from_path(
 	if (!hasnodata)
 		nodataval = GDALGetRasterNoDataValue(hbandSrc, &hasnodata);
 
-	GDALClose(hdsSrc);
+	rt_util_gdal_cache_close(hdsSrc);
 
 	return rt_band_new_offline(
 		width, height,
@@ -482,6 +483,25 @@ rt_band_is_offline(rt_band band) {
 	return band->offline ? 1 : 0;
 }
 
+/* free blocks read by rt_band_get_data_line() */
+static void
+_rti_band_offline_blocks_destroy(rt_band band) {
+	struct rt_extband_blocks_t *blocks = band->data.offline.blocks;
+	int i;
+
+	if (blocks == NULL)
+		return;
+
+	for (i = 0; i < blocks->nx * blocks->ny; i++) {
+		if (blocks->block[i] != NULL)
+			rtdealloc(blocks->block[i]);
+	}
+	rtdealloc(blocks->block);
+	rtdealloc(blocks);
+
+	band->data.offline.blocks = NULL;
+}
+
 /**
  * Destroy a raster band
  *
@@ -499,6 +519,8 @@ rt_band_destroy(rt_band band) {
 		/* memory cache */
 		if (band->data.offline.mem != NULL)
 			rtdealloc(band->data.offline.mem);
+		/* blocks read by rt_band_get_data_line */
+		_rti_band_offline_blocks_destroy(band);
 		/* offline file path */
 		if (band->data.offline.path != NULL)
 			rtdealloc(band->data.offline.path);
@@ -567,26 +589,23 @@ rt_band_get_data(rt_band band) {
 /* variable for PostgreSQL GUC: postgis.enable_outdb_rasters */
 bool enable_outdb_rasters = true;
 
-/**
-	* Load offline band's data.  Loaded data is internally owned
-	* and should not be released by the caller.  Data will be
-	* released when band is destroyed with rt_band_destroy().
-	*
-	* @param band : the band who's data to get
-	*
-	* @return ES_NONE if success, ES_ERROR if failure
-	*/
-rt_errorstate
-rt_band_load_offline_data(rt_band band) {
+/*
+	open the out-db raster of band, and locate the band in it.
+	offset is the cell of the band holding the out-db raster's
+	upper-left corner. inside is set if the band lies inside the
+	out-db raster on its grid, so that its pixels can be read
+	straight from the out-db band
+*/
+static GDALDatasetH
+_rti_band_offline_open(
+	rt_band band, const char *func,
+	double *ogt, double *offset, int *inside
+) {
 	GDALDatasetH hdsSrc = NULL;
+	GDALRasterBandH hbandSrc = NULL;
+	GDALDataType gdpixtype;
 	int nband = 0;
-	VRTDatasetH hdsDst = NULL;
-	VRTSourcedRasterBandH hbandDst = NULL;
-	double ogt[6] = {0};
-	double offset[2] = {0};
-
 	rt_raster _rast = NULL;
-	rt_band _band = NULL;
 	int aligned = 0;
 	int err = ES_NONE;
 
@@ -594,39 +613,39 @@ rt_band_load_offline_data(rt_band band) {
 	assert(band->raster != NULL);
 
 	if (!band->offline) {
-		rterror("rt_band_load_offline_data: Band is not offline");
-		return ES_ERROR;
+		rterror("%s: Band is not offline", func);
+		return NULL;
 	}
 	else if (!strlen(band->data.offline.path)) {
-		rterror("rt_band_load_offline_data: Offline band does not a have a specified file");
-		return ES_ERROR;
+		rterror("%s: Offline band does not a have a specified file", func);
+		return NULL;
 	}
 
 	/* offline_data is disabled */
 	if (!enable_outdb_rasters) {
-		rterror("rt_band_load_offline_data: Access to offline bands disabled");
-		return ES_ERROR;
+		rterror("%s: Access to offline bands disabled", func);
+		return NULL;
 	}
 
 	rt_util_gdal_register_all(0);
-	hdsSrc = rt_util_gdal_open(band->data.offline.path, GA_ReadOnly, 1);
+	hdsSrc = rt_util_gdal_cache_open(band->data.offline.path);
 	if (hdsSrc == NULL) {
-		rterror("rt_band_load_offline_data: Cannot open offline raster: %s", band->data.offline.path);
-		return ES_ERROR;
+		rterror("%s: Cannot open offline raster: %s", func, band->data.offline.path);
+		return NULL;
 	}
 
 	/* # of bands */
 	nband = GDALGetRasterCount(hdsSrc);
 	if (!nband) {
-		rterror("rt_band_load_offline_data: No bands found in offline raster: %s", band->data.offline.path);
-		GDALClose(hdsSrc);
-		return ES_ERROR;
+		rt_util_gdal_cache_close(hdsSrc);
+		rterror("%s: No bands found in offline raster: %s", func, band->data.offline.path);
+		return NULL;
 	}
 	/* bandNum is 0-based */
 	else if (band->data.offline.bandNum + 1 > nband) {
-		rterror("rt_band_load_offline_data: Specified band %d not found in offline raster: %s", band->data.offline.bandNum, band->data.offline.path);
-		GDALClose(hdsSrc);
-		return ES_ERROR;
+		rt_util_gdal_cache_close(hdsSrc);
+		rterror("%s: Specified band %d not found in offline raster: %s", func, band->data.offline.bandNum, band->data.offline.path);
+		return NULL;
 	}
 
 	/* get offline raster's geotransform */
@@ -650,9 +669,9 @@ rt_band_load_offline_data(rt_band band) {
 	rt_raster_destroy(_rast);
 
 	if (err != ES_NONE) {
-		rterror("rt_band_load_offline_data: Could not test alignment of in-db representation of out-db raster");
-		GDALClose(hdsSrc);
-		return ES_ERROR;
+		rt_util_gdal_cache_close(hdsSrc);
+		rterror("%s: Could not test alignment of in-db representation of out-db raster", func);
+		return NULL;
 	}
 	else if (!aligned) {
 		rtwarn("The in-db representation of the out-db raster is not aligned. Band data may be incorrect");
@@ -668,6 +687,87 @@ rt_band_load_offline_data(rt_band band) {
 
 	RASTER_DEBUGF(4, "offsets: (%f, %f)", offset[0], offset[1]);
 
+	hbandSrc = GDALGetRasterBand(hdsSrc, band->data.offline.bandNum + 1);
+	gdpixtype = rt_util_pixtype_to_gdal_datatype(band->pixtype);
+
+	*inside = (
+		aligned &&
+		offset[0] <= 0 && offset[1] <= 0 &&
+		-offset[0] + band->width <= GDALGetRasterBandXSize(hbandSrc) &&
+		-offset[1] + band->height <= GDALGetRasterBandYSize(hbandSrc) &&
+		GDALGetDataTypeSizeBytes(gdpixtype) == rt_pixtype_size(band->pixtype)
+	);
+
+	return hdsSrc;
+}
+
+/**
+	* Load offline band's data.  Loaded data is internally owned
+	* and should not be released by the caller.  Data will be
+	* released when band is destroyed with rt_band_destroy().
+	*
+	* @param band : the band who's data to get
+	*
+	* @return ES_NONE if success, ES_ERROR if failure
+	*/
+rt_errorstate
+rt_band_load_offline_data(rt_band band) {
+	GDALDatasetH hdsSrc = NULL;
+	GDALRasterBandH hbandSrc = NULL;
+	VRTDatasetH hdsDst = NULL;
+	VRTSourcedRasterBandH hbandDst = NULL;
+	double ogt[6] = {0};
+	double offset[2] = {0};
+	int inside = 0;
+
+	rt_raster _rast = NULL;
+	rt_band _band = NULL;
+
+	hdsSrc = _rti_band_offline_open(band, "rt_band_load_offline_data", ogt, offset, &inside);
+	if (hdsSrc == NULL)
+		return ES_ERROR;
+
+	hbandSrc = GDALGetRasterBand(hdsSrc, band->data.offline.bandNum + 1);
+
+	/* tile lies inside the out-db raster, read it straight from the file */
+	if (inside) {
+		uint8_t *mem = NULL;
+
+		RASTER_DEBUG(3, "Reading out-db band without VRT");
+
+		mem = rtalloc((size_t) band->width * band->height * rt_pixtype_size(band->pixtype));
+		if (mem == NULL) {
+			rt_util_gdal_cache_close(hdsSrc);
+			rterror("rt_band_load_offline_data: Could not allocate memory for band data");
+			return ES_ERROR;
+		}
+
+		if (GDALRasterIO(
+			hbandSrc, GF_Read,
+			(int) -offset[0], (int) -offset[1],
+			band->width, band->height,
+			mem, band->width, band->height,
+			rt_util_pixtype_to_gdal_datatype(band->pixtype),
+			0, 0
+		) != CE_None) {
+			rtdealloc(mem);
+			rt_util_gdal_cache_close(hdsSrc);
+			rterror("rt_band_load_offline_data: Cannot load data from offline raster: %s", band->data.offline.path);
+			return ES_ERROR;
+		}
+		rt_util_gdal_cache_close(hdsSrc);
+
+		/* band->data.offline.mem not NULL, free first */
+		if (band->data.offline.mem != NULL)
+			rtdealloc(band->data.offline.mem);
+		band->data.offline.mem = mem;
+
+		/* whole band is loaded, blocks are not needed anymore */
+		_rti_band_offline_blocks_destroy(band);
+
+		return ES_NONE;
+	}
+
 	/* create VRT dataset */
 	hdsDst = VRTCreate(band->width, band->height);
 	GDALSetGeoTransform(hdsDst, ogt);
@@ -683,7 +783,7 @@ rt_band_load_offline_data(rt_band band) {
 		GDALSetRasterNoDataValue(hbandDst, band->nodataval);
 
 	VRTAddSimpleSource(
-		hbandDst, GDALGetRasterBand(hdsSrc, band->data.offline.bandNum + 1),
+		hbandDst, hbandSrc,
 		fabs(offset[0]), fabs(offset[1]),
 		band->width, band->height,
 		0, 0,
@@ -698,7 +798,7 @@ rt_band_load_offline_data(rt_band band) {
 	_rast = rt_raster_from_gdal_dataset(hdsDst);
 
 	GDALClose(hdsDst);
-	GDALClose(hdsSrc);
+	rt_util_gdal_cache_close(hdsSrc);
 	/*
 	{
 		FILE *fp;
@@ -731,9 +831,186 @@ rt_band_load_offline_data(rt_band band) {
 	rtdealloc(_band); /* cannot use rt_band_destroy */
 	rt_raster_destroy(_rast);
 
+	/* whole band is loaded, blocks are not needed anymore */
+	_rti_band_offline_blocks_destroy(band);
+
+	return ES_NONE;
+}
+
+/* find the blocks of the out-db raster covering band */
+static rt_errorstate
+_rti_band_offline_blocks_init(rt_band band) {
+	struct rt_extband_blocks_t *blocks = NULL;
+	GDALDatasetH hdsSrc = NULL;
+	GDALRasterBandH hbandSrc = NULL;
+	double ogt[6] = {0};
+	double offset[2] = {0};
+	int inside = 0;
+
+	hdsSrc = _rti_band_offline_open(band, "rt_band_get_data_line", ogt, offset, &inside);
+	if (hdsSrc == NULL)
+		return ES_ERROR;
+
+	/* band is not a window of the out-db band, read all of it */
+	if (!inside) {
+		rt_util_gdal_cache_close(hdsSrc);
+		return rt_band_load_offline_data(band);
+	}
+
+	blocks = rtalloc(sizeof(struct rt_extband_blocks_t));
+	if (blocks == NULL) {
+		rt_util_gdal_cache_close(hdsSrc);
+		rterror("rt_band_get_data_line: Could not allocate memory for out-db blocks");
+		return ES_ERROR;
+	}
+
+	hbandSrc = GDALGetRasterBand(hdsSrc, band->data.offline.bandNum + 1);
+	GDALGetBlockSize(hbandSrc, &(blocks->xsize), &(blocks->ysize));
+	rt_util_gdal_cache_close(hdsSrc);
+
+	if (blocks->xsize < 1) blocks->xsize = 1;
+	if (blocks->ysize < 1) blocks->ysize = 1;
+
+	blocks->srcx = (int) -offset[0];
+	blocks->srcy = (int) -offset[1];
+	blocks->nx = (blocks->srcx + band->width - 1) / blocks->xsize - blocks->srcx / blocks->xsize + 1;
+	blocks->ny = (blocks->srcy + band->height - 1) / blocks->ysize - blocks->srcy / blocks->ysize + 1;
+	RASTER_DEBUGF(3, "band at (%d, %d) of out-db band covered by %d x %d blocks of %d x %d",
+		blocks->srcx, blocks->srcy, blocks->nx, blocks->ny, blocks->xsize, blocks->ysize);
+
+	blocks->block = rtalloc(sizeof(uint8_t *) * blocks->nx * blocks->ny);
+	if (blocks->block == NULL) {
+		rterror("rt_band_get_data_line: Could not allocate memory for out-db blocks");
+		rtdealloc(blocks);
+		return ES_ERROR;
+	}
+	memset(blocks->block, 0, sizeof(uint8_t *) * blocks->nx * blocks->ny);
+
+	band->data.offline.blocks = blocks;
+
 	return ES_NONE;
 }
 
+uint8_t *
+rt_band_get_data_line(
+	rt_band band,
+	int x, int y,
+	uint16_t len,
+	uint16_t *nvals
+) {
+	struct rt_extband_blocks_t *blocks = NULL;
+	int pixsize = 0;
+	uint8_t *data = NULL;
+	size_t offset = 0;
+	int bx = 0;
+	int by = 0;
+	int i = 0;
+	int xmin = 0;
+	int xmax = 0;
+	int ymin = 0;
+	int ymax = 0;
+	int _nvals = 0;
+
+	assert(NULL != band);
+	assert(x >= 0 && x < band->width);
+	assert(y >= 0 && y < band->height);
+	assert(len > 0);
+
+	pixsize = rt_pixtype_size(band->pixtype);
+
+	/* out-db band not loaded, read the blocks of its out-db raster */
+	if (band->offline && band->data.offline.mem == NULL) {
+		if (
+			band->data.offline.blocks == NULL &&
+			_rti_band_offline_blocks_init(band) != ES_NONE
+		) {
+			return NULL;
+		}
+		blocks = band->data.offline.blocks;
+	}
+
+	/* data is in memory, pixels are contiguous up to the end of the band */
+	if (blocks == NULL) {
+		data = rt_band_get_data(band);
+		if (data == NULL)
+			return NULL;
+
+		offset = (size_t) y * band->width + x;
+		_nvals = band->width * band->height - offset;
+		if (nvals != NULL)
+			*nvals = _nvals < len ? _nvals : len;
+
+		return data + offset * pixsize;
+	}
+
+	/* block holding pixel (x, y), and the band's pixels inside it */
+	bx = (blocks->srcx + x) / blocks->xsize - blocks->srcx / blocks->xsize;
+	by = (blocks->srcy + y) / blocks->ysize - blocks->srcy / blocks->ysize;
+	i = by * blocks->nx + bx;
+
+	xmin = (blocks->srcx / blocks->xsize + bx) * blocks->xsize - blocks->srcx;
+	xmax = xmin + blocks->xsize;
+	if (xmin < 0) xmin = 0;
+	if (xmax > band->width) xmax = band->width;
+	ymin = (blocks->srcy / blocks->ysize + by) * blocks->ysize - blocks->srcy;
+	ymax = ymin + blocks->ysize;
+	if (ymin < 0) ymin = 0;
+	if (ymax > band->height) ymax = band->height;
+
+	if (blocks->block[i] == NULL) {
+		GDALDatasetH hdsSrc = NULL;
+		uint8_t *block = NULL;
+		CPLErr cplerr;
+
+		RASTER_DEBUGF(3, "reading block (%d, %d) of out-db band: pixels (%d, %d) to (%d, %d)",
+			bx, by, xmin, ymin, xmax - 1, ymax - 1);
+
+		/* offline_data is disabled */
+		if (!enable_outdb_rasters) {
+			rterror("rt_band_get_data_line: Access to offline bands disabled");
+			return NULL;
+		}
+
+		block = rtalloc((size_t) (xmax - xmin) * (ymax - ymin) * pixsize);
+		if (block == NULL) {
+			rterror("rt_band_get_data_line: Could not allocate memory for out-db block");
+			return NULL;
+		}
+
+		hdsSrc = rt_util_gdal_cache_open(band->data.offline.path);
+		if (hdsSrc == NULL) {
+			rtdealloc(block);
+			rterror("rt_band_get_data_line: Cannot open offline raster: %s", band->data.offline.path);
+			return NULL;
+		}
+
+		cplerr = GDALRasterIO(
+			GDALGetRasterBand(hdsSrc, band->data.offline.bandNum + 1), GF_Read,
+			blocks->srcx + xmin, blocks->srcy + ymin,
+			xmax - xmin, ymax - ymin,
+			block, xmax - xmin, ymax - ymin,
+			rt_util_pixtype_to_gdal_datatype(band->pixtype),
+			0, 0
+		);
+		rt_util_gdal_cache_close(hdsSrc);
+
+		if (cplerr != CE_None) {
+			rtdealloc(block);
+			rterror("rt_band_get_data_line: Cannot load data from offline raster: %s", band->data.offline.path);
+			return NULL;
+		}
+
+		blocks->block[i] = block;
+	}
+
+	offset = (size_t) (y - ymin) * (xmax - xmin) + (x - xmin);
+	_nvals = xmax - x;
+	if (nvals != NULL)
+		*nvals = _nvals < len ? _nvals : len;
+
+	return blocks->block[i] + offset * pixsize;
+}
+
 uint64_t rt_band_get_file_size(rt_band band) {
     VSIStatBufL sStat;
 
@@ -1293,11 +1570,12 @@ rt_errorstate rt_band_get_pixel_line(
 ) {
 	uint8_t *_vals = NULL;
 	int pixsize = 0;
-	uint8_t *data = NULL;
 	uint32_t offset = 0;
 	uint16_t _nvals = 0;
 	int maxlen = 0;
 	uint8_t *ptr = NULL;
+	uint16_t n = 0;
+	uint16_t i = 0;
 
 	assert(NULL != band);
 	assert(vals != NULL && nvals != NULL);
@@ -1316,12 +1594,6 @@ rt_errorstate rt_band_get_pixel_line(
 	if (len < 1)
 		return ES_NONE;
 
-	data = rt_band_get_data(band);
-	if (data == NULL) {
-		rterror("rt_band_get_pixel_line: Cannot get band data");
-		return ES_ERROR;
-	}
-
 	/* +1 for the nodata value */
 	offset = x + (y * band->width);
 	RASTER_DEBUGF(4, "offset = %d", offset);
@@ -1339,16 +1611,23 @@ rt_errorstate rt_band_get_pixel_line(
 	}
 	RASTER_DEBUGF(4, "_nvals = %d", _nvals);
 
-	ptr = data + ((size_t)offset * pixsize);
-
 	_vals = rtalloc((size_t)_nvals * pixsize);
 	if (_vals == NULL) {
 		rterror("rt_band_get_pixel_line: Could not allocate memory for pixel values");
 		return ES_ERROR;
 	}
 
-	/* copy pixels */
-	memcpy(_vals, ptr, (size_t)_nvals * pixsize);
+	/* copy pixels, a run of contiguous pixels at a time */
+	for (i = 0; i < _nvals; i += n) {
+		ptr = rt_band_get_data_line(band, (offset + i) % band->width, (offset + i) / band->width, _nvals - i, &n);
+		if (ptr == NULL) {
+			rterror("rt_band_get_pixel_line: Cannot get band data");
+			rtdealloc(_vals);
+			return ES_ERROR;
+		}
+
+		memcpy(_vals + ((size_t)i * pixsize), ptr, (size_t)n * pixsize);
+	}
 
 	*vals = _vals;
 	*nvals = _nvals;
@@ -1557,14 +1836,15 @@ rt_band_get_pixel(
 		return ES_NONE;
 	}
 
-	data = rt_band_get_data(band);
+	/* out-db bands only read the block holding the pixel */
+	data = rt_band_get_data_line(band, x, y, 1, NULL);
 	if (data == NULL) {
 		rterror("rt_band_get_pixel: Cannot get band data");
 		return ES_ERROR;
 	}
 
-	/* +1 for the nodata value */
-	offset = x + (y * band->width);
+	/* data points to the pixel */
+	offset = 0;
 
 	pixtype = band->pixtype;
 
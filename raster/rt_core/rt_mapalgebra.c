@@ -30,6 +30,128 @@
 #include "librtcore.h"
 #include "librtcore_internal.h"
 
+/*
+	rterror() and friends are not thread-safe, so worker threads are
+	only used in builds that do not emit messages while processing pixels
+*/
+#if POSTGIS_RASTER_THREADS > 0 && POSTGIS_RASTER_WARN_ON_TRUNCATION == 0 && POSTGIS_DEBUG_LEVEL == 0
+#define RTI_THREADS 1
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+/* a strip of fewer pixels is not worth a thread */
+#define RTI_STRIP_PIXELS 65536
+
+/******************************************************************************
+* row strips
+******************************************************************************/
+
+typedef struct _rti_strip_job_t* _rti_strip_job;
+struct _rti_strip_job_t {
+	int (*run)(void *arg);
+	void *arg;
+	int status;
+
+#ifdef RTI_THREADS
+	pthread_t thread;
+	int started;
+#endif
+};
+
+/*
+	number of strips to split height rows of width pixels into,
+	at most one per thread allowed by postgis.raster_threads
+*/
+static int
+_rti_strip_count(uint32_t width, uint32_t height) {
+#ifdef RTI_THREADS
+	char *option = NULL;
+	long count = 0;
+	uint64_t limit = 0;
+
+	option = rtoptions("raster_threads");
+	if (option == NULL)
+		return 1;
+
+	count = strtol(option, NULL, 10);
+	if (count > POSTGIS_RT_MAX_THREADS)
+		count = POSTGIS_RT_MAX_THREADS;
+
+	/* at least one row and RTI_STRIP_PIXELS pixels per strip */
+	limit = ((uint64_t) width * height) / RTI_STRIP_PIXELS;
+	if (limit > height)
+		limit = height;
+	if ((uint64_t) count > limit)
+		count = (long) limit;
+
+	return (count > 1) ? (int) count : 1;
+#else
+	return 1;
+#endif
+}
+
+/* first row of strip k of count strips over height rows */
+static uint32_t
+_rti_strip_start(uint32_t height, int k, int count) {
+	return (uint32_t) (((uint64_t) height * k) / count);
+}
+
+#ifdef RTI_THREADS
+static void *
+_rti_strip_job_thread(void *job) {
+	_rti_strip_job _job = (_rti_strip_job) job;
+
+	_job->status = _job->run(_job->arg);
+
+	return NULL;
+}
+#endif
+
+/*
+	run count jobs, the first one on the calling thread and the others
+	on worker threads. jobs must not call rtalloc(), rterror() and friends.
+	returns zero if any job failed
+*/
+static int
+_rti_strip_jobs_run(_rti_strip_job jobs, int count) {
+	int i = 0;
+	int status = 1;
+
+#ifdef RTI_THREADS
+	sigset_t blocked;
+	sigset_t saved;
+
+	/* signals are handled by the calling thread, workers block all of them */
+	sigfillset(&blocked);
+	pthread_sigmask(SIG_SETMASK, &blocked, &saved);
+	for (i = 1; i < count; i++)
+		jobs[i].started = (pthread_create(&(jobs[i].thread), NULL, _rti_strip_job_thread, &(jobs[i])) == 0);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+#endif
+
+	jobs[0].status = jobs[0].run(jobs[0].arg);
+
+	for (i = 1; i < count; i++) {
+#ifdef RTI_THREADS
+		if (jobs[i].started) {
+			pthread_join(jobs[i].thread, NULL);
+			continue;
+		}
+#endif
+
+		/* no thread for job, run it here */
+		jobs[i].status = jobs[i].run(jobs[i].arg);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].status)
+			status = 0;
+	}
+
+	return status;
+}
+
 /******************************************************************************
 * rt_band_reclass()
 ******************************************************************************/
@@ -53,32 +175,35 @@ rt_band_reclass_round_integer(rt_pixtype pixtype, double nv)
 	}
 }
 
-/**
- * Returns new band with values reclassified
- *
- * @param srcband : the band who's values will be reclassified
- * @param pixtype : pixel type of the new band
- * @param hasnodata : indicates if the band has a nodata value
- * @param nodataval : nodata value for the new band
- * @param exprset : array of rt_reclassexpr structs
- * @param exprcount : number of elements in expr
- *
- * @return a new rt_band or NULL on error
- */
-rt_band
-rt_band_reclass(
-	rt_band srcband, rt_pixtype pixtype,
-	uint32_t hasnodata, double nodataval,
-	rt_reclassexpr *exprset, int exprcount
-) {
-	rt_band band = NULL;
-	uint32_t width = 0;
-	uint32_t height = 0;
-	int numval = 0;
-	int memsize = 0;
-	void *mem = NULL;
-	uint32_t src_hasnodata = 0;
-	double src_nodataval = 0.0;
+typedef struct _rti_reclass_arg_t* _rti_reclass_arg;
+struct _rti_reclass_arg_t {
+	rt_band srcband;
+	rt_pixtype pixtype;
+	uint32_t hasnodata;
+	double nodataval;
+	rt_reclassexpr *exprset;
+	int exprcount;
+
+	/* rows [ystart, yend) of the strip */
+	uint32_t ystart;
+	uint32_t yend;
+
+	/* copy of the new band, for the isnodata flag of the strip */
+	struct rt_band_t band;
+};
+
+/* reclassify the rows of one strip */
+static int
+_rti_reclass_strip(void *_arg) {
+	_rti_reclass_arg arg = (_rti_reclass_arg) _arg;
+	rt_band srcband = arg->srcband;
+	rt_band band = &(arg->band);
+	rt_pixtype pixtype = arg->pixtype;
+	uint32_t hasnodata = arg->hasnodata;
+	double nodataval = arg->nodataval;
+	rt_reclassexpr *exprset = arg->exprset;
+	int exprcount = arg->exprcount;
+	uint32_t width = rt_band_get_width(srcband);
 	int isnodata = 0;
 
 	int rtn;
@@ -92,40 +217,8 @@ rt_band_reclass(
 	int do_nv = 0;
 	rt_reclassexpr expr = NULL;
 
-	assert(NULL != srcband);
-	assert(NULL != exprset && exprcount > 0);
-	RASTER_DEBUGF(4, "exprcount = %d", exprcount);
-	RASTER_DEBUGF(4, "exprset @ %p", exprset);
-
-	/* source nodata */
-	src_hasnodata = rt_band_get_hasnodata_flag(srcband);
-	if (src_hasnodata)
-		rt_band_get_nodata(srcband, &src_nodataval);
-
-	/* size of memory block to allocate */
-	width = rt_band_get_width(srcband);
-	height = rt_band_get_height(srcband);
-	numval = width * height;
-	memsize = rt_pixtype_size(pixtype) * numval;
-	mem = (int *) rtalloc(memsize);
-	if (!mem) {
-		rterror("rt_band_reclass: Could not allocate memory for band");
-		return 0;
-	}
-
-	band = rt_band_new_inline(width, height, pixtype, hasnodata, nodataval, mem);
-	if (!band) {
-		rterror("rt_band_reclass: Could not create new band");
-		rtdealloc(mem);
-		return 0;
-	}
-	rt_band_set_ownsdata_flag(band, 1); /* we DO own this data!!! */
-	rt_band_init_value(band, hasnodata ? nodataval : 0.0);
-
-	RASTER_DEBUGF(3, "rt_band_reclass: new band @ %p", band);
-
-	for (x = 0; x < width; x++) {
-		for (y = 0; y < height; y++) {
+	for (y = arg->ystart; y < arg->yend; y++) {
+		for (x = 0; x < width; x++) {
 			rtn = rt_band_get_pixel(srcband, x, y, &ov, &isnodata);
 
 			/* error getting value, skip */
@@ -243,17 +336,121 @@ rt_band_reclass(
 				, (NULL != expr) ? expr->dst.max : 0
 				, nv
 			);
-			if (rt_band_set_pixel(band, x, y, nv, NULL) != ES_NONE) {
-				rterror("rt_band_reclass: Could not assign value to new band");
-				rt_band_destroy(band);
-				rtdealloc(mem);
+			if (rt_band_set_pixel(band, x, y, nv, NULL) != ES_NONE)
 				return 0;
-			}
 
 			expr = NULL;
 		}
 	}
 
+	return 1;
+}
+
+/**
+ * Returns new band with values reclassified
+ *
+ * @param srcband : the band who's values will be reclassified
+ * @param pixtype : pixel type of the new band
+ * @param hasnodata : indicates if the band has a nodata value
+ * @param nodataval : nodata value for the new band
+ * @param exprset : array of rt_reclassexpr structs
+ * @param exprcount : number of elements in expr
+ *
+ * @return a new rt_band or NULL on error
+ */
+rt_band
+rt_band_reclass(
+	rt_band srcband, rt_pixtype pixtype,
+	uint32_t hasnodata, double nodataval,
+	rt_reclassexpr *exprset, int exprcount
+) {
+	rt_band band = NULL;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int numval = 0;
+	int memsize = 0;
+	void *mem = NULL;
+
+	struct _rti_reclass_arg_t *strips = NULL;
+	struct _rti_strip_job_t *jobs = NULL;
+	int count = 1;
+	int status = 0;
+	int k = 0;
+
+	assert(NULL != srcband);
+	assert(NULL != exprset && exprcount > 0);
+	RASTER_DEBUGF(4, "exprcount = %d", exprcount);
+	RASTER_DEBUGF(4, "exprset @ %p", exprset);
+
+	/* size of memory block to allocate */
+	width = rt_band_get_width(srcband);
+	height = rt_band_get_height(srcband);
+	numval = width * height;
+	memsize = rt_pixtype_size(pixtype) * numval;
+	mem = (int *) rtalloc(memsize);
+	if (!mem) {
+		rterror("rt_band_reclass: Could not allocate memory for band");
+		return 0;
+	}
+
+	band = rt_band_new_inline(width, height, pixtype, hasnodata, nodataval, mem);
+	if (!band) {
+		rterror("rt_band_reclass: Could not create new band");
+		rtdealloc(mem);
+		return 0;
+	}
+	rt_band_set_ownsdata_flag(band, 1); /* we DO own this data!!! */
+	rt_band_init_value(band, hasnodata ? nodataval : 0.0);
+
+	RASTER_DEBUGF(3, "rt_band_reclass: new band @ %p", band);
+
+	/* source band is read by all strips, load it here */
+	count = _rti_strip_count(width, height);
+	if (count > 1 && !rt_band_get_isnodata_flag(srcband) && rt_band_get_data(srcband) == NULL)
+		count = 1;
+
+	strips = rtalloc(sizeof(struct _rti_reclass_arg_t) * count);
+	jobs = rtalloc(sizeof(struct _rti_strip_job_t) * count);
+	if (strips == NULL || jobs == NULL) {
+		rterror("rt_band_reclass: Could not allocate memory for strips");
+		if (strips != NULL) rtdealloc(strips);
+		if (jobs != NULL) rtdealloc(jobs);
+		rt_band_destroy(band);
+		return 0;
+	}
+
+	for (k = 0; k < count; k++) {
+		strips[k].srcband = srcband;
+		strips[k].pixtype = pixtype;
+		strips[k].hasnodata = hasnodata;
+		strips[k].nodataval = nodataval;
+		strips[k].exprset = exprset;
+		strips[k].exprcount = exprcount;
+		strips[k].ystart = _rti_strip_start(height, k, count);
+		strips[k].yend = _rti_strip_start(height, k + 1, count);
+		memcpy(&(strips[k].band), band, sizeof(struct rt_band_t));
+
+		jobs[k].run = _rti_reclass_strip;
+		jobs[k].arg = &(strips[k]);
+	}
+	RASTER_DEBUGF(3, "rt_band_reclass: %d strips", count);
+
+	status = _rti_strip_jobs_run(jobs, count);
+
+	for (k = 0; k < count; k++) {
+		if (!strips[k].band.isnodata)
+			band->isnodata = FALSE;
+	}
+
+	rtdealloc(strips);
+	rtdealloc(jobs);
+
+	if (!status) {
+		rterror("rt_band_reclass: Could not assign value to new band");
+		rt_band_destroy(band);
+		return 0;
+	}
+
 	return band;
 }
 
@@ -426,7 +623,32 @@ struct _rti_iterator_arg_t {
 		int **nodata;
 	} empty;
 
+	/* ring of input rows around the output row, per raster */
+	struct {
+		uint32_t columns;
+		double ***values;
+		uint8_t ***nodata;
+
+		/* shared by rasters that are all NODATA */
+		double *empty_values;
+		uint8_t *empty_nodata;
+
+		/* output row of row callback */
+		double *dst_values;
+		uint8_t *dst_nodata;
+	} row;
+
+	/* neighborhood of pixel callback, per raster */
+	struct {
+		double ***values;
+		int ***nodata;
+	} window;
+
 	rt_iterator_arg arg;
+	rt_iterator_rows_arg rowarg;
+
+	/* message of error while iterating, reported by the calling thread */
+	char error[RT_ITERATOR_ERROR_SIZE];
 };
 
 static _rti_iterator_arg
@@ -462,7 +684,21 @@ _rti_iterator_arg_init() {
 	_param->empty.values = NULL;
 	_param->empty.nodata = NULL;
 
+	_param->row.columns = 0;
+	_param->row.values = NULL;
+	_param->row.nodata = NULL;
+	_param->row.empty_values = NULL;
+	_param->row.empty_nodata = NULL;
+	_param->row.dst_values = NULL;
+	_param->row.dst_nodata = NULL;
+
+	_param->window.values = NULL;
+	_param->window.nodata = NULL;
+
 	_param->arg = NULL;
+	_param->rowarg = NULL;
+
+	_param->error[0] = '\0';
 
 	return _param;
 }
@@ -470,6 +706,7 @@ _rti_iterator_arg_init() {
 static void
 _rti_iterator_arg_destroy(_rti_iterator_arg _param) {
 	uint32_t i = 0;
+	uint32_t y = 0;
 
 	if (_param->raster != NULL)
 		rtdealloc(_param->raster);
@@ -517,6 +754,90 @@ _rti_iterator_arg_destroy(_rti_iterator_arg _param) {
 		rtdealloc(_param->empty.nodata);
 	}
 
+	if (_param->row.values != NULL) {
+		for (i = 0; i < _param->count; i++) {
+			if (_param->row.values[i] == NULL)
+				continue;
+			for (y = 0; y < _param->dimension.rows; y++) {
+				if (_param->row.values[i][y] != NULL && _param->row.values[i][y] != _param->row.empty_values)
+					rtdealloc(_param->row.values[i][y]);
+			}
+			rtdealloc(_param->row.values[i]);
+		}
+		rtdealloc(_param->row.values);
+	}
+	if (_param->row.nodata != NULL) {
+		for (i = 0; i < _param->count; i++) {
+			if (_param->row.nodata[i] == NULL)
+				continue;
+			for (y = 0; y < _param->dimension.rows; y++) {
+				if (_param->row.nodata[i][y] != NULL && _param->row.nodata[i][y] != _param->row.empty_nodata)
+					rtdealloc(_param->row.nodata[i][y]);
+			}
+			rtdealloc(_param->row.nodata[i]);
+		}
+		rtdealloc(_param->row.nodata);
+	}
+	if (_param->row.empty_values != NULL)
+		rtdealloc(_param->row.empty_values);
+	if (_param->row.empty_nodata != NULL)
+		rtdealloc(_param->row.empty_nodata);
+	if (_param->row.dst_values != NULL)
+		rtdealloc(_param->row.dst_values);
+	if (_param->row.dst_nodata != NULL)
+		rtdealloc(_param->row.dst_nodata);
+
+	if (_param->window.values != NULL) {
+		for (i = 0; i < _param->count; i++) {
+			if (_param->window.values[i] == NULL)
+				continue;
+			for (y = 0; y < _param->dimension.rows; y++) {
+				if (_param->window.values[i][y] != NULL)
+					rtdealloc(_param->window.values[i][y]);
+			}
+			rtdealloc(_param->window.values[i]);
+		}
+		rtdealloc(_param->window.values);
+	}
+	if (_param->window.nodata != NULL) {
+		for (i = 0; i < _param->count; i++) {
+			if (_param->window.nodata[i] == NULL)
+				continue;
+			for (y = 0; y < _param->dimension.rows; y++) {
+				if (_param->window.nodata[i][y] != NULL)
+					rtdealloc(_param->window.nodata[i][y]);
+			}
+			rtdealloc(_param->window.nodata[i]);
+		}
+		rtdealloc(_param->window.nodata);
+	}
+
+	if (_param->rowarg != NULL) {
+		if (_param->rowarg->values != NULL) {
+			for (i = 0; i < _param->count; i++) {
+				if (_param->rowarg->values[i] != NULL)
+					rtdealloc(_param->rowarg->values[i]);
+			}
+			rtdealloc(_param->rowarg->values);
+		}
+		if (_param->rowarg->nodata != NULL) {
+			for (i = 0; i < _param->count; i++) {
+				if (_param->rowarg->nodata[i] != NULL)
+					rtdealloc(_param->rowarg->nodata[i]);
+			}
+			rtdealloc(_param->rowarg->nodata);
+		}
+		if (_param->rowarg->src_pixel != NULL) {
+			for (i = 0; i < _param->count; i++) {
+				if (_param->rowarg->src_pixel[i] != NULL)
+					rtdealloc(_param->rowarg->src_pixel[i]);
+			}
+			rtdealloc(_param->rowarg->src_pixel);
+		}
+
+		rtdealloc(_param->rowarg);
+	}
+
 	if (_param->arg != NULL) {
 		if (_param->arg->values != NULL)
 			rtdealloc(_param->arg->values);
@@ -710,6 +1031,7 @@ _rti_iterator_arg_empty_init(_rti_iterator_arg _param) {
 static int
 _rti_iterator_arg_callback_init(_rti_iterator_arg _param) {
 	uint32_t i = 0;
+	uint32_t y = 0;
 
 	_param->arg = rtalloc(sizeof(struct rt_iterator_arg_t));
 	if (_param->arg == NULL) {
@@ -720,6 +1042,7 @@ _rti_iterator_arg_callback_init(_rti_iterator_arg _param) {
 	_param->arg->values = NULL;
 	_param->arg->nodata = NULL;
 	_param->arg->src_pixel = NULL;
+	_param->arg->error = _param->error;
 
 	/* initialize argument components */
 	_param->arg->values = rtalloc(sizeof(double **) * _param->count);
@@ -750,77 +1073,703 @@ _rti_iterator_arg_callback_init(_rti_iterator_arg _param) {
 	_param->arg->dst_pixel[0] = 0;
 	_param->arg->dst_pixel[1] = 0;
 
+	/* neighborhoods, reused for every pixel */
+	_param->window.values = rtalloc(sizeof(double **) * _param->count);
+	_param->window.nodata = rtalloc(sizeof(int **) * _param->count);
+	if (_param->window.values == NULL || _param->window.nodata == NULL) {
+		rterror("_rti_iterator_arg_callback_init: Could not allocate memory for neighborhoods");
+		return 0;
+	}
+	memset(_param->window.values, 0, sizeof(double **) * _param->count);
+	memset(_param->window.nodata, 0, sizeof(int **) * _param->count);
+
+	for (i = 0; i < _param->count; i++) {
+		_param->window.values[i] = rtalloc(sizeof(double *) * _param->dimension.rows);
+		_param->window.nodata[i] = rtalloc(sizeof(int *) * _param->dimension.rows);
+		if (_param->window.values[i] == NULL || _param->window.nodata[i] == NULL) {
+			rterror("_rti_iterator_arg_callback_init: Could not allocate memory for neighborhoods");
+			return 0;
+		}
+		memset(_param->window.values[i], 0, sizeof(double *) * _param->dimension.rows);
+		memset(_param->window.nodata[i], 0, sizeof(int *) * _param->dimension.rows);
+
+		for (y = 0; y < _param->dimension.rows; y++) {
+			_param->window.values[i][y] = rtalloc(sizeof(double) * _param->dimension.columns);
+			_param->window.nodata[i][y] = rtalloc(sizeof(int) * _param->dimension.columns);
+			if (_param->window.values[i][y] == NULL || _param->window.nodata[i][y] == NULL) {
+				rterror("_rti_iterator_arg_callback_init: Could not allocate memory for neighborhoods");
+				return 0;
+			}
+		}
+	}
+
 	return 1;
 }
 
-static void
-_rti_iterator_arg_callback_clean(_rti_iterator_arg _param) {
+static int
+_rti_iterator_arg_rows_callback_init(_rti_iterator_arg _param) {
 	uint32_t i = 0;
-	uint32_t y = 0;
 
-	for (i = 0; i < _param->count; i++) {
-		RASTER_DEBUGF(5, "empty at @ %p", _param->empty.values);
-		RASTER_DEBUGF(5, "values at @ %p", _param->arg->values[i]);
+	_param->rowarg = rtalloc(sizeof(struct rt_iterator_rows_arg_t));
+	if (_param->rowarg == NULL) {
+		rterror("_rti_iterator_arg_rows_callback_init: Could not allocate memory for rt_iterator_rows_arg");
+		return 0;
+	}
 
-		if (_param->arg->values[i] == _param->empty.values) {
-			_param->arg->values[i] = NULL;
-			_param->arg->nodata[i] = NULL;
+	_param->rowarg->values = NULL;
+	_param->rowarg->nodata = NULL;
+	_param->rowarg->src_pixel = NULL;
 
-			continue;
-		}
+	/* initialize argument components */
+	_param->rowarg->values = rtalloc(sizeof(double **) * _param->count);
+	_param->rowarg->nodata = rtalloc(sizeof(uint8_t **) * _param->count);
+	_param->rowarg->src_pixel = rtalloc(sizeof(int *) * _param->count);
+	if (_param->rowarg->values == NULL || _param->rowarg->nodata == NULL || _param->rowarg->src_pixel == NULL) {
+		rterror("_rti_iterator_arg_rows_callback_init: Could not allocate memory for element of rt_iterator_rows_arg");
+		return 0;
+	}
+	memset(_param->rowarg->values, 0, sizeof(double **) * _param->count);
+	memset(_param->rowarg->nodata, 0, sizeof(uint8_t **) * _param->count);
+	memset(_param->rowarg->src_pixel, 0, sizeof(int *) * _param->count);
 
-		for (y = 0; y < _param->dimension.rows; y++) {
-			rtdealloc(_param->arg->values[i][y]);
-			rtdealloc(_param->arg->nodata[i][y]);
+	for (i = 0; i < _param->count; i++) {
+		_param->rowarg->values[i] = rtalloc(sizeof(double *) * _param->dimension.rows);
+		_param->rowarg->nodata[i] = rtalloc(sizeof(uint8_t *) * _param->dimension.rows);
+		_param->rowarg->src_pixel[i] = rtalloc(sizeof(int) * 2);
+		if (
+			_param->rowarg->values[i] == NULL ||
+			_param->rowarg->nodata[i] == NULL ||
+			_param->rowarg->src_pixel[i] == NULL
+		) {
+			rterror("_rti_iterator_arg_rows_callback_init: Could not allocate memory for element of rt_iterator_rows_arg");
+			return 0;
 		}
+		memset(_param->rowarg->src_pixel[i], 0, sizeof(int) * 2);
+	}
 
-		rtdealloc(_param->arg->values[i]);
-		rtdealloc(_param->arg->nodata[i]);
-
-		_param->arg->values[i] = NULL;
-		_param->arg->nodata[i] = NULL;
+	/* output row */
+	_param->row.dst_values = rtalloc(sizeof(double) * (_param->row.columns - _param->distance.x * 2));
+	_param->row.dst_nodata = rtalloc(sizeof(uint8_t) * (_param->row.columns - _param->distance.x * 2));
+	if (_param->row.dst_values == NULL || _param->row.dst_nodata == NULL) {
+		rterror("_rti_iterator_arg_rows_callback_init: Could not allocate memory for output row");
+		return 0;
 	}
+
+	_param->rowarg->rasters = _param->count;
+	_param->rowarg->rows = _param->dimension.rows;
+	_param->rowarg->columns = _param->row.columns - _param->distance.x * 2;
+	_param->rowarg->distancex = _param->distance.x;
+
+	_param->rowarg->dst_row = 0;
+
+	return 1;
 }
 
-/**
- * n-raster iterator.
- * The raster returned should be freed by the caller
- *
- * @param itrset : set of rt_iterator objects.
- * @param itrcount : number of objects in itrset.
- * @param extenttype : type of extent for the output raster.
- * @param customextent : raster specifying custom extent.
- * is only used if extenttype is ET_CUSTOM.
- * @param pixtype : the desired pixel type of the output raster's band.
- * @param hasnodata : indicates if the band has nodata value
- * @param nodataval : the nodata value, will be appropriately
- * truncated to fit the pixtype size.
- * @param distancex : the number of pixels around the specified pixel
- * along the X axis
- * @param distancey : the number of pixels around the specified pixel
- * along the Y axis
- * @param mask : the object of mask
- * @param userarg : pointer to any argument that is passed as-is to callback.
- * @param callback : callback function for actual processing of pixel values.
- * @param *rtnraster : return one band raster from iterator process
- *
- * The callback function _must_ have the following signature.
- *
- *    int FNAME(rt_iterator_arg arg, void *userarg, double *value, int *nodata)
- *
- * The callback function _must_ return zero (error) or non-zero (success)
- * indicating whether the function ran successfully.
- * The parameters passed to the callback function are as follows.
- *
- * - rt_iterator_arg arg: struct containing pixel values, NODATA flags and metadata
- * - void *userarg: NULL or calling function provides to rt_raster_iterator() for use by callback function
- * - double *value: value of pixel to be burned by rt_raster_iterator()
- * - int *nodata: flag (0 or 1) indicating that pixel to be burned is NODATA
- *
- * @return ES_NONE on success, ES_ERROR on error
- */
-rt_errorstate
-rt_raster_iterator(
+/* raster i has no band values, all of its pixels are NODATA */
+static int
+_rti_iterator_arg_is_empty(_rti_iterator_arg _param, int i) {
+	return (
+		_param->isempty[i] ||
+		_param->band.rtband[i] == NULL ||
+		_param->band.isnodata[i]
+	);
+}
+
+static int
+_rti_iterator_arg_rows_init(_rti_iterator_arg _param, int width) {
+	uint32_t i = 0;
+	uint32_t y = 0;
+
+	/* rows are padded by distance X on both sides */
+	_param->row.columns = width + _param->distance.x * 2;
+
+	_param->row.empty_values = rtalloc(sizeof(double) * _param->row.columns);
+	_param->row.empty_nodata = rtalloc(sizeof(uint8_t) * _param->row.columns);
+	_param->row.values = rtalloc(sizeof(double **) * _param->count);
+	_param->row.nodata = rtalloc(sizeof(uint8_t **) * _param->count);
+	if (
+		_param->row.empty_values == NULL ||
+		_param->row.empty_nodata == NULL ||
+		_param->row.values == NULL ||
+		_param->row.nodata == NULL
+	) {
+		rterror("_rti_iterator_arg_rows_init: Could not allocate memory for rows");
+		return 0;
+	}
+	memset(_param->row.empty_values, 0, sizeof(double) * _param->row.columns);
+	memset(_param->row.empty_nodata, 1, sizeof(uint8_t) * _param->row.columns);
+	memset(_param->row.values, 0, sizeof(double **) * _param->count);
+	memset(_param->row.nodata, 0, sizeof(uint8_t **) * _param->count);
+
+	for (i = 0; i < _param->count; i++) {
+		_param->row.values[i] = rtalloc(sizeof(double *) * _param->dimension.rows);
+		_param->row.nodata[i] = rtalloc(sizeof(uint8_t *) * _param->dimension.rows);
+		if (_param->row.values[i] == NULL || _param->row.nodata[i] == NULL) {
+			rterror("_rti_iterator_arg_rows_init: Could not allocate memory for rows of raster %d", i);
+			return 0;
+		}
+		memset(_param->row.values[i], 0, sizeof(double *) * _param->dimension.rows);
+		memset(_param->row.nodata[i], 0, sizeof(uint8_t *) * _param->dimension.rows);
+
+		for (y = 0; y < _param->dimension.rows; y++) {
+			if (_rti_iterator_arg_is_empty(_param, i)) {
+				_param->row.values[i][y] = _param->row.empty_values;
+				_param->row.nodata[i][y] = _param->row.empty_nodata;
+				continue;
+			}
+
+			_param->row.values[i][y] = rtalloc(sizeof(double) * _param->row.columns);
+			_param->row.nodata[i][y] = rtalloc(sizeof(uint8_t) * _param->row.columns);
+			if (_param->row.values[i][y] == NULL || _param->row.nodata[i][y] == NULL) {
+				rterror("_rti_iterator_arg_rows_init: Could not allocate memory for rows of raster %d", i);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* position of output row y in the ring of rows */
+static uint32_t
+_rti_iterator_arg_rows_slot(_rti_iterator_arg _param, int y) {
+	int rows = _param->dimension.rows;
+
+	return ((y % rows) + rows) % rows;
+}
+
+/* convert count pixels of band data to doubles */
+static int
+_rti_iterator_row_to_double(rt_pixtype pixtype, const uint8_t *data, uint32_t count, double *values) {
+	uint32_t x = 0;
+
+	switch (pixtype) {
+		case PT_1BB:
+		case PT_2BUI:
+		case PT_4BUI:
+		case PT_8BUI:
+			for (x = 0; x < count; x++)
+				values[x] = data[x];
+			break;
+		case PT_8BSI: {
+			const int8_t *ptr = (const int8_t *) data;
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_16BSI: {
+			const int16_t *ptr = (const int16_t *) data; /* we assume correct alignment */
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_16BUI: {
+			const uint16_t *ptr = (const uint16_t *) data; /* we assume correct alignment */
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_32BSI: {
+			const int32_t *ptr = (const int32_t *) data; /* we assume correct alignment */
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_32BUI: {
+			const uint32_t *ptr = (const uint32_t *) data; /* we assume correct alignment */
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_32BF: {
+			const float *ptr = (const float *) data; /* we assume correct alignment */
+			for (x = 0; x < count; x++)
+				values[x] = ptr[x];
+			break;
+		}
+		case PT_64BF:
+			memcpy(values, data, sizeof(double) * count);
+			break;
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+/* read output row y of raster i into its ring of rows */
+static int
+_rti_iterator_arg_rows_load(_rti_iterator_arg _param, int i, int y) {
+	rt_band band = NULL;
+	rt_pixtype pixtype = PT_END;
+	uint8_t *data = NULL;
+	double *values = NULL;
+	uint8_t *nodata = NULL;
+	uint32_t slot = 0;
+	int start = 0;
+	int end = 0;
+	int x = 0;
+	int _x = 0;
+	int _y = 0;
+	uint16_t n = 0;
+
+	/* rows are shared and always NODATA */
+	if (_rti_iterator_arg_is_empty(_param, i))
+		return 1;
+
+	slot = _rti_iterator_arg_rows_slot(_param, y);
+	values = _param->row.values[i][slot];
+	nodata = _param->row.nodata[i][slot];
+
+	/* outside band extent, set to NODATA */
+	memset(values, 0, sizeof(double) * _param->row.columns);
+	memset(nodata, 1, sizeof(uint8_t) * _param->row.columns);
+
+	/* input raster's Y and X of first column */
+	_y = y - (int) _param->offset[i][1];
+	_x = -((int) _param->distance.x) - (int) _param->offset[i][0];
+	RASTER_DEBUGF(4, "raster %d: loading row %d from (x, y) = (%d, %d)", i, y, _x, _y);
+
+	if (_y < 0 || _y >= _param->height[i])
+		return 1;
+
+	start = (_x < 0) ? -_x : 0;
+	end = _param->width[i] - _x;
+	if (end > (int) _param->row.columns)
+		end = _param->row.columns;
+	if (start >= end)
+		return 1;
+
+	band = _param->band.rtband[i];
+	pixtype = rt_band_get_pixtype(band);
+
+	/* out-db bands only read the blocks holding the row */
+	for (x = start; x < end; x += n) {
+		data = rt_band_get_data_line(band, _x + x, _y, end - x, &n);
+		if (data == NULL) {
+			snprintf(_param->error, sizeof(_param->error), "Could not get band data of raster %d", i);
+			return 0;
+		}
+
+		if (!_rti_iterator_row_to_double(pixtype, data, n, values + x)) {
+			snprintf(_param->error, sizeof(_param->error), "Unknown pixeltype %d of raster %d", pixtype, i);
+			return 0;
+		}
+	}
+
+	for (x = start; x < end; x++) {
+		if (_param->band.hasnodata[i] && rt_band_clamped_value_is_nodata(band, values[x]))
+			values[x] = 0;
+		else
+			nodata[x] = 0;
+	}
+
+	return 1;
+}
+
+/* move the ring of rows of raster i to output row y, the first one if fill */
+static int
+_rti_iterator_arg_rows_advance(_rti_iterator_arg _param, int i, int y, int fill) {
+	int distance = _param->distance.y;
+	int _y = 0;
+
+	/* first row, fill the ring */
+	if (fill) {
+		for (_y = -distance; _y <= distance; _y++) {
+			if (!_rti_iterator_arg_rows_load(_param, i, y + _y))
+				return 0;
+		}
+
+		return 1;
+	}
+
+	/* replace the row above the neighborhood by the one below */
+	return _rti_iterator_arg_rows_load(_param, i, y + distance);
+}
+
+/* copy neighborhood of output pixel (x, y) of raster i from its rows */
+static void
+_rti_iterator_arg_window_fill(_rti_iterator_arg _param, int i, int x, int y, rt_mask mask) {
+	double **values = _param->window.values[i];
+	int **nodata = _param->window.nodata[i];
+	double *rowvalues = NULL;
+	uint8_t *rownodata = NULL;
+	uint32_t _x = 0;
+	uint32_t _y = 0;
+	uint32_t slot = 0;
+
+	/* neighbors are only used when both distances are set */
+	int neighbors = (_param->distance.x > 0 && _param->distance.y > 0);
+
+	for (_y = 0; _y < _param->dimension.rows; _y++) {
+		slot = _rti_iterator_arg_rows_slot(_param, y - (int) _param->distance.y + (int) _y);
+		rowvalues = _param->row.values[i][slot] + x;
+		rownodata = _param->row.nodata[i][slot] + x;
+
+		for (_x = 0; _x < _param->dimension.columns; _x++) {
+			values[_y][_x] = 0;
+			nodata[_y][_x] = 1;
+
+			if (rownodata[_x])
+				continue;
+			if (!neighbors && (_x != _param->distance.x || _y != _param->distance.y))
+				continue;
+
+			/* no mask */
+			if (mask == NULL) {
+				values[_y][_x] = rowvalues[_x];
+				nodata[_y][_x] = 0;
+			}
+			/* unweighted (boolean) mask, pixel is used if not zero or nodata */
+			else if (mask->weighted == 0) {
+				if (!FLT_EQ(mask->values[_y][_x], 0.0) && mask->nodata[_y][_x] != 1) {
+					values[_y][_x] = rowvalues[_x];
+					nodata[_y][_x] = 0;
+				}
+			}
+			/* weighted mask, apply weight to pixel value */
+			else if (mask->nodata[_y][_x] != 1) {
+				values[_y][_x] = rowvalues[_x] * mask->values[_y][_x];
+				nodata[_y][_x] = 0;
+			}
+		}
+	}
+}
+
+/* burn value of output pixel (x, y) */
+static int
+_rti_iterator_burn(
+	_rti_iterator_arg _param,
+	rt_band band, int x, int y,
+	double value, int nodata,
+	uint8_t hasnodata, double minval
+) {
+	rt_errorstate status = ES_NONE;
+
+	if (!nodata) {
+		status = rt_band_set_pixel(band, x, y, value, NULL);
+		RASTER_DEBUGF(4, "burning pixel (%d, %d) with value: %f", x, y, value);
+	}
+	else if (!hasnodata) {
+		status = rt_band_set_pixel(band, x, y, minval, NULL);
+		RASTER_DEBUGF(4, "burning pixel (%d, %d) with minval: %f", x, y, minval);
+	}
+	else {
+		RASTER_DEBUGF(4, "NOT burning pixel (%d, %d)", x, y);
+	}
+
+	if (status != ES_NONE) {
+		snprintf(_param->error, sizeof(_param->error), "Could not set pixel value");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* call row callback for output row y and burn the row it returns */
+static int
+_rti_iterator_rows(
+	_rti_iterator_arg _param, int y,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	),
+	rt_band band, uint8_t hasnodata, double minval
+) {
+	rt_iterator_rows_arg arg = _param->rowarg;
+	uint32_t slot = 0;
+	uint32_t i = 0;
+	uint32_t k = 0;
+	uint32_t x = 0;
+
+	arg->dst_row = y;
+
+	for (i = 0; i < _param->count; i++) {
+		/* rows in order from the top of the neighborhood */
+		for (k = 0; k < _param->dimension.rows; k++) {
+			slot = _rti_iterator_arg_rows_slot(_param, y - (int) _param->distance.y + (int) k);
+			arg->values[i][k] = _param->row.values[i][slot];
+			arg->nodata[i][k] = _param->row.nodata[i][slot];
+		}
+
+		if (_rti_iterator_arg_is_empty(_param, i))
+			continue;
+
+		/* input raster's X,Y of first pixel of row */
+		arg->src_pixel[i][0] = -((int) _param->offset[i][0]);
+		arg->src_pixel[i][1] = y - (int) _param->offset[i][1];
+	}
+
+	memset(_param->row.dst_values, 0, sizeof(double) * arg->columns);
+	memset(_param->row.dst_nodata, 0, sizeof(uint8_t) * arg->columns);
+
+	RASTER_DEBUG(4, "calling row callback function");
+	if (!callback(arg, userarg, _param->row.dst_values, _param->row.dst_nodata)) {
+		snprintf(_param->error, sizeof(_param->error), "Callback function returned an error");
+		return 0;
+	}
+
+	/* burn values to row */
+	for (x = 0; x < arg->columns; x++) {
+		if (!_rti_iterator_burn(_param, band, x, y, _param->row.dst_values[x], _param->row.dst_nodata[x], hasnodata, minval))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* copy of _param with rows and callback argument of its own, for another strip */
+static _rti_iterator_arg
+_rti_iterator_arg_copy(_rti_iterator_arg _param, rt_iterator itrset, int width, int byrow) {
+	_rti_iterator_arg _copy = NULL;
+	int allnull = 0;
+	int allempty = 0;
+	uint32_t i = 0;
+
+	if ((_copy = _rti_iterator_arg_init()) == NULL)
+		return NULL;
+
+	if (
+		!_rti_iterator_arg_populate(_copy, itrset, _param->count, _param->distance.x, _param->distance.y, &allnull, &allempty) ||
+		!_rti_iterator_arg_empty_init(_copy) ||
+		!_rti_iterator_arg_rows_init(_copy, width) ||
+		(byrow && !_rti_iterator_arg_rows_callback_init(_copy)) ||
+		(!byrow && !_rti_iterator_arg_callback_init(_copy))
+	) {
+		_rti_iterator_arg_destroy(_copy);
+		return NULL;
+	}
+
+	for (i = 0; i < _param->count; i++) {
+		if (_param->offset[i] != NULL)
+			memcpy(_copy->offset[i], _param->offset[i], sizeof(double) * 2);
+	}
+
+	return _copy;
+}
+
+typedef struct _rti_iterator_strip_t* _rti_iterator_strip;
+struct _rti_iterator_strip_t {
+	_rti_iterator_arg param;
+
+	/* rows [ystart, yend) of output raster */
+	int ystart;
+	int yend;
+	int width;
+
+	rt_mask mask;
+	void *userarg;
+	int (*callback)(
+		rt_iterator_arg arg,
+		void *userarg,
+		double *value,
+		int *nodata
+	);
+	int (*rowcallback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	);
+
+	/* copy of output band, for the isnodata flag of the strip */
+	struct rt_band_t band;
+	uint8_t hasnodata;
+	double minval;
+};
+
+/* iterate over the rows of one strip */
+static int
+_rti_iterator_strip_run(void *_strip) {
+	_rti_iterator_strip strip = (_rti_iterator_strip) _strip;
+	_rti_iterator_arg _param = strip->param;
+	uint32_t i = 0;
+	int _x = 0;
+	int _y = 0;
+	double value;
+	int nodata;
+
+	/* _x,_y are for output raster */
+	for (_y = strip->ystart; _y < strip->yend; _y++) {
+		RASTER_DEBUGF(4, "iterating output row %d", _y);
+
+		/* each input raster's rows around output row */
+		for (i = 0; i < _param->count; i++) {
+			if (!_rti_iterator_arg_rows_advance(_param, i, _y, _y == strip->ystart))
+				return 0;
+		}
+
+		/* callback for whole row */
+		if (strip->rowcallback != NULL) {
+			if (!_rti_iterator_rows(_param, _y, strip->userarg, strip->rowcallback, &(strip->band), strip->hasnodata, strip->minval))
+				return 0;
+
+			continue;
+		}
+
+		/* loop over each pixel (POI) of output row */
+		for (_x = 0; _x < strip->width; _x++) {
+			RASTER_DEBUGF(4, "iterating output pixel (x, y) = (%d, %d)", _x, _y);
+			_param->arg->dst_pixel[0] = _x;
+			_param->arg->dst_pixel[1] = _y;
+
+			/* loop through each input raster */
+			for (i = 0; i < _param->count; i++) {
+				RASTER_DEBUGF(4, "raster %d", i);
+
+				/*
+					empty raster
+					OR band does not exist and flag set to use NODATA
+					OR band is NODATA
+				*/
+				if (_rti_iterator_arg_is_empty(_param, i)) {
+					RASTER_DEBUG(4, "empty raster, band does not exist or band is NODATA. using empty values and NODATA");
+
+					_param->arg->values[i] = _param->empty.values;
+					_param->arg->nodata[i] = _param->empty.nodata;
+
+					continue;
+				}
+
+				/* input raster's X,Y */
+				_param->arg->src_pixel[i][0] = _x - (int) _param->offset[i][0];
+				_param->arg->src_pixel[i][1] = _y - (int) _param->offset[i][1];
+				RASTER_DEBUGF(4, "source pixel (x, y) = (%d, %d)",
+					_param->arg->src_pixel[i][0], _param->arg->src_pixel[i][1]);
+
+				/* neighborhood from rows */
+				_rti_iterator_arg_window_fill(_param, i, _x, _y, strip->mask);
+				_param->arg->values[i] = _param->window.values[i];
+				_param->arg->nodata[i] = _param->window.nodata[i];
+			}
+
+			/* callback */
+			RASTER_DEBUG(4, "calling callback function");
+			value = 0;
+			nodata = 0;
+			if (!strip->callback(_param->arg, strip->userarg, &value, &nodata)) {
+				if (_param->error[0] == '\0')
+					snprintf(_param->error, sizeof(_param->error), "Callback function returned an error");
+				return 0;
+			}
+
+			/* burn value to pixel */
+			if (!_rti_iterator_burn(_param, &(strip->band), _x, _y, value, nodata, strip->hasnodata, strip->minval))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+	iterate over all rows of output band, in strips on worker threads
+	if parallel is set and postgis.raster_threads allows
+*/
+static int
+_rti_iterator_run(
+	_rti_iterator_arg _param, rt_iterator itrset, int parallel,
+	int width, int height,
+	rt_mask mask,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_arg arg,
+		void *userarg,
+		double *value,
+		int *nodata
+	),
+	int (*rowcallback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	),
+	rt_band band, uint8_t hasnodata, double minval
+) {
+	struct _rti_iterator_strip_t *strips = NULL;
+	struct _rti_strip_job_t *jobs = NULL;
+	int count = 1;
+	int status = 0;
+	uint32_t i = 0;
+	int k = 0;
+
+	if (parallel) {
+		count = _rti_strip_count(width, height);
+
+		/* band data is read by all strips, load it here */
+		for (i = 0; i < _param->count && count > 1; i++) {
+			if (!_rti_iterator_arg_is_empty(_param, i) && rt_band_get_data(_param->band.rtband[i]) == NULL)
+				count = 1;
+		}
+	}
+	RASTER_DEBUGF(3, "iterating over %d strips", count);
+
+	strips = rtalloc(sizeof(struct _rti_iterator_strip_t) * count);
+	jobs = rtalloc(sizeof(struct _rti_strip_job_t) * count);
+	if (strips == NULL || jobs == NULL) {
+		rterror("rt_raster_iterator: Could not allocate memory for strips");
+		if (strips != NULL) rtdealloc(strips);
+		if (jobs != NULL) rtdealloc(jobs);
+		return 0;
+	}
+	memset(strips, 0, sizeof(struct _rti_iterator_strip_t) * count);
+
+	status = 1;
+	for (k = 0; k < count; k++) {
+		/* first strip uses _param, others get their own rows */
+		if (k == 0)
+			strips[k].param = _param;
+		else if ((strips[k].param = _rti_iterator_arg_copy(_param, itrset, width, callback == NULL)) == NULL) {
+			rterror("rt_raster_iterator: Could not initialize internal variables of strip %d", k);
+			status = 0;
+			break;
+		}
+
+		strips[k].ystart = _rti_strip_start(height, k, count);
+		strips[k].yend = _rti_strip_start(height, k + 1, count);
+		strips[k].width = width;
+		strips[k].mask = mask;
+		strips[k].userarg = userarg;
+		strips[k].callback = callback;
+		strips[k].rowcallback = rowcallback;
+		memcpy(&(strips[k].band), band, sizeof(struct rt_band_t));
+		strips[k].hasnodata = hasnodata;
+		strips[k].minval = minval;
+
+		jobs[k].run = _rti_iterator_strip_run;
+		jobs[k].arg = &(strips[k]);
+	}
+
+	if (status) {
+		status = _rti_strip_jobs_run(jobs, count);
+
+		for (k = 0; k < count; k++) {
+			if (!jobs[k].status) {
+				rterror("rt_raster_iterator: %s", strips[k].param->error);
+				break;
+			}
+
+			if (!strips[k].band.isnodata)
+				band->isnodata = FALSE;
+		}
+	}
+
+	for (k = 1; k < count; k++) {
+		if (strips[k].param != NULL)
+			_rti_iterator_arg_destroy(strips[k].param);
+	}
+	rtdealloc(strips);
+	rtdealloc(jobs);
+
+	return status;
+}
+
+/* shared by rt_raster_iterator(), rt_raster_iterator_parallel() and rt_raster_iterator_rows() */
+static rt_errorstate
+_rti_raster_iterator(
 	rt_iterator itrset, uint16_t itrcount,
 	rt_extenttype extenttype, rt_raster customextent,
 	rt_pixtype pixtype,
@@ -834,6 +1783,13 @@ rt_raster_iterator(
 		double *value,
 		int *nodata
 	),
+	int (*rowcallback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	),
+	int parallel,
 	rt_raster *rtnraster
 ) {
 	/* output raster */
@@ -849,23 +1805,14 @@ rt_raster_iterator(
 	int allempty = 0;
 	int aligned = 0;
 	double offset[4] = {0.};
-	rt_pixel npixels;
 
 	int i = 0;
 	int status = 0;
-	int inextent = 0;
-	int x = 0;
-	int y = 0;
-	int _x = 0;
-	int _y = 0;
 
 	int _width = 0;
 	int _height = 0;
 
 	double minval;
-	double value;
-	int isnodata;
-	int nodata;
 
 	RASTER_DEBUG(3, "Starting...");
 
@@ -875,12 +1822,6 @@ rt_raster_iterator(
 	/* init rtnraster to NULL */
 	*rtnraster = NULL;
 
-	/* check that callback function is not NULL */
-	if (callback == NULL) {
-		rterror("rt_raster_iterator: Callback function not provided");
-		return ES_ERROR;
-	}
-
 	/* check that custom extent is provided if extenttype = ET_CUSTOM */
 	if (extenttype == ET_CUSTOM && rt_raster_is_empty(customextent)) {
 		rterror("rt_raster_iterator: Custom extent cannot be empty if extent type is ET_CUSTOM");
@@ -1196,8 +2137,22 @@ rt_raster_iterator(
 	/* output band's minimum value */
 	minval = rt_band_get_min_value(rtnband);
 
+	/* rows of input rasters around the output row */
+	if (!_rti_iterator_arg_rows_init(_param, _width)) {
+		rterror("rt_raster_iterator: Could not initialize rows of input rasters");
+
+		_rti_iterator_arg_destroy(_param);
+		rt_band_destroy(rtnband);
+		rt_raster_destroy(rtnrast);
+
+		return ES_ERROR;
+	}
+
 	/* initialize argument for callback function */
-	if (!_rti_iterator_arg_callback_init(_param)) {
+	if (
+		(callback != NULL && !_rti_iterator_arg_callback_init(_param)) ||
+		(callback == NULL && !_rti_iterator_arg_rows_callback_init(_param))
+	) {
 		rterror("rt_raster_iterator: Could not initialize callback function argument");
 
 		_rti_iterator_arg_destroy(_param);
@@ -1207,6 +2162,31 @@ rt_raster_iterator(
 		return ES_ERROR;
 	}
 
+	/* make sure that the mask matches the neighborhood */
+	if (mask != NULL) {
+		if (mask->dimx != _param->dimension.columns || mask->dimy != _param->dimension.rows) {
+			rterror("rt_raster_iterator: mask dimensions %d x %d do not match given dims %d x %d",
+				mask->dimx, mask->dimy, _param->dimension.columns, _param->dimension.rows
+			);
+
+			_rti_iterator_arg_destroy(_param);
+			rt_band_destroy(rtnband);
+			rt_raster_destroy(rtnrast);
+
+			return ES_ERROR;
+		}
+
+		if (mask->values == NULL || mask->nodata == NULL) {
+			rterror("rt_raster_iterator: Invalid mask");
+
+			_rti_iterator_arg_destroy(_param);
+			rt_band_destroy(rtnband);
+			rt_raster_destroy(rtnrast);
+
+			return ES_ERROR;
+		}
+	}
+
 	/* fill _param->offset */
 	for (i = 0; i < itrcount; i++) {
 		if (_param->isempty[i])
@@ -1229,208 +2209,199 @@ rt_raster_iterator(
 		RASTER_DEBUGF(4, "rast %d offset: %f %f", i, offset[2], offset[3]);
 	}
 
-	/* loop over each pixel (POI) of output raster */
-	/* _x,_y are for output raster */
-	/* x,y are for input raster */
-	for (_y = 0; _y < _height; _y++) {
-		for (_x = 0; _x < _width; _x++) {
-			RASTER_DEBUGF(4, "iterating output pixel (x, y) = (%d, %d)", _x, _y);
-			_param->arg->dst_pixel[0] = _x;
-			_param->arg->dst_pixel[1] = _y;
-
-			/* loop through each input raster */
-			for (i = 0; i < itrcount; i++) {
-				RASTER_DEBUGF(4, "raster %d", i);
-
-				/*
-					empty raster
-					OR band does not exist and flag set to use NODATA
-					OR band is NODATA
-				*/
-				if (
-					_param->isempty[i] ||
-					(_param->band.rtband[i] == NULL && itrset[i].nbnodata) ||
-					_param->band.isnodata[i]
-				) {
-					RASTER_DEBUG(4, "empty raster, band does not exist or band is NODATA. using empty values and NODATA");
-
-					x = _x;
-					y = _y;
-
-					_param->arg->values[i] = _param->empty.values;
-					_param->arg->nodata[i] = _param->empty.nodata;
-
-					continue;
-				}
-
-				/* input raster's X,Y */
-				x = _x - (int) _param->offset[i][0];
-				y = _y - (int) _param->offset[i][1];
-				RASTER_DEBUGF(4, "source pixel (x, y) = (%d, %d)", x, y);
-
-				_param->arg->src_pixel[i][0] = x;
-				_param->arg->src_pixel[i][1] = y;
-
-				/* neighborhood */
-				npixels = NULL;
-				status = 0;
-				if (distancex > 0 && distancey > 0) {
-					RASTER_DEBUG(4, "getting neighborhood");
-
-					status = rt_band_get_nearest_pixel(
-						_param->band.rtband[i],
-						x, y,
-						distancex, distancey,
-						1,
-						&npixels
-					);
-					if (status < 0) {
-						rterror("rt_raster_iterator: Could not get pixel neighborhood");
-
-						_rti_iterator_arg_destroy(_param);
-						rt_band_destroy(rtnband);
-						rt_raster_destroy(rtnrast);
-
-						return ES_ERROR;
-					}
-				}
-
-				/* get value of POI */
-				/* get pixel's value */
-				if (
-					(x >= 0 && x < _param->width[i]) &&
-					(y >= 0 && y < _param->height[i])
-				) {
-					RASTER_DEBUG(4, "getting value of POI");
-					if (rt_band_get_pixel(
-						_param->band.rtband[i],
-						x, y,
-						&value,
-						&isnodata
-					) != ES_NONE) {
-						rterror("rt_raster_iterator: Could not get the pixel value of band");
-
-						_rti_iterator_arg_destroy(_param);
-						rt_band_destroy(rtnband);
-						rt_raster_destroy(rtnrast);
-
-						return ES_ERROR;
-					}
-					inextent = 1;
-				}
-				/* outside band extent, set to NODATA */
-				else {
-					RASTER_DEBUG(4, "Outside band extent, setting value to NODATA");
-					/* has NODATA, use NODATA */
-					if (_param->band.hasnodata[i])
-						value = _param->band.nodataval[i];
-					/* no NODATA, use min possible value */
-					else
-						value = _param->band.minval[i];
-
-					inextent = 0;
-					isnodata = 1;
-				}
-
-				/* add pixel to neighborhood */
-				status++;
-				if (status > 1)
-					npixels = (rt_pixel) rtrealloc(npixels, sizeof(struct rt_pixel_t) * status);
-				else
-					npixels = (rt_pixel) rtalloc(sizeof(struct rt_pixel_t));
-
-				if (npixels == NULL) {
-					rterror("rt_raster_iterator: Could not reallocate memory for neighborhood");
-
-					_rti_iterator_arg_destroy(_param);
-					rt_band_destroy(rtnband);
-					rt_raster_destroy(rtnrast);
-
-					return ES_ERROR;
-				}
-
-				npixels[status - 1].x = x;
-				npixels[status - 1].y = y;
-				npixels[status - 1].nodata = 1;
-				npixels[status - 1].value = value;
-
-				/* set nodata flag */
-				if ((!_param->band.hasnodata[i] && inextent) || !isnodata) {
-					npixels[status - 1].nodata = 0;
-				}
-				RASTER_DEBUGF(4, "value, nodata: %f, %d", value, npixels[status - 1].nodata);
-
-				/* convert set of rt_pixel to 2D array */
-				status = rt_pixel_set_to_array(
-					npixels, status, mask,
-					x, y,
-					distancex, distancey,
-					&(_param->arg->values[i]),
-					&(_param->arg->nodata[i]),
-					NULL, NULL
-				);
-				rtdealloc(npixels);
-				if (status != ES_NONE) {
-					rterror("rt_raster_iterator: Could not create 2D array of neighborhood");
-
-					_rti_iterator_arg_destroy(_param);
-					rt_band_destroy(rtnband);
-					rt_raster_destroy(rtnrast);
-
-					return ES_ERROR;
-				}
-			}
+	/* loop over each row of output raster */
+	if (!_rti_iterator_run(
+		_param, itrset, parallel,
+		_width, _height,
+		mask,
+		userarg,
+		callback, rowcallback,
+		rtnband, hasnodata, minval
+	)) {
+		_rti_iterator_arg_destroy(_param);
+		rt_band_destroy(rtnband);
+		rt_raster_destroy(rtnrast);
 
-			/* callback */
-			RASTER_DEBUG(4, "calling callback function");
-			value = 0;
-			nodata = 0;
-			status = callback(_param->arg, userarg, &value, &nodata);
+		return ES_ERROR;
+	}
 
-			/* free memory from callback */
-			_rti_iterator_arg_callback_clean(_param);
+	/* lots of cleanup */
+	_rti_iterator_arg_destroy(_param);
 
-			/* handle callback status */
-			if (status == 0) {
-				rterror("rt_raster_iterator: Callback function returned an error");
+	*rtnraster = rtnrast;
+	return ES_NONE;
+}
 
-				_rti_iterator_arg_destroy(_param);
-				rt_band_destroy(rtnband);
-				rt_raster_destroy(rtnrast);
+/**
+ * n-raster iterator.
+ * The raster returned should be freed by the caller
+ *
+ * @param itrset : set of rt_iterator objects.
+ * @param itrcount : number of objects in itrset.
+ * @param extenttype : type of extent for the output raster.
+ * @param customextent : raster specifying custom extent.
+ * is only used if extenttype is ET_CUSTOM.
+ * @param pixtype : the desired pixel type of the output raster's band.
+ * @param hasnodata : indicates if the band has nodata value
+ * @param nodataval : the nodata value, will be appropriately
+ * truncated to fit the pixtype size.
+ * @param distancex : the number of pixels around the specified pixel
+ * along the X axis
+ * @param distancey : the number of pixels around the specified pixel
+ * along the Y axis
+ * @param mask : the object of mask
+ * @param userarg : pointer to any argument that is passed as-is to callback.
+ * @param callback : callback function for actual processing of pixel values.
+ * @param *rtnraster : return one band raster from iterator process
+ *
+ * The callback function _must_ have the following signature.
+ *
+ *    int FNAME(rt_iterator_arg arg, void *userarg, double *value, int *nodata)
+ *
+ * The callback function _must_ return zero (error) or non-zero (success)
+ * indicating whether the function ran successfully.
+ * The parameters passed to the callback function are as follows.
+ *
+ * - rt_iterator_arg arg: struct containing pixel values, NODATA flags and metadata
+ * - void *userarg: NULL or calling function provides to rt_raster_iterator() for use by callback function
+ * - double *value: value of pixel to be burned by rt_raster_iterator()
+ * - int *nodata: flag (0 or 1) indicating that pixel to be burned is NODATA
+ *
+ * @return ES_NONE on success, ES_ERROR on error
+ */
+rt_errorstate
+rt_raster_iterator(
+	rt_iterator itrset, uint16_t itrcount,
+	rt_extenttype extenttype, rt_raster customextent,
+	rt_pixtype pixtype,
+	uint8_t hasnodata, double nodataval,
+	uint16_t distancex, uint16_t distancey,
+	rt_mask mask,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_arg arg,
+		void *userarg,
+		double *value,
+		int *nodata
+	),
+	rt_raster *rtnraster
+) {
+	/* check that callback function is not NULL */
+	if (callback == NULL) {
+		rterror("rt_raster_iterator: Callback function not provided");
+		return ES_ERROR;
+	}
 
-				return ES_ERROR;
-			}
+	return _rti_raster_iterator(
+		itrset, itrcount,
+		extenttype, customextent,
+		pixtype,
+		hasnodata, nodataval,
+		distancex, distancey,
+		mask,
+		userarg,
+		callback, NULL,
+		0,
+		rtnraster
+	);
+}
 
-			/* burn value to pixel */
-			status = 0;
-			if (!nodata) {
-				status = rt_band_set_pixel(rtnband, _x, _y, value, NULL);
-				RASTER_DEBUGF(4, "burning pixel (%d, %d) with value: %f", _x, _y, value);
-			}
-			else if (!hasnodata) {
-				status = rt_band_set_pixel(rtnband, _x, _y, minval, NULL);
-				RASTER_DEBUGF(4, "burning pixel (%d, %d) with minval: %f", _x, _y, minval);
-			}
-			else {
-				RASTER_DEBUGF(4, "NOT burning pixel (%d, %d)", _x, _y);
-			}
-			if (status != ES_NONE) {
-				rterror("rt_raster_iterator: Could not set pixel value");
+/**
+ * n-raster iterator over strips of rows on worker threads.
+ * The raster returned should be freed by the caller
+ *
+ * Parameters are those of rt_raster_iterator().  Output rows are
+ * split into up to postgis.raster_threads strips iterated over
+ * concurrently, so the callback must not go through rtalloc(),
+ * rterror() or any other raster core handler and must only read
+ * userarg.  Without thread support, this is rt_raster_iterator().
+ *
+ * @return ES_NONE on success, ES_ERROR on error
+ */
+rt_errorstate
+rt_raster_iterator_parallel(
+	rt_iterator itrset, uint16_t itrcount,
+	rt_extenttype extenttype, rt_raster customextent,
+	rt_pixtype pixtype,
+	uint8_t hasnodata, double nodataval,
+	uint16_t distancex, uint16_t distancey,
+	rt_mask mask,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_arg arg,
+		void *userarg,
+		double *value,
+		int *nodata
+	),
+	rt_raster *rtnraster
+) {
+	/* check that callback function is not NULL */
+	if (callback == NULL) {
+		rterror("rt_raster_iterator_parallel: Callback function not provided");
+		return ES_ERROR;
+	}
 
-				_rti_iterator_arg_destroy(_param);
-				rt_band_destroy(rtnband);
-				rt_raster_destroy(rtnrast);
+	return _rti_raster_iterator(
+		itrset, itrcount,
+		extenttype, customextent,
+		pixtype,
+		hasnodata, nodataval,
+		distancex, distancey,
+		mask,
+		userarg,
+		callback, NULL,
+		1,
+		rtnraster
+	);
+}
 
-				return ES_ERROR;
-			}
-		}
+/**
+ * n-raster iterator calling back once per row.
+ * The raster returned should be freed by the caller
+ *
+ * Parameters are those of rt_raster_iterator() without mask.
+ * The callback is handed the rows of each input raster around the
+ * output row, padded by distancex pixels on both sides, and fills
+ * the values and NODATA flags of the whole output row.
+ *
+ *    int FNAME(rt_iterator_rows_arg arg, void *userarg, double *values, uint8_t *nodata)
+ *
+ * @return ES_NONE on success, ES_ERROR on error
+ */
+rt_errorstate
+rt_raster_iterator_rows(
+	rt_iterator itrset, uint16_t itrcount,
+	rt_extenttype extenttype, rt_raster customextent,
+	rt_pixtype pixtype,
+	uint8_t hasnodata, double nodataval,
+	uint16_t distancex, uint16_t distancey,
+	void *userarg,
+	int (*callback)(
+		rt_iterator_rows_arg arg,
+		void *userarg,
+		double *values,
+		uint8_t *nodata
+	),
+	rt_raster *rtnraster
+) {
+	/* check that callback function is not NULL */
+	if (callback == NULL) {
+		rterror("rt_raster_iterator_rows: Callback function not provided");
+		return ES_ERROR;
 	}
 
-	/* lots of cleanup */
-	_rti_iterator_arg_destroy(_param);
-
-	*rtnraster = rtnrast;
-	return ES_NONE;
+	return _rti_raster_iterator(
+		itrset, itrcount,
+		extenttype, customextent,
+		pixtype,
+		hasnodata, nodataval,
+		distancex, distancey,
+		NULL,
+		userarg,
+		NULL, callback,
+		0,
+		rtnraster
+	);
 }
 
 /******************************************************************************
@@ -893,6 +893,7 @@ rt_raster_deserialize(void* serialized, int header_only) {
 			ptr += pathlen + 1;
 
 			band->data.offline.mem = NULL;
+			band->data.offline.blocks = NULL;
 		}
 		else {
 			/* Register data */
@@ -390,6 +390,30 @@ char *gdal_enabled_drivers = NULL;
 /*
 	wrapper for GDALOpen and GDALOpenShared
 */
+/* check postgis.gdal_enabled_drivers before opening fn */
+static int
+_rti_gdal_open_allowed(const char *fn) {
+	if (gdal_enabled_drivers != NULL) {
+		if (strstr(gdal_enabled_drivers, GDAL_DISABLE_ALL) != NULL) {
+			rterror("rt_util_gdal_open: Cannot open file. All GDAL drivers disabled");
+			return 0;
+		}
+		else if (strstr(gdal_enabled_drivers, GDAL_ENABLE_ALL) != NULL) {
+			/* do nothing */
+		}
+		else if (
+			(strstr(fn, "/vsi") != NULL) &&
+			(strstr(fn, "/vsimem") == NULL) &&
+			(strstr(gdal_enabled_drivers, GDAL_VSICURL) == NULL)
+		) {
+			rterror("rt_util_gdal_open: Cannot open %s file. %s disabled", GDAL_VSICURL, GDAL_VSICURL);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 GDALDatasetH
 rt_util_gdal_open(
 	const char *fn,
@@ -427,23 +451,8 @@ rt_util_gdal_open(
 	unsigned int open_flags;
 	assert(NULL != fn);
 
-	if (gdal_enabled_drivers != NULL) {
-		if (strstr(gdal_enabled_drivers, GDAL_DISABLE_ALL) != NULL) {
-			rterror("rt_util_gdal_open: Cannot open file. All GDAL drivers disabled");
-			return NULL;
-		}
-		else if (strstr(gdal_enabled_drivers, GDAL_ENABLE_ALL) != NULL) {
-			/* do nothing */
-		}
-		else if (
-			(strstr(fn, "/vsi") != NULL) &&
-			(strstr(fn, "/vsimem") == NULL) &&
-			(strstr(gdal_enabled_drivers, GDAL_VSICURL) == NULL)
-		) {
-			rterror("rt_util_gdal_open: Cannot open %s file. %s disabled", GDAL_VSICURL, GDAL_VSICURL);
-			return NULL;
-		}
-	}
+	if (!_rti_gdal_open_allowed(fn))
+		return NULL;
 
 	open_flags = GDAL_OF_RASTER
 		| GDAL_OF_VERBOSE_ERROR
@@ -458,6 +467,212 @@ rt_util_gdal_open(
 		);
 }
 
+/******************************************************************************
+* out-db dataset cache
+******************************************************************************/
+
+/*
+	Out-db bands used to open their file, read one tile and close it
+	again on every access. Keep the most recently used datasets open
+	instead, keyed by path and postgis.gdal_vsi_options and validated
+	against the file's modification time and size on every hit.
+	Entries with refs > 0 are in use and never evicted.
+*/
+typedef struct {
+	char *path;
+	char *vsi_options;
+	GDALDatasetH ds;
+	time_t mtime;
+	vsi_l_offset size;
+	uint64_t used;
+	int refs;
+} _rti_gdal_cache_entry;
+
+static struct {
+	_rti_gdal_cache_entry entry[POSTGIS_RT_MAX_OPEN_FILES];
+	uint32_t count;
+	uint64_t clock;
+	struct rt_gdal_cache_stats_t stats;
+} _rti_gdal_cache;
+
+static uint32_t
+_rti_gdal_cache_capacity(void) {
+	char *value = rtoptions("outdb_max_open_files");
+	int capacity;
+
+	if (value == NULL)
+		return 0;
+
+	capacity = atoi(value);
+	if (capacity < 0)
+		return 0;
+	else if (capacity > POSTGIS_RT_MAX_OPEN_FILES)
+		return POSTGIS_RT_MAX_OPEN_FILES;
+	return (uint32_t) capacity;
+}
+
+static void
+_rti_gdal_cache_remove(uint32_t i) {
+	_rti_gdal_cache_entry *entry = &(_rti_gdal_cache.entry[i]);
+
+	RASTER_DEBUGF(3, "Closing cached dataset %s", entry->path);
+
+	GDALClose(entry->ds);
+	VSIFree(entry->path);
+	VSIFree(entry->vsi_options);
+
+	/* keep the array packed */
+	_rti_gdal_cache.count--;
+	if (i != _rti_gdal_cache.count)
+		*entry = _rti_gdal_cache.entry[_rti_gdal_cache.count];
+}
+
+/* evict unused entries, least recently used first, until count <= capacity */
+static void
+_rti_gdal_cache_trim(uint32_t capacity) {
+	while (_rti_gdal_cache.count > capacity) {
+		uint32_t i;
+		int lru = -1;
+
+		for (i = 0; i < _rti_gdal_cache.count; i++) {
+			if (_rti_gdal_cache.entry[i].refs > 0)
+				continue;
+			if (lru < 0 || _rti_gdal_cache.entry[i].used < _rti_gdal_cache.entry[lru].used)
+				lru = i;
+		}
+		if (lru < 0)
+			return;
+
+		_rti_gdal_cache_remove(lru);
+		_rti_gdal_cache.stats.evictions++;
+	}
+}
+
+GDALDatasetH
+rt_util_gdal_cache_open(const char *fn) {
+	uint32_t capacity = _rti_gdal_cache_capacity();
+	const char *vsi_options = rtoptions("gdal_vsi_options");
+	_rti_gdal_cache_entry *entry = NULL;
+	GDALDatasetH ds = NULL;
+	VSIStatBufL sStat;
+	int hasstat = 0;
+	uint32_t i;
+
+	assert(NULL != fn);
+
+	if (!capacity) {
+		_rti_gdal_cache_trim(0);
+		return rt_util_gdal_open(fn, GA_ReadOnly, 1);
+	}
+
+	/* the enabled drivers may have changed since a cached file was opened */
+	if (!_rti_gdal_open_allowed(fn))
+		return NULL;
+
+	if (vsi_options == NULL)
+		vsi_options = "";
+
+	for (i = 0; i < _rti_gdal_cache.count; i++) {
+		if (
+			strcmp(_rti_gdal_cache.entry[i].path, fn) == 0 &&
+			strcmp(_rti_gdal_cache.entry[i].vsi_options, vsi_options) == 0
+		) {
+			entry = &(_rti_gdal_cache.entry[i]);
+			break;
+		}
+	}
+
+	hasstat = (VSIStatL(fn, &sStat) == 0);
+
+	if (entry != NULL) {
+		if (hasstat && entry->mtime == sStat.st_mtime && entry->size == sStat.st_size) {
+			RASTER_DEBUGF(3, "Reusing cached dataset %s", fn);
+			_rti_gdal_cache.stats.hits++;
+			entry->used = ++_rti_gdal_cache.clock;
+			entry->refs++;
+			return entry->ds;
+		}
+
+		/* file changed on disk */
+		_rti_gdal_cache.stats.stale++;
+		if (entry->refs > 0)
+			return rt_util_gdal_open(fn, GA_ReadOnly, 1);
+		_rti_gdal_cache_remove(i);
+	}
+
+	_rti_gdal_cache.stats.misses++;
+	ds = rt_util_gdal_open(fn, GA_ReadOnly, 0);
+	if (ds == NULL || !hasstat)
+		return ds;
+
+	/* make room, or leave the dataset uncached if every entry is in use */
+	_rti_gdal_cache_trim(capacity - 1);
+	if (_rti_gdal_cache.count >= capacity)
+		return ds;
+
+	entry = &(_rti_gdal_cache.entry[_rti_gdal_cache.count]);
+	entry->path = VSIStrdup(fn);
+	entry->vsi_options = VSIStrdup(vsi_options);
+	if (entry->path == NULL || entry->vsi_options == NULL) {
+		VSIFree(entry->path);
+		VSIFree(entry->vsi_options);
+		return ds;
+	}
+	entry->ds = ds;
+	entry->mtime = sStat.st_mtime;
+	entry->size = sStat.st_size;
+	entry->used = ++_rti_gdal_cache.clock;
+	entry->refs = 1;
+	_rti_gdal_cache.count++;
+
+	return ds;
+}
+
+void
+rt_util_gdal_cache_close(GDALDatasetH ds) {
+	uint32_t i;
+
+	if (ds == NULL)
+		return;
+
+	for (i = 0; i < _rti_gdal_cache.count; i++) {
+		if (_rti_gdal_cache.entry[i].ds == ds) {
+			if (_rti_gdal_cache.entry[i].refs > 0)
+				_rti_gdal_cache.entry[i].refs--;
+			return;
+		}
+	}
+
+	/* not cached */
+	GDALClose(ds);
+}
+
+void
+rt_util_gdal_cache_release_all(void) {
+	uint32_t i;
+
+	for (i = 0; i < _rti_gdal_cache.count; i++)
+		_rti_gdal_cache.entry[i].refs = 0;
+
+	/* entries pinned past a lowered limit can go now */
+	_rti_gdal_cache_trim(_rti_gdal_cache_capacity());
+}
+
+void
+rt_util_gdal_cache_flush(void) {
+	while (_rti_gdal_cache.count > 0)
+		_rti_gdal_cache_remove(_rti_gdal_cache.count - 1);
+}
+
+void
+rt_util_gdal_cache_get_stats(rt_gdal_cache_stats stats) {
+	assert(NULL != stats);
+
+	*stats = _rti_gdal_cache.stats;
+	stats->entries = _rti_gdal_cache.count;
+	stats->capacity = _rti_gdal_cache_capacity();
+}
+
 void
 rt_util_from_ogr_envelope(
 	OGREnvelope	env,
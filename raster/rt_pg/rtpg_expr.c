@@ -0,0 +1,1427 @@
+/*
+ *
+ * WKTRaster - Raster Types for PostGIS
+ * http://trac.osgeo.org/postgis/wiki/WKTRaster
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Compiled map algebra expressions
+ *
+ * The expressions of ST_MapAlgebra are SQL, evaluated with a prepared
+ * SPI plan for every pixel. The common ones only use arithmetic,
+ * comparisons, CASE and a few math functions on the pixel values,
+ * so they are compiled here into a tree evaluated without the
+ * executor, a block of pixels at a time.
+ *
+ * The evaluation gives the result PostgreSQL would give, including
+ * NULL handling, integer arithmetic on the positions and the errors
+ * raised on overflow or division by zero. Anything whose semantics
+ * are not reproduced exactly (numeric arithmetic, other operators and
+ * functions, subqueries...) makes rtpg_expr_compile() decline and the
+ * caller keeps using SPI.
+ */
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <postgres.h> /* for palloc */
+#include <utils/memutils.h>
+#include <catalog/pg_type.h> /* for INT4OID and FLOAT8OID */
+
+#include "../../postgis_config.h"
+#include "rtpg_internal.h"
+
+/* Number of pixels evaluated at once */
+#define RTPG_EXPR_BLOCK 256
+
+/* Deepest expression compiled, deeper ones are left to SPI */
+#define RTPG_EXPR_MAXDEPTH 64
+
+/* Value types, all values are held as doubles */
+typedef enum {
+	RTPG_EXPR_BOOL,
+	RTPG_EXPR_INT4,
+	RTPG_EXPR_FLOAT8,
+	/* numeric literals, or values picked from them and from int4 */
+	/* values, so exactly known as doubles */
+	RTPG_EXPR_NUMERIC,
+	/* untyped NULL literal */
+	RTPG_EXPR_UNKNOWN
+} rtpg_expr_type;
+
+typedef enum {
+	EXPR_CONST,
+	EXPR_PARAM,
+	EXPR_NEG,
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_MUL,
+	EXPR_DIV,
+	EXPR_MOD,
+	EXPR_LT,
+	EXPR_LE,
+	EXPR_GT,
+	EXPR_GE,
+	EXPR_EQ,
+	EXPR_NE,
+	EXPR_AND,
+	EXPR_OR,
+	EXPR_NOT,
+	EXPR_ISNULL,
+	EXPR_ISNOTNULL,
+	EXPR_CASE,
+	EXPR_COALESCE,
+	EXPR_GREATEST,
+	EXPR_LEAST,
+	EXPR_TOINT4,
+	EXPR_ABS,
+	EXPR_SQRT,
+	EXPR_LN,
+	EXPR_LOG10,
+	EXPR_FLOOR,
+	EXPR_CEIL,
+	EXPR_ROUND,
+	EXPR_TRUNC,
+	EXPR_SIGN,
+	EXPR_SIN,
+	EXPR_COS,
+	EXPR_TAN,
+	EXPR_ATAN
+} rtpg_expr_op;
+
+typedef struct rtpg_expr_node_t *rtpg_expr_node;
+struct rtpg_expr_node_t {
+	rtpg_expr_op op;
+	/* type of the value, changed by casts */
+	rtpg_expr_type type;
+	/* type the operation works in, int4 arithmetic or float8 */
+	rtpg_expr_type optype;
+
+	double constval;
+	bool constnull;
+	int param;
+
+	/* operands, CASE has condition/result pairs then the ELSE result */
+	int nargs;
+	rtpg_expr_node *args;
+	bool haselse;
+
+	/* values of a block */
+	double *val;
+	bool *isnull;
+};
+
+struct rtpg_expr_t {
+	MemoryContext context;
+	int nargs;
+	rtpg_expr_node root;
+};
+
+/******************************************************************************
+ * Parser
+ */
+
+typedef enum {
+	TOK_END,
+	TOK_NUM,
+	TOK_PARAM,
+	TOK_IDENT,
+	TOK_LPAREN,
+	TOK_RPAREN,
+	TOK_COMMA,
+	TOK_CAST,
+	TOK_PLUS,
+	TOK_MINUS,
+	TOK_STAR,
+	TOK_SLASH,
+	TOK_PERCENT,
+	TOK_LT,
+	TOK_LE,
+	TOK_GT,
+	TOK_GE,
+	TOK_EQ,
+	TOK_NE,
+	TOK_BAD
+} rtpg_expr_token;
+
+typedef struct {
+	const char *pos;
+	int nargs;
+	const Oid *argtypes;
+	int depth;
+
+	/* current token */
+	rtpg_expr_token tok;
+	char ident[NAMEDATALEN];
+	double num;
+	rtpg_expr_type numtype;
+	int param;
+} rtpg_expr_parser;
+
+static bool
+expr_is_opchar(char c) {
+	return c != '\0' && strchr("+-*/<>=~!@#%^&|`?", c) != NULL;
+}
+
+/*
+ * Read a number the way the PostgreSQL lexer does: integers that fit
+ * are int4, the others numeric. Numeric literals with more significant
+ * digits than a double holds exactly are refused.
+ */
+static rtpg_expr_token
+expr_lex_number(rtpg_expr_parser *p) {
+	const char *start = p->pos;
+	const char *ptr = p->pos;
+	bool isint = true;
+	int sigdigits = 0;
+	int pending = 0;
+	bool leading = true;
+	char *end;
+
+	while (isdigit((unsigned char) *ptr) || *ptr == '.') {
+		if (*ptr == '.') {
+			if (!isint)
+				return TOK_BAD;
+			isint = false;
+		}
+		else if (*ptr == '0') {
+			if (!leading)
+				pending++;
+		}
+		else {
+			sigdigits += pending + 1;
+			pending = 0;
+			leading = false;
+		}
+		ptr++;
+	}
+	if (*ptr == 'e' || *ptr == 'E') {
+		ptr++;
+		if (*ptr == '+' || *ptr == '-')
+			ptr++;
+		if (!isdigit((unsigned char) *ptr))
+			return TOK_BAD;
+		while (isdigit((unsigned char) *ptr))
+			ptr++;
+		isint = false;
+	}
+	/* trailing junk */
+	if (isalnum((unsigned char) *ptr) || *ptr == '_' || *ptr == '$')
+		return TOK_BAD;
+
+	p->num = strtod(start, &end);
+	if (end != ptr)
+		return TOK_BAD;
+	p->pos = ptr;
+
+	if (isint) {
+		if (p->num > PG_INT32_MAX)
+			return TOK_BAD;
+		p->numtype = RTPG_EXPR_INT4;
+	}
+	else {
+		if (sigdigits > DBL_DIG || !isfinite(p->num))
+			return TOK_BAD;
+		p->numtype = RTPG_EXPR_NUMERIC;
+	}
+	return TOK_NUM;
+}
+
+static rtpg_expr_token
+expr_lex_operator(rtpg_expr_parser *p) {
+	const char *ptr = p->pos;
+	size_t len = 0;
+	bool trim = true;
+
+	while (expr_is_opchar(ptr[len])) {
+		/* comments */
+		if ((ptr[len] == '-' && ptr[len + 1] == '-') || (ptr[len] == '/' && ptr[len + 1] == '*'))
+			return TOK_BAD;
+		if (strchr("~!@#%^&|`?", ptr[len]) != NULL)
+			trim = false;
+		len++;
+	}
+	/* like the PostgreSQL lexer, a trailing + or - is a separate operator */
+	if (trim) {
+		while (len > 1 && (ptr[len - 1] == '+' || ptr[len - 1] == '-'))
+			len--;
+	}
+	p->pos += len;
+
+	if (len == 1) {
+		switch (*ptr) {
+			case '+': return TOK_PLUS;
+			case '-': return TOK_MINUS;
+			case '*': return TOK_STAR;
+			case '/': return TOK_SLASH;
+			case '%': return TOK_PERCENT;
+			case '<': return TOK_LT;
+			case '>': return TOK_GT;
+			case '=': return TOK_EQ;
+			default: return TOK_BAD;
+		}
+	}
+	if (len == 2) {
+		if (strncmp(ptr, "<=", 2) == 0) return TOK_LE;
+		if (strncmp(ptr, ">=", 2) == 0) return TOK_GE;
+		if (strncmp(ptr, "<>", 2) == 0) return TOK_NE;
+		if (strncmp(ptr, "!=", 2) == 0) return TOK_NE;
+	}
+	return TOK_BAD;
+}
+
+static void
+expr_next(rtpg_expr_parser *p) {
+	while (isspace((unsigned char) *p->pos))
+		p->pos++;
+
+	if (*p->pos == '\0') {
+		p->tok = TOK_END;
+	}
+	else if (isdigit((unsigned char) *p->pos) || (*p->pos == '.' && isdigit((unsigned char) p->pos[1]))) {
+		p->tok = expr_lex_number(p);
+	}
+	else if (*p->pos == '$') {
+		long param;
+		char *end;
+
+		param = strtol(p->pos + 1, &end, 10);
+		if (end == p->pos + 1 || param < 1 || param > p->nargs ||
+			isalpha((unsigned char) *end) || *end == '_' || *end == '$')
+			p->tok = TOK_BAD;
+		else {
+			p->param = (int) param - 1;
+			p->pos = end;
+			p->tok = TOK_PARAM;
+		}
+	}
+	else if (isalpha((unsigned char) *p->pos) || *p->pos == '_') {
+		size_t len = 0;
+
+		while (isalnum((unsigned char) p->pos[len]) || p->pos[len] == '_' || p->pos[len] == '$') {
+			if (len + 1 >= NAMEDATALEN) {
+				p->tok = TOK_BAD;
+				return;
+			}
+			p->ident[len] = tolower((unsigned char) p->pos[len]);
+			len++;
+		}
+		p->ident[len] = '\0';
+		p->pos += len;
+		p->tok = TOK_IDENT;
+	}
+	else if (*p->pos == '(') {
+		p->pos++;
+		p->tok = TOK_LPAREN;
+	}
+	else if (*p->pos == ')') {
+		p->pos++;
+		p->tok = TOK_RPAREN;
+	}
+	else if (*p->pos == ',') {
+		p->pos++;
+		p->tok = TOK_COMMA;
+	}
+	else if (p->pos[0] == ':' && p->pos[1] == ':') {
+		p->pos += 2;
+		p->tok = TOK_CAST;
+	}
+	else if (expr_is_opchar(*p->pos)) {
+		p->tok = expr_lex_operator(p);
+	}
+	else
+		p->tok = TOK_BAD;
+}
+
+static bool
+expr_accept_ident(rtpg_expr_parser *p, const char *kw) {
+	if (p->tok == TOK_IDENT && strcmp(p->ident, kw) == 0) {
+		expr_next(p);
+		return true;
+	}
+	return false;
+}
+
+static bool
+expr_accept(rtpg_expr_parser *p, rtpg_expr_token tok) {
+	if (p->tok == tok) {
+		expr_next(p);
+		return true;
+	}
+	return false;
+}
+
+static rtpg_expr_node
+expr_node(rtpg_expr_op op, rtpg_expr_type type, int nargs) {
+	rtpg_expr_node node = palloc0(sizeof(struct rtpg_expr_node_t));
+	node->op = op;
+	node->type = type;
+	node->optype = type;
+	node->nargs = nargs;
+	if (nargs)
+		node->args = palloc0(sizeof(rtpg_expr_node) * nargs);
+	node->val = palloc(sizeof(double) * RTPG_EXPR_BLOCK);
+	node->isnull = palloc(sizeof(bool) * RTPG_EXPR_BLOCK);
+	return node;
+}
+
+static bool
+expr_is_number(rtpg_expr_type type) {
+	return type == RTPG_EXPR_INT4 || type == RTPG_EXPR_FLOAT8 || type == RTPG_EXPR_NUMERIC;
+}
+
+/*
+ * Common type of the branches of CASE, COALESCE, GREATEST and LEAST,
+ * as PostgreSQL resolves it. Returns false if there is none we handle.
+ */
+static bool
+expr_common_type(rtpg_expr_node *nodes, int count, int step, rtpg_expr_type *type) {
+	rtpg_expr_type common = RTPG_EXPR_UNKNOWN;
+
+	for (int i = 0; i < count; i += step) {
+		rtpg_expr_type t = nodes[i]->type;
+		if (t == RTPG_EXPR_UNKNOWN)
+			continue;
+		if (common == RTPG_EXPR_UNKNOWN)
+			common = t;
+		else if (common == RTPG_EXPR_BOOL || t == RTPG_EXPR_BOOL) {
+			if (common != t)
+				return false;
+		}
+		else if (common == RTPG_EXPR_FLOAT8 || t == RTPG_EXPR_FLOAT8)
+			common = RTPG_EXPR_FLOAT8;
+		else if (common == RTPG_EXPR_NUMERIC || t == RTPG_EXPR_NUMERIC)
+			common = RTPG_EXPR_NUMERIC;
+	}
+	*type = common;
+	return true;
+}
+
+static rtpg_expr_node expr_parse_or(rtpg_expr_parser *p);
+
+static rtpg_expr_node
+expr_parse_typename(rtpg_expr_parser *p, rtpg_expr_node arg) {
+	rtpg_expr_node node;
+
+	if (!arg || p->tok != TOK_IDENT)
+		return NULL;
+
+	if (expr_accept_ident(p, "double")) {
+		if (!expr_accept_ident(p, "precision"))
+			return NULL;
+	}
+	else if (expr_accept_ident(p, "float8") || expr_accept_ident(p, "float")) {
+		/* float without a precision is double precision */
+		if (p->tok == TOK_LPAREN)
+			return NULL;
+	}
+	else if (expr_accept_ident(p, "integer") || expr_accept_ident(p, "int") || expr_accept_ident(p, "int4")) {
+		if (arg->type == RTPG_EXPR_INT4 || arg->type == RTPG_EXPR_UNKNOWN) {
+			arg->type = RTPG_EXPR_INT4;
+			return arg;
+		}
+		if (!expr_is_number(arg->type))
+			return NULL;
+		node = expr_node(EXPR_TOINT4, RTPG_EXPR_INT4, 1);
+		node->optype = arg->type;
+		node->args[0] = arg;
+		return node;
+	}
+	else
+		return NULL;
+
+	/* to double precision */
+	if (arg->type == RTPG_EXPR_BOOL)
+		return NULL;
+	arg->type = RTPG_EXPR_FLOAT8;
+	return arg;
+}
+
+static rtpg_expr_node
+expr_parse_function(rtpg_expr_parser *p, const char *name) {
+	static const struct {
+		const char *name;
+		rtpg_expr_op op;
+		int nargs; /* -1 for variadic */
+		bool numeric; /* has a numeric variant we reproduce */
+	} functions[] = {
+		{"abs", EXPR_ABS, 1, true},
+		{"sqrt", EXPR_SQRT, 1, false},
+		{"ln", EXPR_LN, 1, false},
+		{"log", EXPR_LOG10, 1, false},
+		{"log10", EXPR_LOG10, 1, false},
+		{"floor", EXPR_FLOOR, 1, true},
+		{"ceil", EXPR_CEIL, 1, true},
+		{"ceiling", EXPR_CEIL, 1, true},
+		{"round", EXPR_ROUND, 1, true},
+		{"trunc", EXPR_TRUNC, 1, true},
+		{"sign", EXPR_SIGN, 1, true},
+		{"sin", EXPR_SIN, 1, false},
+		{"cos", EXPR_COS, 1, false},
+		{"tan", EXPR_TAN, 1, false},
+		{"atan", EXPR_ATAN, 1, false},
+		{"coalesce", EXPR_COALESCE, -1, true},
+		{"greatest", EXPR_GREATEST, -1, true},
+		{"least", EXPR_LEAST, -1, true}
+	};
+	rtpg_expr_node args[FUNC_MAX_ARGS];
+	rtpg_expr_node node;
+	int nargs = 0;
+	int f;
+
+	/* pi() */
+	if (strcmp(name, "pi") == 0) {
+		if (!expr_accept(p, TOK_RPAREN))
+			return NULL;
+		node = expr_node(EXPR_CONST, RTPG_EXPR_FLOAT8, 0);
+		node->constval = M_PI;
+		return node;
+	}
+
+	for (f = 0; f < (int) (sizeof(functions) / sizeof(functions[0])); f++) {
+		if (strcmp(name, functions[f].name) == 0)
+			break;
+	}
+	if (f == (int) (sizeof(functions) / sizeof(functions[0])))
+		return NULL;
+
+	do {
+		if (nargs == FUNC_MAX_ARGS)
+			return NULL;
+		args[nargs] = expr_parse_or(p);
+		if (!args[nargs])
+			return NULL;
+		nargs++;
+	}
+	while (expr_accept(p, TOK_COMMA));
+	if (!expr_accept(p, TOK_RPAREN))
+		return NULL;
+
+	if (functions[f].nargs >= 0 && nargs != functions[f].nargs)
+		return NULL;
+
+	if (functions[f].nargs < 0) {
+		rtpg_expr_type type;
+		if (!expr_common_type(args, nargs, 1, &type))
+			return NULL;
+		/* comparing booleans is not supported */
+		if (type == RTPG_EXPR_BOOL && functions[f].op != EXPR_COALESCE)
+			return NULL;
+		if (type == RTPG_EXPR_UNKNOWN)
+			return NULL;
+		node = expr_node(functions[f].op, type, nargs);
+		memcpy(node->args, args, sizeof(rtpg_expr_node) * nargs);
+		return node;
+	}
+
+	/* one argument math functions */
+	if (!expr_is_number(args[0]->type))
+		return NULL;
+	/* numeric arguments use the numeric variant of the function */
+	if (args[0]->type == RTPG_EXPR_NUMERIC && !functions[f].numeric) {
+		/* only the trigonometric ones have no numeric variant */
+		if (functions[f].op != EXPR_SIN && functions[f].op != EXPR_COS &&
+			functions[f].op != EXPR_TAN && functions[f].op != EXPR_ATAN)
+			return NULL;
+	}
+
+	node = expr_node(functions[f].op, RTPG_EXPR_FLOAT8, 1);
+	node->optype = args[0]->type;
+	node->args[0] = args[0];
+	/* abs(int4) is int4, the numeric variants return numeric */
+	if (args[0]->type == RTPG_EXPR_INT4 && functions[f].op == EXPR_ABS)
+		node->type = RTPG_EXPR_INT4;
+	else if (args[0]->type == RTPG_EXPR_NUMERIC && functions[f].numeric)
+		node->type = RTPG_EXPR_NUMERIC;
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_case(rtpg_expr_parser *p) {
+	rtpg_expr_node args[2 * FUNC_MAX_ARGS + 1];
+	rtpg_expr_node results[FUNC_MAX_ARGS + 1];
+	rtpg_expr_node node;
+	int nargs = 0;
+	int nresults = 0;
+	bool haselse = false;
+	rtpg_expr_type type;
+
+	/* only the searched form, CASE WHEN cond THEN ... */
+	while (expr_accept_ident(p, "when")) {
+		if (nargs + 2 > 2 * FUNC_MAX_ARGS)
+			return NULL;
+		args[nargs] = expr_parse_or(p);
+		if (!args[nargs])
+			return NULL;
+		if (args[nargs]->type != RTPG_EXPR_BOOL && args[nargs]->type != RTPG_EXPR_UNKNOWN)
+			return NULL;
+		if (!expr_accept_ident(p, "then"))
+			return NULL;
+		args[nargs + 1] = expr_parse_or(p);
+		if (!args[nargs + 1])
+			return NULL;
+		results[nresults++] = args[nargs + 1];
+		nargs += 2;
+	}
+	if (!nargs)
+		return NULL;
+	if (expr_accept_ident(p, "else")) {
+		args[nargs] = expr_parse_or(p);
+		if (!args[nargs])
+			return NULL;
+		results[nresults++] = args[nargs];
+		nargs++;
+		haselse = true;
+	}
+	if (!expr_accept_ident(p, "end"))
+		return NULL;
+
+	if (!expr_common_type(results, nresults, 1, &type) || type == RTPG_EXPR_UNKNOWN)
+		return NULL;
+
+	node = expr_node(EXPR_CASE, type, nargs);
+	memcpy(node->args, args, sizeof(rtpg_expr_node) * nargs);
+	node->haselse = haselse;
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_primary(rtpg_expr_parser *p) {
+	rtpg_expr_node node = NULL;
+
+	switch (p->tok) {
+		case TOK_NUM:
+			node = expr_node(EXPR_CONST, p->numtype, 0);
+			node->constval = p->num;
+			expr_next(p);
+			return node;
+		case TOK_PARAM:
+			node = expr_node(EXPR_PARAM, p->argtypes[p->param] == INT4OID ? RTPG_EXPR_INT4 : RTPG_EXPR_FLOAT8, 0);
+			node->param = p->param;
+			expr_next(p);
+			return node;
+		case TOK_LPAREN:
+			expr_next(p);
+			node = expr_parse_or(p);
+			if (!node || !expr_accept(p, TOK_RPAREN))
+				return NULL;
+			return node;
+		case TOK_IDENT: {
+			char name[NAMEDATALEN];
+
+			if (expr_accept_ident(p, "null")) {
+				node = expr_node(EXPR_CONST, RTPG_EXPR_UNKNOWN, 0);
+				node->constnull = true;
+				return node;
+			}
+			if (strcmp(p->ident, "true") == 0 || strcmp(p->ident, "false") == 0) {
+				node = expr_node(EXPR_CONST, RTPG_EXPR_BOOL, 0);
+				node->constval = strcmp(p->ident, "true") == 0;
+				expr_next(p);
+				return node;
+			}
+			if (expr_accept_ident(p, "case"))
+				return expr_parse_case(p);
+			if (expr_accept_ident(p, "cast")) {
+				if (!expr_accept(p, TOK_LPAREN))
+					return NULL;
+				node = expr_parse_or(p);
+				if (!node || !expr_accept_ident(p, "as"))
+					return NULL;
+				node = expr_parse_typename(p, node);
+				if (!node || !expr_accept(p, TOK_RPAREN))
+					return NULL;
+				return node;
+			}
+
+			strcpy(name, p->ident);
+			expr_next(p);
+			if (!expr_accept(p, TOK_LPAREN))
+				return NULL;
+			return expr_parse_function(p, name);
+		}
+		default:
+			return NULL;
+	}
+}
+
+static rtpg_expr_node
+expr_parse_postfix(rtpg_expr_parser *p) {
+	rtpg_expr_node node = expr_parse_primary(p);
+
+	while (node && expr_accept(p, TOK_CAST))
+		node = expr_parse_typename(p, node);
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_unary(rtpg_expr_parser *p) {
+	rtpg_expr_node node;
+	rtpg_expr_node arg;
+
+	if (++p->depth > RTPG_EXPR_MAXDEPTH)
+		return NULL;
+
+	if (expr_accept(p, TOK_PLUS)) {
+		node = expr_parse_unary(p);
+		if (node && !expr_is_number(node->type))
+			node = NULL;
+	}
+	else if (expr_accept(p, TOK_MINUS)) {
+		arg = expr_parse_unary(p);
+		if (!arg || !expr_is_number(arg->type))
+			return NULL;
+		/* a negative literal, as the PostgreSQL parser folds them */
+		if (arg->op == EXPR_CONST && arg->type != RTPG_EXPR_INT4) {
+			arg->constval = -arg->constval;
+			node = arg;
+		}
+		else {
+			node = expr_node(EXPR_NEG, arg->type, 1);
+			node->optype = arg->type;
+			node->args[0] = arg;
+		}
+	}
+	else
+		node = expr_parse_postfix(p);
+
+	p->depth--;
+	return node;
+}
+
+static rtpg_expr_node
+expr_arith(rtpg_expr_op op, rtpg_expr_node left, rtpg_expr_node right) {
+	rtpg_expr_node node;
+	rtpg_expr_type type;
+
+	if (!left || !right)
+		return NULL;
+	/* an untyped NULL takes the type of the other side */
+	if (left->type == RTPG_EXPR_UNKNOWN)
+		left->type = right->type;
+	if (right->type == RTPG_EXPR_UNKNOWN)
+		right->type = left->type;
+	if (!expr_is_number(left->type) || !expr_is_number(right->type))
+		return NULL;
+
+	if (left->type == RTPG_EXPR_INT4 && right->type == RTPG_EXPR_INT4)
+		type = RTPG_EXPR_INT4;
+	else if (left->type == RTPG_EXPR_FLOAT8 || right->type == RTPG_EXPR_FLOAT8)
+		type = RTPG_EXPR_FLOAT8;
+	/* numeric arithmetic is left to SPI */
+	else
+		return NULL;
+
+	/* there is no float8 modulo */
+	if (op == EXPR_MOD && type != RTPG_EXPR_INT4)
+		return NULL;
+
+	node = expr_node(op, type, 2);
+	node->optype = type;
+	node->args[0] = left;
+	node->args[1] = right;
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_mul(rtpg_expr_parser *p) {
+	rtpg_expr_node node = expr_parse_unary(p);
+
+	while (node) {
+		if (expr_accept(p, TOK_STAR))
+			node = expr_arith(EXPR_MUL, node, expr_parse_unary(p));
+		else if (expr_accept(p, TOK_SLASH))
+			node = expr_arith(EXPR_DIV, node, expr_parse_unary(p));
+		else if (expr_accept(p, TOK_PERCENT))
+			node = expr_arith(EXPR_MOD, node, expr_parse_unary(p));
+		else
+			break;
+	}
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_add(rtpg_expr_parser *p) {
+	rtpg_expr_node node = expr_parse_mul(p);
+
+	while (node) {
+		if (expr_accept(p, TOK_PLUS))
+			node = expr_arith(EXPR_ADD, node, expr_parse_mul(p));
+		else if (expr_accept(p, TOK_MINUS))
+			node = expr_arith(EXPR_SUB, node, expr_parse_mul(p));
+		else
+			break;
+	}
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_cmp(rtpg_expr_parser *p) {
+	rtpg_expr_node left = expr_parse_add(p);
+	rtpg_expr_node right;
+	rtpg_expr_node node;
+	rtpg_expr_op op;
+
+	if (!left)
+		return NULL;
+
+	switch (p->tok) {
+		case TOK_LT: op = EXPR_LT; break;
+		case TOK_LE: op = EXPR_LE; break;
+		case TOK_GT: op = EXPR_GT; break;
+		case TOK_GE: op = EXPR_GE; break;
+		case TOK_EQ: op = EXPR_EQ; break;
+		case TOK_NE: op = EXPR_NE; break;
+		default: return left;
+	}
+	expr_next(p);
+
+	right = expr_parse_add(p);
+	if (!right)
+		return NULL;
+	if (left->type == RTPG_EXPR_UNKNOWN)
+		left->type = right->type;
+	if (right->type == RTPG_EXPR_UNKNOWN)
+		right->type = left->type;
+	if (!expr_is_number(left->type) || !expr_is_number(right->type))
+		return NULL;
+
+	node = expr_node(op, RTPG_EXPR_BOOL, 2);
+	node->args[0] = left;
+	node->args[1] = right;
+	if (left->type == RTPG_EXPR_FLOAT8 || right->type == RTPG_EXPR_FLOAT8)
+		node->optype = RTPG_EXPR_FLOAT8;
+	else
+		node->optype = RTPG_EXPR_INT4;
+
+	/* comparisons do not chain */
+	if (p->tok >= TOK_LT && p->tok <= TOK_NE)
+		return NULL;
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_is(rtpg_expr_parser *p) {
+	rtpg_expr_node arg = expr_parse_cmp(p);
+	rtpg_expr_node node;
+	rtpg_expr_op op = EXPR_ISNULL;
+
+	if (!arg || !expr_accept_ident(p, "is"))
+		return arg;
+
+	if (expr_accept_ident(p, "not"))
+		op = EXPR_ISNOTNULL;
+	if (!expr_accept_ident(p, "null"))
+		return NULL;
+
+	node = expr_node(op, RTPG_EXPR_BOOL, 1);
+	node->args[0] = arg;
+	return node;
+}
+
+static rtpg_expr_node
+expr_bool_operand(rtpg_expr_node node) {
+	if (!node)
+		return NULL;
+	if (node->type == RTPG_EXPR_UNKNOWN)
+		node->type = RTPG_EXPR_BOOL;
+	return node->type == RTPG_EXPR_BOOL ? node : NULL;
+}
+
+static rtpg_expr_node
+expr_parse_not(rtpg_expr_parser *p) {
+	rtpg_expr_node node;
+	rtpg_expr_node arg;
+
+	if (!expr_accept_ident(p, "not"))
+		return expr_parse_is(p);
+
+	if (++p->depth > RTPG_EXPR_MAXDEPTH)
+		return NULL;
+	arg = expr_bool_operand(expr_parse_not(p));
+	p->depth--;
+	if (!arg)
+		return NULL;
+
+	node = expr_node(EXPR_NOT, RTPG_EXPR_BOOL, 1);
+	node->args[0] = arg;
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_and(rtpg_expr_parser *p) {
+	rtpg_expr_node node = expr_parse_not(p);
+
+	while (node && expr_accept_ident(p, "and")) {
+		rtpg_expr_node left = expr_bool_operand(node);
+		rtpg_expr_node right = expr_bool_operand(expr_parse_not(p));
+		if (!left || !right)
+			return NULL;
+		node = expr_node(EXPR_AND, RTPG_EXPR_BOOL, 2);
+		node->args[0] = left;
+		node->args[1] = right;
+	}
+	return node;
+}
+
+static rtpg_expr_node
+expr_parse_or(rtpg_expr_parser *p) {
+	rtpg_expr_node node;
+
+	if (++p->depth > RTPG_EXPR_MAXDEPTH)
+		return NULL;
+
+	node = expr_parse_and(p);
+	while (node && expr_accept_ident(p, "or")) {
+		rtpg_expr_node left = expr_bool_operand(node);
+		rtpg_expr_node right = expr_bool_operand(expr_parse_and(p));
+		if (!left || !right)
+			return NULL;
+		node = expr_node(EXPR_OR, RTPG_EXPR_BOOL, 2);
+		node->args[0] = left;
+		node->args[1] = right;
+	}
+
+	p->depth--;
+	return node;
+}
+
+/**
+ * Compile the expression of a map algebra, with its pixel keywords
+ * already replaced by the $1 ... $nargs placeholders of types argtypes
+ * (INT4OID or FLOAT8OID). The result is the expression cast to double
+ * precision.
+ *
+ * @return the compiled expression, or NULL if the expression uses
+ * anything that is not supported, in which case it has to be run
+ * through SPI.
+ */
+rtpg_expr
+rtpg_expr_compile(const char *str, int nargs, const Oid *argtypes) {
+	MemoryContext context;
+	MemoryContext oldcontext;
+	rtpg_expr_parser parser;
+	rtpg_expr_node root;
+	rtpg_expr expr;
+
+	if (nargs > FUNC_MAX_ARGS)
+		return NULL;
+	for (int i = 0; i < nargs; i++) {
+		if (argtypes[i] != INT4OID && argtypes[i] != FLOAT8OID)
+			return NULL;
+	}
+
+	context = AllocSetContextCreate(CurrentMemoryContext, "rtpg_expr", ALLOCSET_SMALL_SIZES);
+	oldcontext = MemoryContextSwitchTo(context);
+
+	memset(&parser, 0, sizeof(parser));
+	parser.pos = str;
+	parser.nargs = nargs;
+	parser.argtypes = argtypes;
+	expr_next(&parser);
+
+	root = expr_parse_or(&parser);
+	if (root && parser.tok != TOK_END)
+		root = NULL;
+	/* the result is cast to double precision */
+	if (root && root->type == RTPG_EXPR_BOOL)
+		root = NULL;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (!root) {
+		MemoryContextDelete(context);
+		return NULL;
+	}
+
+	expr = MemoryContextAlloc(context, sizeof(struct rtpg_expr_t));
+	expr->context = context;
+	expr->nargs = nargs;
+	expr->root = root;
+	return expr;
+}
+
+void
+rtpg_expr_free(rtpg_expr expr) {
+	if (expr)
+		MemoryContextDelete(expr->context);
+}
+
+/******************************************************************************
+ * Evaluation
+ */
+
+typedef struct {
+	int n;
+	const double * const *args;
+	const bool * const *argnulls;
+} rtpg_expr_block;
+
+#define LANE_ACTIVE(mask, i) (!(mask) || (mask)[i])
+
+static void
+expr_int4_error(void) {
+	ereport(ERROR,
+		(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+		 errmsg("integer out of range")));
+}
+
+static void
+expr_division_by_zero(void) {
+	ereport(ERROR,
+		(errcode(ERRCODE_DIVISION_BY_ZERO),
+		 errmsg("division by zero")));
+}
+
+static void
+expr_float8_error(bool overflow) {
+	ereport(ERROR,
+		(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+		 errmsg("value out of range: %s", overflow ? "overflow" : "underflow")));
+}
+
+static double
+expr_int4_result(double val) {
+	if (val < PG_INT32_MIN || val > PG_INT32_MAX)
+		expr_int4_error();
+	return val;
+}
+
+/* float8 comparison, NaN being equal to itself and above everything */
+static int
+expr_float8_cmp(double a, double b) {
+	if (isnan(a))
+		return isnan(b) ? 0 : 1;
+	if (isnan(b))
+		return -1;
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+static double
+expr_arith_eval(rtpg_expr_node node, double a, double b) {
+	double r;
+
+	if (node->optype == RTPG_EXPR_INT4) {
+		/* exact in a double, as both operands are int4 */
+		switch (node->op) {
+			case EXPR_ADD: return expr_int4_result(a + b);
+			case EXPR_SUB: return expr_int4_result(a - b);
+			case EXPR_MUL: {
+				int64 m = (int64) a * (int64) b;
+				if (m < PG_INT32_MIN || m > PG_INT32_MAX)
+					expr_int4_error();
+				return (double) m;
+			}
+			case EXPR_DIV:
+				if (b == 0)
+					expr_division_by_zero();
+				/* INT_MIN / -1 overflows */
+				if (b == -1)
+					return expr_int4_result(-a);
+				return (double) ((int32) a / (int32) b);
+			case EXPR_MOD:
+				if (b == 0)
+					expr_division_by_zero();
+				if (b == -1)
+					return 0;
+				return (double) ((int32) a % (int32) b);
+			default:
+				break;
+		}
+	}
+
+	switch (node->op) {
+		case EXPR_ADD:
+			r = a + b;
+			if (isinf(r) && !isinf(a) && !isinf(b))
+				expr_float8_error(true);
+			return r;
+		case EXPR_SUB:
+			r = a - b;
+			if (isinf(r) && !isinf(a) && !isinf(b))
+				expr_float8_error(true);
+			return r;
+		case EXPR_MUL:
+			r = a * b;
+			if (isinf(r) && !isinf(a) && !isinf(b))
+				expr_float8_error(true);
+			if (r == 0.0 && a != 0.0 && b != 0.0)
+				expr_float8_error(false);
+			return r;
+		case EXPR_DIV:
+			if (b == 0.0 && !isnan(a))
+				expr_division_by_zero();
+			r = a / b;
+			if (isinf(r) && !isinf(a))
+				expr_float8_error(true);
+			if (r == 0.0 && a != 0.0 && !isinf(b))
+				expr_float8_error(false);
+			return r;
+		default:
+			return 0;
+	}
+}
+
+static double
+expr_math_eval(rtpg_expr_node node, double a) {
+	/* integer and numeric arguments are finite */
+	switch (node->op) {
+		case EXPR_ABS:
+			if (node->optype == RTPG_EXPR_INT4 && a == PG_INT32_MIN)
+				expr_int4_error();
+			return fabs(a);
+		case EXPR_SQRT:
+			if (a < 0)
+				ereport(ERROR,
+					(errcode(ERRCODE_INVALID_ARGUMENT_FOR_POWER_FUNCTION),
+					 errmsg("cannot take square root of a negative number")));
+			return sqrt(a);
+		case EXPR_LN:
+		case EXPR_LOG10:
+			if (a == 0.0)
+				ereport(ERROR,
+					(errcode(ERRCODE_INVALID_ARGUMENT_FOR_LOG),
+					 errmsg("cannot take logarithm of zero")));
+			if (a < 0)
+				ereport(ERROR,
+					(errcode(ERRCODE_INVALID_ARGUMENT_FOR_LOG),
+					 errmsg("cannot take logarithm of a negative number")));
+			return node->op == EXPR_LN ? log(a) : log10(a);
+		case EXPR_FLOOR:
+			return floor(a);
+		case EXPR_CEIL:
+			return ceil(a);
+		case EXPR_ROUND:
+			/* float8 rounds half to even, numeric half away from zero */
+			return node->optype == RTPG_EXPR_NUMERIC ? round(a) : rint(a);
+		case EXPR_TRUNC:
+			return trunc(a);
+		case EXPR_SIGN:
+			return a > 0 ? 1.0 : (a < 0 ? -1.0 : 0.0);
+		case EXPR_SIN:
+		case EXPR_COS:
+		case EXPR_TAN:
+			if (isnan(a))
+				return a;
+			if (isinf(a))
+				ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("input is out of range")));
+			return node->op == EXPR_SIN ? sin(a) : (node->op == EXPR_COS ? cos(a) : tan(a));
+		case EXPR_ATAN:
+			return atan(a);
+		case EXPR_TOINT4:
+			if (isnan(a))
+				expr_int4_error();
+			/* float8 rounds half to even, numeric half away from zero */
+			a = node->optype == RTPG_EXPR_NUMERIC ? round(a) : rint(a);
+			if (!(a >= (double) PG_INT32_MIN && a < -((double) PG_INT32_MIN)))
+				expr_int4_error();
+			return a;
+		default:
+			return 0;
+	}
+}
+
+static void expr_eval(rtpg_expr_node node, const rtpg_expr_block *block, const bool *mask);
+
+/* Copy the active lanes of src into node */
+static void
+expr_copy(rtpg_expr_node node, rtpg_expr_node src, int n, const bool *mask) {
+	for (int i = 0; i < n; i++) {
+		if (!mask[i])
+			continue;
+		node->val[i] = src->val[i];
+		node->isnull[i] = src->isnull[i];
+	}
+}
+
+static void
+expr_eval(rtpg_expr_node node, const rtpg_expr_block *block, const bool *mask) {
+	int n = block->n;
+	bool sub[RTPG_EXPR_BLOCK];
+	bool any;
+	int i, a;
+
+	switch (node->op) {
+		case EXPR_CONST:
+			for (i = 0; i < n; i++) {
+				node->val[i] = node->constval;
+				node->isnull[i] = node->constnull;
+			}
+			return;
+
+		case EXPR_PARAM:
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = block->argnulls[node->param][i];
+				node->val[i] = block->args[node->param][i];
+			}
+			return;
+
+		case EXPR_NEG:
+			expr_eval(node->args[0], block, mask);
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = node->args[0]->isnull[i];
+				if (node->isnull[i])
+					continue;
+				node->val[i] = -node->args[0]->val[i];
+				if (node->optype == RTPG_EXPR_INT4)
+					expr_int4_result(node->val[i]);
+			}
+			return;
+
+		case EXPR_ADD:
+		case EXPR_SUB:
+		case EXPR_MUL:
+		case EXPR_DIV:
+		case EXPR_MOD:
+			expr_eval(node->args[0], block, mask);
+			expr_eval(node->args[1], block, mask);
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = node->args[0]->isnull[i] || node->args[1]->isnull[i];
+				if (!node->isnull[i])
+					node->val[i] = expr_arith_eval(node, node->args[0]->val[i], node->args[1]->val[i]);
+			}
+			return;
+
+		case EXPR_LT:
+		case EXPR_LE:
+		case EXPR_GT:
+		case EXPR_GE:
+		case EXPR_EQ:
+		case EXPR_NE:
+			expr_eval(node->args[0], block, mask);
+			expr_eval(node->args[1], block, mask);
+			for (i = 0; i < n; i++) {
+				int cmp;
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = node->args[0]->isnull[i] || node->args[1]->isnull[i];
+				if (node->isnull[i])
+					continue;
+				cmp = expr_float8_cmp(node->args[0]->val[i], node->args[1]->val[i]);
+				switch (node->op) {
+					case EXPR_LT: node->val[i] = cmp < 0; break;
+					case EXPR_LE: node->val[i] = cmp <= 0; break;
+					case EXPR_GT: node->val[i] = cmp > 0; break;
+					case EXPR_GE: node->val[i] = cmp >= 0; break;
+					case EXPR_EQ: node->val[i] = cmp == 0; break;
+					default: node->val[i] = cmp != 0; break;
+				}
+			}
+			return;
+
+		case EXPR_AND:
+		case EXPR_OR: {
+			/* the right side only runs where the left one does not decide */
+			double decisive = node->op == EXPR_OR ? 1 : 0;
+
+			expr_eval(node->args[0], block, mask);
+			any = false;
+			for (i = 0; i < n; i++) {
+				sub[i] = LANE_ACTIVE(mask, i) &&
+					(node->args[0]->isnull[i] || node->args[0]->val[i] != decisive);
+				any |= sub[i];
+				if (LANE_ACTIVE(mask, i) && !sub[i]) {
+					node->val[i] = decisive;
+					node->isnull[i] = false;
+				}
+			}
+			if (!any)
+				return;
+			expr_eval(node->args[1], block, sub);
+			for (i = 0; i < n; i++) {
+				if (!sub[i])
+					continue;
+				if (!node->args[1]->isnull[i] && node->args[1]->val[i] == decisive) {
+					node->val[i] = decisive;
+					node->isnull[i] = false;
+				}
+				else if (node->args[0]->isnull[i] || node->args[1]->isnull[i])
+					node->isnull[i] = true;
+				else {
+					node->val[i] = 1 - decisive;
+					node->isnull[i] = false;
+				}
+			}
+			return;
+		}
+
+		case EXPR_NOT:
+			expr_eval(node->args[0], block, mask);
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = node->args[0]->isnull[i];
+				node->val[i] = node->args[0]->val[i] == 0;
+			}
+			return;
+
+		case EXPR_ISNULL:
+		case EXPR_ISNOTNULL:
+			expr_eval(node->args[0], block, mask);
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = false;
+				node->val[i] = node->args[0]->isnull[i] == (node->op == EXPR_ISNULL);
+			}
+			return;
+
+		case EXPR_CASE: {
+			bool remaining[RTPG_EXPR_BLOCK];
+			int nwhen = node->haselse ? node->nargs - 1 : node->nargs;
+
+			for (i = 0; i < n; i++)
+				remaining[i] = LANE_ACTIVE(mask, i);
+
+			for (a = 0; a < nwhen; a += 2) {
+				rtpg_expr_node cond = node->args[a];
+
+				expr_eval(cond, block, remaining);
+				any = false;
+				for (i = 0; i < n; i++) {
+					sub[i] = remaining[i] && !cond->isnull[i] && cond->val[i] != 0;
+					remaining[i] &= !sub[i];
+					any |= sub[i];
+				}
+				if (any) {
+					expr_eval(node->args[a + 1], block, sub);
+					expr_copy(node, node->args[a + 1], n, sub);
+				}
+			}
+
+			any = false;
+			for (i = 0; i < n; i++) {
+				any |= remaining[i];
+				if (remaining[i])
+					node->isnull[i] = true;
+			}
+			if (any && node->haselse) {
+				expr_eval(node->args[node->nargs - 1], block, remaining);
+				expr_copy(node, node->args[node->nargs - 1], n, remaining);
+			}
+			return;
+		}
+
+		case EXPR_COALESCE: {
+			bool remaining[RTPG_EXPR_BLOCK];
+
+			for (i = 0; i < n; i++) {
+				remaining[i] = LANE_ACTIVE(mask, i);
+				node->isnull[i] = true;
+			}
+			for (a = 0; a < node->nargs; a++) {
+				any = false;
+				for (i = 0; i < n; i++)
+					any |= remaining[i];
+				if (!any)
+					break;
+
+				expr_eval(node->args[a], block, remaining);
+				for (i = 0; i < n; i++) {
+					if (!remaining[i] || node->args[a]->isnull[i])
+						continue;
+					node->val[i] = node->args[a]->val[i];
+					node->isnull[i] = false;
+					remaining[i] = false;
+				}
+			}
+			return;
+		}
+
+		case EXPR_GREATEST:
+		case EXPR_LEAST:
+			for (i = 0; i < n; i++)
+				node->isnull[i] = true;
+			for (a = 0; a < node->nargs; a++) {
+				rtpg_expr_node arg = node->args[a];
+
+				expr_eval(arg, block, mask);
+				for (i = 0; i < n; i++) {
+					int cmp;
+					if (!LANE_ACTIVE(mask, i) || arg->isnull[i])
+						continue;
+					if (node->isnull[i]) {
+						node->val[i] = arg->val[i];
+						node->isnull[i] = false;
+						continue;
+					}
+					cmp = expr_float8_cmp(arg->val[i], node->val[i]);
+					if ((node->op == EXPR_GREATEST && cmp > 0) || (node->op == EXPR_LEAST && cmp < 0))
+						node->val[i] = arg->val[i];
+				}
+			}
+			return;
+
+		default:
+			/* one argument functions */
+			expr_eval(node->args[0], block, mask);
+			for (i = 0; i < n; i++) {
+				if (!LANE_ACTIVE(mask, i))
+					continue;
+				node->isnull[i] = node->args[0]->isnull[i];
+				if (!node->isnull[i])
+					node->val[i] = expr_math_eval(node, node->args[0]->val[i]);
+			}
+			return;
+	}
+}
+
+/**
+ * Evaluate a compiled expression for n pixels. args[k][i] and
+ * argnulls[k][i] are the value and nullness of the placeholder $k+1
+ * for the pixel i, for each of the nargs placeholders given to
+ * rtpg_expr_compile(), positions being passed as doubles.
+ * Errors are raised like PostgreSQL would raise them.
+ */
+void
+rtpg_expr_eval(
+	rtpg_expr expr, int n,
+	const double * const *args, const bool * const *argnulls,
+	double *result, bool *resultnull
+) {
+	rtpg_expr_node root = expr->root;
+
+	for (int offset = 0; offset < n; offset += RTPG_EXPR_BLOCK) {
+		const double *blockargs[FUNC_MAX_ARGS];
+		const bool *blockargnulls[FUNC_MAX_ARGS];
+		rtpg_expr_block block;
+
+		block.n = Min(RTPG_EXPR_BLOCK, n - offset);
+		for (int a = 0; a < expr->nargs; a++) {
+			blockargs[a] = args[a] + offset;
+			blockargnulls[a] = argnulls[a] + offset;
+		}
+		block.args = blockargs;
+		block.argnulls = blockargnulls;
+
+		expr_eval(root, &block, NULL);
+
+		memcpy(result + offset, root->val, sizeof(double) * block.n);
+		memcpy(resultnull + offset, root->isnull, sizeof(bool) * block.n);
+	}
+}
@@ -65,4 +65,20 @@ rtpg_strrstr(const char *s1, const char *s2);
 
 char *rtpg_getSR(int32_t srid);
 
+/* Map algebra expressions compiled for evaluation without SPI */
+typedef struct rtpg_expr_t *rtpg_expr;
+
+rtpg_expr
+rtpg_expr_compile(const char *str, int nargs, const Oid *argtypes);
+
+void
+rtpg_expr_eval(
+	rtpg_expr expr, int n,
+	const double * const *args, const bool * const *argnulls,
+	double *result, bool *resultnull
+);
+
+void
+rtpg_expr_free(rtpg_expr expr);
+
 #endif /* RTPG_INTERNAL_H_INCLUDED */
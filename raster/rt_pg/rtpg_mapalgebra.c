@@ -986,6 +986,9 @@ typedef struct {
 		uint32_t spi_argcount;
 		uint8_t *spi_argpos;
 
+		/* used instead of spi_plan when the expression compiles */
+		rtpg_expr compiled;
+
 		int hasval;
 		double val;
 	} expr[3];
@@ -1031,6 +1034,7 @@ static rtpg_nmapalgebraexpr_arg rtpg_nmapalgebraexpr_arg_init(int cnt, char **kw
 	arg->callback.exprcount = 3;
 	for (i = 0; i < arg->callback.exprcount; i++) {
 		arg->callback.expr[i].spi_plan = NULL;
+		arg->callback.expr[i].compiled = NULL;
 		arg->callback.expr[i].spi_argcount = 0;
 		arg->callback.expr[i].spi_argpos = palloc(cnt * sizeof(uint8_t));
 		if (arg->callback.expr[i].spi_argpos == NULL) {
@@ -1056,6 +1060,7 @@ static void rtpg_nmapalgebraexpr_arg_destroy(rtpg_nmapalgebraexpr_arg arg) {
 	for (i = 0; i < arg->callback.exprcount; i++) {
 		if (arg->callback.expr[i].spi_plan)
 			SPI_freeplan(arg->callback.expr[i].spi_plan);
+		rtpg_expr_free(arg->callback.expr[i].compiled);
 		if (arg->callback.kw.count)
 			pfree(arg->callback.expr[i].spi_argpos);
 	}
@@ -1063,114 +1068,131 @@ static void rtpg_nmapalgebraexpr_arg_destroy(rtpg_nmapalgebraexpr_arg arg) {
 	pfree(arg);
 }
 
-static int rtpg_nmapalgebraexpr_callback(
-	rt_iterator_arg arg, void *userarg,
+/* index of the expression giving the value of a pixel, -1 if the value is set */
+static int rtpg_nmapalgebraexpr_select(
+	rtpg_nmapalgebraexpr_callback_arg *callback, uint16_t rasters,
+	int nodata1, int nodata2,
 	double *value, int *nodata
 ) {
-	rtpg_nmapalgebraexpr_callback_arg *callback = (rtpg_nmapalgebraexpr_callback_arg *) userarg;
-	SPIPlanPtr plan = NULL;
-	int i = 0;
-	uint8_t id = 0;
-
-	if (arg == NULL)
-		return 0;
+	int id = 0;
 
 	*value = 0;
 	*nodata = 0;
 
 	/* 2 raster */
-	if (arg->rasters > 1) {
+	if (rasters > 1) {
 		/* nodata1 = 1 AND nodata2 = 1, nodatanodataval */
-		if (arg->nodata[0][0][0] && arg->nodata[1][0][0]) {
+		if (nodata1 && nodata2) {
 			if (callback->nodatanodata.hasval)
 				*value = callback->nodatanodata.val;
 			else
 				*nodata = 1;
+			return -1;
 		}
 		/* nodata1 = 1 AND nodata2 != 1, nodata1expr */
-		else if (arg->nodata[0][0][0] && !arg->nodata[1][0][0]) {
+		else if (nodata1 && !nodata2)
 			id = 1;
-			if (callback->expr[id].hasval)
-				*value = callback->expr[id].val;
-			else if (callback->expr[id].spi_plan)
-				plan = callback->expr[id].spi_plan;
-			else
-				*nodata = 1;
-		}
 		/* nodata1 != 1 AND nodata2 = 1, nodata2expr */
-		else if (!arg->nodata[0][0][0] && arg->nodata[1][0][0]) {
+		else if (!nodata1 && nodata2)
 			id = 2;
-			if (callback->expr[id].hasval)
-				*value = callback->expr[id].val;
-			else if (callback->expr[id].spi_plan)
-				plan = callback->expr[id].spi_plan;
-			else
-				*nodata = 1;
-		}
 		/* expression */
 		else {
 			id = 0;
-			if (callback->expr[id].hasval)
-				*value = callback->expr[id].val;
-			else if (callback->expr[id].spi_plan)
-				plan = callback->expr[id].spi_plan;
-			else {
+			if (
+				!callback->expr[id].hasval &&
+				!callback->expr[id].spi_plan &&
+				!callback->expr[id].compiled
+			) {
 				if (callback->nodatanodata.hasval)
 					*value = callback->nodatanodata.val;
 				else
 					*nodata = 1;
+				return -1;
 			}
 		}
 	}
 	/* 1 raster */
 	else {
 		/* nodata = 1, nodata1expr */
-		if (arg->nodata[0][0][0]) {
+		if (nodata1)
 			id = 1;
-			if (callback->expr[id].hasval)
-				*value = callback->expr[id].val;
-			else if (callback->expr[id].spi_plan)
-				plan = callback->expr[id].spi_plan;
-			else
-				*nodata = 1;
-		}
 		/* expression */
 		else {
 			id = 0;
-			if (callback->expr[id].hasval)
-				*value = callback->expr[id].val;
-			else if (callback->expr[id].spi_plan)
-				plan = callback->expr[id].spi_plan;
-			else {
-				/* see if nodata1expr is available */
+			/* see if nodata1expr is available */
+			if (
+				!callback->expr[id].hasval &&
+				!callback->expr[id].spi_plan &&
+				!callback->expr[id].compiled
+			) {
 				id = 1;
-				if (callback->expr[id].hasval)
-					*value = callback->expr[id].val;
-				else if (callback->expr[id].spi_plan)
-					plan = callback->expr[id].spi_plan;
-				else
-					*nodata = 1;
 			}
 		}
 	}
 
-	/* run prepared plan */
-	if (plan != NULL) {
-		Datum values[12];
-		char nulls[12];
-		int err = 0;
+	if (callback->expr[id].hasval) {
+		*value = callback->expr[id].val;
+		return -1;
+	}
+	else if (callback->expr[id].spi_plan || callback->expr[id].compiled)
+		return id;
+
+	*nodata = 1;
+	return -1;
+}
+
+/* value of a pixel whose expression returned NULL */
+static void rtpg_nmapalgebraexpr_null(
+	rtpg_nmapalgebraexpr_callback_arg *callback, uint16_t rasters,
+	double *value, int *nodata
+) {
+	/* 2 raster, check nodatanodataval */
+	if (rasters > 1) {
+		if (callback->nodatanodata.hasval)
+			*value = callback->nodatanodata.val;
+		else
+			*nodata = 1;
+	}
+	/* 1 raster, check nodataval */
+	else {
+		if (callback->expr[1].hasval)
+			*value = callback->expr[1].val;
+		else
+			*nodata = 1;
+	}
+}
+
+static int rtpg_nmapalgebraexpr_callback(
+	rt_iterator_arg arg, void *userarg,
+	double *value, int *nodata
+) {
+	rtpg_nmapalgebraexpr_callback_arg *callback = (rtpg_nmapalgebraexpr_callback_arg *) userarg;
+	int i = 0;
+	int id = 0;
+
+	if (arg == NULL)
+		return 0;
 
-		TupleDesc tupdesc;
-		SPITupleTable *tuptable = NULL;
-		HeapTuple tuple;
-		Datum datum;
+	id = rtpg_nmapalgebraexpr_select(
+		callback, arg->rasters,
+		arg->nodata[0][0][0], arg->rasters > 1 ? arg->nodata[1][0][0] : 0,
+		value, nodata
+	);
+
+	/* run compiled expression or prepared plan */
+	if (id >= 0) {
+		double argval[12];
+		bool argnull[12];
+		bool argint[12];
+		double result = 0;
 		bool isnull = FALSE;
 
-		POSTGIS_RT_DEBUGF(4, "Running plan %d", id);
+		POSTGIS_RT_DEBUGF(4, "Running %s %d", callback->expr[id].compiled ? "compiled expression" : "plan", id);
 
 		/* init values and nulls */
-		memset(values, (Datum) NULL, sizeof(Datum) * callback->kw.count);
-		memset(nulls, FALSE, sizeof(char) * callback->kw.count);
+		memset(argval, 0, sizeof(double) * callback->kw.count);
+		memset(argnull, FALSE, sizeof(bool) * callback->kw.count);
+		memset(argint, FALSE, sizeof(bool) * callback->kw.count);
 
 		if (callback->expr[id].spi_argcount) {
 			int idx = 0;
@@ -1188,106 +1210,243 @@ static int rtpg_nmapalgebraexpr_callback(
 				switch (i) {
 					/* [rast.x] */
 					case 0:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][0] + 1);
+					/* [rast1.x] */
+					case 4:
+						argint[idx] = TRUE;
+						argval[idx] = arg->src_pixel[0][0] + 1;
 						break;
 					/* [rast.y] */
 					case 1:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][1] + 1);
+					/* [rast1.y] */
+					case 5:
+						argint[idx] = TRUE;
+						argval[idx] = arg->src_pixel[0][1] + 1;
 						break;
 					/* [rast.val] */
 					case 2:
 					/* [rast] */
 					case 3:
-						if (!arg->nodata[0][0][0])
-							values[idx] = Float8GetDatum(arg->values[0][0][0]);
-						else
-							nulls[idx] = TRUE;
-						break;
-
-					/* [rast1.x] */
-					case 4:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][0] + 1);
-						break;
-					/* [rast1.y] */
-					case 5:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][1] + 1);
-						break;
 					/* [rast1.val] */
 					case 6:
 					/* [rast1] */
 					case 7:
+						/* a NODATA pixel has always reached the expression as 0 */
 						if (!arg->nodata[0][0][0])
-							values[idx] = Float8GetDatum(arg->values[0][0][0]);
-						else
-							nulls[idx] = TRUE;
+							argval[idx] = arg->values[0][0][0];
 						break;
 
 					/* [rast2.x] */
 					case 8:
-						values[idx] = Int32GetDatum(arg->src_pixel[1][0] + 1);
+						argint[idx] = TRUE;
+						argval[idx] = arg->src_pixel[1][0] + 1;
 						break;
 					/* [rast2.y] */
 					case 9:
-						values[idx] = Int32GetDatum(arg->src_pixel[1][1] + 1);
+						argint[idx] = TRUE;
+						argval[idx] = arg->src_pixel[1][1] + 1;
 						break;
 					/* [rast2.val] */
 					case 10:
 					/* [rast2] */
 					case 11:
 						if (!arg->nodata[1][0][0])
-							values[idx] = Float8GetDatum(arg->values[1][0][0]);
-						else
-							nulls[idx] = TRUE;
+							argval[idx] = arg->values[1][0][0];
 						break;
 				}
 
 			}
 		}
 
-		/* run prepared plan */
-		err = SPI_execute_plan(plan, values, nulls, TRUE, 1);
-		if (err != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
-			elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unexpected error when running prepared statement %d", id);
-			return 0;
+		if (callback->expr[id].compiled) {
+			const double *args[12];
+			const bool *argnulls[12];
+
+			for (i = 0; i < (int) callback->expr[id].spi_argcount; i++) {
+				args[i] = &(argval[i]);
+				argnulls[i] = &(argnull[i]);
+			}
+			rtpg_expr_eval(callback->expr[id].compiled, 1, args, argnulls, &result, &isnull);
 		}
+		else {
+			Datum values[12];
+			char nulls[12];
+			int err = 0;
+
+			TupleDesc tupdesc;
+			SPITupleTable *tuptable = NULL;
+			HeapTuple tuple;
+			Datum datum;
+
+			for (i = 0; i < (int) callback->expr[id].spi_argcount; i++) {
+				if (argint[i])
+					values[i] = Int32GetDatum((int32) argval[i]);
+				else
+					values[i] = Float8GetDatum(argval[i]);
+				nulls[i] = ' ';
+			}
 
-		/* get output of prepared plan */
-		tupdesc = SPI_tuptable->tupdesc;
-		tuptable = SPI_tuptable;
-		tuple = tuptable->vals[0];
+			/* run prepared plan */
+			err = SPI_execute_plan(callback->expr[id].spi_plan, values, nulls, TRUE, 1);
+			if (err != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
+				elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unexpected error when running prepared statement %d", id);
+				return 0;
+			}
+
+			/* get output of prepared plan */
+			tupdesc = SPI_tuptable->tupdesc;
+			tuptable = SPI_tuptable;
+			tuple = tuptable->vals[0];
+
+			datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+			if (SPI_result == SPI_ERROR_NOATTRIBUTE) {
+				if (SPI_tuptable) SPI_freetuptable(tuptable);
+				elog(ERROR, "rtpg_nmapalgebraexpr_callback: Could not get result of prepared statement %d", id);
+				return 0;
+			}
+
+			if (!isnull)
+				result = DatumGetFloat8(datum);
 
-		datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
-		if (SPI_result == SPI_ERROR_NOATTRIBUTE) {
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			elog(ERROR, "rtpg_nmapalgebraexpr_callback: Could not get result of prepared statement %d", id);
-			return 0;
 		}
 
 		if (!isnull) {
-			*value = DatumGetFloat8(datum);
-			POSTGIS_RT_DEBUG(4, "Getting value from Datum");
+			*value = result;
+			POSTGIS_RT_DEBUG(4, "Getting value from expression");
 		}
-		else {
-			/* 2 raster, check nodatanodataval */
-			if (arg->rasters > 1) {
-				if (callback->nodatanodata.hasval)
-					*value = callback->nodatanodata.val;
-				else
-					*nodata = 1;
+		else
+			rtpg_nmapalgebraexpr_null(callback, arg->rasters, value, nodata);
+	}
+
+	POSTGIS_RT_DEBUGF(4, "(value, nodata) = (%f, %d)", *value, *nodata);
+	return 1;
+}
+
+/* row callback when no expression needs SPI */
+static int rtpg_nmapalgebraexpr_rows_callback(
+	rt_iterator_rows_arg arg, void *userarg,
+	double *values, uint8_t *nodata
+) {
+	rtpg_nmapalgebraexpr_callback_arg *callback = (rtpg_nmapalgebraexpr_callback_arg *) userarg;
+	int *exprid = NULL;
+	int *pixels = NULL;
+	double *argval = NULL;
+	bool *argnull = NULL;
+	double *result = NULL;
+	bool *resultnull = NULL;
+	const double *args[12];
+	const bool *argnulls[12];
+	uint32_t x = 0;
+	uint32_t n = 0;
+	int _nodata = 0;
+	int id = 0;
+	int i = 0;
+	int k = 0;
+
+	if (arg == NULL)
+		return 0;
+
+	/* expression of each pixel, or the value it gets */
+	exprid = palloc(sizeof(int) * arg->columns);
+	for (x = 0; x < arg->columns; x++) {
+		exprid[x] = rtpg_nmapalgebraexpr_select(
+			callback, arg->rasters,
+			arg->nodata[0][0][x], arg->rasters > 1 ? arg->nodata[1][0][x] : 0,
+			&(values[x]), &_nodata
+		);
+		nodata[x] = _nodata;
+	}
+
+	pixels = palloc(sizeof(int) * arg->columns);
+	argval = palloc(sizeof(double) * arg->columns * callback->kw.count);
+	argnull = palloc0(sizeof(bool) * arg->columns);
+	result = palloc(sizeof(double) * arg->columns);
+	resultnull = palloc(sizeof(bool) * arg->columns);
+
+	/* evaluate each expression over its pixels */
+	for (id = 0; id < callback->exprcount; id++) {
+		for (x = 0, n = 0; x < arg->columns; x++) {
+			if (exprid[x] == id)
+				pixels[n++] = x;
+		}
+		if (!n)
+			continue;
+
+		POSTGIS_RT_DEBUGF(4, "Running compiled expression %d on %d pixels of row %d", id, n, arg->dst_row);
+
+		for (i = 0; i < callback->kw.count; i++) {
+			double *val = NULL;
+			int idx = callback->expr[id].spi_argpos[i];
+			if (idx < 1) continue;
+			idx--; /* 1-based now 0-based */
+
+			if (arg->rasters == 1 && i > 7) {
+				elog(ERROR, "rtpg_nmapalgebraexpr_callback: rast2 argument specified in single-raster invocation");
+				return 0;
 			}
-			/* 1 raster, check nodataval */
-			else {
-				if (callback->expr[1].hasval)
-					*value = callback->expr[1].val;
-				else
-					*nodata = 1;
+
+			val = argval + ((size_t) idx * arg->columns);
+			args[idx] = val;
+			argnulls[idx] = argnull;
+
+			for (k = 0; k < (int) n; k++) {
+				x = pixels[k];
+				switch (i) {
+					/* [rast.x], [rast1.x] */
+					case 0:
+					case 4:
+						val[k] = arg->src_pixel[0][0] + (int) x + 1;
+						break;
+					/* [rast.y], [rast1.y] */
+					case 1:
+					case 5:
+						val[k] = arg->src_pixel[0][1] + 1;
+						break;
+					/* [rast.val], [rast], [rast1.val], [rast1] */
+					case 2:
+					case 3:
+					case 6:
+					case 7:
+						/* NODATA pixels are 0 */
+						val[k] = arg->values[0][0][x];
+						break;
+					/* [rast2.x] */
+					case 8:
+						val[k] = arg->src_pixel[1][0] + (int) x + 1;
+						break;
+					/* [rast2.y] */
+					case 9:
+						val[k] = arg->src_pixel[1][1] + 1;
+						break;
+					/* [rast2.val], [rast2] */
+					case 10:
+					case 11:
+						val[k] = arg->values[1][0][x];
+						break;
+				}
 			}
 		}
 
-		if (SPI_tuptable) SPI_freetuptable(tuptable);
+		rtpg_expr_eval(callback->expr[id].compiled, n, args, argnulls, result, resultnull);
+
+		for (k = 0; k < (int) n; k++) {
+			x = pixels[k];
+			if (!resultnull[k])
+				values[x] = result[k];
+			else {
+				rtpg_nmapalgebraexpr_null(callback, arg->rasters, &(values[x]), &_nodata);
+				nodata[x] = _nodata;
+			}
+		}
 	}
 
-	POSTGIS_RT_DEBUGF(4, "(value, nodata) = (%f, %d)", *value, *nodata);
+	pfree(exprid);
+	pfree(pixels);
+	pfree(argval);
+	pfree(argnull);
+	pfree(result);
+	pfree(resultnull);
+
 	return 1;
 }
 
@@ -1304,6 +1463,7 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 	int k = 0;
 
 	int numraster = 0;
+	int byrow = 1;
 	int err = 0;
 	int allnull = 0;
 	int allempty = 0;
@@ -1531,6 +1691,15 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 				k++;
 			}
 
+			/* evaluate without SPI if possible */
+			arg->callback.expr[i].compiled = rtpg_expr_compile(expr, arg->callback.expr[i].spi_argcount, argtype);
+			if (arg->callback.expr[i].compiled != NULL) {
+				POSTGIS_RT_DEBUGF(3, "expression parameter %d is compiled", exprpos[i]);
+				pfree(argtype);
+				pfree(sql);
+				continue;
+			}
+
 			arg->callback.expr[i].spi_plan = SPI_prepare(sql, arg->callback.expr[i].spi_argcount, argtype);
 			pfree(argtype);
 			pfree(sql);
@@ -1632,18 +1801,38 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 		itrset[i].nbnodata = 1;
 	}
 
+	/* without prepared plans, expressions are evaluated a row at a time */
+	for (i = 0; i < arg->callback.exprcount; i++) {
+		if (arg->callback.expr[i].spi_plan != NULL)
+			byrow = 0;
+	}
+
 	/* pass everything to iterator */
-	err = rt_raster_iterator(
-		itrset, numraster,
-		arg->bandarg->extenttype, arg->bandarg->cextent,
-		arg->bandarg->pixtype,
-		arg->bandarg->hasnodata, arg->bandarg->nodataval,
-		0, 0,
-		NULL,
-		&(arg->callback),
-		rtpg_nmapalgebraexpr_callback,
-		&raster
-	);
+	if (byrow) {
+		err = rt_raster_iterator_rows(
+			itrset, numraster,
+			arg->bandarg->extenttype, arg->bandarg->cextent,
+			arg->bandarg->pixtype,
+			arg->bandarg->hasnodata, arg->bandarg->nodataval,
+			0, 0,
+			&(arg->callback),
+			rtpg_nmapalgebraexpr_rows_callback,
+			&raster
+		);
+	}
+	else {
+		err = rt_raster_iterator(
+			itrset, numraster,
+			arg->bandarg->extenttype, arg->bandarg->cextent,
+			arg->bandarg->pixtype,
+			arg->bandarg->hasnodata, arg->bandarg->nodataval,
+			0, 0,
+			NULL,
+			&(arg->callback),
+			rtpg_nmapalgebraexpr_callback,
+			&raster
+		);
+	}
 
 	pfree(itrset);
 	rtpg_nmapalgebraexpr_arg_destroy(arg);
@@ -1756,6 +1945,11 @@ static void rtpg_union_arg_destroy(rtpg_union_arg arg) {
 	pfree(arg);
 }
 
+/*
+	union callbacks are run by rt_raster_iterator_parallel() so they
+	must not call palloc(), elog() or anything else of the backend,
+	errors are written to arg->error and reported by the iterator
+*/
 static int rtpg_union_callback(
 	rt_iterator_arg arg, void *userarg,
 	double *value, int *nodata
@@ -1770,7 +1964,7 @@ static int rtpg_union_callback(
 		arg->rows != 1 ||
 		arg->columns != 1
 	) {
-		elog(ERROR, "rtpg_union_callback: Invalid arguments passed to callback");
+		snprintf(arg->error, RT_ITERATOR_ERROR_SIZE, "rtpg_union_callback: Invalid arguments passed to callback");
 		return 0;
 	}
 
@@ -1859,7 +2053,7 @@ static int rtpg_union_mean_callback(
 		arg->rows != 1 ||
 		arg->columns != 1
 	) {
-		elog(ERROR, "rtpg_union_mean_callback: Invalid arguments passed to callback");
+		snprintf(arg->error, RT_ITERATOR_ERROR_SIZE, "rtpg_union_mean_callback: Invalid arguments passed to callback");
 		return 0;
 	}
 
@@ -1892,7 +2086,7 @@ static int rtpg_union_range_callback(
 		arg->rows != 1 ||
 		arg->columns != 1
 	) {
-		elog(ERROR, "rtpg_union_range_callback: Invalid arguments passed to callback");
+		snprintf(arg->error, RT_ITERATOR_ERROR_SIZE, "rtpg_union_range_callback: Invalid arguments passed to callback");
 		return 0;
 	}
 
@@ -2614,7 +2808,7 @@ Datum RASTER_union_transfn(PG_FUNCTION_ARGS)
 				}
 
 				/* run iterator for extent of input raster */
-				noerr = rt_raster_iterator(
+				noerr = rt_raster_iterator_parallel(
 					itrset, 2,
 					ET_LAST, NULL,
 					pixtype,
@@ -2707,7 +2901,7 @@ Datum RASTER_union_transfn(PG_FUNCTION_ARGS)
 				POSTGIS_RT_DEBUG(3, "using pixel method");
 
 				/* pass everything to iterator */
-				noerr = rt_raster_iterator(
+				noerr = rt_raster_iterator_parallel(
 					itrset, 2,
 					ET_UNION, NULL,
 					pixtype,
@@ -2821,7 +3015,7 @@ Datum RASTER_union_finalfn(PG_FUNCTION_ARGS)
 
 			/* pass everything to iterator */
 			if (iwr->bandarg[i].uniontype == UT_MEAN) {
-				noerr = rt_raster_iterator(
+				noerr = rt_raster_iterator_parallel(
 					itrset, 2,
 					ET_UNION, NULL,
 					pixtype,
@@ -2834,7 +3028,7 @@ Datum RASTER_union_finalfn(PG_FUNCTION_ARGS)
 				);
 			}
 			else if (iwr->bandarg[i].uniontype == UT_RANGE) {
-				noerr = rt_raster_iterator(
+				noerr = rt_raster_iterator_parallel(
 					itrset, 2,
 					ET_UNION, NULL,
 					pixtype,
@@ -4616,6 +4810,15 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
     bool isnull = FALSE;
     int i = 0;
     int j = 0;
+    rtpg_expr compiled = NULL;
+    double *exprval = NULL;
+    const double *exprargs[3] = {NULL};
+    bool *exprnull = NULL;
+    const bool *exprnulls[3] = {NULL};
+    double *exprresult = NULL;
+    bool *exprresultnull = NULL;
+    int *exprpixel = NULL;
+    int n = 0;
 
     POSTGIS_RT_DEBUG(2, "RASTER_mapAlgebraExpr: Starting...");
 
@@ -5045,6 +5248,30 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
 
         POSTGIS_RT_DEBUGF(3, "RASTER_mapAlgebraExpr: initexpr = %s", initexpr);
 
+        /* evaluate without SPI if possible, a column of pixels at a time */
+        if (skipcomputation == 0) {
+            len = strlen(initexpr) - strlen("SELECT (") - strlen(")::double precision");
+            newexpr = pnstrdup(initexpr + strlen("SELECT ("), len);
+            compiled = rtpg_expr_compile(newexpr, argcount, argtype);
+            pfree(newexpr);
+        }
+
+        if (compiled != NULL) {
+            POSTGIS_RT_DEBUG(3, "RASTER_mapAlgebraExpr: expression is compiled");
+
+            exprval = palloc(sizeof(double) * argcount * height);
+            exprnull = palloc0(sizeof(bool) * height);
+            for (i = 0; i < argcount; i++) {
+                exprargs[i] = exprval + (size_t) i * height;
+                exprnulls[i] = exprnull;
+            }
+            exprresult = palloc(sizeof(double) * height);
+            exprresultnull = palloc(sizeof(bool) * height);
+            exprpixel = palloc(sizeof(int) * height);
+        }
+    }
+
+    if (initexpr != NULL && compiled == NULL) {
         /* define values */
         values = (Datum *) palloc(sizeof(Datum) * argcount);
         if (values == NULL) {
@@ -5106,6 +5333,38 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
     }
 
     for (x = 0; x < width; x++) {
+        if (compiled != NULL) {
+            /* same pixels and values as the prepared plan gets below */
+            n = 0;
+            for (y = 0; y < height; y++) {
+                ret = rt_band_get_pixel(band, x, y, &r, NULL);
+                if (ret != ES_NONE || !FLT_NEQ(r, newnodatavalue))
+                    continue;
+
+                for (i = 0; i < argkwcount; i++) {
+                    idx = argpos[i];
+                    if (idx < 1) continue;
+                    idx--;
+
+                    if (i == kX)
+                        exprval[(size_t) idx * height + n] = x + 1;
+                    else if (i == kY)
+                        exprval[(size_t) idx * height + n] = y + 1;
+                    else
+                        exprval[(size_t) idx * height + n] = r;
+                }
+                exprpixel[n++] = y;
+            }
+
+            rtpg_expr_eval(compiled, n, exprargs, exprnulls, exprresult, exprresultnull);
+
+            for (i = 0; i < n; i++) {
+                newval = exprresultnull[i] ? newinitialvalue : exprresult[i];
+                rt_band_set_pixel(newband, x, exprpixel[i], newval, NULL);
+            }
+            continue;
+        }
+
         for(y = 0; y < height; y++) {
             ret = rt_band_get_pixel(band, x, y, &r, NULL);
 
@@ -5196,7 +5455,16 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
         }
     }
 
-    if (initexpr != NULL) {
+    if (compiled != NULL) {
+        rtpg_expr_free(compiled);
+        pfree(exprval);
+        pfree(exprnull);
+        pfree(exprresult);
+        pfree(exprresultnull);
+        pfree(exprpixel);
+        pfree(initexpr);
+    }
+    else if (initexpr != NULL) {
         SPI_freeplan(spi_plan);
         SPI_finish();
 
@@ -6287,6 +6555,7 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 	char *expr = NULL;
 	char *sql = NULL;
 	SPIPlanPtr spi_plan[3] = {NULL};
+	rtpg_expr compiled[3] = {NULL};
 	uint16_t spi_empty = 0;
 	Oid *argtype = NULL;
 	uint8_t argpos[3][8] = {{0}};
@@ -6898,10 +7167,15 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 							k++;
 						}
 
-						spi_plan[i] = SPI_prepare(sql, spi_argcount[i], argtype);
+						/* evaluate without SPI if possible */
+						compiled[i] = rtpg_expr_compile(expr, spi_argcount[i], argtype);
+						if (compiled[i] != NULL)
+							POSTGIS_RT_DEBUGF(3, "expression parameter %d is compiled", spi_exprpos[i]);
+						else
+							spi_plan[i] = SPI_prepare(sql, spi_argcount[i], argtype);
 						pfree(argtype);
 
-						if (spi_plan[i] == NULL) {
+						if (compiled[i] == NULL && spi_plan[i] == NULL) {
 
 							pfree(sql);
 							for (k = 0; k < spi_count; k++) SPI_freeplan(spi_plan[k]);
@@ -7175,6 +7449,48 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 							haspixel = 1;
 							pixel = argval[i];
 						}
+						/* compiled expression */
+						else if (compiled[i] != NULL) {
+							double exprval[ARGKWCOUNT] = {0};
+							const double *exprargs[ARGKWCOUNT];
+							const bool *exprnulls[ARGKWCOUNT];
+							bool exprnull = FALSE;
+							bool resultnull = FALSE;
+							double result = 0;
+
+							/* same values as the prepared plan gets below */
+							for (j = 0; j < ARGKWCOUNT; j++) {
+								idx = argpos[i][j];
+								if (idx < 1) continue;
+								idx--; /* 1-based becomes 0-based */
+
+								/* argkw is [rast1.x], [rast1.y], [rast1.val], [rast1], then rast2 */
+								k = j < 4 ? 0 : 1;
+								switch (j % 4) {
+									case 0:
+										exprval[idx] = _pos[k][0];
+										break;
+									case 1:
+										exprval[idx] = _pos[k][1];
+										break;
+									default:
+										/* a NODATA pixel has always reached the expression as 0 */
+										if (!_isempty[k] && _haspixel[k])
+											exprval[idx] = _pixel[k];
+										break;
+								}
+							}
+							for (j = 0; j < spi_argcount[i]; j++) {
+								exprargs[j] = &(exprval[j]);
+								exprnulls[j] = &exprnull;
+							}
+
+							rtpg_expr_eval(compiled[i], 1, exprargs, exprnulls, &result, &resultnull);
+							if (!resultnull) {
+								haspixel = 1;
+								pixel = result;
+							}
+						}
 						/* prepared plan exists */
 						else if (spi_plan[i] != NULL) {
 							POSTGIS_RT_DEBUGF(4, "Using prepared plan: %d", i);
@@ -7361,6 +7677,7 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 	if (calltype == TEXTOID) {
 		for (i = 0; i < spi_count; i++) {
 			if (spi_plan[i] != NULL) SPI_freeplan(spi_plan[i]);
+			rtpg_expr_free(compiled[i]);
 		}
 		SPI_finish();
 	}
@@ -38,11 +38,13 @@
 #define str(s) #s
 
 #include "rtpostgis.h"
+#include "stringbuffer.h"
 
 Datum RASTER_lib_version(PG_FUNCTION_ARGS);
 Datum RASTER_lib_build_date(PG_FUNCTION_ARGS);
 Datum RASTER_gdal_version(PG_FUNCTION_ARGS);
 Datum RASTER_minPossibleValue(PG_FUNCTION_ARGS);
+Datum RASTER_outdb_cache_stats(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(RASTER_lib_version);
 Datum RASTER_lib_version(PG_FUNCTION_ARGS)
@@ -93,6 +95,29 @@ Datum RASTER_gdal_version(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(result);
 }
 
+PG_FUNCTION_INFO_V1(RASTER_outdb_cache_stats);
+Datum RASTER_outdb_cache_stats(PG_FUNCTION_ARGS)
+{
+	struct rt_gdal_cache_stats_t stats;
+	stringbuffer_t sb;
+
+	rt_util_gdal_cache_get_stats(&stats);
+
+	stringbuffer_init(&sb);
+	stringbuffer_aprintf(&sb,
+		"{\"capacity\":%u,\"entries\":%u,\"hits\":" UINT64_FORMAT
+		",\"misses\":" UINT64_FORMAT ",\"stale\":" UINT64_FORMAT
+		",\"evictions\":" UINT64_FORMAT "}",
+		stats.capacity,
+		stats.entries,
+		(uint64)stats.hits,
+		(uint64)stats.misses,
+		(uint64)stats.stale,
+		(uint64)stats.evictions);
+
+	PG_RETURN_TEXT_P(cstring_to_text(stringbuffer_getstring(&sb)));
+}
+
 PG_FUNCTION_INFO_V1(RASTER_minPossibleValue);
 Datum RASTER_minPossibleValue(PG_FUNCTION_ARGS)
 {
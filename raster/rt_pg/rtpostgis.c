@@ -131,6 +131,7 @@
 
 /* PostgreSQL */
 #include "postgres.h" /* for palloc */
+#include "access/xact.h" /* for RegisterXactCallback */
 #include "fmgr.h" /* for PG_MODULE_MAGIC */
 #include "libpq/pqsignal.h"
 #include "utils/guc.h"
@@ -462,6 +463,8 @@ static char *gdal_vsi_options = NULL;
 static char *gdal_enabled_drivers = NULL;
 static bool enable_outdb_rasters = false;
 static bool gdal_cpl_debug = false;
+static int raster_threads = 1;
+static int outdb_max_open_files = 16;
 
 /* ---------------------------------------------------------------- */
 /*  Useful variables                                                */
@@ -512,6 +515,9 @@ rtpg_assignHookGDALEnabledDrivers(const char *enabled_drivers, void *extra) {
 
 	elog(DEBUG4, "Enabling GDAL drivers: %s", enabled_drivers);
 
+	/* cached out-db datasets cannot outlive their drivers */
+	rt_util_gdal_cache_flush();
+
 	/* destroy the driver manager */
 	/* this is the only way to ensure GDAL_SKIP is recognized */
 	GDALDestroyDriverManager();
@@ -646,6 +652,26 @@ rtpg_assignHookEnableOutDBRasters(bool enable, void *extra) {
 }
 
 
+/*
+ * rterror() does not return in the backend, so a cached out-db dataset
+ * opened by a failing call is never released. Nothing can be reading an
+ * out-db band once the transaction is over, so drop all references then.
+ */
+static void
+rtpg_xact_callback(XactEvent event, void *arg)
+{
+	switch (event) {
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			rt_util_gdal_cache_release_all();
+			break;
+		default:
+			break;
+	}
+}
+
 /* Module load callback */
 void
 _PG_init(void) {
@@ -828,6 +854,53 @@ _PG_init(void) {
 		);
 	}
 
+	if ( postgis_guc_find_option("postgis.raster_threads") )
+	{
+		elog(WARNING, "'%s' is already set and cannot be changed until you reconnect", "postgis.raster_threads");
+	}
+	else
+	{
+		DefineCustomIntVariable(
+			"postgis.raster_threads", /* name */
+			"Threads used by raster processing", /* short_desc */
+			"Maximum number of threads ST_Reclass and pixel-wise ST_Union split their output rows between", /* long_desc */
+			&raster_threads, /* valueAddr */
+			1, /* bootValue */
+			1, /* minValue */
+			POSTGIS_RT_MAX_THREADS, /* maxValue */
+			PGC_USERSET, /* GucContext context */
+			0, /* int flags */
+			NULL, /* GucIntCheckHook check_hook */
+			NULL, /* GucIntAssignHook assign_hook */
+			NULL  /* GucShowHook show_hook */
+		);
+	}
+
+	if ( postgis_guc_find_option("postgis.outdb_max_open_files") )
+	{
+		elog(WARNING, "'%s' is already set and cannot be changed until you reconnect", "postgis.outdb_max_open_files");
+	}
+	else
+	{
+		DefineCustomIntVariable(
+			"postgis.outdb_max_open_files", /* name */
+			"Out-db raster files kept open", /* short_desc */
+			"Maximum number of out-db raster files kept open between reads of out-db bands. 0 disables the cache", /* long_desc */
+			&outdb_max_open_files, /* valueAddr */
+			16, /* bootValue */
+			0, /* minValue */
+			POSTGIS_RT_MAX_OPEN_FILES, /* maxValue */
+			PGC_USERSET, /* GucContext context */
+			0, /* int flags */
+			NULL, /* GucIntCheckHook check_hook */
+			NULL, /* GucIntAssignHook assign_hook */
+			NULL  /* GucShowHook show_hook */
+		);
+	}
+
+	/* hook on transaction end to release cached out-db datasets */
+	RegisterXactCallback(rtpg_xact_callback, NULL);
+
 	/* Revert back to old context */
 	MemoryContextSwitchTo(old_context);
 }
@@ -841,6 +914,8 @@ _PG_fini(void) {
 	elog(NOTICE, "Goodbye from PostGIS Raster %s", POSTGIS_VERSION);
 
 	/* Clean up */
+	UnregisterXactCallback(rtpg_xact_callback, NULL);
+	rt_util_gdal_cache_flush();
 	pfree(env_postgis_gdal_enabled_drivers);
 	pfree(boot_postgis_gdal_enabled_drivers);
 	pfree(env_postgis_enable_outdb_rasters);
@@ -1295,6 +1295,177 @@ static void test_band_new_offline_from_path() {
 	rt_band_destroy(band);
 }
 
+static char *testBandOfflineCache_options(const char *varname) {
+	static char max_open_files[] = "4";
+
+	if (strcmp(varname, "outdb_max_open_files") == 0)
+		return max_open_files;
+
+	return NULL;
+}
+
+static void test_band_load_offline_cache() {
+	rt_raster full = NULL;
+	rt_band fullband = NULL;
+	rt_raster rast = NULL;
+	rt_band band = NULL;
+	GDALDatasetH hds = NULL;
+	struct rt_gdal_cache_stats_t stats;
+	char *path = POSTGIS_TOP_SRC_DIR "/raster/test/regress/loader/testraster.tif";
+	int width = 10;
+	int height = 10;
+	double gt[6];
+	double ulx;
+	double uly;
+	double val;
+	double fullval;
+	int i;
+	int x;
+	int y;
+
+	/* whole file, for reference values */
+	rt_util_gdal_register_all(0);
+	hds = rt_util_gdal_open(path, GA_ReadOnly, 0);
+	CU_ASSERT(hds != NULL);
+	full = rt_raster_from_gdal_dataset(hds);
+	GDALClose(hds);
+	CU_ASSERT(full != NULL);
+	fullband = rt_raster_get_band(full, 0);
+	CU_ASSERT(fullband != NULL);
+
+	/* tile at (3, 4) of the file, on its grid */
+	rast = rt_raster_new(width, height);
+	CU_ASSERT(rast != NULL);
+	rt_raster_get_geotransform_matrix(full, gt);
+	rt_raster_set_geotransform_matrix(rast, gt);
+	CU_ASSERT_EQUAL(rt_raster_cell_to_geopoint(full, 3, 4, &ulx, &uly, NULL), ES_NONE);
+	rt_raster_set_offsets(rast, ulx, uly);
+
+	band = rt_band_new_offline(
+		width, height,
+		rt_band_get_pixtype(fullband),
+		0, 0,
+		0, path
+	);
+	CU_ASSERT(band != NULL);
+	CU_ASSERT_NOT_EQUAL(rt_raster_add_band(rast, band, 0), -1);
+
+	cu_set_rt_options(testBandOfflineCache_options);
+
+	/* second load reuses the open file */
+	for (i = 0; i < 2; i++) {
+		CU_ASSERT_EQUAL(rt_band_load_offline_data(band), ES_NONE);
+
+		for (y = 0; y < height; y++) {
+			for (x = 0; x < width; x++) {
+				CU_ASSERT_EQUAL(rt_band_get_pixel(band, x, y, &val, NULL), ES_NONE);
+				CU_ASSERT_EQUAL(rt_band_get_pixel(fullband, x + 3, y + 4, &fullval, NULL), ES_NONE);
+				CU_ASSERT_DOUBLE_EQUAL(val, fullval, DBL_EPSILON);
+			}
+		}
+	}
+
+	rt_util_gdal_cache_get_stats(&stats);
+	CU_ASSERT_EQUAL(stats.capacity, 4);
+	CU_ASSERT_EQUAL(stats.entries, 1);
+	CU_ASSERT(stats.hits >= 1);
+
+	rt_util_gdal_cache_flush();
+	rt_util_gdal_cache_get_stats(&stats);
+	CU_ASSERT_EQUAL(stats.entries, 0);
+
+	cu_set_rt_options(NULL);
+
+	cu_free_raster(rast);
+	cu_free_raster(full);
+}
+
+static void test_band_get_data_line_offline() {
+	rt_raster full = NULL;
+	rt_band fullband = NULL;
+	rt_raster rast = NULL;
+	rt_band band = NULL;
+	GDALDatasetH hds = NULL;
+	char *path = POSTGIS_TOP_SRC_DIR "/raster/test/regress/loader/testraster.tif";
+	int width = 10;
+	int height = 10;
+	double gt[6];
+	double ulx;
+	double uly;
+	double val;
+	double fullval;
+	uint8_t *data = NULL;
+	uint16_t nvals = 0;
+	void *vals = NULL;
+	int x;
+	int y;
+
+	/* whole file, for reference values */
+	rt_util_gdal_register_all(0);
+	hds = rt_util_gdal_open(path, GA_ReadOnly, 0);
+	CU_ASSERT(hds != NULL);
+	full = rt_raster_from_gdal_dataset(hds);
+	GDALClose(hds);
+	CU_ASSERT(full != NULL);
+	fullband = rt_raster_get_band(full, 1);
+	CU_ASSERT(fullband != NULL);
+
+	/* tile at (3, 4) of the file, on its grid */
+	rast = rt_raster_new(width, height);
+	CU_ASSERT(rast != NULL);
+	rt_raster_get_geotransform_matrix(full, gt);
+	rt_raster_set_geotransform_matrix(rast, gt);
+	CU_ASSERT_EQUAL(rt_raster_cell_to_geopoint(full, 3, 4, &ulx, &uly, NULL), ES_NONE);
+	rt_raster_set_offsets(rast, ulx, uly);
+
+	band = rt_band_new_offline(
+		width, height,
+		rt_band_get_pixtype(fullband),
+		0, 0,
+		1, path
+	);
+	CU_ASSERT(band != NULL);
+	CU_ASSERT_NOT_EQUAL(rt_raster_add_band(rast, band, 0), -1);
+
+	/* one pixel only reads blocks */
+	CU_ASSERT_EQUAL(rt_band_get_pixel(band, 5, 6, &val, NULL), ES_NONE);
+	CU_ASSERT_EQUAL(rt_band_get_pixel(fullband, 8, 10, &fullval, NULL), ES_NONE);
+	CU_ASSERT_DOUBLE_EQUAL(val, fullval, DBL_EPSILON);
+	CU_ASSERT(band->data.offline.blocks != NULL);
+	CU_ASSERT(band->data.offline.mem == NULL);
+
+	data = rt_band_get_data_line(band, 2, 3, width, &nvals);
+	CU_ASSERT(data != NULL);
+	CU_ASSERT(nvals >= 1 && nvals <= width - 2);
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			CU_ASSERT_EQUAL(rt_band_get_pixel(band, x, y, &val, NULL), ES_NONE);
+			CU_ASSERT_EQUAL(rt_band_get_pixel(fullband, x + 3, y + 4, &fullval, NULL), ES_NONE);
+			CU_ASSERT_DOUBLE_EQUAL(val, fullval, DBL_EPSILON);
+		}
+	}
+
+	/* line across rows */
+	CU_ASSERT_EQUAL(rt_band_get_pixel_line(band, width - 2, 1, 5, &vals, &nvals), ES_NONE);
+	CU_ASSERT_EQUAL(nvals, 5);
+	for (x = 0; x < nvals; x++) {
+		CU_ASSERT_EQUAL(rt_band_get_pixel(fullband, (width - 2 + x) % width + 3, 1 + (width - 2 + x) / width + 4, &fullval, NULL), ES_NONE);
+		CU_ASSERT_DOUBLE_EQUAL(((uint8_t *) vals)[x], fullval, DBL_EPSILON);
+	}
+	rtdealloc(vals);
+
+	/* whole band replaces the blocks */
+	CU_ASSERT(rt_band_get_data(band) != NULL);
+	CU_ASSERT(band->data.offline.blocks == NULL);
+	CU_ASSERT_EQUAL(rt_band_get_pixel(band, 5, 6, &val, NULL), ES_NONE);
+	CU_ASSERT_EQUAL(rt_band_get_pixel(fullband, 8, 10, &fullval, NULL), ES_NONE);
+	CU_ASSERT_DOUBLE_EQUAL(val, fullval, DBL_EPSILON);
+
+	cu_free_raster(rast);
+	cu_free_raster(full);
+}
+
 /* register tests */
 void band_basics_suite_setup(void);
 void band_basics_suite_setup(void)
@@ -1314,5 +1485,7 @@ void band_basics_suite_setup(void)
 	PG_ADD_TEST(suite, test_band_pixtype_64BF);
 	PG_ADD_TEST(suite, test_band_get_pixel_line);
 	PG_ADD_TEST(suite, test_band_new_offline_from_path);
+	PG_ADD_TEST(suite, test_band_load_offline_cache);
+	PG_ADD_TEST(suite, test_band_get_data_line_offline);
 }
 
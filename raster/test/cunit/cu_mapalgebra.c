@@ -793,6 +793,364 @@ static void test_raster_iterator() {
 	if (rtn != NULL) cu_free_raster(rtn);
 }
 
+/* callback summing neighborhoods of all rasters, one pixel */
+static int testRasterIteratorRows_pixel_callback(rt_iterator_arg arg, void *userarg, double *value, int *nodata) {
+	uint32_t z, y, x;
+	int count = 0;
+
+	*value = 0;
+	for (z = 0; z < arg->rasters; z++) {
+		for (y = 0; y < arg->rows; y++) {
+			for (x = 0; x < arg->columns; x++) {
+				if (arg->nodata[z][y][x])
+					continue;
+				*value += arg->values[z][y][x] * (z + 1);
+				count++;
+			}
+		}
+	}
+	*nodata = (count < 1);
+
+	return 1;
+}
+
+/* callback summing neighborhoods of all rasters, one row */
+static int testRasterIteratorRows_callback(rt_iterator_rows_arg arg, void *userarg, double *values, uint8_t *nodata) {
+	_callback_userargs _userarg = (_callback_userargs) userarg;
+	uint32_t z, y, x, i;
+	int count = 0;
+
+	/* check that we're getting what we expect from userarg */
+	CU_ASSERT_EQUAL(arg->rasters, _userarg->rasters);
+	CU_ASSERT_EQUAL(arg->rows, _userarg->rows);
+	CU_ASSERT_EQUAL(arg->columns, _userarg->columns);
+
+	/* pixel 0,0 of first raster is at 1,1 of output */
+	CU_ASSERT_EQUAL(arg->src_pixel[0][0], -1);
+	CU_ASSERT_EQUAL(arg->src_pixel[0][1], arg->dst_row - 1);
+
+	for (i = 0; i < arg->columns; i++) {
+		values[i] = 0;
+		count = 0;
+		for (z = 0; z < arg->rasters; z++) {
+			for (y = 0; y < arg->rows; y++) {
+				for (x = i; x < i + arg->distancex * 2 + 1; x++) {
+					if (arg->nodata[z][y][x])
+						continue;
+					values[i] += arg->values[z][y][x] * (z + 1);
+					count++;
+				}
+			}
+		}
+		nodata[i] = (count < 1);
+	}
+
+	return 1;
+}
+
+static void test_raster_iterator_rows() {
+	rt_raster rast1;
+	rt_raster rast2;
+	rt_raster rtn = NULL;
+	rt_raster rtnrows = NULL;
+	rt_band band;
+	rt_band rtnband;
+	rt_band rtnrowsband;
+	int maxX = 5;
+	int maxY = 5;
+	rt_iterator itrset;
+	_callback_userargs userargs;
+	int noerr = 0;
+	int x = 0;
+	int y = 0;
+	double value = 0;
+	double rowvalue = 0;
+	int nodata = 0;
+	int rownodata = 0;
+
+	rast1 = rt_raster_new(maxX, maxY);
+	CU_ASSERT(rast1 != NULL);
+	rt_raster_set_offsets(rast1, 0, 0);
+	rt_raster_set_scale(rast1, 1, -1);
+
+	band = cu_add_band(rast1, PT_32BUI, 1, 6);
+	CU_ASSERT(band != NULL);
+	for (y = 0; y < maxY; y++) {
+		for (x = 0; x < maxX; x++)
+			rt_band_set_pixel(band, x, y, x + (y * maxX), NULL);
+	}
+
+	rast2 = rt_raster_new(maxX, maxY);
+	CU_ASSERT(rast2 != NULL);
+	rt_raster_set_offsets(rast2, -1, 1);
+	rt_raster_set_scale(rast2, 1, -1);
+
+	band = cu_add_band(rast2, PT_16BSI, 0, 0);
+	CU_ASSERT(band != NULL);
+	for (y = 0; y < maxY; y++) {
+		for (x = 0; x < maxX; x++)
+			rt_band_set_pixel(band, x, y, (x * y) - 100, NULL);
+	}
+
+	userargs = rtalloc(sizeof(struct _callback_userargs_t));
+	CU_ASSERT(userargs != NULL);
+
+	itrset = rtalloc(sizeof(struct rt_iterator_t) * 2);
+	CU_ASSERT(itrset != NULL);
+	itrset[0].raster = rast1;
+	itrset[0].nband = 0;
+	itrset[0].nbnodata = 1;
+	itrset[1].raster = rast2;
+	itrset[1].nband = 0;
+	itrset[1].nbnodata = 1;
+
+	/* 2 rasters, 1 distance, UNION: rows match pixel by pixel iteration */
+	userargs->rasters = 2;
+	userargs->rows = 3;
+	userargs->columns = 6;
+
+	noerr = rt_raster_iterator(
+		itrset, 2,
+		ET_UNION, NULL,
+		PT_64BF,
+		1, -9999,
+		1, 1,
+		NULL,
+		userargs,
+		testRasterIteratorRows_pixel_callback,
+		&rtn
+	);
+	CU_ASSERT_EQUAL(noerr, ES_NONE);
+
+	noerr = rt_raster_iterator_rows(
+		itrset, 2,
+		ET_UNION, NULL,
+		PT_64BF,
+		1, -9999,
+		1, 1,
+		userargs,
+		testRasterIteratorRows_callback,
+		&rtnrows
+	);
+	CU_ASSERT_EQUAL(noerr, ES_NONE);
+
+	CU_ASSERT_EQUAL(rt_raster_get_width(rtnrows), 6);
+	CU_ASSERT_EQUAL(rt_raster_get_height(rtnrows), 6);
+	CU_ASSERT_DOUBLE_EQUAL(rt_raster_get_x_offset(rtnrows), -1, DBL_EPSILON);
+	CU_ASSERT_DOUBLE_EQUAL(rt_raster_get_y_offset(rtnrows), 1, DBL_EPSILON);
+
+	rtnband = rt_raster_get_band(rtn, 0);
+	rtnrowsband = rt_raster_get_band(rtnrows, 0);
+	CU_ASSERT(rtnband != NULL);
+	CU_ASSERT(rtnrowsband != NULL);
+
+	for (y = 0; y < 6; y++) {
+		for (x = 0; x < 6; x++) {
+			rt_band_get_pixel(rtnband, x, y, &value, &nodata);
+			rt_band_get_pixel(rtnrowsband, x, y, &rowvalue, &rownodata);
+			CU_ASSERT_DOUBLE_EQUAL(rowvalue, value, DBL_EPSILON);
+			CU_ASSERT_EQUAL(rownodata, nodata);
+		}
+	}
+
+	/* pixel 1,1 of output: 0 + 1 + 5 of first raster (6 is NODATA), 3 x 3 pixels of second raster */
+	rt_band_get_pixel(rtnrowsband, 1, 1, &value, &nodata);
+	CU_ASSERT_DOUBLE_EQUAL(value, (0 + 1 + 5) + 2 * (-300 - 297 - 294), DBL_EPSILON);
+	CU_ASSERT_EQUAL(nodata, 0);
+
+	if (rtn != NULL) cu_free_raster(rtn);
+	if (rtnrows != NULL) cu_free_raster(rtnrows);
+
+	rtdealloc(userargs);
+	rtdealloc(itrset);
+
+	cu_free_raster(rast1);
+	cu_free_raster(rast2);
+}
+
+static char *testRasterThreads_options(const char *varname) {
+	static char threads[] = "4";
+
+	if (strcmp(varname, "raster_threads") == 0)
+		return threads;
+
+	return NULL;
+}
+
+/* callback for 1 raster, 1 distance, called from several threads */
+static int testRasterThreads_callback(rt_iterator_arg arg, void *userarg, double *value, int *nodata) {
+	int x = 0;
+	int y = 0;
+
+	if (arg->nodata[0][1][1]) {
+		*nodata = 1;
+		return 1;
+	}
+
+	*value = 0;
+	for (y = 0; y < 3; y++) {
+		for (x = 0; x < 3; x++) {
+			if (!arg->nodata[0][y][x])
+				*value += arg->values[0][y][x];
+		}
+	}
+
+	return 1;
+}
+
+/* callback failing on one pixel of the last strip */
+static int testRasterThreads_error_callback(rt_iterator_arg arg, void *userarg, double *value, int *nodata) {
+	if (arg->dst_pixel[0] == 3 && arg->dst_pixel[1] == 500) {
+		snprintf(arg->error, RT_ITERATOR_ERROR_SIZE, "pixel %d %d is off limits", arg->dst_pixel[0], arg->dst_pixel[1]);
+		return 0;
+	}
+
+	*value = 0;
+	*nodata = 0;
+	return 1;
+}
+
+static void test_raster_threads() {
+	rt_raster rast;
+	rt_band band;
+	rt_iterator itrset;
+	rt_raster rtn = NULL;
+	rt_raster rtnthreads = NULL;
+	rt_raster rtnerror = NULL;
+	rt_band rtnband;
+	rt_band rtnbandthreads;
+	struct rt_reclassexpr_t expr;
+	rt_reclassexpr exprset[1] = {&expr};
+	rt_band reclass = NULL;
+	rt_band reclassthreads = NULL;
+	int width = 512;
+	int height = 512;
+	int mismatch = 0;
+	int x;
+	int y;
+	double val;
+	double valthreads;
+	int nodata;
+	int nodatathreads;
+	rt_errorstate noerr;
+
+	rast = rt_raster_new(width, height);
+	CU_ASSERT(rast != NULL);
+	band = cu_add_band(rast, PT_32BF, 1, -1);
+	CU_ASSERT(band != NULL);
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++)
+			rt_band_set_pixel(band, x, y, (x * 7 + y * 13) % 100 - 1, NULL);
+	}
+
+	itrset = rtalloc(sizeof(struct rt_iterator_t));
+	CU_ASSERT(itrset != NULL);
+	itrset[0].raster = rast;
+	itrset[0].nband = 0;
+	itrset[0].nbnodata = 1;
+
+	memset(&expr, 0, sizeof(struct rt_reclassexpr_t));
+	expr.src.min = 0;
+	expr.src.max = 50;
+	expr.src.inc_max = 1;
+	expr.dst.min = 1;
+	expr.dst.max = 10;
+
+	/* one thread */
+	noerr = rt_raster_iterator(
+		itrset, 1,
+		ET_FIRST, NULL,
+		PT_64BF,
+		1, -1,
+		1, 1,
+		NULL,
+		NULL,
+		testRasterThreads_callback,
+		&rtn
+	);
+	CU_ASSERT_EQUAL(noerr, ES_NONE);
+	CU_ASSERT(rtn != NULL);
+
+	reclass = rt_band_reclass(band, PT_8BUI, 1, 0, exprset, 1);
+	CU_ASSERT(reclass != NULL);
+
+	/* strips on four threads */
+	cu_set_rt_options(testRasterThreads_options);
+
+	noerr = rt_raster_iterator_parallel(
+		itrset, 1,
+		ET_FIRST, NULL,
+		PT_64BF,
+		1, -1,
+		1, 1,
+		NULL,
+		NULL,
+		testRasterThreads_callback,
+		&rtnthreads
+	);
+	CU_ASSERT_EQUAL(noerr, ES_NONE);
+	CU_ASSERT(rtnthreads != NULL);
+
+	reclassthreads = rt_band_reclass(band, PT_8BUI, 1, 0, exprset, 1);
+	CU_ASSERT(reclassthreads != NULL);
+
+	/* error of a callback on another thread is reported by the caller */
+	cu_error_msg_reset();
+	noerr = rt_raster_iterator_parallel(
+		itrset, 1,
+		ET_FIRST, NULL,
+		PT_64BF,
+		1, -1,
+		1, 1,
+		NULL,
+		NULL,
+		testRasterThreads_error_callback,
+		&rtnerror
+	);
+	CU_ASSERT_EQUAL(noerr, ES_ERROR);
+	CU_ASSERT(strstr(cu_error_msg, "pixel 3 500 is off limits") != NULL);
+	if (rtnerror != NULL) cu_free_raster(rtnerror);
+
+	cu_set_rt_options(NULL);
+
+	if (rtn != NULL && rtnthreads != NULL && reclass != NULL && reclassthreads != NULL) {
+		rtnband = rt_raster_get_band(rtn, 0);
+		rtnbandthreads = rt_raster_get_band(rtnthreads, 0);
+		CU_ASSERT_EQUAL(rt_band_get_isnodata_flag(rtnbandthreads), rt_band_get_isnodata_flag(rtnband));
+
+		for (y = 0; y < height; y++) {
+			for (x = 0; x < width; x++) {
+				rt_band_get_pixel(rtnband, x, y, &val, &nodata);
+				rt_band_get_pixel(rtnbandthreads, x, y, &valthreads, &nodatathreads);
+				if (nodata != nodatathreads || FLT_NEQ(val, valthreads))
+					mismatch++;
+
+				rt_band_get_pixel(reclass, x, y, &val, &nodata);
+				rt_band_get_pixel(reclassthreads, x, y, &valthreads, &nodatathreads);
+				if (nodata != nodatathreads || FLT_NEQ(val, valthreads))
+					mismatch++;
+			}
+		}
+		CU_ASSERT_EQUAL(mismatch, 0);
+
+		/* first pixel is NODATA, next one sums its neighbors but the first */
+		rt_band_get_pixel(rtnbandthreads, 0, 0, &val, &nodata);
+		CU_ASSERT_EQUAL(nodata, 1);
+		rt_band_get_pixel(rtnbandthreads, 1, 0, &val, &nodata);
+		CU_ASSERT_EQUAL(nodata, 0);
+		CU_ASSERT_DOUBLE_EQUAL(val, 6 + 13 + 12 + 19 + 26, DBL_EPSILON);
+	}
+
+	if (rtn != NULL) cu_free_raster(rtn);
+	if (rtnthreads != NULL) cu_free_raster(rtnthreads);
+	if (reclass != NULL) rt_band_destroy(reclass);
+	if (reclassthreads != NULL) rt_band_destroy(reclassthreads);
+
+	rtdealloc(itrset);
+	cu_free_raster(rast);
+}
+
 static void test_band_reclass() {
 	rt_reclassexpr *exprset;
 
@@ -1189,6 +1547,8 @@ void mapalgebra_suite_setup(void)
 {
 	CU_pSuite suite = CU_add_suite("mapalgebra", NULL, NULL);
 	PG_ADD_TEST(suite, test_raster_iterator);
+	PG_ADD_TEST(suite, test_raster_iterator_rows);
+	PG_ADD_TEST(suite, test_raster_threads);
 	PG_ADD_TEST(suite, test_band_reclass);
 	PG_ADD_TEST(suite, test_raster_colormap);
 }
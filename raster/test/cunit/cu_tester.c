@@ -208,6 +208,18 @@ void cu_error_msg_reset() {
 	memset(cu_error_msg, '\0', MAX_CUNIT_MSG_LENGTH);
 }
 
+void cu_set_rt_options(rt_options options) {
+	rt_set_handlers_options(
+		default_rt_allocator,
+		default_rt_reallocator,
+		default_rt_deallocator,
+		cu_error_reporter,
+		default_rt_info_handler,
+		default_rt_warning_handler,
+		options != NULL ? options : default_rt_options
+	);
+}
+
 void cu_free_raster(rt_raster raster) {
 	uint16_t i;
 	uint16_t nbands = rt_raster_get_num_bands(raster);
@@ -29,6 +29,9 @@ void cu_error_msg_reset(void);
 /* free raster object */
 void cu_free_raster(rt_raster raster);
 
+/* install rt_core options handler, NULL for the default one */
+void cu_set_rt_options(rt_options options);
+
 /* helper to add bands to raster */
 rt_band cu_add_band(
 	rt_raster raster,
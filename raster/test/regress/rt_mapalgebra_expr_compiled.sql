@@ -0,0 +1,30 @@
+-- Expressions that evaluate without SPI must give the same results and
+-- errors as the prepared statement they replace
+SET client_min_messages TO warning;
+
+DROP TABLE IF EXISTS raster_mapalgebra_compiled;
+CREATE TABLE raster_mapalgebra_compiled AS
+SELECT
+	ST_SetValues(ST_AddBand(ST_MakeEmptyRaster(3, 1, 0, 0, 1, -1, 0, 0, 0), '32BF', 0, NULL), 1, 1, 1, ARRAY[[1, 2, 4]]::double precision[]) AS rast1,
+	ST_SetValues(ST_AddBand(ST_MakeEmptyRaster(3, 1, 0, 0, 1, -1, 0, 0, 0), '32BF', 0, NULL), 1, 1, 1, ARRAY[[3, 2, 0]]::double precision[]) AS rast2;
+
+-- two rasters
+SELECT 'C1', (ST_DumpValues(ST_MapAlgebra(rast1, 1, rast2, 1, '([rast2] - [rast1]) / ([rast2] + [rast1])', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+SELECT 'C2', (ST_DumpValues(ST_MapAlgebra(rast1, 1, rast2, 1, 'CASE WHEN [rast2] = 0 THEN NULL ELSE round([rast1] / [rast2]) END', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+-- integer division of positions
+SELECT 'C3', (ST_DumpValues(ST_MapAlgebra(rast1, 1, rast2, 1, '[rast1.x] / 2 + [rast1.y]', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+-- not compiled, prepared statement
+SELECT 'C4', (ST_DumpValues(ST_MapAlgebra(rast1, 1, rast2, 1, '[rast1] ^ 2', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+SELECT 'C5', (ST_DumpValues(ST_MapAlgebra(rast1, 1, rast2, 1, '[rast1] / ([rast2] - 2)', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+-- NODATA pixel of rast1 takes nodata1expr
+SELECT 'C10', (ST_DumpValues(ST_MapAlgebra(ST_SetBandNoDataValue(rast1, 2), 1, rast2, 1, '[rast1] + [rast2]', '32BF', 'INTERSECTION', '[rast2] * 10', NULL, NULL))).valarray FROM raster_mapalgebra_compiled;
+
+-- one raster
+SELECT 'C6', (ST_DumpValues(ST_MapAlgebra(rast1, 1, '32BF', 'greatest([rast], 2) + abs(-1)'))).valarray FROM raster_mapalgebra_compiled;
+SELECT 'C7', (ST_DumpValues(ST_MapAlgebra(rast1, 1, '32BF', '[rast.x] * 2147483647'))).valarray FROM raster_mapalgebra_compiled;
+
+-- ST_MapAlgebraExpr
+SELECT 'C8', (ST_DumpValues(ST_MapAlgebraExpr(rast1, rast2, 'coalesce([rast1], 0) * [rast2.x]', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+SELECT 'C9', (ST_DumpValues(ST_MapAlgebraExpr(rast1, rast2, 'ln([rast2])', '32BF'))).valarray FROM raster_mapalgebra_compiled;
+
+DROP TABLE IF EXISTS raster_mapalgebra_compiled;
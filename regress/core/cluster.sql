@@ -84,3 +84,13 @@ from (values (null::geometry), ('POINT(1 1)'), ('POINT EMPTY'), ('POINT(0 0)'),
 
 select 'weight-and-limit-support-1', count(distinct cid) from (select ST_ClusterKMeans(ST_Force2D(geom), 1, 1) over () as cid from (values ('POINT(0 0 0 1)'::geometry), ('POINT(1 0 0 1)'), ('POINT(2 0 0 10000)')) g(geom)) kmeans;
 select 'weight-and-limit-support-2', count(distinct cid) from (select ST_ClusterKMeans(geom, 1, 1) over () as cid from (values ('POINT(0 0 0 1)'::geometry), ('POINT(1 0 0 1)'), ('POINT(2 0 0 10000)')) g(geom)) kmeans;
+
+-- k-means methods
+select 'kmeans-method-1', count(*) from
+(select
+	ST_ClusterKMeans(geom, 5) over () a,
+	ST_ClusterKMeans(geom, 5, null, 'lloyd') over () b,
+	ST_ClusterKMeans(geom, 5, null, 'minibatch') over () c
+from (select ST_MakePoint(i % 17, i % 23) from generate_series(1, 391) i) as g (geom)) z
+where a = b and a = c;
+select 'kmeans-method-2', ST_ClusterKMeans('POINT(0 0)'::geometry, 1, null, 'foo') over ();
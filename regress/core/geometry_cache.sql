@@ -0,0 +1,40 @@
+---
+--- Tests for the backend geometry cache (postgis.geometry_cache_size)
+---
+
+SET postgis.geometry_cache_size = '1MB';
+
+-- First sighting only records the geometries
+SELECT 'intersects1', ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(5 5, 20 20)');
+-- Second sighting, in another statement, builds the prepared polygon
+SELECT 'intersects2', ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(5 5, 20 20)');
+-- Reused by a later statement
+SELECT 'intersects3', ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(-2 9, 8 19)');
+-- Reused by another call site
+SELECT 'contains1', ST_Contains('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(1 1, 2 2)');
+SELECT 'contains2', ST_Contains('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(0 0, 0 10)');
+
+SELECT 'stats1', s->>'entries', s->>'builds', s->>'hits'
+FROM (SELECT _postgis_geometry_cache_stats()::json AS s) AS t;
+
+-- Disabling the cache releases the entries
+SET postgis.geometry_cache_size = 0;
+SELECT 'intersects4', ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(5 5, 20 20)');
+
+SELECT 'stats2', s->>'entries', s->>'bytes', s->>'evictions'
+FROM (SELECT _postgis_geometry_cache_stats()::json AS s) AS t;
+
+-- A cache too small for more than a few entries, looking up
+-- the second argument must not push out the first one
+SET postgis.geometry_cache_size = 1;
+SELECT 'tiny1', count(*) FILTER (WHERE ST_Intersects(p, l)), count(*)
+FROM (SELECT ST_MakeEnvelope(i, 0, i + 1, 1) AS p FROM generate_series(1, 30) AS i) AS polys,
+     (SELECT ST_MakeLine(ST_MakePoint(j + 0.5, 0.5), ST_MakePoint(j + 0.5, 5)) AS l FROM generate_series(1, 30) AS j) AS lines;
+SELECT 'tiny2', count(*) FILTER (WHERE ST_Intersects(p, l)), count(*)
+FROM (SELECT ST_MakeEnvelope(i, 0, i + 1, 1) AS p FROM generate_series(1, 30) AS i) AS polys,
+     (SELECT ST_MakeLine(ST_MakePoint(j + 0.5, 0.5), ST_MakePoint(j + 0.5, 5)) AS l FROM generate_series(1, 30) AS j) AS lines;
+
+SELECT 'stats3', (s->>'bytes')::integer <= 1024
+FROM (SELECT _postgis_geometry_cache_stats()::json AS s) AS t;
+
+RESET postgis.geometry_cache_size;
@@ -239,3 +239,62 @@ SET enable_seqscan = false;
 SELECT '#5782', l FROM t5782 ORDER BY g <-> 'POINT(18.006691126034692 69.04048768506776)'::geometry;
 DROP TABLE t5782;
 SET enable_seqscan to default;
+
+-- Polygon query geometry, kept as a cached edge tree across the rechecks
+CREATE TABLE knn_recheck_poly AS
+SELECT i AS gid, ST_Buffer(ST_Point(i % 30 * 10, i / 30 * 10), 3 + i % 4, 1 + i % 5) AS geom
+FROM generate_series(0, 899) i;
+INSERT INTO knn_recheck_poly VALUES (900, 'LINESTRING(-20 -20, 150 310, 320 -20)');
+INSERT INTO knn_recheck_poly VALUES (901, 'MULTIPOINT(-20 150, 350 150)');
+CREATE INDEX ON knn_recheck_poly USING GIST(geom);
+ANALYZE knn_recheck_poly;
+SET enable_seqscan = false;
+SELECT '#rectree-1', count(*) FILTER (WHERE abs(knn_dist - true_dist) > 1e-9), count(*) FILTER (WHERE knn_dist < prev_dist)
+FROM (
+	SELECT knn_dist, lag(knn_dist) OVER () AS prev_dist,
+		ST_Distance(geom, 'POLYGON((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130))'::geometry) AS true_dist
+	FROM (
+		SELECT geom, geom <-> 'POLYGON((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130))'::geometry AS knn_dist
+		FROM knn_recheck_poly
+		ORDER BY geom <-> 'POLYGON((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130))'::geometry LIMIT 100
+	) AS knn
+) AS checked;
+SELECT '#rectree-2', count(*) FILTER (WHERE abs(knn_dist - true_dist) > 1e-9), count(*) FILTER (WHERE knn_dist < prev_dist)
+FROM (
+	SELECT knn_dist, lag(knn_dist) OVER () AS prev_dist,
+		ST_Distance(geom, 'CURVEPOLYGON(CIRCULARSTRING(40 40, 80 80, 120 40, 80 0, 40 40))'::geometry) AS true_dist
+	FROM (
+		SELECT geom, geom <-> 'CURVEPOLYGON(CIRCULARSTRING(40 40, 80 80, 120 40, 80 0, 40 40))'::geometry AS knn_dist
+		FROM knn_recheck_poly
+		ORDER BY geom <-> 'CURVEPOLYGON(CIRCULARSTRING(40 40, 80 80, 120 40, 80 0, 40 40))'::geometry LIMIT 100
+	) AS knn
+) AS checked;
+SELECT '#rectree-3', count(*) FILTER (WHERE abs(knn_dist - true_dist) > 1e-9), count(*) FILTER (WHERE knn_dist < prev_dist)
+FROM (
+	SELECT knn_dist, lag(knn_dist) OVER () AS prev_dist,
+		ST_Distance(geom, 'MULTIPOLYGON(((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130)),((200 100, 260 100, 260 160, 200 160, 200 100)))'::geometry) AS true_dist
+	FROM (
+		SELECT geom, geom <-> 'MULTIPOLYGON(((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130)),((200 100, 260 100, 260 160, 200 160, 200 100)))'::geometry AS knn_dist
+		FROM knn_recheck_poly
+		ORDER BY geom <-> 'MULTIPOLYGON(((100 100, 180 120, 160 190, 90 170, 100 100),(120 130, 150 140, 140 160, 120 130)),((200 100, 260 100, 260 160, 200 160, 200 100)))'::geometry LIMIT 100
+	) AS knn
+) AS checked;
+DROP TABLE knn_recheck_poly;
+
+-- Points inside a part, in a hole and between the parts of the query geometry
+CREATE TABLE knn_recheck_pts (label text, geom geometry);
+INSERT INTO knn_recheck_pts VALUES
+	('inside', 'POINT(40 40)'),
+	('inside2', 'POINT(100 25)'),
+	('hole', 'POINT(15 15)'),
+	('between', 'POINT(60 25)'),
+	('outside', 'POINT(25 80)');
+CREATE INDEX ON knn_recheck_pts USING GIST(geom);
+SELECT '#rectree-4', label, round((geom <-> 'MULTIPOLYGON(((0 0, 50 0, 50 50, 0 50, 0 0),(10 10, 20 10, 20 20, 10 20, 10 10)),((70 0, 120 0, 120 50, 70 50, 70 0)))'::geometry)::numeric, 3)
+FROM knn_recheck_pts
+ORDER BY geom <-> 'MULTIPOLYGON(((0 0, 50 0, 50 50, 0 50, 0 0),(10 10, 20 10, 20 20, 10 20, 10 10)),((70 0, 120 0, 120 50, 70 50, 70 0)))'::geometry, label;
+SELECT '#rectree-5', label, round((geom <-> 'TIN(((0 0, 50 0, 0 50, 0 0)),((50 0, 120 0, 120 50, 50 0)))'::geometry)::numeric, 3)
+FROM knn_recheck_pts
+ORDER BY geom <-> 'TIN(((0 0, 50 0, 0 50, 0 0)),((50 0, 120 0, 120 50, 50 0)))'::geometry, label;
+DROP TABLE knn_recheck_pts;
+SET enable_seqscan to default;
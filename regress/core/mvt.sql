@@ -734,3 +734,126 @@ WITH geom AS (
 	SELECT 3 as id, 'TRIANGLE EMPTY'::geometry geom
 )
 select '#4399', id, 'ST_AsMVTGeom', ST_AsText(ST_AsMVTGeom(geom, ST_MakeBox2D(ST_Point(0, 0), ST_Point(32, 32))))::text from geom order by id asc;
+
+-- ST_AsMVTPyramid must match ST_AsMVT over ST_AsMVTGeom of each tile
+CREATE TEMP TABLE mvt_pyramid_pts AS
+	SELECT 1 AS id, 'SRID=3857;POINT(10 10)'::geometry AS geom
+	UNION ALL
+	SELECT 2 AS id, 'SRID=3857;POINT(-5000000 7000000)'::geometry AS geom
+	UNION ALL
+	SELECT 3 AS id, 'SRID=3857;MULTIPOINT(-9000000 -3000000, 4000000 6000000)'::geometry AS geom;
+WITH pyramid AS (
+	SELECT * FROM ST_AsMVTPyramid('SELECT id, geom FROM mvt_pyramid_pts ORDER BY id',
+		'layer', 0, 3, ST_TileEnvelope(0, 0, 0))
+)
+SELECT 'AsMVTPyramid', count(*) > 0,
+	count(*) FILTER (WHERE py.mvt IS DISTINCT FROM (
+		SELECT ST_AsMVT(q, 'layer')
+		FROM (SELECT id, ST_AsMVTGeom(geom, ST_TileEnvelope(py.z, py.x, py.y)) AS geom
+			FROM mvt_pyramid_pts ORDER BY id) q
+		WHERE q.geom IS NOT NULL))
+FROM pyramid py;
+DROP TABLE mvt_pyramid_pts;
+
+-- ST_AsMVTPyramid over more rows than a cursor batch, several zoom_min
+-- tiles, feature ids and tiles holding hundreds of features
+CREATE TEMP TABLE mvt_pyramid_pts AS
+	SELECT i AS id, 'kind' || (i % 7) AS kind,
+		CASE WHEN i % 10 = 0 THEN
+			ST_SetSRID(ST_MakePoint(-19000000 + (i * 7919 % 38000) * 1000.0, -19000000 + (i * 104729 % 38000) * 1000.0), 3857)
+		ELSE
+			ST_SetSRID(ST_Collect(
+				ST_MakePoint(-19000000 + (i * 7919 % 38000) * 1000.0, -19000000 + (i * 104729 % 38000) * 1000.0),
+				ST_MakePoint(-19000000 + (i * 6007 % 38000) * 1000.0, -19000000 + (i * 3041 % 38000) * 1000.0)), 3857)
+		END AS geom
+	FROM generate_series(1, 2000) i;
+WITH pyramid AS (
+	SELECT * FROM ST_AsMVTPyramid('SELECT id, kind, geom FROM mvt_pyramid_pts ORDER BY id',
+		'layer', 1, 4, ST_TileEnvelope(0, 0, 0), feature_id_name => 'id')
+),
+expected AS (
+	SELECT t.z, t.x, t.y, (
+		SELECT ST_AsMVT(q, 'layer', 4096, 'geom', 'id')
+		FROM (SELECT id, kind, ST_AsMVTGeom(geom, ST_TileEnvelope(t.z, t.x, t.y)) AS geom
+			FROM mvt_pyramid_pts ORDER BY id) q
+		WHERE q.geom IS NOT NULL) AS mvt
+	FROM (SELECT z, x, y FROM generate_series(1, 4) z,
+		generate_series(0, (1 << z) - 1) x, generate_series(0, (1 << z) - 1) y) t
+)
+SELECT 'AsMVTPyramidLarge', count(py.mvt),
+	count(*) FILTER (WHERE py.mvt IS NULL OR e.mvt IS NULL),
+	count(*) FILTER (WHERE py.mvt IS DISTINCT FROM e.mvt),
+	max(length(py.mvt)) > 10000
+FROM pyramid py FULL JOIN (SELECT * FROM expected WHERE length(mvt) > 0) e USING (z, x, y);
+DROP TABLE mvt_pyramid_pts;
+
+-- ST_AsMVTPyramid lines and polygons crossing tile edges and buffers, and
+-- geometries around the small geometry cutoff, must match ST_AsMVTGeom
+CREATE TEMP TABLE mvt_pyramid_shapes AS
+	-- Long lines across many tiles
+	SELECT i AS id, 'line' AS kind,
+		ST_SetSRID(ST_MakeLine(
+			ST_MakePoint(-19000000 + i * 1500000.0, -18000000 + (i * 7919 % 36000) * 1000.0),
+			ST_MakePoint(18000000 - (i * 104729 % 36000) * 1000.0, 19000000 - i * 1300000.0)), 3857) AS geom
+	FROM generate_series(1, 25) i
+	UNION ALL
+	-- Zigzags with vertices on both sides of many tile edges
+	SELECT 100 + i, 'zigzag',
+		ST_SetSRID(ST_MakeLine(ARRAY(
+			SELECT ST_MakePoint(-19000000 + j * 950000.0 + i * 1234.5, -15000000 + i * 1200000.0 + (j % 2) * 2500000.0)
+			FROM generate_series(0, 40) j)), 3857)
+	FROM generate_series(1, 20) i
+	UNION ALL
+	-- Polygons with holes spanning several tiles
+	SELECT 200 + i, 'polygon',
+		ST_SetSRID(ST_Difference(
+			ST_Buffer(ST_MakePoint(-15000000 + (i % 6) * 6000000.0, -15000000 + (i / 6) * 6000000.0), 1500000 + i * 100000.0, 8),
+			ST_Buffer(ST_MakePoint(-15000000 + (i % 6) * 6000000.0 + 300000, -15000000 + (i / 6) * 6000000.0), 500000, 4)), 3857)
+	FROM generate_series(0, 29) i
+	UNION ALL
+	-- Small polygons on the tile edges, inside the buffer of the next tile
+	SELECT 300 + i, 'edge',
+		ST_SetSRID(ST_MakeEnvelope(-20000 + i * 2504688.5, -30000.0, 25000 + i * 2504688.5, 15000.0), 3857)
+	FROM generate_series(-7, 7) i
+	UNION ALL
+	-- Multipolygons with parts in different tiles
+	SELECT 400 + i, 'multipolygon',
+		ST_SetSRID(ST_Collect(
+			ST_MakeEnvelope(i * 1000000.0, i * 900000.0, i * 1000000.0 + 400000, i * 900000.0 + 300000),
+			ST_MakeEnvelope(-i * 1100000.0 - 500000, -i * 800000.0 - 200000, -i * 1100000.0, -i * 800000.0)), 3857)
+	FROM generate_series(1, 15) i
+	UNION ALL
+	-- Around half a pixel at zoom 2 (1222.99 units): the double box is
+	-- under the cutoff, the float box may be over it
+	SELECT 500 + i, 'cutoff',
+		ST_SetSRID(ST_MakeEnvelope(5000000.3 + i * 20000, 3000000.7, 5000000.3 + i * 20000 + 1222.8 + i * 0.05, 3000000.7 + 900), 3857)
+	FROM generate_series(0, 9) i
+	UNION ALL
+	SELECT 600 + i, 'cutoff_line',
+		ST_SetSRID(ST_MakeLine(
+			ST_MakePoint(-7000000.1 - i * 30000, 2000000.9),
+			ST_MakePoint(-7000000.1 - i * 30000 + 1222.7 + i * 0.06, 2000000.9 + 1000)), 3857)
+	FROM generate_series(0, 9) i
+	UNION ALL
+	-- Under the cutoff at every zoom
+	SELECT 700 + i, 'tiny',
+		ST_SetSRID(ST_MakeEnvelope(i * 100000.0, 8000000.0, i * 100000.0 + 10, 8000010.0), 3857)
+	FROM generate_series(0, 9) i;
+WITH pyramid AS (
+	SELECT * FROM ST_AsMVTPyramid('SELECT id, kind, geom FROM mvt_pyramid_shapes ORDER BY id',
+		'layer', 1, 4, ST_TileEnvelope(0, 0, 0), feature_id_name => 'id')
+),
+expected AS (
+	SELECT t.z, t.x, t.y, (
+		SELECT ST_AsMVT(q, 'layer', 4096, 'geom', 'id')
+		FROM (SELECT id, kind, ST_AsMVTGeom(geom, ST_TileEnvelope(t.z, t.x, t.y)) AS geom
+			FROM mvt_pyramid_shapes ORDER BY id) q
+		WHERE q.geom IS NOT NULL) AS mvt
+	FROM (SELECT z, x, y FROM generate_series(1, 4) z,
+		generate_series(0, (1 << z) - 1) x, generate_series(0, (1 << z) - 1) y) t
+)
+SELECT 'AsMVTPyramidShapes', count(py.mvt) > 0,
+	count(*) FILTER (WHERE py.mvt IS NULL OR e.mvt IS NULL),
+	count(*) FILTER (WHERE py.mvt IS DISTINCT FROM e.mvt)
+FROM pyramid py FULL JOIN (SELECT * FROM expected WHERE length(mvt) > 0) e USING (z, x, y);
+DROP TABLE mvt_pyramid_shapes;
@@ -0,0 +1,26 @@
+---
+--- Tests for the PROJ cache prewarming (postgis.proj_preload)
+---
+
+-- Nothing to build by default
+SELECT 'prewarm0', postgis_proj_cache_prewarm();
+
+SET postgis.proj_preload = '4326:3857', '4269:3857';
+SELECT 'prewarm1', postgis_proj_cache_prewarm();
+-- Already cached transforms are not built again
+SELECT 'prewarm2', postgis_proj_cache_prewarm();
+
+SELECT 'transform', ST_AsText(ST_SnapToGrid(ST_Transform('SRID=4326;POINT(-20 -20)'::geometry, 3857), 1));
+
+SELECT 'stats1', s->>'entries', s->>'misses', s->>'hits', s->>'evictions'
+FROM (SELECT _postgis_proj_cache_stats()::json AS s) AS t;
+SELECT 'stats2', e->>'srid_from', e->>'srid_to', e->>'hits'
+FROM (SELECT json_array_elements(_postgis_proj_cache_stats()::json->'transforms') AS e) AS t
+ORDER BY 2;
+
+-- Malformed lists are rejected
+SET postgis.proj_preload = '4326';
+SET postgis.proj_preload = '4326:3857:900913';
+SHOW postgis.proj_preload;
+
+RESET postgis.proj_preload;
@@ -58,6 +58,24 @@ SELECT 'scan_idx', qnodes('select * from test where the_geom @ ST_MakePoint(0,0)
 
 DROP INDEX brin_2d;
 
+-- 2D, several boxes per range
+CREATE INDEX brin_2d_multi on test using brin (the_geom brin_geometry_multi_ops_2d);
+
+set enable_indexscan = off;
+set enable_bitmapscan = on;
+set enable_seqscan = off;
+
+SELECT 'scan_idx', qnodes('select * from test where the_geom && ST_MakePoint(0,0)');
+ select num,ST_astext(the_geom) from test where the_geom && 'BOX(125 125,135 135)'::box2d order by num;
+
+SELECT 'scan_idx', qnodes('select * from test where ST_MakePoint(0,0) ~ the_geom');
+ select num,ST_astext(the_geom) from test where 'BOX(125 125,135 135)'::box2d ~ the_geom order by num;
+
+SELECT 'scan_idx', qnodes('select * from test where the_geom @ ST_MakePoint(0,0)');
+ select num,ST_astext(the_geom) from test where the_geom @ 'BOX(125 125,135 135)'::box2d order by num;
+
+DROP INDEX brin_2d_multi;
+
 -- 3D
 CREATE INDEX brin_3d on test using brin (the_geom brin_geometry_inclusion_ops_3d);
 
@@ -0,0 +1,174 @@
+-- Sorted GiST builds of the n-dimensional geometry and the geography
+-- operator classes must find the same rows as an index built one key at
+-- a time. On PostgreSQL 15+ a plain CREATE INDEX takes the sorted build
+-- path through the sortsupport function, while buffering = on forces the
+-- insertion build. Older servers build both indexes by insertion.
+
+create table tbl_gist_sorted_nd (
+	id serial primary key,
+	g geometry
+);
+
+insert into tbl_gist_sorted_nd (g)
+select case i % 4
+	when 0 then ST_MakePoint(x, y)
+	when 1 then ST_MakePoint(x, y, z)
+	when 2 then ST_MakePoint(x, y, z, m)
+	else ST_MakeLine(ST_MakePoint(x, y, z), ST_MakePoint(x + 3, y + 2, z + 1))
+	end
+from (
+	select i,
+		(i * 7919 % 1000) / 10.0 as x,
+		(i * 104729 % 1000) / 10.0 as y,
+		(i * 31 % 100) as z,
+		(i * 17 % 50) as m
+	from generate_series(1, 20000) as i
+) as s;
+
+insert into tbl_gist_sorted_nd (g)
+select case i % 3
+	when 0 then 'POINT EMPTY'::geometry
+	when 1 then 'LINESTRING EMPTY'::geometry
+	else NULL
+	end
+from generate_series(1, 30) as i;
+
+create table tbl_gist_sorted_nd_q (
+	qid serial primary key,
+	q geometry
+);
+
+insert into tbl_gist_sorted_nd_q (q)
+select ST_MakeEnvelope(a, b, a + 10, b + 10)
+from generate_series(0, 90, 30) as a, generate_series(0, 90, 30) as b;
+
+insert into tbl_gist_sorted_nd_q (q)
+select ST_3DMakeBox(ST_MakePoint(a, a, 10), ST_MakePoint(a + 20, a + 20, 60))::geometry
+from generate_series(0, 80, 20) as a;
+
+create table tbl_gist_sorted_geog (
+	id serial primary key,
+	g geography
+);
+
+insert into tbl_gist_sorted_geog (g)
+select case i % 5
+	when 0 then ST_MakeLine(ST_Point(lon, lat), ST_Point(lon + 2, least(lat + 1, 90)))::geography
+	else ST_Point(lon, lat)::geography
+	end
+from (
+	select i,
+		(i * 7919 % 3560) / 10.0 - 180 as lon,
+		(i * 104729 % 1780) / 10.0 - 89 as lat
+	from generate_series(1, 20000) as i
+) as s;
+
+insert into tbl_gist_sorted_geog (g)
+select case i % 2 when 0 then 'POINT EMPTY'::geography else NULL end
+from generate_series(1, 20) as i;
+
+create table tbl_gist_sorted_geog_q (
+	qid serial primary key,
+	q geography
+);
+
+insert into tbl_gist_sorted_geog_q (q)
+select ST_Buffer(ST_Point(lon, lat)::geography, 500000)
+from (values (0, 0), (179.5, 0), (-179.5, 20), (-45, 60), (120, -30), (0, 89.5), (60, -89.5)) as v(lon, lat);
+
+create table test_gist_sorted (
+	build text,
+	test text,
+	qid integer,
+	ids text
+);
+
+-- Runs the index supported searches and records their results
+create procedure gist_sorted_results(build text)
+language sql as
+$$
+insert into test_gist_sorted
+select build, 'nd &&&', q.qid, string_agg(t.id::text, ',' order by t.id)
+from tbl_gist_sorted_nd_q q left join tbl_gist_sorted_nd t on t.g &&& q.q
+group by q.qid;
+
+insert into test_gist_sorted
+select build, 'nd @@', q.qid, string_agg(t.id::text, ',' order by t.id)
+from tbl_gist_sorted_nd_q q left join tbl_gist_sorted_nd t on t.g @@ q.q
+group by q.qid;
+
+insert into test_gist_sorted
+select build, 'nd <<->>', p.qid, (
+	select string_agg(round(d::numeric, 6)::text, ',' order by d)
+	from (select t.g <<->> p.p as d from tbl_gist_sorted_nd t order by t.g <<->> p.p limit 10) as k)
+from (select qid, ST_MakePoint(qid * 6.5, 100 - qid * 4.5, qid * 3, qid) as p from tbl_gist_sorted_nd_q) as p;
+
+insert into test_gist_sorted
+select build, 'geog &&', q.qid, string_agg(t.id::text, ',' order by t.id)
+from tbl_gist_sorted_geog_q q left join tbl_gist_sorted_geog t on t.g && q.q
+group by q.qid;
+
+insert into test_gist_sorted
+select build, 'geog dwithin', q.qid, string_agg(t.id::text, ',' order by t.id)
+from tbl_gist_sorted_geog_q q left join tbl_gist_sorted_geog t on ST_DWithin(t.g, q.q, 100000)
+group by q.qid;
+
+insert into test_gist_sorted
+select build, 'geog <->', q.qid, (
+	select string_agg(round(d::numeric, 1)::text, ',' order by d)
+	from (select t.g <-> q.q as d from tbl_gist_sorted_geog t order by t.g <-> q.q limit 10) as k)
+from tbl_gist_sorted_geog_q q;
+$$;
+
+-------------------------------------------------------------------------------
+
+set enable_indexscan = off;
+set enable_bitmapscan = off;
+set enable_seqscan = on;
+
+call gist_sorted_results('seq');
+
+-------------------------------------------------------------------------------
+
+create index tbl_gist_sorted_nd_idx on tbl_gist_sorted_nd using gist (g gist_geometry_ops_nd);
+create index tbl_gist_sorted_geog_idx on tbl_gist_sorted_geog using gist (g);
+
+set enable_indexscan = on;
+set enable_bitmapscan = on;
+set enable_seqscan = off;
+
+call gist_sorted_results('sorted');
+
+drop index tbl_gist_sorted_nd_idx;
+drop index tbl_gist_sorted_geog_idx;
+
+create index tbl_gist_sorted_nd_idx on tbl_gist_sorted_nd using gist (g gist_geometry_ops_nd) with (buffering = on);
+create index tbl_gist_sorted_geog_idx on tbl_gist_sorted_geog using gist (g) with (buffering = on);
+
+call gist_sorted_results('insert');
+
+-------------------------------------------------------------------------------
+
+select s.test, count(*),
+	count(*) filter (where s.ids is distinct from i.ids),
+	count(*) filter (where s.ids is distinct from q.ids),
+	bool_or(s.ids is not null)
+from test_gist_sorted s
+join test_gist_sorted i on i.build = 'insert' and i.test = s.test and i.qid = s.qid
+join test_gist_sorted q on q.build = 'seq' and q.test = s.test and q.qid = s.qid
+where s.build = 'sorted'
+group by s.test
+order by s.test collate "C";
+
+-------------------------------------------------------------------------------
+
+reset enable_indexscan;
+reset enable_bitmapscan;
+reset enable_seqscan;
+
+drop procedure gist_sorted_results(text);
+drop table test_gist_sorted;
+drop table tbl_gist_sorted_nd;
+drop table tbl_gist_sorted_nd_q;
+drop table tbl_gist_sorted_geog;
+drop table tbl_gist_sorted_geog_q;
@@ -43,6 +43,21 @@ set enable_seqscan = off;
 SELECT 'scan_seq', qnodes('select * from test where the_geom && ST_MakePoint(0,0)');
  select num,ST_astext(the_geom) from test where the_geom && 'BOX3D(125 125,135 135)'::box3d order by num;
 
+-- GiST index with compact keys
+
+DROP INDEX quick_gist;
+CREATE INDEX quick_gist_compact on test using gist (the_geom gist_geometry_ops_2d_compact);
+
+SELECT 'scan_compact', qnodes('select * from test where the_geom && ST_MakePoint(0,0)');
+ select num,ST_astext(the_geom) from test where the_geom && 'BOX3D(125 125,135 135)'::box3d order by num;
+ select num,ST_astext(the_geom) from test where the_geom @ ST_MakeEnvelope(125,125,135,135) order by num;
+
+SELECT 'knn_compact', qnodes('select num from test order by the_geom <-> ST_MakePoint(130,130) limit 5'),
+  array(select num from test order by the_geom <-> ST_MakePoint(130,130) limit 5) =
+  array(select num from test order by ST_Distance(the_geom, ST_MakePoint(130,130)), num limit 5);
+
+DROP INDEX quick_gist_compact;
+
 CREATE FUNCTION estimate_error(qry text, tol int)
 RETURNS text
 LANGUAGE 'plpgsql' VOLATILE AS $$
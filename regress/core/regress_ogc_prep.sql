@@ -292,3 +292,21 @@ SELECT 'covers311', ST_Covers('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', p) FROM
 ('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)')
 ) AS v(p);
 
+
+-- Alternating between polygons must not confuse the cache
+SELECT 'intersects320', id, ST_Intersects(ply::geometry, l::geometry) FROM ( VALUES
+(1, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(1 1, 2 2)'),
+(2, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(21 21, 22 22)'),
+(3, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(-2 9, 8 19)'),
+(4, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(18 29, 28 39)'),
+(5, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(2 2, 3 3)'),
+(6, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(22 22, 23 23)')
+) AS v(id, ply, l) ORDER BY id;
+SELECT 'contains320', id, ST_Contains(ply::geometry, l::geometry) FROM ( VALUES
+(1, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(1 1, 2 2)'),
+(2, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(21 21, 22 22)'),
+(3, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(0 0, 0 10)'),
+(4, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(20 20, 20 30)'),
+(5, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(2 2, 3 3)'),
+(6, 'POLYGON((20 20, 20 30, 30 30, 30 20, 20 20))', 'LINESTRING(22 22, 23 23)')
+) AS v(id, ply, l) ORDER BY id;
@@ -28,3 +28,20 @@ SELECT 'M2', ST_AsText(ST_SnapToGrid(st_transform('SRID=4326;POINT(-20 -21.5)'::
 SELECT 'M3', ST_AsText(ST_SnapToGrid(st_transform('SRID=4326;POINT(-30 -21.5)'::geometry, 3857),1));
 SELECT 'M4', ST_AsText(ST_SnapToGrid(st_transform('SRID=4326;POINT(-72.345 41.3)'::geometry, 3857),1));
 SELECT 'M5', ST_AsText(ST_SnapToGrid(st_transform('SRID=4326;POINT(71.999 -42.5)'::geometry, 3857),1));
+
+-- ST_TransformBatch gives the ST_Transform result of every element
+WITH g AS (SELECT ARRAY[
+	'SRID=4326;POINT(-20 -20)',
+	'SRID=4326;POINT(16 48 171)',
+	NULL,
+	'SRID=4326;LINESTRING(16 48,16 49)',
+	'SRID=4326;POLYGON((0 0,0 1,1 1,1 0,0 0),(0.2 0.2,0.2 0.3,0.3 0.3,0.2 0.2))',
+	'SRID=3857;POINT(100 100)',
+	'SRID=4326;GEOMETRYCOLLECTION(POINT EMPTY,MULTIPOINT(1 2,3 4))',
+	'SRID=4326;POINT EMPTY',
+	'SRID=4269;CIRCULARSTRING(-71 42 1,-71.5 42.5 2,-72 42 3)'
+	]::geometry[] AS a)
+SELECT 'B1', i, ST_AsEWKT(b) IS NOT DISTINCT FROM ST_AsEWKT(ST_Transform(a[i], 3857))
+FROM g, unnest(ST_TransformBatch(a, 3857)) WITH ORDINALITY AS t(b, i)
+ORDER BY i;
+SELECT 'B2', ST_TransformBatch('{}'::geometry[], 3857);
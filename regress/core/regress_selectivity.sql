@@ -2199,6 +2199,42 @@ select 'selectivity_09', 'estimated', _postgis_selectivity('regular_overdots','g
 select 'selectivity_10', 'actual', 1;
 select 'selectivity_09', 'estimated', _postgis_selectivity('regular_overdots','g','LINESTRING(0 0, 12 12)');
 
+-- Table with most points in three small clusters, and a few spread out
+create table skewed_dots as
+  select st_makepoint(c.x + (i % 10) * 0.1, c.y + (i / 10) * 0.1) as g
+  from (values (100, 200), (400, 700), (750, 300)) c(x, y), generate_series(0, 299) i
+  union all
+  select st_makepoint((i % 10) * 100 + 50, (i / 10) * 100 + 50)
+  from generate_series(0, 99) i;
+analyze skewed_dots;
+
+-- Sixth test, one whole cluster
+select 'selectivity_11', count(*) from skewed_dots where g && 'LINESTRING(99 199, 102 203)';
+select 'selectivity_12', 'estimated', abs(_postgis_selectivity('skewed_dots','g','LINESTRING(99 199, 102 203)') - 0.3) < 0.1;
+
+-- Seventh test, part of a cluster
+select 'selectivity_13', count(*) from skewed_dots where g && 'LINESTRING(99.95 200.45, 100.55 201.55)';
+select 'selectivity_14', 'estimated', abs(_postgis_selectivity('skewed_dots','g','LINESTRING(99.95 200.45, 100.55 201.55)') - 0.066) < 0.03;
+
+drop table if exists skewed_dots;
+
+-- Merge a loaded batch into the stats, the batch lying outside the old extent
+create table merged_dots as
+  select st_makepoint(i % 40 * 2.5, i / 40 * 2.5)::geometry as g
+  from generate_series(0, 1599) i;
+analyze merged_dots;
+create table merged_dots_batch as
+  select st_makepoint(200 + i % 20 * 5, 200 + i / 20 * 5)::geometry as g
+  from generate_series(0, 399) i;
+insert into merged_dots select g from merged_dots_batch;
+select 'merge_01', _postgis_selectivity('merged_dots','g','LINESTRING(199 199, 301 301)');
+select 'merge_02', _postgis_stats_merge('merged_dots', 'g', 'select g from merged_dots_batch');
+select 'merge_03', abs(_postgis_selectivity('merged_dots','g','LINESTRING(199 199, 301 301)') - 0.2) < 0.06;
+select 'merge_04', abs(_postgis_selectivity('merged_dots','g','LINESTRING(-1 -1, 101 101)') - 0.8) < 0.1;
+select 'merge_05', (_postgis_stats('merged_dots', 'g')::json->>'table_features')::float8;
+drop table if exists merged_dots_batch;
+drop table if exists merged_dots;
+
 -- Clean
 drop table if exists regular_overdots;
 drop table if exists regular_overdots_ab;
@@ -81,6 +81,82 @@ where op = '~~=';
 
 select * from test_spgist_idx_nd;
 
+-------------------------------------------------------------------------------
+-- Geography, on a global grid around the poles and across the dateline
+
+create table tbl_geog_spgist as
+select i as k, ST_MakePoint(-180 + (i % 72) * 5, -90 + (i / 72) * 5)::geography as g
+from generate_series(72, 72 * 36 - 1) i;
+create temp table geog_spgist_noidx as
+select 'overlap' as q, count(*)::text as r from tbl_geog_spgist
+where g && 'POLYGON((170 60, -170 60, -170 80, 170 80, 170 60))'::geography
+union all
+select 'knn_pole', string_agg(k::text, ',' order by d, k) from (
+	select k, g <-> 'POINT(12 89.5)'::geography as d from tbl_geog_spgist
+	order by g <-> 'POINT(12 89.5)'::geography, k limit 5) t
+union all
+select 'knn_dateline', string_agg(k::text, ',' order by d, k) from (
+	select k, g <-> 'POINT(179.9 -1)'::geography as d from tbl_geog_spgist
+	order by g <-> 'POINT(179.9 -1)'::geography, k limit 5) t;
+
+create index tbl_geog_spgist_idx on tbl_geog_spgist using spgist (g);
+analyze tbl_geog_spgist;
+set enable_seqscan = off;
+set enable_indexscan = on;
+set enable_bitmapscan = off;
+
+select 'geog_knn', qnodes('select k from tbl_geog_spgist order by g <-> ''POINT(12 89.5)''::geography limit 5');
+select q, r = n as same from geog_spgist_noidx join (
+select 'overlap' as q, count(*)::text as n from tbl_geog_spgist
+where g && 'POLYGON((170 60, -170 60, -170 80, 170 80, 170 60))'::geography
+union all
+select 'knn_pole', string_agg(k::text, ',' order by d, k) from (
+	select k, g <-> 'POINT(12 89.5)'::geography as d from tbl_geog_spgist
+	order by g <-> 'POINT(12 89.5)'::geography limit 5) t
+union all
+select 'knn_dateline', string_agg(k::text, ',' order by d, k) from (
+	select k, g <-> 'POINT(179.9 -1)'::geography as d from tbl_geog_spgist
+	order by g <-> 'POINT(179.9 -1)'::geography limit 5) t
+) idx using (q) order by q;
+
+set enable_seqscan = on;
+DROP TABLE tbl_geog_spgist;
+
+-- KNN order over a larger table, and pruning of the octants far from
+-- the query: the scan reads a fraction of the index pages
+create table tbl_geog_spgist_knn as
+select i as k, ST_MakePoint(-179.5 + (i % 180) * 2, -88 + (i / 180) * 2)::geography as g
+from generate_series(0, 180 * 89 - 1) i;
+create temp table geog_spgist_knn_noidx as
+select string_agg(k::text, ',' order by d, k) as r from (
+	select k, g <-> 'POINT(-71.06 42.36)'::geography as d from tbl_geog_spgist_knn
+	order by g <-> 'POINT(-71.06 42.36)'::geography, k limit 100) t;
+create index tbl_geog_spgist_knn_idx on tbl_geog_spgist_knn using spgist (g);
+analyze tbl_geog_spgist_knn;
+set enable_seqscan = off;
+
+create function spgist_knn_blocks(q text) returns bigint language plpgsql as $$
+declare
+	p json;
+begin
+	execute 'explain (analyze, buffers, costs off, timing off, format json) ' || q into p;
+	return (p->0->'Plan'->>'Shared Hit Blocks')::bigint + (p->0->'Plan'->>'Shared Read Blocks')::bigint;
+end
+$$;
+
+select 'geog_knn_order', r = (
+	select string_agg(k::text, ',' order by d, k) from (
+		select k, g <-> 'POINT(-71.06 42.36)'::geography as d from tbl_geog_spgist_knn
+		order by g <-> 'POINT(-71.06 42.36)'::geography limit 100) t)
+from geog_spgist_knn_noidx;
+select 'geog_knn_pruned',
+	spgist_knn_blocks('select k from tbl_geog_spgist_knn order by g <-> ''POINT(-71.06 42.36)''::geography limit 10')
+	< pg_relation_size('tbl_geog_spgist_knn_idx') / current_setting('block_size')::bigint / 2;
+
+set enable_seqscan = on;
+DROP FUNCTION spgist_knn_blocks(text);
+DROP TABLE tbl_geog_spgist_knn;
+
 -------------------------------------------------------------------------------
 
 DROP TABLE tbl_geomcollection_nd CASCADE;
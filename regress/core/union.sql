@@ -13,6 +13,12 @@ SELECT ST_Area(g), ST_XMin((g)), ST_YMin(g), ST_XMax(g), ST_YMax(g) from u;
 WITH u AS (SELECT ST_Union(geom, -1.0) AS g FROM geoms)
 SELECT ST_Area(g), ST_XMin((g)), sT_YMin(g), ST_XMax(g), ST_YMax(g) from u;
 
+-- Inputs put in Hilbert order give the same union
+SET postgis.union_sort_threshold = 1;
+WITH u AS (SELECT ST_Union(geom) AS g FROM geoms)
+SELECT 'sorted', ST_Area(g), ST_NumGeometries(g), ST_NumInteriorRings(g) from u;
+RESET postgis.union_sort_threshold;
+
 TRUNCATE TABLE geoms;
 
 -- Empty table